@@ -0,0 +1,93 @@
+// Copyright (c) 2015, David Pineau
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of the copyright holder nor the names of its contributors
+//    may be used to endorse or promote products derived from this software
+//    without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER AND CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef __CLOUDMIG_FILTER_H__
+#define __CLOUDMIG_FILTER_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <droplet.h>
+
+/*
+ * Rules selecting the entries of the sources to migrate, by path prefix,
+ * glob, size range or modification time window. Each rule is compiled as it
+ * is added, and evaluated by the crawlers as the sources are listed: the
+ * directories excluded are never listed.
+ *
+ * An entry is kept if it matches none of the exclude rules and, for each
+ * kind of include rule (path, size, mtime), at least one of them. The size
+ * and mtime rules only apply to the files. Excluding a directory excludes
+ * its whole subtree.
+ */
+struct cloudmig_filter;
+
+/*
+ * @brief Compile a rule of the form "kind:value" and add it to the filter,
+ * allocating the filter first if *filterp is NULL.
+ *
+ * The kinds are:
+ * - prefix:path/to/      path starting with the value
+ * - glob:*.log           path matching the value, as fnmatch(3) would
+ * - size:min..max        size in bytes, with an optional K/M/G/T suffix
+ * - mtime:from..to       modification time, as seconds since the Epoch or
+ *                        as YYYY-MM-DD[THH:MM:SS] (UTC)
+ * Either bound of a range may be omitted.
+ */
+int             filter_add(struct cloudmig_filter **filterp, bool exclude,
+                           const char *rule);
+void            filter_free(struct cloudmig_filter *filter);
+
+/*
+ * @brief Tell whether an entry is kept, its path being relative to the
+ * bucket. The parent directories of the entry are assumed to be kept.
+ *
+ * A directory is kept if any of its descendants may be: it must then be
+ * listed.
+ */
+bool            filter_match(struct cloudmig_filter *filter, const char *path,
+                             dpl_ftype_t type, uint64_t size, time_t mtime);
+
+/*
+ * @brief Same as filter_match(), checking the parent directories of the
+ * entry too, for the entries not listed directory by directory.
+ */
+bool            filter_match_tree(struct cloudmig_filter *filter, const char *path,
+                                  dpl_ftype_t type, uint64_t size, time_t mtime);
+
+/*
+ * @brief Retrieve the path prefix shared by all the entries the filter may
+ * keep, so that the listings can be narrowed to it.
+ */
+const char      *filter_prefix(struct cloudmig_filter *filter, size_t *lenp);
+
+/*
+ * @brief Log the number of entries each rule decided upon.
+ */
+void            filter_report(struct cloudmig_filter *filter);
+
+#endif /* ! __CLOUDMIG_FILTER_H__ */
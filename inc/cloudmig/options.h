@@ -29,6 +29,8 @@
 
 #include "droplet.h"
 
+struct cloudmig_filter;
+
 enum cloudmig_flags
 {
     SRC_PROFILE_NAME    = 1 << 0,
@@ -39,6 +41,29 @@ enum cloudmig_flags
     QUIET               = 1 << 5,
     DELETE_SOURCE_DATA  = 1 << 6,
     AUTO_CREATE_DIRS    = 1 << 7,
+    COOPERATIVE_MIGRATION = 1 << 8,
+    COMPRESS_STATUS     = 1 << 9,
+    RESYNC_MIGRATION    = 1 << 10,
+};
+
+enum cloudmig_listing
+{
+    LISTING_RECURSIVE   = 0,    // one listing per directory
+    LISTING_FLAT        = 1,    // one listing of the whole bucket
+};
+
+enum cloudmig_claim
+{
+    CLAIM_SEQUENTIAL    = 0,    // all the workers share one cursor
+    CLAIM_LOCALITY      = 1,    // each worker keeps to a range of the entries
+};
+
+enum cloudmig_checkpoint
+{
+    CHECKPOINT_BLOCK    = 0,    // after every block
+    CHECKPOINT_BYTES    = 1,    // every checkpoint_bytes bytes
+    CHECKPOINT_INTERVAL = 2,    // every checkpoint_interval seconds
+    CHECKPOINT_RESUMABLE = 3,   // when droplet reports a new resume point
 };
 
 struct cloudmig_options
@@ -57,6 +82,23 @@ struct cloudmig_options
     char                        **dst_buckets;
     char                        *config;
     long unsigned int           block_size;
+    long int                    stall_timeout;
+    uint64_t                    stall_min_rate;
+    long int                    commit_batch;       // entries whose completions are saved at once
+    long unsigned int           lease_size;
+    long int                    lease_duration;
+    char                        *status_log;
+    enum cloudmig_checkpoint    checkpoint_policy;
+    uint64_t                    checkpoint_bytes;
+    long int                    checkpoint_interval;
+    long int                    digest_min_interval;
+    long int                    digest_max_interval;
+    uint64_t                    digest_changes;
+    long int                    sync_interval;      // 0 unless syncing continuously
+    char                        *inventory_dir;
+    enum cloudmig_listing       listing;
+    struct cloudmig_filter      *filter;            // NULL if all is migrated
+    enum cloudmig_claim         claim_policy;
 };
 
 #define OPTIONS_INITIALIZER                 \
@@ -74,13 +116,33 @@ struct cloudmig_options
     NULL,                                   \
     NULL,                                   \
     NULL,                                   \
-    0                                       \
+    0,                                      \
+    0,                                      \
+    0,                                      \
+    0,                                      \
+    0,                                      \
+    0,                                      \
+    NULL,                                   \
+    CHECKPOINT_BLOCK,                       \
+    0,                                      \
+    0,                                      \
+    0,                                      \
+    0,                                      \
+    0,                                      \
+    0,                                      \
+    NULL,                                   \
+    LISTING_RECURSIVE,                      \
+    NULL,                                   \
+    CLAIM_SEQUENTIAL                        \
 }
 
 // Used by config parser as well as command line arguments parser.
 int opt_buckets(struct cloudmig_options *, const char *arg);
 int opt_trace(struct cloudmig_options *, const char *arg);
 int opt_verbose(const char *arg);
+int opt_checkpoint_policy(struct cloudmig_options *, const char *arg);
+int opt_listing(struct cloudmig_options *, const char *arg);
+int opt_claim_policy(struct cloudmig_options *, const char *arg);
 int cloudmig_options_check(struct cloudmig_options *);
 
 #endif /* ! __SD_CLOUMIG_OPT_H__ */
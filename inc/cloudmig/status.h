@@ -28,6 +28,8 @@
 #define __TRANSFER_STATE_H__
 
 #include <pthread.h>
+#include <stdbool.h>
+#include <time.h>
 
 /*
  * This macro rounds a number to superior 4
@@ -48,6 +50,35 @@
 \***********************************************************************/
 
 struct dpl_ctx;
+struct status_wal;
+
+/*
+ * Summary of the progress of one bucket status, kept within the digest so
+ * that it is known without loading the bucket status itself.
+ */
+struct digest_bucket
+{
+    char            *name;              // name of the bucket status file
+    uint64_t        bytes;
+    uint64_t        done_bytes;
+    uint64_t        objects;
+    uint64_t        done_objects;
+    bool            done;               // All the entries are done
+};
+
+/*
+ * Progress accounted by the workers, spread over shards so that they do not
+ * contend on the same counters. Each shard fills a cache line of its own,
+ * which requires the digest to be allocated with that alignment.
+ */
+#define CLOUDMIG_STATUS_DIGEST_SHARDS   16
+#define CLOUDMIG_CACHE_LINE             64
+
+struct digest_shard
+{
+    uint64_t        done_bytes;
+    uint64_t        done_objects;
+} __attribute__((aligned(CLOUDMIG_CACHE_LINE)));
 
 struct status_digest
 {
@@ -56,7 +87,13 @@ struct status_digest
         uint64_t        done_bytes;
         uint64_t        objects;
         uint64_t        done_objects;
-    }               fixed;
+    }               fixed;              // as loaded, plus the totals added since
+
+    struct digest_shard shards[CLOUDMIG_STATUS_DIGEST_SHARDS];
+
+    // Only added to while loading the store: the workers never see it move.
+    struct digest_bucket *buckets;      // per-bucket summaries
+    int             n_buckets;
 
     struct dpl_ctx  *status_ctx;
 
@@ -65,8 +102,26 @@ struct status_digest
     pthread_mutex_t lock;
     int             lock_inited;
 
-    int             refresh_frequency;
-    int             refresh_count;
+    // Upload policy
+    uint64_t        refresh_frequency;  // done objects triggering an upload
+    time_t          min_interval;
+    time_t          max_interval;
+
+    uint64_t        refresh_count;      // done objects since the last upload
+    int             buckets_done;       // buckets done since the last upload
+    time_t          last_upload;
+    uint64_t        last_done_bytes;    // progress as of the last upload
+    uint64_t        last_done_objects;
+    uint64_t        n_uploads;
+
+    // Uploads are made by a background thread, never by the workers.
+    pthread_cond_t  cond;
+    int             cond_inited;
+    pthread_t       thread;
+    int             started;
+    int             stop;
+
+    struct status_wal *wal;             // local status log, if enabled
 };
 
 /***********************************************************************\
@@ -74,6 +129,17 @@ struct status_digest
 * These structs are used for the files that describe a bucket's status. *
 *                                                                       *
 \***********************************************************************/
+/*
+ * Growable buffer, reused across the serializations of bucket status
+ * segments, or across the entries claimed by a worker.
+ */
+struct status_buffer
+{
+    char                        *data;
+    size_t                      len;
+    size_t                      size;
+};
+
 /*
  * File state entry structure
  */
@@ -107,6 +173,8 @@ struct file_transfer_state
 
     char                    *status_path;
     int                     state_idx;
+
+    struct status_buffer    paths;      // Holds the paths above, kept across claims
 };
 
 #define CLOUDMIG_FILESTATE_INITIALIZER  \
@@ -119,7 +187,8 @@ struct file_transfer_state
         NULL,                           \
         NULL,                           \
         NULL,                           \
-        0                               \
+        0,                              \
+        { NULL, 0, 0 }                  \
     }
 
 
@@ -130,6 +199,80 @@ struct file_transfer_state
 *           These structs are used for the status management            *
 *                                                                       *
 \***********************************************************************/
+/*
+ * Progress of the search of a range to lease within a bucket status.
+ */
+struct lease_scan
+{
+    unsigned int    next_range;         // index of the next range to try
+    unsigned int    held_elsewhere;     // ranges leased by other processes
+    time_t          earliest_expiry;    // earliest expiry of those leases
+};
+
+struct lease_table;
+
+/*
+ * Entries handed out to one worker under the locality claim policy.
+ */
+struct claim_range
+{
+    unsigned int    next;               // index of the next entry to try
+    unsigned int    end;                // end of the range, excluded
+};
+
+struct bucket_claims
+{
+    struct claim_range  *ranges;        // one per worker
+    int                 n_ranges;
+    bool                split;          // ranges computed for the current pass
+};
+
+/*
+ * Index of the entries of a bucket status by path, used to merge the new
+ * listings of the source into it. Only the hashes of the paths are kept: the
+ * path of an entry is rebuilt to confirm a match.
+ */
+struct bucket_index
+{
+    uint64_t            *hashes;
+    unsigned int        *idxs;          // entry index + 1, 0 if the slot is free
+    size_t              mask;
+    unsigned int        n_indexed;      // the entries before are indexed
+};
+
+/*
+ * In-memory representation of an entry of a bucket status.
+ *
+ * The paths are front-coded: an entry only stores the part of its path that
+ * differs from the path of the previous entry of its segment.
+ */
+struct bucket_entry
+{
+    uint64_t                    size;
+    int64_t                     mtime;          // at the source when listed, 0 if unknown
+    uint32_t                    path;           // offset of the path's suffix in the segment's paths
+    uint32_t                    prefix;         // length shared with the previous path
+    uint32_t                    type;           // dpl_ftype_t
+    bool                        done;
+    bool                        deleted;        // gone from the source, as of the last listing
+};
+
+/*
+ * Describes one segment of the entries of a bucket status, stored in its own
+ * file next to the bucket status file (which then acts as a manifest).
+ */
+struct bucket_segment
+{
+    struct bucket_entry         *entries;
+    unsigned int                n_entries;
+    unsigned int                capacity;
+    unsigned int                n_done;         // Nb of entries done
+    struct status_buffer        paths;          // NUL-terminated path suffixes
+    struct status_buffer        last;           // path of the last entry added
+    bool                        loaded;         // Entries are in memory
+    bool                        dirty;          // Modified since last upload
+};
+
 /*
  * Describes a bucket status file.
  */
@@ -137,10 +280,36 @@ struct bucket_status
 {
     pthread_mutex_t             lock;
     int                         lock_inited;
-    struct json_object          *json;          // File's Json representation
+    struct dpl_ctx              *status_ctx;
+    struct json_object          *json;          // Manifest's Json representation
     char                        *path;          // path to the bucket status file
+    bool                        loaded;         // Manifest is in memory
+    bool                        complete;       // All the entries are done
+    bool                        cooperative;    // Entries also done within leases
+    bool                        manifest_dirty;
+    unsigned int                n_entries;
+    unsigned int                segment_size;   // Nb of entries per segment
+    unsigned int                n_segments;
+    struct bucket_segment       *segments;
+    struct status_buffer        outbuf;         // Segment serialization buffer
     unsigned int                refcount;       // Nb of refs currently held to it or its data
     unsigned int                next_entry;     // index to the next entry
+    struct lease_table          *leases;        // cooperative mode only
+    struct lease_scan           lease_scan;
+    struct bucket_claims        *claims;        // locality claim policy only
+    struct bucket_index         *index;         // by path, kept across resyncs
+    struct status_wal           *wal;           // local status log, if enabled
+    int                         summary;        // index of its summary within the digest
+    struct json_object          *states;        // intermediary states, by entry index
+    unsigned int                *partial;       // sorted indexes of the entries having a state
+    unsigned int                n_partial;
+    unsigned int                partial_size;
+    bool                        partial_known;  // index loaded or rebuilt from the states
+    bool                        partial_dirty;  // index grown since the last manifest upload
+    bool                        states_dirty;   // changed since their last upload
+    time_t                      states_saved;   // time of their last upload
+    pthread_mutex_t             states_lock;    // serializes the uploads of the states
+    int                         states_lock_inited;
 };
 
 /*
@@ -159,6 +328,9 @@ struct cloudmig_status
     int                     n_buckets;          // number of bucket states
     int                     cur_bucket;          // index of the current state
     int                     n_loaded;
+
+    struct lease_table      *leases;            // cooperative mode only
+    struct status_wal       *wal;               // local status log, if enabled
 };
 
 
@@ -40,16 +40,79 @@ void                    status_bucket_free(struct bucket_status *bst);
 int                     status_bucket_dup_paths(struct bucket_status *bst,
                                                 char **statusp, char **srcp);
 
+/*
+ * Opens a bucket status without loading anything: its manifest gets loaded
+ * when the status is first used. A status known to be complete is not even
+ * loaded for the iteration of its incomplete entries. The entries completed
+ * within the leases of cooperative processes are only merged into a
+ * cooperative bucket status.
+ */
+struct bucket_status*   status_bucket_open(dpl_ctx_t *status_ctx,
+                                           char *storepath, char *name,
+                                           bool complete, bool cooperative);
 struct bucket_status*   status_bucket_load(dpl_ctx_t *status_ctx,
                                            char *storepath, char *name,
+                                           bool cooperative,
                                            uint64_t *countp, uint64_t *sizep);
-struct bucket_status*   status_bucket_create(dpl_ctx_t *status_ctx, dpl_ctx_t *src_ctx,
+/*
+ * How the sources are listed, to create or resync a bucket status.
+ */
+struct bucket_crawl
+{
+    dpl_ctx_t               *src_ctx;
+    enum cloudmig_listing   listing;
+    struct cloudmig_filter  *filter;        // entries to keep, NULL for all
+};
+
+/*
+ * The entries are read from the inventory file if any, instead of listing
+ * the source.
+ */
+struct bucket_status*   status_bucket_create(dpl_ctx_t *status_ctx,
+                                             const struct bucket_crawl *crawl,
                                              char *storepath, char *src, char *dst,
+                                             const char *inventory,
                                              uint64_t *countp, uint64_t *sizep);
 void                    status_bucket_delete(dpl_ctx_t *status_ctx,
                                              struct bucket_status *bst);
 
+/*
+ * Outcome of the merge of a new listing of the source into a bucket status,
+ * with the totals of the bucket status once merged.
+ */
+struct bucket_resync
+{
+    uint64_t    added;
+    uint64_t    modified;       // size, type or mtime changed
+    uint64_t    deleted;
+    uint64_t    unchanged;
+
+    uint64_t    objects;
+    uint64_t    bytes;
+    uint64_t    done_objects;
+    uint64_t    done_bytes;
+    bool        complete;
+};
+
+/*
+ * Lists the source of a bucket status again, and merges the listing into it:
+ * new entries are added, modified ones are reset, and the ones not found
+ * anymore are flagged as deleted. Unchanged entries are left untouched.
+ */
+int                     status_bucket_resync(dpl_ctx_t *status_ctx,
+                                             const struct bucket_crawl *crawl,
+                                             struct bucket_status *bst,
+                                             struct bucket_resync *stats);
+
 void                    status_bucket_reset_iteration(struct bucket_status *bst);
+/*
+ * Keeps each worker to its own range of the entries, cut at the directories,
+ * instead of having them all claim from the same cursor. A worker whose range
+ * is exhausted takes over half of the largest range left.
+ */
+int                     status_bucket_claims_init(struct bucket_status *bst,
+                                                  int n_workers);
+bool                    status_bucket_complete(struct bucket_status *bst);
 
 /**
  *
@@ -59,16 +122,37 @@ void                    status_bucket_reset_iteration(struct bucket_status *bst)
  */
 int                     status_bucket_next_incomplete_entry(dpl_ctx_t *status_ctx,
                                                             struct bucket_status *bst,
+                                                            int worker,
                                                             struct file_transfer_state *filestate);
 int                     status_bucket_next_entry(dpl_ctx_t *status_ctx,
                                                  struct bucket_status *bst,
                                                  struct file_transfer_state *filestate);
 void                    status_bucket_release_entry(struct file_transfer_state *filestate);
+/*
+ * Frees the buffer holding the paths of the entries claimed with a filestate,
+ * which is kept from one claim to the next.
+ */
+void                    status_bucket_clear_entry(struct file_transfer_state *filestate);
 
 /*
  * Function to upate one given entry within a status file.
  */
 int     status_bucket_entry_update(dpl_ctx_t *ctx, struct file_transfer_state *filestate);
 int     status_bucket_entry_complete(dpl_ctx_t *ctx, struct file_transfer_state *filestate);
+/*
+ * Completes a batch of entries, uploading each bucket status involved once.
+ */
+int     status_bucket_entries_complete(dpl_ctx_t *ctx,
+                                       struct file_transfer_state **filestates,
+                                       int n_entries);
+
+/*
+ * Used by the status log to replicate the completions and first checkpoints
+ * it recorded. Flushing also uploads the intermediary states of the entries,
+ * which the checkpoints only upload once in a while.
+ */
+int     status_bucket_mark_done(struct bucket_status *bst, unsigned int idx);
+int     status_bucket_mark_partial(struct bucket_status *bst, unsigned int idx);
+int     status_bucket_flush(dpl_ctx_t *ctx, struct bucket_status *bst);
 
 #endif /* ! __CLOUDMIG_STATUS_BUCKET_H__ */
@@ -0,0 +1,85 @@
+// Copyright (c) 2015, David Pineau
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of the copyright holder nor the names of its contributors
+//    may be used to endorse or promote products derived from this software
+//    without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER AND CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef __CLOUDMIG_STATUS_CODEC_H__
+#define __CLOUDMIG_STATUS_CODEC_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <droplet.h>
+
+/*
+ * The status files may be stored compressed (gzip). Compressed files are
+ * recognized by their magic number when read, so that the status stores
+ * written uncompressed remain readable, whatever the current setting.
+ */
+
+struct status_codec_stats
+{
+    uint64_t    put_raw;        // Bytes uploaded, before compression
+    uint64_t    put_stored;     // Bytes uploaded, as stored
+    uint64_t    get_raw;        // Bytes downloaded, after decompression
+    uint64_t    get_stored;     // Bytes downloaded, as stored
+};
+
+/*
+ * @brief Enable or disable the compression of the status files written.
+ */
+void            status_codec_setup(bool compress);
+
+/*
+ * @brief Retrieve the status bytes transferred until now.
+ */
+void            status_codec_stats(struct status_codec_stats *stats);
+
+/*
+ * Write/Read a whole status file, compressing or decompressing it if need be.
+ * They return the same codes as their droplet counterparts.
+ */
+dpl_status_t    status_codec_put(dpl_ctx_t *status_ctx, const char *path,
+                                 const char *data, size_t len);
+dpl_status_t    status_codec_get(dpl_ctx_t *status_ctx, const char *path,
+                                 char **datap, unsigned int *lenp);
+
+/*
+ * The decoder handles a status file read in several parts, passing the
+ * decompressed data to the sink as it comes.
+ */
+typedef int (*status_decoder_sink_t)(void *data, const char *buf, size_t len);
+
+struct status_decoder;
+
+struct status_decoder   *status_decoder_new(status_decoder_sink_t sink, void *data);
+void                    status_decoder_free(struct status_decoder *decoder);
+int                     status_decoder_feed(struct status_decoder *decoder,
+                                            const char *buf, size_t len);
+/*
+ * @brief Check that the whole compressed data was received.
+ */
+int                     status_decoder_end(struct status_decoder *decoder);
+
+#endif /* ! __CLOUDMIG_STATUS_CODEC_H__ */
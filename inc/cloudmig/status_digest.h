@@ -38,14 +38,31 @@ enum digest_field
     DIGEST_DONE_BYTES
 };
 
+/*
+ * Once started, the digest is uploaded when refresh_frequency objects were
+ * done since its last upload, or a bucket got done, but not more often than
+ * every min_interval seconds. It is uploaded at least every max_interval
+ * seconds as long as the migration progresses, and when stopped.
+ */
 struct status_digest*   status_digest_new(dpl_ctx_t *status_ctx,
                                           const char *storepath,
-                                          uint64_t refresh_freqency);
+                                          uint64_t refresh_freqency,
+                                          time_t min_interval,
+                                          time_t max_interval);
 void                    status_digest_free(struct status_digest *digest);
 
+int                     status_digest_parse(struct status_digest *digest,
+                                            const char *buffer,
+                                            unsigned int bufsize);
 int                     status_digest_download(struct status_digest *digest,
                                                int *regenerate);
 int                     status_digest_upload(struct status_digest *digest);
+/*
+ * Starts/stops the thread uploading the digest as the migration progresses.
+ */
+int                     status_digest_start(struct status_digest *digest);
+void                    status_digest_stop(struct status_digest *digest);
+uint64_t                status_digest_uploads(struct status_digest *digest);
 void                    status_digest_delete(dpl_ctx_t *status_ctx,
                                              struct status_digest *digest);
 
@@ -55,5 +72,31 @@ void                    status_digest_add(struct status_digest *digest,
                                           enum digest_field,
                                           uint64_t value);
 
+/*
+ * Per-bucket summaries, identified by the name of the bucket status file.
+ * status_digest_bucket() returns the index of a summary, creating it if asked
+ * to, or -1.
+ */
+int                     status_digest_bucket(struct status_digest *digest,
+                                             const char *name, bool create);
+void                    status_digest_bucket_get(struct status_digest *digest,
+                                                 int bucket,
+                                                 struct digest_bucket *summary);
+void                    status_digest_bucket_set(struct status_digest *digest,
+                                                 int bucket, uint64_t objects,
+                                                 uint64_t bytes, bool done);
+void                    status_digest_bucket_add(struct status_digest *digest,
+                                                 int bucket,
+                                                 enum digest_field,
+                                                 uint64_t value);
+/*
+ * Replaces the totals and progress of a summary, for a bucket status merged
+ * with a new listing of its source, adjusting the global counters along.
+ * Only meant to be used while loading the store.
+ */
+void                    status_digest_bucket_resync(struct status_digest *digest,
+                                                    int bucket,
+                                                    const struct digest_bucket *totals);
+
 #endif /* ! __CLOUDMIG_STATUS_DIGEST_H__ */
 
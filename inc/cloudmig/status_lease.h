@@ -0,0 +1,192 @@
+// Copyright (c) 2015, David Pineau
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of the copyright holder nor the names of its contributors
+//    may be used to endorse or promote products derived from this software
+//    without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER AND CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef __CLOUDMIG_STATUS_LEASE_H__
+#define __CLOUDMIG_STATUS_LEASE_H__
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include <droplet.h>
+
+struct bucket_status;
+struct json_object;
+
+/*
+ * A lease on a contiguous range of entries of a bucket status.
+ *
+ * On the status store, the lease is the directory
+ * <bucketdir>/lease.<start>.<gen>, which holds the lease record. Creating the
+ * directory is what grants the lease: it fails if another process created it
+ * first. Stealing an expired lease means creating the directory of the next
+ * generation, which the previous holder detects when renewing.
+ */
+struct status_lease
+{
+    struct status_lease     *next;
+    struct bucket_status    *bst;
+
+    char                    *path;      // lease directory
+    char                    *record;    // lease record file path
+
+    unsigned int            start;
+    unsigned int            count;
+    unsigned int            gen;
+
+    unsigned int            cursor;     // next entry to hand out
+    unsigned int            pending;    // entries handed out and not released
+    time_t                  expires;
+    bool                    lost;       // stolen by another process
+    bool                    finishing;
+    bool                    complete;   // as recorded by its final record
+
+    // The record is uploaded outside of the table lock, by one thread at once.
+    unsigned int            busy;       // threads using it outside the table lock
+    bool                    uploading;
+    bool                    dirty;      // changed since its upload started
+
+    struct json_object      *done;      // indexes of the completed entries
+};
+
+/*
+ * Leases held by the process, shared by all the bucket statuses.
+ */
+struct lease_table
+{
+    dpl_ctx_t               *status_ctx;
+    char                    *owner;
+    unsigned int            range_size;
+    time_t                  ttl;
+
+    struct status_lease     *leases;
+
+    pthread_mutex_t         lock;
+    int                     lock_inited;
+    pthread_cond_t          cond;
+    int                     cond_inited;
+    pthread_cond_t          idle;       // a lease is no longer used outside the lock
+    int                     idle_inited;
+    pthread_t               renewer;
+    int                     started;
+    int                     stop;
+
+    char                    *store_lock;    // store lock held, renewed with the leases
+    bool                    refreshing;     // store lock being renewed
+
+    uint64_t                n_acquired;
+    uint64_t                n_stolen;
+    uint64_t                n_lost;
+};
+
+/*
+ * @brief Allocate the lease table and start the thread renewing its leases.
+ */
+struct lease_table  *status_lease_table_new(dpl_ctx_t *status_ctx,
+                                            unsigned int range_size, time_t ttl);
+/*
+ * @brief Stop the renewing thread, release the leases still held so that
+ * other processes can take them over at once, and free the table.
+ */
+void                status_lease_table_free(struct lease_table *table);
+
+/*
+ * @brief Lease the next range of the bucket status that is neither complete
+ * nor held by another process. Must be called with the status store lock held.
+ *
+ * @return  1 - Lease acquired
+ *          0 - No range left to lease within the bucket
+ *         -1 - An error occurred, see log
+ */
+int                 status_lease_acquire(struct lease_table *table,
+                                         struct bucket_status *bst,
+                                         const char *bucketdir,
+                                         unsigned int n_entries,
+                                         struct status_lease **leasep);
+
+/*
+ * @brief Returns the lease of the bucket still handing out entries, if any.
+ */
+struct status_lease *status_lease_active(struct lease_table *table,
+                                         struct bucket_status *bst);
+/*
+ * @brief Returns the lease covering the given entry of the bucket, if any.
+ */
+struct status_lease *status_lease_find(struct lease_table *table,
+                                       struct bucket_status *bst,
+                                       unsigned int idx);
+
+/*
+ * @brief Account the entries handed out from a lease, up to cursor.
+ *
+ * @return true if the lease is exhausted and must be finished by the caller
+ */
+bool                status_lease_handout(struct lease_table *table,
+                                         struct status_lease *lease,
+                                         unsigned int cursor, bool found);
+/*
+ * @brief Account the release of an entry handed out from a lease.
+ *
+ * @return true if the lease is exhausted and must be finished by the caller
+ */
+bool                status_lease_put(struct lease_table *table,
+                                     struct status_lease *lease);
+/*
+ * @brief Record the completion of entries of the bucket within their leases,
+ * uploading each lease record involved once.
+ */
+int                 status_lease_record_done(struct lease_table *table,
+                                             struct bucket_status *bst,
+                                             const unsigned int *idxs, int n_idxs);
+/*
+ * @brief Upload the final record of an exhausted lease (marking the range
+ * complete, or releasing it for another attempt) and free it.
+ */
+void                status_lease_finish(struct lease_table *table,
+                                        struct status_lease *lease,
+                                        bool complete);
+
+/*
+ * @brief Collect the indexes of the entries completed within all the leases
+ * ever taken on a bucket status.
+ *
+ * @return the JSON array of indexes (possibly empty), or NULL on error
+ */
+struct json_object  *status_lease_merge(dpl_ctx_t *status_ctx,
+                                        const char *bucketdir);
+
+/*
+ * @brief Serialize the setup of the status store between processes, using the
+ * same exclusive directory creation as the leases. The lock holds a record of
+ * its expiry, which the renewing thread of the table pushes back along with
+ * the leases: only the lock of a process that stopped renewing it is broken,
+ * by taking over its next generation.
+ */
+int                 status_lease_lock_store(struct lease_table *table,
+                                            const char *storepath);
+void                status_lease_unlock_store(struct lease_table *table);
+
+#endif /* ! __CLOUDMIG_STATUS_LEASE_H__ */
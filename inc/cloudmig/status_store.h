@@ -28,6 +28,7 @@
 #define __CLOUDMIG_STATUS_STORE_H__
 
 struct cloudmig_ctx;
+struct bucket_resync;
 
 struct cloudmig_status* status_store_new();
 void                    status_store_free(struct cloudmig_status *status);
@@ -37,16 +38,23 @@ int status_store_load(struct cloudmig_ctx* ctx, char *src_host, char *dst_host,
 
 void status_store_reset_iteration(struct cloudmig_ctx *ctx);
 
+/*
+ * Merges a new listing of the sources into all the bucket statuses, and
+ * restarts the iteration over their entries.
+ */
+int  status_store_resync(struct cloudmig_ctx *ctx, struct bucket_resync *changes);
+
 /**
  *
  * @return  1 - SUCCESS - Entry found
  *          0 - SUCCESS - No entry found (reached the end of the status'associated files)
  *         -1 - FAILURE - an error occurred, see log
  */
-int     status_store_next_incomplete_entry(struct cloudmig_ctx *ctx,
+int     status_store_next_incomplete_entry(struct cloudmig_ctx *ctx, int worker,
                                            struct file_transfer_state *filestate);
 int     status_store_next_entry(struct cloudmig_ctx *ctx, struct file_transfer_state *filestate);
 void    status_store_release_entry(struct file_transfer_state *filestate);
+void    status_store_clear_entry(struct file_transfer_state *filestate);
 
 
 
@@ -58,5 +66,8 @@ int     status_store_entry_update(struct cloudmig_ctx *ctx,
                                   uint64_t done_size);
 int     status_store_entry_complete(struct cloudmig_ctx *ctx,
                                     struct file_transfer_state *filestate);
+int     status_store_entries_complete(struct cloudmig_ctx *ctx,
+                                      struct file_transfer_state **filestates,
+                                      int n_entries);
 
 #endif /* ! __CLOUDMIG_STATUS_STORE_H__ */
@@ -0,0 +1,67 @@
+// Copyright (c) 2015, David Pineau
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of the copyright holder nor the names of its contributors
+//    may be used to endorse or promote products derived from this software
+//    without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER AND CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef __CLOUDMIG_STATUS_STREAM_H__
+#define __CLOUDMIG_STATUS_STREAM_H__
+
+#include <droplet.h>
+
+struct bucket_entry;
+struct status_stream;
+
+/*
+ * The status stream parses the entries of a bucket status segment as its
+ * data comes in, handing each entry out as soon as it is complete, without
+ * ever building the JSON tree of the whole segment.
+ *
+ * The emit callback is given the whole path of the entry, which is only
+ * valid during the call, along with its size, type and done flag.
+ */
+typedef int (*status_stream_emit_t)(void *data, const char *path,
+                                    const struct bucket_entry *entry);
+
+struct status_stream    *status_stream_new(status_stream_emit_t emit, void *data);
+void                    status_stream_free(struct status_stream *stream);
+
+/*
+ * @brief Parse the next bytes of the segment.
+ */
+int                     status_stream_feed(struct status_stream *stream,
+                                           const char *buf, size_t len);
+/*
+ * @brief Check that the whole segment was parsed.
+ */
+int                     status_stream_end(struct status_stream *stream);
+
+/*
+ * @brief Fetch a status file by ranges of range_size bytes and parse it, the
+ * next range being fetched while the current one is parsed.
+ */
+int                     status_stream_load(dpl_ctx_t *status_ctx, const char *path,
+                                           size_t range_size,
+                                           struct status_stream *stream);
+
+#endif /* ! __CLOUDMIG_STATUS_STREAM_H__ */
@@ -0,0 +1,100 @@
+// Copyright (c) 2015, David Pineau
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of the copyright holder nor the names of its contributors
+//    may be used to endorse or promote products derived from this software
+//    without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER AND CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef __CLOUDMIG_STATUS_WAL_H__
+#define __CLOUDMIG_STATUS_WAL_H__
+
+#include <time.h>
+
+#include <droplet.h>
+
+struct cloudmig_status;
+struct bucket_status;
+struct status_wal;
+
+/*
+ * The status log records every status mutation within a local append-only
+ * file, synced to disk before the mutation is considered done. A background
+ * thread replicates the mutations to the status store, coalescing the ones
+ * applying to the same status file, and the log is compacted after each
+ * replication, down to the mutations recorded meanwhile.
+ */
+
+/*
+ * @brief Open the status log, reading the mutations it may still hold from
+ * a previous run, which were not replicated to the status store.
+ */
+struct status_wal   *status_wal_open(dpl_ctx_t *status_ctx, const char *path);
+
+/*
+ * @brief Apply the mutations left over by a previous run to the loaded
+ * status, and replicate them before the migration starts.
+ */
+int                 status_wal_recover(struct status_wal *wal,
+                                       struct cloudmig_status *status);
+
+/*
+ * @brief Start the replication thread.
+ */
+int                 status_wal_start(struct status_wal *wal, time_t period);
+
+/*
+ * @brief Stop the replication thread, replicate the remaining mutations, and
+ * close the log.
+ */
+void                status_wal_close(struct status_wal *wal);
+
+/*
+ * Record a mutation. The status file will be written (or removed) on the
+ * status store by the replication thread.
+ */
+int                 status_wal_put(struct status_wal *wal,
+                                   const char *path, const char *data);
+int                 status_wal_unlink(struct status_wal *wal, const char *path);
+int                 status_wal_done(struct status_wal *wal,
+                                    struct bucket_status *bst,
+                                    const unsigned int *idxs, int n_idxs);
+/*
+ * Records the first checkpoint of entries, for the index of the partial
+ * entries to be uploaded along with their states.
+ */
+int                 status_wal_partial(struct status_wal *wal,
+                                       struct bucket_status *bst,
+                                       const unsigned int *idxs, int n_idxs);
+
+/*
+ * @brief Replicate synchronously all the recorded mutations.
+ */
+int                 status_wal_flush(struct status_wal *wal);
+
+/*
+ * @brief Replication lag: age of the oldest mutation not yet replicated, and
+ * worst value seen when replicating.
+ */
+time_t              status_wal_lag(struct status_wal *wal);
+time_t              status_wal_max_lag(struct status_wal *wal);
+
+#endif /* ! __CLOUDMIG_STATUS_WAL_H__ */
@@ -50,6 +50,13 @@ struct synceddir_ctx
         struct synceddir        *first;
         struct synceddir        *last;
     }                       list;
+
+    // Hash set of the directories known to exist, by path
+    struct {
+        char                    **paths;
+        unsigned int            count;
+        unsigned int            size;
+    }                       known;
 };
 
 /*
@@ -110,5 +117,18 @@ void synced_dir_unregister(struct synceddir *sdir, bool is_responsible, bool exi
  */
 bool synced_dir_completion_wait(struct synceddir *sdir);
 
+/*
+ * @brief Tell whether a directory is known to exist, as it was created or
+ * found by a responsible directory creator. Since the directories are
+ * migrated before their children, this spares most files the check of the
+ * existence of their parent directory.
+ *
+ * @param path  The path of the directory, as registered.
+ *
+ * @return true     The directory exists.
+ *         false    The directory is unknown, and may exist or not.
+ */
+bool synced_dir_exists(struct synceddir_ctx *ctx, const char *path);
+
 
 #endif /* ! __CLOUDMIG_SYNCED_DIR_H__ */
@@ -0,0 +1,72 @@
+// Copyright (c) 2011, David Pineau
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of the copyright holder nor the names of its contributors
+//    may be used to endorse or promote products derived from this software
+//    without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER AND CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef __CLOUDMIG_WATCHDOG_H__
+#define __CLOUDMIG_WATCHDOG_H__
+
+#include <signal.h>
+
+/*
+ * Signal sent by the watchdog to a worker thread stuck within a transfer, in
+ * order to interrupt the blocking system call it may be waiting on. The calls
+ * retried by droplet are not interrupted: the worker only aborts in-between
+ * two blocks.
+ */
+#define CLOUDMIG_STALL_SIGNAL   SIGUSR1
+
+struct cloudmig_ctx;
+struct cldmig_info;
+struct cldmig_watchdog;
+
+/*
+ * @brief Start the transfer watchdog (supervisor thread), which periodically
+ * samples the progress of each worker thread. A transfer that moved less than
+ * the minimal rate over the configured time window is flagged as stalled and its
+ * worker is interrupted until it aborts, so that the transfer can be resumed
+ * from its last checkpoint.
+ *
+ * @return The watchdog    The supervisor thread is running
+ *         NULL            The watchdog is disabled by the configuration, or
+ *                         could not be started (see log)
+ */
+struct cldmig_watchdog  *watchdog_create(struct cloudmig_ctx *ctx);
+
+/*
+ * @brief Stop the supervisor thread and free the watchdog.
+ */
+void                    watchdog_destroy(struct cldmig_watchdog *wd);
+
+/*
+ * @brief Called by a worker thread in-between two data blocks, or once a
+ * transfer failed: consumes the stall flag raised by the watchdog for the
+ * current transfer, if any, and accounts for the abort.
+ *
+ * @return true     The transfer was flagged as stalled and must be aborted
+ *         false    The transfer can go on
+ */
+bool                    watchdog_check_stalled(struct cldmig_info *tinfo);
+
+#endif /* ! __CLOUDMIG_WATCHDOG_H__ */
@@ -41,7 +41,7 @@ void delete_source(struct cloudmig_ctx *ctx)
     int                         found = 1;
     char                        *bucketpath = NULL;
     char                        *statuspath = NULL;
-    struct file_transfer_state  filestate;
+    struct file_transfer_state  filestate = CLOUDMIG_FILESTATE_INITIALIZER;
 
     cloudmig_log(INFO_LVL,
     "[Deleting Source]: Starting deletion of the migration's source...\n");
@@ -68,6 +68,7 @@ void delete_source(struct cloudmig_ctx *ctx)
     "[Deleting Source]: Deletion of the migration's source done.\n");
 
 cleanup:
+    status_store_clear_entry(&filestate);
     if (bucketpath)
         free(bucketpath);
     if (statuspath)
@@ -27,6 +27,7 @@
 #include <errno.h>
 #include <string.h>
 #include <sys/time.h>
+#include <time.h>
 #include <droplet.h>
 #include <droplet/vfs.h>
 #include <libgen.h>
@@ -37,6 +38,7 @@
 #include "status_store.h"
 #include "status_digest.h"
 #include "synced_dir.h"
+#include "watchdog.h"
 
 /*
  * This function creates an element for the byte rate computing list
@@ -69,6 +71,9 @@ _add_transfer_info(struct cldmig_info *tinfo, size_t len)
  * one of two concurrent mkdir calls.
  *
  * Because of this, the synchronized directory module exists and is used here.
+ * The directories being migrated before their children, the parent directory
+ * is usually known to exist already, or being created by another worker,
+ * whose completion is then waited for instead of checking the destination.
  */
 static int
 create_parent_dirs(struct cloudmig_ctx *ctx, char *srcpath, char *dstpath)
@@ -105,13 +110,28 @@ create_parent_dirs(struct cloudmig_ctx *ctx, char *srcpath, char *dstpath)
      * backend requires the ending '/' to be part of the object name when
      * reading informations (attributes) from directories.
      */
-    cloudmig_log(WARN_LVL, "[Migrating] Creating parent directory of file %s\n",
-                 dstpath);
     *dstdelim = 0;
     if (*(srcdelim+1) != 0)
         *(srcdelim+1) = 0;
-    cloudmig_log(WARN_LVL, "[Migrating] Creating parent directory=%s\n",
-                 dstpath);
+
+    if (synced_dir_exists(ctx->synced_dir_ctx, dstpath))
+    {
+        ret = EXIT_SUCCESS;
+        goto err;
+    }
+
+    synced_dir_register(ctx->synced_dir_ctx, dstpath, &sdir, &is_responsible);
+    if (!is_responsible)
+    {
+        created = synced_dir_completion_wait(sdir);
+        if (!created)
+        {
+            ret = EXIT_FAILURE;
+            goto err;
+        }
+        ret = EXIT_SUCCESS;
+        goto err;
+    }
 
     // Check existence
     dplret = dpl_getattr(ctx->dest_ctx, dstpath, NULL /*mdp*/, NULL/*sysmd*/);
@@ -124,51 +144,40 @@ create_parent_dirs(struct cloudmig_ctx *ctx, char *srcpath, char *dstpath)
         }
 
         // ENOENT, try to create parents then self.
-        synced_dir_register(ctx->synced_dir_ctx, dstpath, &sdir, &is_responsible);
-        if (is_responsible)
-        {
-
-            ret = create_parent_dirs(ctx, srcpath, dstpath);
-            if (ret != EXIT_SUCCESS)
-                goto err;
-
-            dplret = dpl_getattr(ctx->src_ctx, srcpath, &md, NULL/*sysmd*/);
-            if (dplret != DPL_SUCCESS)
-            {
-                PRINTERR("[Migrating] Could not get source directory %s attributes: %s.\n",
-                         srcpath, dpl_status_str(dplret));
-                ret = EXIT_FAILURE;
-                goto err;
-            }
+        cloudmig_log(WARN_LVL, "[Migrating] Creating parent directory=%s\n",
+                     dstpath);
 
-            /*
-             * In a Multi-threaded context, directory might have been created by a
-             * concurrent thread
-             * -> EEXIST is not an error.
-             */
-            dplret = dpl_mkdir(ctx->dest_ctx, dstpath, md, NULL/*sysmd*/);
-            if (dplret != DPL_SUCCESS && dplret != DPL_EEXIST)
-            {
-                PRINTERR("[Migrating] Creating parent directory %s: %s\n",
-                         dstpath, dpl_status_str(dplret));
-                ret = EXIT_FAILURE;
-                goto err;
-            }
-            created = true;
+        ret = create_parent_dirs(ctx, srcpath, dstpath);
+        if (ret != EXIT_SUCCESS)
+            goto err;
 
-            cloudmig_log(DEBUG_LVL,
-                         "[Migrating] Parent directories created with success !\n");
+        dplret = dpl_getattr(ctx->src_ctx, srcpath, &md, NULL/*sysmd*/);
+        if (dplret != DPL_SUCCESS)
+        {
+            PRINTERR("[Migrating] Could not get source directory %s attributes: %s.\n",
+                     srcpath, dpl_status_str(dplret));
+            ret = EXIT_FAILURE;
+            goto err;
         }
-        else
+
+        /*
+         * In a Multi-threaded context, directory might have been created by a
+         * concurrent thread
+         * -> EEXIST is not an error.
+         */
+        dplret = dpl_mkdir(ctx->dest_ctx, dstpath, md, NULL/*sysmd*/);
+        if (dplret != DPL_SUCCESS && dplret != DPL_EEXIST)
         {
-            created = synced_dir_completion_wait(sdir);
-            if (!created)
-            {
-                ret = EXIT_FAILURE;
-                goto err;
-            }
+            PRINTERR("[Migrating] Creating parent directory %s: %s\n",
+                     dstpath, dpl_status_str(dplret));
+            ret = EXIT_FAILURE;
+            goto err;
         }
+
+        cloudmig_log(DEBUG_LVL,
+                     "[Migrating] Parent directories created with success !\n");
     }
+    created = true;
 
     ret = EXIT_SUCCESS;
 
@@ -248,6 +257,14 @@ create_directory(struct cldmig_info *tinfo,
     else
         delim = NULL;
 
+    // Already created as the parent of an entry migrated before it.
+    if (synced_dir_exists(ctx->synced_dir_ctx, filestate->dst_path))
+    {
+        _add_transfer_info(tinfo, 0);
+        ret = EXIT_SUCCESS;
+        goto err;
+    }
+
     synced_dir_register(ctx->synced_dir_ctx, filestate->dst_path, &sdir, &is_responsible);
     if (is_responsible)
     {
@@ -373,7 +390,8 @@ create_symlink(struct cldmig_info *tinfo,
     // Update info list for viewer's ETA
     _add_transfer_info(tinfo, 0);
 
-    status_digest_add(ctx->status->digest, DIGEST_DONE_BYTES, filestate->fixed.size);
+    status_digest_bucket_add(ctx->status->digest, filestate->bst->summary,
+                             DIGEST_DONE_BYTES, filestate->fixed.size);
 
     ret = EXIT_SUCCESS;
 
@@ -458,6 +476,103 @@ err:
     return ret;
 }
 
+/*
+ * Saves the progress of a chunked transfer into the status, accounting for
+ * the cost of doing so.
+ */
+static int
+_checkpoint(struct cldmig_info *tinfo,
+            struct file_transfer_state *filestate,
+            uint64_t pending_bytes)
+{
+    int                 ret;
+    struct timespec     start;
+    struct timespec     end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    ret = status_store_entry_update(tinfo->ctx, filestate, pending_bytes);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    tinfo->checkpoint_count += 1;
+    tinfo->checkpoint_bytes += pending_bytes;
+    tinfo->checkpoint_usec += (end.tv_sec - start.tv_sec) * 1000000
+                              + (end.tv_nsec - start.tv_nsec) / 1000;
+
+    return ret;
+}
+
+/*
+ * Remembers the progress of a chunked transfer as last checkpointed, so that
+ * it can be restored when the blocks written since are lost.
+ */
+struct checkpoint_mark
+{
+    uint64_t            offset;
+    struct json_object  *rstatus;
+    struct json_object  *wstatus;
+};
+
+static void
+_checkpoint_mark(struct checkpoint_mark *mark,
+                 struct file_transfer_state *filestate)
+{
+    if (mark->rstatus)
+        json_object_put(mark->rstatus);
+    if (mark->wstatus)
+        json_object_put(mark->wstatus);
+    mark->offset = filestate->fixed.offset;
+    mark->rstatus = filestate->rstatus ? json_object_get(filestate->rstatus) : NULL;
+    mark->wstatus = filestate->wstatus ? json_object_get(filestate->wstatus) : NULL;
+}
+
+static void
+_checkpoint_restore(struct checkpoint_mark *mark,
+                    struct file_transfer_state *filestate)
+{
+    if (filestate->rstatus)
+        json_object_put(filestate->rstatus);
+    if (filestate->wstatus)
+        json_object_put(filestate->wstatus);
+    filestate->fixed.offset = mark->offset;
+    filestate->rstatus = mark->rstatus;
+    filestate->wstatus = mark->wstatus;
+    mark->rstatus = NULL;
+    mark->wstatus = NULL;
+}
+
+/*
+ * Tells whether the checkpoint policy requires to save the progress of a
+ * chunked transfer, given what was transferred since the last checkpoint.
+ */
+static bool
+_checkpoint_due(struct cloudmig_options *options,
+                struct file_transfer_state *filestate,
+                uint64_t pending_bytes, time_t last_time,
+                const char *last_wstatus)
+{
+    const char  *wstatus;
+
+    switch (options->checkpoint_policy)
+    {
+    case CHECKPOINT_BYTES:
+        return pending_bytes >= options->checkpoint_bytes;
+    case CHECKPOINT_INTERVAL:
+        return time(NULL) - last_time >= options->checkpoint_interval;
+    case CHECKPOINT_RESUMABLE:
+        /*
+         * The write status is what droplet needs to resume the destination
+         * stream: it only is worth saving when it moved to a new point.
+         */
+        if (filestate->wstatus == NULL)
+            return false;
+        wstatus = json_object_to_json_string(filestate->wstatus);
+        return last_wstatus == NULL || strcmp(wstatus, last_wstatus) != 0;
+    case CHECKPOINT_BLOCK:
+    default:
+        return true;
+    }
+}
+
 int
 transfer_chunked(struct cldmig_info *tinfo,
                  struct file_transfer_state *filestate)
@@ -467,8 +582,15 @@ transfer_chunked(struct cldmig_info *tinfo,
     struct cloudmig_ctx     *ctx = tinfo->ctx;
     dpl_vfile_t             *src = NULL;
     dpl_vfile_t             *dst = NULL;
+    uint64_t                pending_bytes = 0;
+    time_t                  last_checkpoint = time(NULL);
+    char                    *last_wstatus = NULL;
+    struct checkpoint_mark  mark = { 0, NULL, NULL };
 
     cloudmig_log(WARN_LVL, "Transfer Chunked of file %s\n", filestate->obj_path);
+    // Any failure resumes from the state the transfer started from, at worst.
+    _checkpoint_mark(&mark, filestate);
+
     /*
      * Open the source file for reading
      */
@@ -506,15 +628,51 @@ transfer_chunked(struct cldmig_info *tinfo,
     /* Transfer the actual data */
     while (filestate->fixed.offset < filestate->fixed.size)
     {
-        uint64_t    bytes_transfered;
+        uint64_t    bytes_transfered = 0;
 
         ret = transfer_data_chunk(tinfo, filestate, src, dst, &bytes_transfered);
         if (ret != EXIT_SUCCESS)
             goto err;
+        pending_bytes += bytes_transfered;
 
-        ret = status_store_entry_update(ctx, filestate, bytes_transfered);
-        if (ret != EXIT_SUCCESS)
+        if (_checkpoint_due(&ctx->options, filestate, pending_bytes,
+                            last_checkpoint, last_wstatus))
+        {
+            ret = _checkpoint(tinfo, filestate, pending_bytes);
+            if (ret != EXIT_SUCCESS)
+                goto err;
+            pending_bytes = 0;
+            last_checkpoint = time(NULL);
+            _checkpoint_mark(&mark, filestate);
+            if (ctx->options.checkpoint_policy == CHECKPOINT_RESUMABLE)
+            {
+                free(last_wstatus);
+                last_wstatus = NULL;
+                if (filestate->wstatus)
+                {
+                    last_wstatus = strdup(json_object_to_json_string(filestate->wstatus));
+                    if (last_wstatus == NULL)
+                    {
+                        PRINTERR("%s: Could not save the write status of %s: out of memory.\n",
+                                 __FUNCTION__, filestate->obj_path);
+                        ret = EXIT_FAILURE;
+                        goto err;
+                    }
+                }
+            }
+        }
+
+        /*
+         * If the watchdog deemed the transfer stalled, abort it so it gets
+         * retried from the last checkpoint over fresh connections.
+         */
+        if (watchdog_check_stalled(tinfo))
+        {
+            PRINTERR("%s: Transfer of %s stalled, aborting at offset %"PRIu64".\n",
+                     __FUNCTION__, filestate->obj_path, filestate->fixed.offset);
+            ret = EXIT_FAILURE;
             goto err;
+        }
     }
 
     /*
@@ -529,9 +687,36 @@ transfer_chunked(struct cldmig_info *tinfo,
         goto err;
     }
 
+    /*
+     * The entry is about to be completed, so the progress not checkpointed
+     * yet only needs to be accounted for.
+     */
+    status_digest_bucket_add(ctx->status->digest, filestate->bst->summary,
+                             DIGEST_DONE_BYTES, pending_bytes);
+    pending_bytes = 0;
+
     ret = EXIT_SUCCESS;
 
 err:
+    /*
+     * The blocks written since the last checkpoint may not have reached the
+     * destination, whatever failed: the retry resumes from that checkpoint.
+     * They were transfered all the same, and are only accounted for.
+     */
+    if (ret != EXIT_SUCCESS)
+    {
+        if (pending_bytes)
+            status_digest_bucket_add(ctx->status->digest, filestate->bst->summary,
+                                     DIGEST_DONE_BYTES, pending_bytes);
+        _checkpoint_restore(&mark, filestate);
+    }
+    if (last_wstatus)
+        free(last_wstatus);
+    if (mark.rstatus)
+        json_object_put(mark.rstatus);
+    if (mark.wstatus)
+        json_object_put(mark.wstatus);
+
     if (dst)
     {
         dplret = dpl_close(dst);
@@ -598,7 +783,8 @@ transfer_whole(struct cldmig_info *tinfo,
     // Update info list for viewer's ETA
     _add_transfer_info(tinfo, buflen);
 
-    status_digest_add(ctx->status->digest, DIGEST_DONE_BYTES, filestate->fixed.size);
+    status_digest_bucket_add(ctx->status->digest, filestate->bst->summary,
+                             DIGEST_DONE_BYTES, filestate->fixed.size);
 
     ret = EXIT_SUCCESS;
 
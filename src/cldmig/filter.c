@@ -0,0 +1,499 @@
+// Copyright (c) 2015, David Pineau
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of the copyright holder nor the names of its contributors
+//    may be used to endorse or promote products derived from this software
+//    without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER AND CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <ctype.h>
+#include <fnmatch.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <droplet.h>
+
+#include "cloudmig.h"
+#include "filter.h"
+
+#define FILTER_GLOB_SPECIALS    "*?[\\"
+
+enum filter_kind
+{
+    FILTER_PREFIX,
+    FILTER_GLOB,
+    FILTER_SIZE,
+    FILTER_MTIME,
+};
+
+// Kinds of include rules, each of which must be matched by the entries kept.
+enum filter_class
+{
+    FILTER_CLASS_PATH,
+    FILTER_CLASS_SIZE,
+    FILTER_CLASS_MTIME,
+    FILTER_N_CLASSES,
+};
+
+struct filter_rule
+{
+    enum filter_kind    kind;
+    bool                exclude;
+    char                *rule;          // as given, for the reports
+    char                *pattern;       // prefix or glob
+    size_t              literal_len;    // length of the pattern before any wildcard
+    const char          *suffix;        // globs of the form "*suffix" only
+    size_t              suffix_len;
+    uint64_t            min;            // size or mtime range, bounds included
+    uint64_t            max;
+    uint64_t            hits;           // entries decided upon by the rule
+};
+
+struct cloudmig_filter
+{
+    struct filter_rule  *rules;
+    unsigned int        n_rules;
+    unsigned int        n_includes[FILTER_N_CLASSES];
+    char                *prefix;        // shared by the path include rules
+    size_t              prefix_len;
+    uint64_t            unmatched;      // entries matching no include rule
+    uint64_t            checked;
+};
+
+static enum filter_class
+_filter_class(enum filter_kind kind)
+{
+    switch (kind)
+    {
+    case FILTER_SIZE:
+        return FILTER_CLASS_SIZE;
+    case FILTER_MTIME:
+        return FILTER_CLASS_MTIME;
+    case FILTER_PREFIX:
+    case FILTER_GLOB:
+    default:
+        return FILTER_CLASS_PATH;
+    }
+}
+
+static int
+_filter_parse_size(const char *str, size_t len, uint64_t *sizep)
+{
+    char        *end = NULL;
+    uint64_t    size;
+    int         shift = 0;
+
+    if (len == 0 || !isdigit((unsigned char)*str))
+        return EXIT_FAILURE;
+    size = strtoull(str, &end, 10);
+    if ((size_t)(end - str) < len)
+    {
+        switch (toupper((unsigned char)*end))
+        {
+        case 'K': shift = 10; break;
+        case 'M': shift = 20; break;
+        case 'G': shift = 30; break;
+        case 'T': shift = 40; break;
+        default:
+            return EXIT_FAILURE;
+        }
+        if ((size_t)(end + 1 - str) != len || size > (UINT64_MAX >> shift))
+            return EXIT_FAILURE;
+    }
+    *sizep = size << shift;
+
+    return EXIT_SUCCESS;
+}
+
+static int
+_filter_parse_time(const char *str, size_t len, uint64_t *timep)
+{
+    char        buf[32];
+    char        *end = NULL;
+    struct tm   tm;
+
+    if (len == 0 || len >= sizeof(buf))
+        return EXIT_FAILURE;
+    memcpy(buf, str, len);
+    buf[len] = 0;
+
+    if (strspn(buf, "0123456789") == len)
+    {
+        *timep = strtoull(buf, NULL, 10);
+        return EXIT_SUCCESS;
+    }
+
+    memset(&tm, 0, sizeof(tm));
+    end = strptime(buf, "%Y-%m-%dT%H:%M:%S", &tm);
+    if (end == NULL || *end != 0)
+    {
+        memset(&tm, 0, sizeof(tm));
+        end = strptime(buf, "%Y-%m-%d", &tm);
+    }
+    if (end == NULL || *end != 0)
+        return EXIT_FAILURE;
+    *timep = timegm(&tm);
+
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Parses a range of the form "min..max", either bound being optional.
+ */
+static int
+_filter_parse_range(struct filter_rule *rule, const char *value,
+                    int (*parse)(const char *, size_t, uint64_t *))
+{
+    const char  *sep = strstr(value, "..");
+
+    rule->min = 0;
+    rule->max = UINT64_MAX;
+    if (sep == NULL)
+        return EXIT_FAILURE;
+    if (sep != value && parse(value, sep - value, &rule->min) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+    if (sep[2] && parse(sep + 2, strlen(sep + 2), &rule->max) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+    if (rule->min > rule->max || (sep == value && !sep[2]))
+        return EXIT_FAILURE;
+
+    return EXIT_SUCCESS;
+}
+
+static int
+_filter_compile(struct filter_rule *rule, const char *str)
+{
+    const char  *value = strchr(str, ':');
+    size_t      len;
+
+    if (value == NULL)
+        return EXIT_FAILURE;
+    len = value - str;
+    ++value;
+
+    if (len == strlen("prefix") && strncmp(str, "prefix", len) == 0)
+    {
+        rule->kind = FILTER_PREFIX;
+        rule->pattern = strdup(value);
+        if (rule->pattern == NULL)
+            return EXIT_FAILURE;
+        rule->literal_len = strlen(value);
+    }
+    else if (len == strlen("glob") && strncmp(str, "glob", len) == 0)
+    {
+        if (*value == 0)
+            return EXIT_FAILURE;
+        rule->kind = FILTER_GLOB;
+        rule->pattern = strdup(value);
+        if (rule->pattern == NULL)
+            return EXIT_FAILURE;
+        rule->literal_len = strcspn(value, FILTER_GLOB_SPECIALS);
+        // The most common globs are matched without fnmatch().
+        if (value[0] == '*' && value[1] != 0
+            && strpbrk(value + 1, FILTER_GLOB_SPECIALS) == NULL)
+        {
+            rule->suffix = rule->pattern + 1;
+            rule->suffix_len = strlen(rule->suffix);
+        }
+    }
+    else if (len == strlen("size") && strncmp(str, "size", len) == 0)
+    {
+        rule->kind = FILTER_SIZE;
+        return _filter_parse_range(rule, value, &_filter_parse_size);
+    }
+    else if (len == strlen("mtime") && strncmp(str, "mtime", len) == 0)
+    {
+        rule->kind = FILTER_MTIME;
+        return _filter_parse_range(rule, value, &_filter_parse_time);
+    }
+    else
+        return EXIT_FAILURE;
+
+    return EXIT_SUCCESS;
+}
+
+int
+filter_add(struct cloudmig_filter **filterp, bool exclude, const char *str)
+{
+    struct cloudmig_filter  *filter = *filterp;
+    struct filter_rule      *rules = NULL;
+    struct filter_rule      *rule = NULL;
+    size_t                  common;
+
+    if (filter == NULL)
+    {
+        filter = calloc(1, sizeof(*filter));
+        if (filter == NULL)
+        {
+            PRINTERR("Could not allocate filter.\n");
+            return EXIT_FAILURE;
+        }
+        *filterp = filter;
+    }
+
+    rules = realloc(filter->rules, sizeof(*rules) * (filter->n_rules + 1));
+    if (rules == NULL)
+    {
+        PRINTERR("Could not allocate filter rule.\n");
+        return EXIT_FAILURE;
+    }
+    filter->rules = rules;
+    rule = &rules[filter->n_rules];
+    memset(rule, 0, sizeof(*rule));
+    rule->exclude = exclude;
+    rule->rule = strdup(str);
+    if (rule->rule == NULL || _filter_compile(rule, str) != EXIT_SUCCESS)
+    {
+        PRINTERR("Invalid filter rule: %s\n", str);
+        free(rule->rule);
+        free(rule->pattern);
+        return EXIT_FAILURE;
+    }
+    filter->n_rules += 1;
+
+    if (exclude)
+        return EXIT_SUCCESS;
+
+    if (_filter_class(rule->kind) == FILTER_CLASS_PATH)
+    {
+        if (filter->n_includes[FILTER_CLASS_PATH] == 0)
+        {
+            filter->prefix = rule->pattern;
+            filter->prefix_len = rule->literal_len;
+        }
+        else
+        {
+            common = 0;
+            while (common < filter->prefix_len && common < rule->literal_len
+                   && filter->prefix[common] == rule->pattern[common])
+                ++common;
+            filter->prefix_len = common;
+        }
+    }
+    filter->n_includes[_filter_class(rule->kind)] += 1;
+
+    return EXIT_SUCCESS;
+}
+
+void
+filter_free(struct cloudmig_filter *filter)
+{
+    if (filter == NULL)
+        return ;
+    for (unsigned int i=0; i < filter->n_rules; ++i)
+    {
+        free(filter->rules[i].rule);
+        free(filter->rules[i].pattern);
+    }
+    free(filter->rules);
+    free(filter);
+}
+
+static bool
+_filter_rule_match(const struct filter_rule *rule, const char *path, size_t len,
+                   uint64_t size, time_t mtime)
+{
+    switch (rule->kind)
+    {
+    case FILTER_PREFIX:
+        return len >= rule->literal_len
+            && strncmp(path, rule->pattern, rule->literal_len) == 0;
+    case FILTER_GLOB:
+        if (strncmp(path, rule->pattern, rule->literal_len) != 0)
+            return false;
+        if (rule->suffix)
+            return len >= rule->suffix_len
+                && memcmp(path + len - rule->suffix_len, rule->suffix,
+                          rule->suffix_len) == 0;
+        return fnmatch(rule->pattern, path, 0) == 0;
+    case FILTER_SIZE:
+        return size >= rule->min && size <= rule->max;
+    case FILTER_MTIME:
+        // The times unknown never match.
+        return mtime > 0
+            && (uint64_t)mtime >= rule->min && (uint64_t)mtime <= rule->max;
+    }
+
+    return false;
+}
+
+/*
+ * Tells whether a path rule may keep some entry within a directory: its
+ * literal prefix and the directory's path must then be prefixes of one
+ * another.
+ */
+static bool
+_filter_rule_reaches(const struct filter_rule *rule, const char *dir, size_t len)
+{
+    size_t  n = len < rule->literal_len ? len : rule->literal_len;
+
+    return strncmp(dir, rule->pattern, n) == 0;
+}
+
+static bool
+_filter_match_dir(struct cloudmig_filter *filter, const char *path, size_t len)
+{
+    struct filter_rule  *rule = NULL;
+    struct filter_rule  *include = NULL;
+
+    for (unsigned int i=0; i < filter->n_rules; ++i)
+    {
+        rule = &filter->rules[i];
+        if (_filter_class(rule->kind) != FILTER_CLASS_PATH)
+            continue ;
+        if (rule->exclude)
+        {
+            if (_filter_rule_match(rule, path, len, 0, 0))
+            {
+                __atomic_fetch_add(&rule->hits, 1, __ATOMIC_RELAXED);
+                return false;
+            }
+        }
+        else if (include == NULL && _filter_rule_reaches(rule, path, len))
+            include = rule;
+    }
+
+    if (filter->n_includes[FILTER_CLASS_PATH] > 0 && include == NULL)
+    {
+        __atomic_fetch_add(&filter->unmatched, 1, __ATOMIC_RELAXED);
+        return false;
+    }
+
+    return true;
+}
+
+bool
+filter_match(struct cloudmig_filter *filter, const char *path,
+             dpl_ftype_t type, uint64_t size, time_t mtime)
+{
+    struct filter_rule  *rule = NULL;
+    struct filter_rule  *matched[FILTER_N_CLASSES] = { NULL, NULL, NULL };
+    enum filter_class   class;
+    size_t              len;
+
+    if (filter == NULL)
+        return true;
+
+    __atomic_fetch_add(&filter->checked, 1, __ATOMIC_RELAXED);
+    len = strlen(path);
+    if (type == DPL_FTYPE_DIR)
+        return _filter_match_dir(filter, path, len);
+
+    for (unsigned int i=0; i < filter->n_rules; ++i)
+    {
+        rule = &filter->rules[i];
+        class = _filter_class(rule->kind);
+        if (!rule->exclude && matched[class])
+            continue ;
+        if (!_filter_rule_match(rule, path, len, size, mtime))
+            continue ;
+        if (rule->exclude)
+        {
+            __atomic_fetch_add(&rule->hits, 1, __ATOMIC_RELAXED);
+            return false;
+        }
+        matched[class] = rule;
+    }
+
+    for (int i=0; i < FILTER_N_CLASSES; ++i)
+    {
+        if (filter->n_includes[i] > 0 && matched[i] == NULL)
+        {
+            __atomic_fetch_add(&filter->unmatched, 1, __ATOMIC_RELAXED);
+            return false;
+        }
+    }
+    for (int i=0; i < FILTER_N_CLASSES; ++i)
+    {
+        if (matched[i])
+            __atomic_fetch_add(&matched[i]->hits, 1, __ATOMIC_RELAXED);
+    }
+
+    return true;
+}
+
+bool
+filter_match_tree(struct cloudmig_filter *filter, const char *path,
+                  dpl_ftype_t type, uint64_t size, time_t mtime)
+{
+    char    *dir = NULL;
+    size_t  len;
+    bool    match = true;
+
+    if (filter == NULL)
+        return true;
+
+    len = strlen(path);
+    dir = strdup(path);
+    if (dir == NULL)
+    {
+        PRINTERR("Could not allocate path to filter.\n");
+        return false;
+    }
+
+    // The parents, from the bucket's root down, excluding the entry itself.
+    for (size_t end=0; match && end + 1 < len; ++end)
+    {
+        if (path[end] != '/')
+            continue ;
+        dir[end + 1] = 0;
+        match = _filter_match_dir(filter, dir, end + 1);
+        dir[end + 1] = path[end + 1];
+    }
+    free(dir);
+
+    return match && filter_match(filter, path, type, size, mtime);
+}
+
+const char*
+filter_prefix(struct cloudmig_filter *filter, size_t *lenp)
+{
+    if (filter == NULL || filter->n_includes[FILTER_CLASS_PATH] == 0)
+    {
+        *lenp = 0;
+        return "";
+    }
+
+    *lenp = filter->prefix_len;
+    return filter->prefix;
+}
+
+void
+filter_report(struct cloudmig_filter *filter)
+{
+    struct filter_rule  *rule = NULL;
+
+    if (filter == NULL)
+        return ;
+
+    cloudmig_log(STATUS_LVL, "\tFiltered entries : %llu checked, %llu matching no include rule.\n",
+                 (unsigned long long)__atomic_load_n(&filter->checked, __ATOMIC_RELAXED),
+                 (unsigned long long)__atomic_load_n(&filter->unmatched, __ATOMIC_RELAXED));
+    for (unsigned int i=0; i < filter->n_rules; ++i)
+    {
+        rule = &filter->rules[i];
+        cloudmig_log(STATUS_LVL, "\t\t%s %s : %llu entries.\n",
+                     rule->exclude ? "exclude" : "include", rule->rule,
+                     (unsigned long long)__atomic_load_n(&rule->hits, __ATOMIC_RELAXED));
+    }
+}
@@ -38,6 +38,7 @@
 #include <json.h>
 
 #include "cloudmig.h"
+#include "filter.h"
 #include "options.h"
 
 static int
@@ -233,6 +234,43 @@ err:
     return ret;
 }
 
+/*
+ * The filter rules are either a single string or an array of strings, and
+ * add up to those given on the command line.
+ */
+static int
+config_update_json_filter(struct cloudmig_options *options, const char *key,
+                          struct json_object *rules)
+{
+    bool                exclude = (strcasecmp(key, "exclude") == 0);
+    struct json_object  *rule = NULL;
+
+    if (json_object_is_type(rules, json_type_string))
+        return filter_add(&options->filter, exclude, json_object_get_string(rules));
+
+    if (!json_object_is_type(rules, json_type_array))
+    {
+        PRINTERR("Unexpected type %i for option 'cloudmig/%s'.\n",
+                 json_object_get_type(rules), key);
+        return EXIT_FAILURE;
+    }
+    for (int i=0; i < json_object_array_length(rules); ++i)
+    {
+        rule = json_object_array_get_idx(rules, i);
+        if (!json_object_is_type(rule, json_type_string))
+        {
+            PRINTERR("Unexpected type %i for a rule of option 'cloudmig/%s'.\n",
+                     json_object_get_type(rule), key);
+            return EXIT_FAILURE;
+        }
+        if (filter_add(&options->filter, exclude,
+                       json_object_get_string(rule)) != EXIT_SUCCESS)
+            return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
 /*
  * For each option, the configuration file should overwrite the command-line
  * arguments settings. If the option is not "true" for the flags, then unset it
@@ -409,6 +447,224 @@ config_update_options(struct cldmig_config *conf,
             if (options->nb_threads > 1)
                 options->flags |= AUTO_CREATE_DIRS;
         }
+        else if (strcasecmp(key, "stall-timeout") == 0)
+        {
+            if (!json_object_is_type(val, json_type_int))
+            {
+                PRINTERR("Unexpected type %i for option 'cloudmig/stall-timeout'.\n",
+                         json_object_get_type(val));
+                return EXIT_FAILURE;
+            }
+            options->stall_timeout = json_object_get_int64(val);
+            if (options->stall_timeout < 0)
+            {
+                PRINTERR("Invalid value for option 'cloudmig/stall-timeout': %li.\n",
+                         options->stall_timeout);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcasecmp(key, "stall-min-rate") == 0)
+        {
+            if (!json_object_is_type(val, json_type_int))
+            {
+                PRINTERR("Unexpected type %i for option 'cloudmig/stall-min-rate'.\n",
+                         json_object_get_type(val));
+                return EXIT_FAILURE;
+            }
+            options->stall_min_rate = json_object_get_int64(val);
+        }
+        else if (strcasecmp(key, "cooperative") == 0)
+        {
+            if (!json_object_is_type(val, json_type_boolean))
+            {
+                PRINTERR("Unexpected type %i for option 'cloudmig/cooperative'.\n",
+                         json_object_get_type(val));
+                return EXIT_FAILURE;
+            }
+            options->flags &= ~COOPERATIVE_MIGRATION;
+            if (json_object_get_boolean(val) == TRUE)
+                options->flags |= COOPERATIVE_MIGRATION;
+        }
+        else if (strcasecmp(key, "lease-size") == 0)
+        {
+            if (!json_object_is_type(val, json_type_int))
+            {
+                PRINTERR("Unexpected type %i for option 'cloudmig/lease-size'.\n",
+                         json_object_get_type(val));
+                return EXIT_FAILURE;
+            }
+            if (json_object_get_int64(val) <= 0
+                || json_object_get_int64(val) > UINT_MAX)
+            {
+                PRINTERR("Invalid value for option 'cloudmig/lease-size': %"PRId64".\n",
+                         json_object_get_int64(val));
+                return EXIT_FAILURE;
+            }
+            options->lease_size = json_object_get_int64(val);
+        }
+        else if (strcasecmp(key, "lease-duration") == 0)
+        {
+            if (!json_object_is_type(val, json_type_int))
+            {
+                PRINTERR("Unexpected type %i for option 'cloudmig/lease-duration'.\n",
+                         json_object_get_type(val));
+                return EXIT_FAILURE;
+            }
+            options->lease_duration = json_object_get_int64(val);
+            if (options->lease_duration <= 0)
+            {
+                PRINTERR("Invalid value for option 'cloudmig/lease-duration': %li.\n",
+                         options->lease_duration);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcasecmp(key, "commit-batch") == 0)
+        {
+            if (!json_object_is_type(val, json_type_int))
+            {
+                PRINTERR("Unexpected type %i for option 'cloudmig/commit-batch'.\n",
+                         json_object_get_type(val));
+                return EXIT_FAILURE;
+            }
+            options->commit_batch = json_object_get_int64(val);
+            if (options->commit_batch <= 0)
+            {
+                PRINTERR("Invalid value for option 'cloudmig/commit-batch': %li.\n",
+                         options->commit_batch);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcasecmp(key, "checkpoint-policy") == 0)
+        {
+            if (!json_object_is_type(val, json_type_string))
+            {
+                PRINTERR("Unexpected type %i for option 'cloudmig/checkpoint-policy'.\n",
+                         json_object_get_type(val));
+                return EXIT_FAILURE;
+            }
+            if (opt_checkpoint_policy(options, json_object_get_string(val)) != EXIT_SUCCESS)
+                return EXIT_FAILURE;
+        }
+        else if (strcasecmp(key, "checkpoint-bytes") == 0)
+        {
+            if (!json_object_is_type(val, json_type_int))
+            {
+                PRINTERR("Unexpected type %i for option 'cloudmig/checkpoint-bytes'.\n",
+                         json_object_get_type(val));
+                return EXIT_FAILURE;
+            }
+            if (json_object_get_int64(val) <= 0)
+            {
+                PRINTERR("Invalid value for option 'cloudmig/checkpoint-bytes': %"PRId64".\n",
+                         json_object_get_int64(val));
+                return EXIT_FAILURE;
+            }
+            options->checkpoint_bytes = json_object_get_int64(val);
+        }
+        else if (strcasecmp(key, "checkpoint-interval") == 0)
+        {
+            if (!json_object_is_type(val, json_type_int))
+            {
+                PRINTERR("Unexpected type %i for option 'cloudmig/checkpoint-interval'.\n",
+                         json_object_get_type(val));
+                return EXIT_FAILURE;
+            }
+            options->checkpoint_interval = json_object_get_int64(val);
+            if (options->checkpoint_interval <= 0)
+            {
+                PRINTERR("Invalid value for option 'cloudmig/checkpoint-interval': %li.\n",
+                         options->checkpoint_interval);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcasecmp(key, "compress-status") == 0)
+        {
+            if (!json_object_is_type(val, json_type_boolean))
+            {
+                PRINTERR("Unexpected type %i for option 'cloudmig/compress-status'.\n",
+                         json_object_get_type(val));
+                return EXIT_FAILURE;
+            }
+            options->flags &= ~COMPRESS_STATUS;
+            if (json_object_get_boolean(val) == TRUE)
+                options->flags |= COMPRESS_STATUS;
+        }
+        else if (strcasecmp(key, "resync") == 0)
+        {
+            if (!json_object_is_type(val, json_type_boolean))
+            {
+                PRINTERR("Unexpected type %i for option 'cloudmig/resync'.\n",
+                         json_object_get_type(val));
+                return EXIT_FAILURE;
+            }
+            options->flags &= ~RESYNC_MIGRATION;
+            if (json_object_get_boolean(val) == TRUE)
+                options->flags |= RESYNC_MIGRATION;
+        }
+        else if (strcasecmp(key, "sync-interval") == 0)
+        {
+            if (!json_object_is_type(val, json_type_int))
+            {
+                PRINTERR("Unexpected type %i for option 'cloudmig/sync-interval'.\n",
+                         json_object_get_type(val));
+                return EXIT_FAILURE;
+            }
+            if (json_object_get_int64(val) <= 0)
+            {
+                PRINTERR("Invalid value for option 'cloudmig/sync-interval': %"PRId64".\n",
+                         json_object_get_int64(val));
+                return EXIT_FAILURE;
+            }
+            options->sync_interval = json_object_get_int64(val);
+        }
+        else if (strcasecmp(key, "digest-min-interval") == 0)
+        {
+            if (!json_object_is_type(val, json_type_int))
+            {
+                PRINTERR("Unexpected type %i for option 'cloudmig/digest-min-interval'.\n",
+                         json_object_get_type(val));
+                return EXIT_FAILURE;
+            }
+            options->digest_min_interval = json_object_get_int64(val);
+            if (options->digest_min_interval <= 0)
+            {
+                PRINTERR("Invalid value for option 'cloudmig/digest-min-interval': %li.\n",
+                         options->digest_min_interval);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcasecmp(key, "digest-max-interval") == 0)
+        {
+            if (!json_object_is_type(val, json_type_int))
+            {
+                PRINTERR("Unexpected type %i for option 'cloudmig/digest-max-interval'.\n",
+                         json_object_get_type(val));
+                return EXIT_FAILURE;
+            }
+            options->digest_max_interval = json_object_get_int64(val);
+            if (options->digest_max_interval <= 0)
+            {
+                PRINTERR("Invalid value for option 'cloudmig/digest-max-interval': %li.\n",
+                         options->digest_max_interval);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcasecmp(key, "digest-changes") == 0)
+        {
+            if (!json_object_is_type(val, json_type_int))
+            {
+                PRINTERR("Unexpected type %i for option 'cloudmig/digest-changes'.\n",
+                         json_object_get_type(val));
+                return EXIT_FAILURE;
+            }
+            if (json_object_get_int64(val) <= 0)
+            {
+                PRINTERR("Invalid value for option 'cloudmig/digest-changes': %"PRId64".\n",
+                         json_object_get_int64(val));
+                return EXIT_FAILURE;
+            }
+            options->digest_changes = json_object_get_int64(val);
+        }
         else if (strcasecmp(key, "location-constraint") == 0)
         {
             if (!json_object_is_type(val, json_type_string))
@@ -441,6 +697,66 @@ config_update_options(struct cldmig_config *conf,
                 return EXIT_FAILURE;
             }
         }
+        else if (strcasecmp(key, "listing") == 0)
+        {
+            if (!json_object_is_type(val, json_type_string))
+            {
+                PRINTERR("Unexpected type %i for option 'cloudmig/listing'.\n",
+                         json_object_get_type(val));
+                return EXIT_FAILURE;
+            }
+            if (opt_listing(options, json_object_get_string(val)) != EXIT_SUCCESS)
+                return EXIT_FAILURE;
+        }
+        else if (strcasecmp(key, "claim-policy") == 0)
+        {
+            if (!json_object_is_type(val, json_type_string))
+            {
+                PRINTERR("Unexpected type %i for option 'cloudmig/claim-policy'.\n",
+                         json_object_get_type(val));
+                return EXIT_FAILURE;
+            }
+            if (opt_claim_policy(options, json_object_get_string(val)) != EXIT_SUCCESS)
+                return EXIT_FAILURE;
+        }
+        else if (strcasecmp(key, "include") == 0
+                 || strcasecmp(key, "exclude") == 0)
+        {
+            if (config_update_json_filter(options, key, val) != EXIT_SUCCESS)
+                return EXIT_FAILURE;
+        }
+        else if (strcasecmp(key, "inventory-dir") == 0)
+        {
+            if (!json_object_is_type(val, json_type_string))
+            {
+                PRINTERR("Unexpected type %i for option 'cloudmig/inventory-dir'.\n",
+                         json_object_get_type(val));
+                return EXIT_FAILURE;
+            }
+
+            options->inventory_dir = strdup(json_object_get_string(val));
+            if (options->inventory_dir == NULL)
+            {
+                PRINTERR("Could not duplicate value for option 'cloudmig/inventory-dir' value.\n");
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcasecmp(key, "status-log") == 0)
+        {
+            if (!json_object_is_type(val, json_type_string))
+            {
+                PRINTERR("Unexpected type %i for option 'cloudmig/status-log'.\n",
+                         json_object_get_type(val));
+                return EXIT_FAILURE;
+            }
+
+            options->status_log = strdup(json_object_get_string(val));
+            if (options->status_log == NULL)
+            {
+                PRINTERR("Could not duplicate value for option 'cloudmig/status-log' value.\n");
+                return EXIT_FAILURE;
+            }
+        }
     }
     else
         PRINTERR("[Loading Config]: Invalid section name '%s'.\n", section);
@@ -32,10 +32,14 @@
 
 #include "cloudmig.h"
 #include "options.h"
+#include "status_codec.h"
 #include "status_store.h"
 #include "status_digest.h"
+#include "status_wal.h"
 #include "display.h"
+#include "filter.h"
 #include "synced_dir.h"
+#include "watchdog.h"
 
 
 enum cloudmig_loglevel  gl_loglevel = INFO_LVL;
@@ -55,6 +59,9 @@ cloudmig_sighandler(int sig)
             migration_stop(gl_ctx);
         }
         break ;
+    case CLOUDMIG_STALL_SIGNAL:
+        // Only meant to interrupt a blocking system call of a stalled worker.
+        break ;
     default:
         break;
     }
@@ -65,6 +72,12 @@ int main(int argc, char* argv[])
     int                     ret = EXIT_FAILURE;
     time_t                  starttime = 0;
     time_t                  difftime = 0;
+    uint64_t                stalled_transfers = 0;
+    uint64_t                checkpoints = 0;
+    uint64_t                checkpoint_usec = 0;
+    uint64_t                checkpoint_bytes = 0;
+    struct status_codec_stats status_stats;
+    struct sync_report      sync_report;
     struct cloudmig_ctx     ctx = CTX_INITIALIZER;
     struct sigaction        signal_action;
     // hosts strings for source and destination
@@ -169,6 +182,8 @@ int main(int argc, char* argv[])
     if (ctx.display == NULL)
         goto failure;
 
+    status_codec_setup(ctx.options.flags & COMPRESS_STATUS);
+
     ctx.status = status_store_new();
     if (ctx.status == NULL)
         goto failure;
@@ -184,11 +199,19 @@ int main(int argc, char* argv[])
     sigemptyset(&signal_action.sa_mask);
     signal_action.sa_flags = 0;
     sigaction(SIGINT, &signal_action, NULL);
-
-    ret = migrate(&ctx);
-    if (ret != EXIT_SUCCESS)
+    // No SA_RESTART, so that the stall signal interrupts blocking calls.
+    sigaction(CLOUDMIG_STALL_SIGNAL, &signal_action, NULL);
+
+    memset(&sync_report, 0, sizeof(sync_report));
+    if (ctx.options.sync_interval > 0)
+        // Interrupted or not, the passes done are reported below.
+        ret = synchronize(&ctx, &sync_report);
+    else if ((ret = migrate(&ctx)) != EXIT_SUCCESS)
         goto failure;
 
+    // Last upload of the digest, so that it is accounted for below.
+    status_digest_stop(ctx.status->digest);
+
     // Migration ended : Now we can display a status for the migration session.
     difftime = time(NULL);
     difftime -= starttime;
@@ -196,12 +219,21 @@ int main(int argc, char* argv[])
     done_objects = status_digest_get(ctx.status->digest, DIGEST_DONE_OBJECTS) - done_objects;
     done_bytes = status_digest_get(ctx.status->digest, DIGEST_DONE_BYTES) - done_bytes;
 
+    for (int i=0; i < ctx.options.nb_threads; i++)
+    {
+        stalled_transfers += ctx.tinfos[i].stall_count;
+        checkpoints += ctx.tinfos[i].checkpoint_count;
+        checkpoint_usec += ctx.tinfos[i].checkpoint_usec;
+        checkpoint_bytes += ctx.tinfos[i].checkpoint_bytes;
+    }
+
     cloudmig_log(STATUS_LVL,
         "End of data migration. During this session :\n"
         "\tTransfered %llu objects, totaling %llu/%llu objects.\n"
         "\tTransfered %llu Bytes, totaling %llu/%llu Bytes.\n"
         "\tAverage transfer speed : %llu Bytes/s.\n"
-        "\tTransfer Duration : %ud%uh%um%us.\n",
+        "\tTransfer Duration : %ud%uh%um%us.\n"
+        "\tStalled transfers aborted : %llu.\n",
         done_objects,
         status_digest_get(ctx.status->digest, DIGEST_DONE_OBJECTS),
         status_digest_get(ctx.status->digest, DIGEST_OBJECTS),
@@ -212,8 +244,37 @@ int main(int argc, char* argv[])
         difftime / (60 * 60 * 24),
         difftime / (60 * 60) % 24,
         difftime / 60 % 60,
-        difftime % 60
+        difftime % 60,
+        stalled_transfers
     );
+    if (checkpoints)
+        cloudmig_log(STATUS_LVL,
+            "\tProgress checkpoints : %llu (average cost %lluus, every %llu Bytes).\n",
+            checkpoints, checkpoint_usec / checkpoints,
+            checkpoint_bytes / checkpoints);
+    status_codec_stats(&status_stats);
+    cloudmig_log(STATUS_LVL,
+        "\tStatus uploaded : %llu Bytes (%llu Bytes before compression).\n"
+        "\tStatus downloaded : %llu Bytes (%llu Bytes after decompression).\n",
+        status_stats.put_stored, status_stats.put_raw,
+        status_stats.get_stored, status_stats.get_raw);
+    cloudmig_log(STATUS_LVL,
+        "\tStatus digest uploads : %llu.\n",
+        status_digest_uploads(ctx.status->digest));
+    if (ctx.status->wal)
+        cloudmig_log(STATUS_LVL,
+            "\tStatus replication lag : %lis (max %lis).\n",
+            (long)status_wal_lag(ctx.status->wal),
+            (long)status_wal_max_lag(ctx.status->wal));
+    if (sync_report.passes)
+        cloudmig_log(STATUS_LVL,
+            "\tSync passes : %llu (%llu converged).\n"
+            "\tConvergence lag : %lis (max %lis).\n"
+            "\tDeleted at the source, kept on the destination : %llu objects.\n",
+            sync_report.passes, sync_report.converged,
+            (long)sync_report.lag, (long)sync_report.max_lag,
+            sync_report.deleted);
+    filter_report(ctx.options.filter);
 
 failure:
     if (ctx.options.config)
@@ -260,6 +321,7 @@ failure:
             free(ctx.options.dst_buckets[i]);
         free(ctx.options.dst_buckets);
     }
+    filter_free(ctx.options.filter);
     cloudmig_closelog();
 
     return ret;
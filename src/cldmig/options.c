@@ -35,6 +35,7 @@
 
 #include "options.h"
 #include "cloudmig.h"
+#include "filter.h"
 
 static int
 _options_setup_default_status(struct cloudmig_options *options)
@@ -125,9 +126,109 @@ cloudmig_options_check(struct cloudmig_options *options)
         return EXIT_FAILURE;
     }
 
+#ifndef HAVE_ZLIB
+    if (options->flags & COMPRESS_STATUS)
+    {
+        PRINTERR("The status compression (compress-status) is not supported:"
+                 " cloudmig was built without zlib.\n");
+        return EXIT_FAILURE;
+    }
+#endif
+
     if (options->block_size == 0)
         options->block_size = CLOUDMIG_DEFAULT_BLOCK_SIZE;
 
+    if (options->stall_timeout > 0)
+    {
+        /*
+         * The progress of a transfer is only known once a whole block is
+         * written: a healthy transfer at the minimal rate must complete a
+         * block within the window, or it would be aborted on every attempt.
+         */
+        if (options->stall_min_rate == 0)
+            options->stall_min_rate = (options->block_size + options->stall_timeout - 1)
+                                      / options->stall_timeout;
+        if (options->block_size / options->stall_min_rate
+            > (uint64_t)options->stall_timeout)
+        {
+            PRINTERR("The stall timeout (%lis) is shorter than the transfer of a"
+                     " block of %lu bytes at the minimal rate of %"PRIu64" bytes/s:"
+                     " raise --stall-timeout or --stall-min-rate, or lower --block-size.\n",
+                     options->stall_timeout, options->block_size,
+                     options->stall_min_rate);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (options->commit_batch == 0)
+        options->commit_batch = 1;
+
+    if (options->sync_interval > 0)
+    {
+        // The applications keep writing to the source between the passes.
+        if (options->flags & DELETE_SOURCE_DATA)
+        {
+            PRINTERR("Deleting the source is not supported by continuous syncs.\n");
+            return EXIT_FAILURE;
+        }
+        if (options->flags & COOPERATIVE_MIGRATION)
+        {
+            PRINTERR("Continuous syncs are not supported by cooperative migrations.\n");
+            return EXIT_FAILURE;
+        }
+        // A resumed sync starts with a delta pass too.
+        options->flags |= RESYNC_MIGRATION;
+    }
+
+    if (options->flags & COOPERATIVE_MIGRATION)
+    {
+        /*
+         * Another process may still be migrating data when this one is done,
+         * so none of them can safely delete the source.
+         */
+        if (options->flags & DELETE_SOURCE_DATA)
+        {
+            PRINTERR("Deleting the source is not supported by cooperative migrations.\n");
+            return EXIT_FAILURE;
+        }
+        // The processes would merge their listings into the same statuses.
+        if (options->flags & RESYNC_MIGRATION)
+        {
+            PRINTERR("Resyncing is not supported by cooperative migrations.\n");
+            return EXIT_FAILURE;
+        }
+        // The leased ranges already keep each process to its own entries.
+        if (options->claim_policy == CLAIM_LOCALITY)
+        {
+            PRINTERR("The locality claim policy is not supported by cooperative migrations.\n");
+            return EXIT_FAILURE;
+        }
+        if (options->lease_size == 0)
+            options->lease_size = CLOUDMIG_DEFAULT_LEASE_SIZE;
+        if (options->lease_duration == 0)
+            options->lease_duration = CLOUDMIG_DEFAULT_LEASE_DURATION;
+    }
+
+    if (options->checkpoint_policy == CHECKPOINT_BYTES
+        && options->checkpoint_bytes == 0)
+        options->checkpoint_bytes = CLOUDMIG_DEFAULT_CHECKPOINT_BYTES;
+    if (options->checkpoint_policy == CHECKPOINT_INTERVAL
+        && options->checkpoint_interval == 0)
+        options->checkpoint_interval = CLOUDMIG_DEFAULT_CHECKPOINT_INTERVAL;
+
+    if (options->digest_min_interval == 0)
+        options->digest_min_interval = CLOUDMIG_DEFAULT_DIGEST_MIN_INTERVAL;
+    if (options->digest_max_interval == 0)
+        options->digest_max_interval = CLOUDMIG_DEFAULT_DIGEST_MAX_INTERVAL;
+    if (options->digest_changes == 0)
+        options->digest_changes = CLOUDMIG_DEFAULT_DIGEST_CHANGES;
+    if (options->digest_max_interval < options->digest_min_interval)
+    {
+        PRINTERR("The digest maximum interval (%li) is shorter than its minimum interval (%li).\n",
+                 options->digest_max_interval, options->digest_min_interval);
+        return EXIT_FAILURE;
+    }
+
     return EXIT_SUCCESS;
 }
 
@@ -293,6 +394,55 @@ opt_verbose(const char *arg)
     return EXIT_SUCCESS;
 }
 
+int
+opt_listing(struct cloudmig_options *options, const char *arg)
+{
+    if (strcasecmp(arg, "recursive") == 0)
+        options->listing = LISTING_RECURSIVE;
+    else if (strcasecmp(arg, "flat") == 0)
+        options->listing = LISTING_FLAT;
+    else
+    {
+        PRINTERR("Invalid listing method: %s", arg);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+int
+opt_claim_policy(struct cloudmig_options *options, const char *arg)
+{
+    if (strcasecmp(arg, "sequential") == 0)
+        options->claim_policy = CLAIM_SEQUENTIAL;
+    else if (strcasecmp(arg, "locality") == 0)
+        options->claim_policy = CLAIM_LOCALITY;
+    else
+    {
+        PRINTERR("Invalid claim policy: %s", arg);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+int
+opt_checkpoint_policy(struct cloudmig_options *options, const char *arg)
+{
+    if (strcasecmp(arg, "block") == 0)
+        options->checkpoint_policy = CHECKPOINT_BLOCK;
+    else if (strcasecmp(arg, "bytes") == 0)
+        options->checkpoint_policy = CHECKPOINT_BYTES;
+    else if (strcasecmp(arg, "interval") == 0)
+        options->checkpoint_policy = CHECKPOINT_INTERVAL;
+    else if (strcasecmp(arg, "resumable") == 0)
+        options->checkpoint_policy = CHECKPOINT_RESUMABLE;
+    else
+    {
+        PRINTERR("Invalid checkpoint policy: %s", arg);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
 void usage()
 {
     fprintf(stderr,
@@ -306,6 +456,27 @@ void usage()
             "         [ --worker-threads nb | -w nb ]\n"
             "         [ --create-directories ]\n"
             "         [ --force-resume | -r ]\n"
+            "         [ --stall-timeout seconds ]\n"
+            "         [ --stall-min-rate bytes_per_second ]\n"
+            "         [ --commit-batch nb ]\n"
+            "         [ --cooperative ]\n"
+            "         [ --lease-size nb ]\n"
+            "         [ --lease-duration seconds ]\n"
+            "         [ --status-log logfile_path ]\n"
+            "         [ --checkpoint-policy block|bytes|interval|resumable ]\n"
+            "         [ --checkpoint-bytes bytesize ]\n"
+            "         [ --checkpoint-interval seconds ]\n"
+            "         [ --compress-status ]\n"
+            "         [ --digest-min-interval seconds ]\n"
+            "         [ --digest-max-interval seconds ]\n"
+            "         [ --digest-changes nb ]\n"
+            "         [ --resync ]\n"
+            "         [ --sync-interval seconds ]\n"
+            "         [ --inventory-dir dirpath ]\n"
+            "         [ --listing recursive|flat ]\n"
+            "         [ --include kind:value ]\n"
+            "         [ --exclude kind:value ]\n"
+            "         [ --claim-policy sequential|locality ]\n"
             "         [ --block-size bytesize | -B bytesize ]\n"
             "         [ --src-profile path | -s path ]\n"
             "         [ --dst-profile path | -d path ]\n"
@@ -342,6 +513,27 @@ static struct option    long_options[] = {
     {"delete-source",       no_argument,        0,  0 },
     {"background",          no_argument,        0,  0 },
     {"create-directories",  no_argument,        0,  0 },
+    {"stall-timeout",       required_argument,  0,  0 },
+    {"stall-min-rate",      required_argument,  0,  0 },
+    {"commit-batch",        required_argument,  0,  0 },
+    {"cooperative",         no_argument,        0,  0 },
+    {"lease-size",          required_argument,  0,  0 },
+    {"lease-duration",      required_argument,  0,  0 },
+    {"status-log",          required_argument,  0,  0 },
+    {"checkpoint-policy",   required_argument,  0,  0 },
+    {"checkpoint-bytes",    required_argument,  0,  0 },
+    {"checkpoint-interval", required_argument,  0,  0 },
+    {"compress-status",     no_argument,        0,  0 },
+    {"digest-min-interval", required_argument,  0,  0 },
+    {"digest-max-interval", required_argument,  0,  0 },
+    {"digest-changes",      required_argument,  0,  0 },
+    {"resync",              no_argument,        0,  0 },
+    {"sync-interval",       required_argument,  0,  0 },
+    {"inventory-dir",       required_argument,  0,  0 },
+    {"listing",             required_argument,  0,  0 },
+    {"include",             required_argument,  0,  0 },
+    {"exclude",             required_argument,  0,  0 },
+    {"claim-policy",        required_argument,  0,  0 },
     {"block-size",          required_argument,  0, 'B'},
     {"worker-threads",      required_argument,  0, 'w'},
     /* Configuration-related options    */
@@ -396,6 +588,137 @@ int retrieve_opts(struct cloudmig_options *options, int argc, char* argv[])
             case 2: // create-directories
                 options->flags |= AUTO_CREATE_DIRS;
                 break ;
+            case 3: // stall-timeout
+                options->stall_timeout = strtol(optarg, NULL, 10);
+                if (options->stall_timeout < 0
+                    || (options->stall_timeout == LONG_MAX && errno == ERANGE))
+                {
+                    PRINTERR("Invalid value for stall timeout");
+                    return EXIT_FAILURE;
+                }
+                break ;
+            case 4: // stall-min-rate
+                options->stall_min_rate = strtoull(optarg, NULL, 10);
+                if (options->stall_min_rate == ULLONG_MAX && errno == ERANGE)
+                {
+                    PRINTERR("Invalid value for stall minimum rate");
+                    return EXIT_FAILURE;
+                }
+                break ;
+            case 5: // commit-batch
+                options->commit_batch = strtol(optarg, NULL, 10);
+                if (options->commit_batch <= 0
+                    || (options->commit_batch == LONG_MAX && errno == ERANGE))
+                {
+                    PRINTERR("Invalid value for commit batch");
+                    return EXIT_FAILURE;
+                }
+                break ;
+            case 6: // cooperative
+                options->flags |= COOPERATIVE_MIGRATION;
+                break ;
+            case 7: // lease-size
+                options->lease_size = strtoul(optarg, NULL, 10);
+                if (options->lease_size == 0 || options->lease_size > UINT_MAX
+                    || (options->lease_size == ULONG_MAX && errno == ERANGE))
+                {
+                    PRINTERR("Invalid value for lease size");
+                    return EXIT_FAILURE;
+                }
+                break ;
+            case 8: // lease-duration
+                options->lease_duration = strtol(optarg, NULL, 10);
+                if (options->lease_duration <= 0
+                    || (options->lease_duration == LONG_MAX && errno == ERANGE))
+                {
+                    PRINTERR("Invalid value for lease duration");
+                    return EXIT_FAILURE;
+                }
+                break ;
+            case 9: // status-log
+                options->status_log = optarg;
+                break ;
+            case 10: // checkpoint-policy
+                if (opt_checkpoint_policy(options, optarg) != EXIT_SUCCESS)
+                    return EXIT_FAILURE;
+                break ;
+            case 11: // checkpoint-bytes
+                options->checkpoint_bytes = strtoull(optarg, NULL, 10);
+                if (options->checkpoint_bytes == 0
+                    || (options->checkpoint_bytes == ULLONG_MAX && errno == ERANGE))
+                {
+                    PRINTERR("Invalid value for checkpoint bytes");
+                    return EXIT_FAILURE;
+                }
+                break ;
+            case 12: // checkpoint-interval
+                options->checkpoint_interval = strtol(optarg, NULL, 10);
+                if (options->checkpoint_interval <= 0
+                    || (options->checkpoint_interval == LONG_MAX && errno == ERANGE))
+                {
+                    PRINTERR("Invalid value for checkpoint interval");
+                    return EXIT_FAILURE;
+                }
+                break ;
+            case 13: // compress-status
+                options->flags |= COMPRESS_STATUS;
+                break ;
+            case 14: // digest-min-interval
+                options->digest_min_interval = strtol(optarg, NULL, 10);
+                if (options->digest_min_interval <= 0
+                    || (options->digest_min_interval == LONG_MAX && errno == ERANGE))
+                {
+                    PRINTERR("Invalid value for digest minimum interval");
+                    return EXIT_FAILURE;
+                }
+                break ;
+            case 15: // digest-max-interval
+                options->digest_max_interval = strtol(optarg, NULL, 10);
+                if (options->digest_max_interval <= 0
+                    || (options->digest_max_interval == LONG_MAX && errno == ERANGE))
+                {
+                    PRINTERR("Invalid value for digest maximum interval");
+                    return EXIT_FAILURE;
+                }
+                break ;
+            case 16: // digest-changes
+                options->digest_changes = strtoull(optarg, NULL, 10);
+                if (options->digest_changes == 0
+                    || (options->digest_changes == ULLONG_MAX && errno == ERANGE))
+                {
+                    PRINTERR("Invalid value for digest changes");
+                    return EXIT_FAILURE;
+                }
+                break ;
+            case 17: // resync
+                options->flags |= RESYNC_MIGRATION;
+                break ;
+            case 18: // sync-interval
+                options->sync_interval = strtol(optarg, NULL, 10);
+                if (options->sync_interval <= 0
+                    || (options->sync_interval == LONG_MAX && errno == ERANGE))
+                {
+                    PRINTERR("Invalid value for sync interval");
+                    return EXIT_FAILURE;
+                }
+                break ;
+            case 19: // inventory-dir
+                options->inventory_dir = optarg;
+                break ;
+            case 20: // listing
+                if (opt_listing(options, optarg) != EXIT_SUCCESS)
+                    return EXIT_FAILURE;
+                break ;
+            case 21: // include
+            case 22: // exclude
+                if (filter_add(&options->filter, option_index == 22,
+                               optarg) != EXIT_SUCCESS)
+                    return EXIT_FAILURE;
+                break ;
+            case 23: // claim-policy
+                if (opt_claim_policy(options, optarg) != EXIT_SUCCESS)
+                    return EXIT_FAILURE;
+                break ;
             }
             break ;
         case 1:
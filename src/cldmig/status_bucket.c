@@ -24,8 +24,11 @@
 // ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
 // POSSIBILITY OF SUCH DAMAGE.
 
+#include <errno.h>
+#include <limits.h>
 #include <pthread.h>
 #include <stdbool.h>
+#include <stdio.h>
 #include <unistd.h>
 
 #include <droplet.h>
@@ -33,7 +36,12 @@
 
 #include "status.h"
 #include "cloudmig.h"
+#include "filter.h"
 #include "status_bucket.h"
+#include "status_codec.h"
+#include "status_lease.h"
+#include "status_stream.h"
+#include "status_wal.h"
 #include "utils.h"
 
 #define CLOUDMIG_STATUS_BUCKET_SRCPATH      "srcpath"
@@ -43,27 +51,60 @@
 #define CLOUDMIG_STATUS_BUCKET_BYTESDONE    "bytes_done"
 #define CLOUDMIG_STATUS_BUCKET_N_BYTES      "bytes_total"
 #define CLOUDMIG_STATUS_BUCKET_OBJECTS      "objects"
+#define CLOUDMIG_STATUS_BUCKET_SEGSIZE      "segment_size"
+#define CLOUDMIG_STATUS_BUCKET_SEGMENTS     "segments"
+#define CLOUDMIG_STATUS_BUCKET_PARTIAL      "partial"
 
 #define CLOUDMIG_STATUS_BUCKETENTRY_PATH    "path"
+#define CLOUDMIG_STATUS_BUCKETENTRY_PREFIX  "prefix"
+#define CLOUDMIG_STATUS_BUCKETENTRY_SUFFIX  "suffix"
 #define CLOUDMIG_STATUS_BUCKETENTRY_SIZE    "size"
 #define CLOUDMIG_STATUS_BUCKETENTRY_TYPE    "type"
 #define CLOUDMIG_STATUS_BUCKETENTRY_DONE    "done"
+#define CLOUDMIG_STATUS_BUCKETENTRY_MTIME   "mtime"
+#define CLOUDMIG_STATUS_BUCKETENTRY_DELETED "deleted"
 
 #define CLOUDMIG_STATUS_BUCKET_FILEEXT      ".json"
+#define CLOUDMIG_STATUS_SEGMENT_PREFIX      "segment."
+#define CLOUDMIG_STATUS_STATES_FILE         "states.json"
+#define CLOUDMIG_STATUS_LISTING_FILE        "listing.json"
+#define CLOUDMIG_STATUS_LISTING_ENTRIES     "entries"
+#define CLOUDMIG_STATUS_LISTING_OBJECTS     "objects"
+#define CLOUDMIG_STATUS_LISTING_BYTES       "bytes"
+#define CLOUDMIG_STATUS_LISTING_PENDING     "pending"
+#define CLOUDMIG_STATUS_PATH_RESTART        16 // entries between whole paths
 
 static void     _bucket_lock(struct bucket_status *bst);
 static void     _bucket_unlock(struct bucket_status *bst);
 
 static char*    _bucket_filepath(char *storepath, char *bucket_name);
 
-static int      _bucket_add_entry(struct bucket_status *bckt,
-                                  char *path, size_t size, dpl_ftype_t type);
+static int      _bucket_add_entry(struct bucket_status *bckt, char *path,
+                                  size_t size, dpl_ftype_t type, time_t mtime);
 static int      _bucket_set_paths(struct bucket_status *bckt, char *storepath,
                                   char *srcname, char *dstname);
 static int      _bucket_set_infos(struct bucket_status *sbucket,
                                   uint64_t count, uint64_t size);
+static int      _bucket_set_segments(struct bucket_status *sbucket);
+static int      _bucket_upload(dpl_ctx_t *status_ctx, struct bucket_status *bst);
 static int      _bucket_json_check(struct json_object *json_bucket,
                                    uint64_t *n_objsp, uint64_t *n_bytesp);
+static int      _bucket_segment_check(struct json_object *objects,
+                                      unsigned int count, uint64_t *n_bytesp);
+static int      _bucket_entry_set_done(struct bucket_status *bst, int idx);
+static int      _bucket_ensure_loaded(struct bucket_status *bst);
+static char*    _bucket_states_path(struct bucket_status *bst);
+static void     _bucket_index_free(struct bucket_status *bst);
+static int      _bucket_state_read(dpl_ctx_t *status_ctx, const char *path,
+                                   struct json_object **jsonp);
+static int      _bucket_state_write(dpl_ctx_t *status_ctx, struct bucket_status *bst,
+                                    const char *path, const char *filebuf);
+static void     _bucket_state_unlink(dpl_ctx_t *status_ctx, struct bucket_status *bst,
+                                     const char *path);
+static int      _bucket_partial_load(struct bucket_status *bst,
+                                     struct json_object *array, uint64_t count);
+static struct bucket_entry*
+                _bucket_entry(struct bucket_status *bst, unsigned int idx);
 
 
 static void
@@ -170,6 +211,25 @@ end:
     return ret;
 }
 
+/*
+ * Directory holding the intermediary states (and leases) of the entries.
+ */
+static char*
+_bucket_dirpath(const char *path)
+{
+    char    *dirpath = NULL;
+
+    if (asprintf(&dirpath, "%.*s",
+                 (int)(strlen(path) - strlen(CLOUDMIG_STATUS_BUCKET_FILEEXT)),
+                 path) <= 0)
+    {
+        PRINTERR("Could not allocate memory for bucket dir path.\n");
+        return NULL;
+    }
+
+    return dirpath;
+}
+
 int
 status_bucket_namecmp(const char *encoded, const char *raw, bool *errorp)
 {
@@ -198,78 +258,239 @@ end:
     return ret;
 }
 
+/*
+ * Makes room for one more segment at the end of the bucket status.
+ */
 static int
-_bucket_add_entry(struct bucket_status *bckt,
-                  char *path, size_t size, dpl_ftype_t type)
+_bucket_segment_append(struct bucket_status *bckt)
 {
-    int                 ret;
-    int                 bucket_has_objs = 0;
-    struct json_object  *objs = NULL;
-    struct json_object  *obj = NULL;
-    struct json_object  *jspath = NULL;
-    struct json_object  *jssize = NULL;
-    struct json_object  *jstype = NULL;
-    struct json_object  *jsdone = NULL;
+    struct bucket_segment   *segments = NULL;
 
-    cloudmig_log(DEBUG_LVL, "[Creating Bucket Status] "
-                 "Adding entry path=%s size=%lu type=%i\n",
-                 path, size, type);
+    segments = realloc(bckt->segments, sizeof(*segments) * (bckt->n_segments + 1));
+    if (segments == NULL)
+    {
+        PRINTERR("[Creating Bucket Status] Could not allocate segment.\n");
+        return EXIT_FAILURE;
+    }
+    bckt->segments = segments;
 
-    if (json_object_object_get_ex(bckt->json, CLOUDMIG_STATUS_BUCKET_OBJECTS,
-                                  &objs) == TRUE)
-        bucket_has_objs = 1;
-    else
-        objs = json_object_new_array();
-    obj = json_object_new_object();
-    jspath = json_object_new_string(path);
-    jssize = json_object_new_int64(size);
-    jstype = json_object_new_int((int)type);
-    jsdone = json_object_new_boolean(FALSE);
+    memset(&segments[bckt->n_segments], 0, sizeof(*segments));
+    segments[bckt->n_segments].loaded = true;
+    segments[bckt->n_segments].dirty = true;
+    bckt->n_segments += 1;
+
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Makes room for at least len more bytes in the buffer.
+ */
+static int
+_bucket_buffer_reserve(struct status_buffer *buf, size_t len)
+{
+    char    *data = NULL;
+    size_t  size;
 
-    if (objs == NULL || obj == NULL
-        || jspath == NULL || jssize == NULL
-        || jstype == NULL || jsdone == NULL)
+    if (buf->len + len <= buf->size)
+        return EXIT_SUCCESS;
+
+    size = buf->size ? buf->size : 4096;
+    while (size < buf->len + len)
+        size *= 2;
+
+    data = realloc(buf->data, size);
+    if (data == NULL)
     {
-        PRINTERR("[Creating Bucket Status] Could not allocate JSON objects.\n");
-        ret = EXIT_FAILURE;
-        goto end;
+        PRINTERR("[Bucket Status] Could not grow buffer: out of memory.\n");
+        return EXIT_FAILURE;
     }
+    buf->data = data;
+    buf->size = size;
 
-    json_object_object_add(obj, CLOUDMIG_STATUS_BUCKETENTRY_PATH, jspath);
-    json_object_object_add(obj, CLOUDMIG_STATUS_BUCKETENTRY_SIZE, jssize);
-    json_object_object_add(obj, CLOUDMIG_STATUS_BUCKETENTRY_DONE, jsdone);
-    json_object_object_add(obj, CLOUDMIG_STATUS_BUCKETENTRY_TYPE, jstype);
-    jsdone = NULL;
-    jspath = NULL;
-    jssize = NULL;
-    jstype = NULL;
+    return EXIT_SUCCESS;
+}
 
-    json_object_array_add(objs, obj);
-    obj = NULL;
+#define BUFFER_PUT_LITERAL(buf, lit)                            \
+    do {                                                        \
+        memcpy((buf)->data + (buf)->len, lit, sizeof(lit) - 1); \
+        (buf)->len += sizeof(lit) - 1;                          \
+    } while (0)
+
+/*
+ * Appends a string to the output buffer, escaped the same way json-c does.
+ * The caller must have reserved up to six bytes per character of str.
+ */
+static void
+_bucket_buffer_put_string(struct status_buffer *buf, const char *str)
+{
+    static const char   hexchars[] = "0123456789abcdef";
+    char                *out = buf->data + buf->len;
+
+    for (const unsigned char *c = (const unsigned char*)str; *c; ++c)
+    {
+        switch (*c)
+        {
+        case '"':  *out++ = '\\'; *out++ = '"';  break;
+        case '\\': *out++ = '\\'; *out++ = '\\'; break;
+        case '/':  *out++ = '\\'; *out++ = '/';  break;
+        case '\b': *out++ = '\\'; *out++ = 'b';  break;
+        case '\f': *out++ = '\\'; *out++ = 'f';  break;
+        case '\n': *out++ = '\\'; *out++ = 'n';  break;
+        case '\r': *out++ = '\\'; *out++ = 'r';  break;
+        case '\t': *out++ = '\\'; *out++ = 't';  break;
+        default:
+            if (*c < ' ')
+            {
+                memcpy(out, "\\u00", 4);
+                out += 4;
+                *out++ = hexchars[*c >> 4];
+                *out++ = hexchars[*c & 0xf];
+            }
+            else
+                *out++ = *c;
+            break;
+        }
+    }
+
+    buf->len = out - buf->data;
+}
+
+/*
+ * Appends an entry to a segment, front-coding its path against the path of
+ * the previous entry. Every CLOUDMIG_STATUS_PATH_RESTART entries, the whole
+ * path is stored, which bounds the cost of rebuilding a path.
+ */
+static int
+_bucket_segment_push(struct bucket_segment *seg, const char *path,
+                     const struct bucket_entry *entry)
+{
+    struct bucket_entry     *entries = NULL;
+    unsigned int            capacity;
+    size_t                  prefix = 0;
+    size_t                  len = strlen(path);
+
+    if (seg->n_entries % CLOUDMIG_STATUS_PATH_RESTART != 0)
+    {
+        while (prefix < seg->last.len && path[prefix] != 0
+               && path[prefix] == seg->last.data[prefix])
+            ++prefix;
+    }
+
+    if (seg->paths.len + len - prefix + 1 > UINT32_MAX)
+    {
+        PRINTERR("[Bucket Status] Segment paths too large.\n");
+        return EXIT_FAILURE;
+    }
+
+    if (_bucket_buffer_reserve(&seg->paths, len - prefix + 1) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+    seg->last.len = 0;
+    if (_bucket_buffer_reserve(&seg->last, len + 1) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+
+    if (seg->n_entries == seg->capacity)
+    {
+        capacity = seg->capacity ? seg->capacity * 2 : 64;
+        entries = realloc(seg->entries, sizeof(*entries) * capacity);
+        if (entries == NULL)
+        {
+            PRINTERR("[Bucket Status] Could not allocate segment entries.\n");
+            return EXIT_FAILURE;
+        }
+        seg->entries = entries;
+        seg->capacity = capacity;
+    }
+
+    seg->entries[seg->n_entries] = *entry;
+    seg->entries[seg->n_entries].path = seg->paths.len;
+    seg->entries[seg->n_entries].prefix = prefix;
+    seg->n_entries += 1;
+    if (entry->done)
+        seg->n_done += 1;
+
+    memcpy(seg->paths.data + seg->paths.len, path + prefix, len - prefix + 1);
+    seg->paths.len += len - prefix + 1;
+    memcpy(seg->last.data, path, len + 1);
+    seg->last.len = len;
+
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Appends the path of an entry of a segment to buf, NUL-terminated, and
+ * returns the offset at which it starts.
+ */
+static int
+_bucket_segment_path_get(struct bucket_segment *seg, unsigned int idx,
+                         struct status_buffer *buf, size_t *offp)
+{
+    size_t                  base = buf->len;
+    size_t                  len;
+    const char              *suffix = NULL;
+    struct bucket_entry     *entry = NULL;
+
+    // Rebuild the path from the last entry holding a whole path.
+    for (unsigned int i=idx - idx % CLOUDMIG_STATUS_PATH_RESTART; i <= idx; ++i)
+    {
+        entry = &seg->entries[i];
+        suffix = seg->paths.data + entry->path;
+        len = strlen(suffix);
+        buf->len = base + entry->prefix;
+        if (_bucket_buffer_reserve(buf, len + 1) != EXIT_SUCCESS)
+            return EXIT_FAILURE;
+        memcpy(buf->data + buf->len, suffix, len + 1);
+        buf->len += len;
+    }
+    buf->len += 1;
+    *offp = base;
+
+    return EXIT_SUCCESS;
+}
 
-    if (bucket_has_objs == 0)
+static void
+_bucket_segment_release(struct bucket_segment *seg)
+{
+    free(seg->entries);
+    seg->entries = NULL;
+    seg->n_entries = 0;
+    seg->capacity = 0;
+    seg->n_done = 0;
+    free(seg->paths.data);
+    memset(&seg->paths, 0, sizeof(seg->paths));
+    free(seg->last.data);
+    memset(&seg->last, 0, sizeof(seg->last));
+    seg->loaded = false;
+}
+
+static int
+_bucket_add_entry(struct bucket_status *bckt, char *path,
+                  size_t size, dpl_ftype_t type, time_t mtime)
+{
+    int                 ret;
+    struct bucket_entry entry = { size, mtime, 0, 0, (uint32_t)type, false, false };
+
+    cloudmig_log(DEBUG_LVL, "[Creating Bucket Status] "
+                 "Adding entry path=%s size=%lu type=%i\n",
+                 path, size, type);
+
+    // The last segment is full: start a new one.
+    if (bckt->n_entries == bckt->n_segments * bckt->segment_size)
     {
-        json_object_object_add(bckt->json,
-                               CLOUDMIG_STATUS_BUCKET_OBJECTS, objs);
-        objs = NULL;
+        ret = _bucket_segment_append(bckt);
+        if (ret != EXIT_SUCCESS)
+            goto end;
     }
 
+    ret = _bucket_segment_push(&bckt->segments[bckt->n_segments - 1],
+                               path, &entry);
+    if (ret != EXIT_SUCCESS)
+        goto end;
+    bckt->segments[bckt->n_segments - 1].dirty = true;
+    bckt->n_entries += 1;
+
     ret = EXIT_SUCCESS;
 
 end:
-    if (obj)
-        json_object_put(obj);
-    if (objs && !bucket_has_objs)
-        json_object_put(objs);
-    if (jspath)
-        json_object_put(jspath);
-    if (jssize)
-        json_object_put(jssize);
-    if (jstype)
-        json_object_put(jstype);
-    if (jsdone)
-        json_object_put(jsdone);
-
     return ret;
 }
 
@@ -280,7 +501,6 @@ _bucket_set_paths(struct bucket_status *bckt, char *storepath, char *srcname, ch
     struct json_object      *jsobj = NULL;
     struct json_object      *jssrc = NULL;
     struct json_object      *jsdst = NULL;
-    struct json_object      *jsobjs = NULL;
     char                    *fpath = NULL;
 
     fpath = _bucket_filepath(storepath, srcname);
@@ -310,15 +530,6 @@ _bucket_set_paths(struct bucket_status *bckt, char *storepath, char *srcname, ch
         goto end;
     }
 
-    jsobjs = json_object_new_array();
-    if (jsobjs == NULL)
-    {
-        PRINTERR("[Setting Bucket Status Path] "
-                 "Could not allocate JSON array object.\n");
-        ret = EXIT_FAILURE;
-        goto end;
-    }
-
     if (bckt->json == NULL)
     {
         jsobj = json_object_new_object();
@@ -352,12 +563,6 @@ _bucket_set_paths(struct bucket_status *bckt, char *storepath, char *srcname, ch
     }
     jsdst = NULL;
 
-    if (bckt->json == NULL)
-    {
-        json_object_object_add(jsobj, CLOUDMIG_STATUS_BUCKET_OBJECTS, jsobjs);
-        jsobjs = NULL;
-    }
-
     if (bckt->json == NULL)
     {
         bckt->json = jsobj;
@@ -381,8 +586,6 @@ end:
         json_object_put(jssrc);
     if (jsdst)
         json_object_put(jsdst);
-    if (jsobjs)
-        json_object_put(jsobjs);
     if (jsobj)
         json_object_put(jsobj);
 
@@ -415,7 +618,7 @@ _bucket_set_infos(struct bucket_status *bst, uint64_t count, uint64_t size)
     jsnobjs = NULL;
     jszero = NULL;
 
-    ret = EXIT_SUCCESS;
+    ret = _bucket_set_segments(bst);
 
 end:
     if (jszero)
@@ -428,6 +631,44 @@ end:
     return ret;
 }
 
+/*
+ * Describes the segments of the bucket status within its manifest.
+ */
+static int
+_bucket_set_segments(struct bucket_status *bst)
+{
+    int                     ret;
+    struct json_object      *jssegsize = NULL;
+    struct json_object      *jssegs = NULL;
+
+    jssegsize = json_object_new_int64(bst->segment_size);
+    jssegs = json_object_new_int64(bst->n_segments);
+    if (jssegsize == NULL || jssegs == NULL)
+    {
+        PRINTERR("[Creating Bucket Status] Could not create JSON int.\n");
+        ret = EXIT_FAILURE;
+        goto end;
+    }
+
+    json_object_object_del(bst->json, CLOUDMIG_STATUS_BUCKET_SEGSIZE);
+    json_object_object_add(bst->json, CLOUDMIG_STATUS_BUCKET_SEGSIZE, jssegsize);
+    json_object_object_del(bst->json, CLOUDMIG_STATUS_BUCKET_SEGMENTS);
+    json_object_object_add(bst->json, CLOUDMIG_STATUS_BUCKET_SEGMENTS, jssegs);
+    jssegsize = NULL;
+    jssegs = NULL;
+    bst->manifest_dirty = true;
+
+    ret = EXIT_SUCCESS;
+
+end:
+    if (jssegsize)
+        json_object_put(jssegsize);
+    if (jssegs)
+        json_object_put(jssegs);
+
+    return ret;
+}
+
 /*
  * Value's true hidden type must depend on the expected json type:
  * - boolean -> int*
@@ -510,79 +751,38 @@ end:
     return ret;
 }
 
+/*
+ * Checks the entries of a bucket status (or of one of its segments), and
+ * computes the aggregation of their sizes.
+ */
 static int
-_bucket_json_check(struct json_object *json_bucket,
-                   uint64_t *n_objsp, uint64_t *n_bytesp)
+_bucket_segment_check(struct json_object *objects,
+                      unsigned int count, uint64_t *n_bytesp)
 {
     int                 ret;
-    struct json_object  *objects = NULL;
     struct json_object  *obj = NULL;
-    int64_t             n_objs = 0;
-    uint64_t            fullsize = 0;
     uint64_t            entry_sz = 0;
     int                 entry_done = FALSE;
     int                 entry_type = 0;
     uint64_t            aggregated_size = 0;
     char                *str = NULL;
 
-    /*
-     * Here is the following json format we use:
-     * Status
-     *   -> srcpath (bucket source path)
-     *   -> dstpath (bucket destination path)
-     *   -> objects_done
-     *   -> objects_total
-     *   -> bytes_done
-     *   -> bytes_total
-     *   -> objects = [
-     *        -> path (File path within bucket)
-     *        -> Size
-     *        -> Offset (Current amount of bytes migrated)
-     *      ] (array of entries as described within brackets)
-     */
-    ret = _bucket_json_check_field(json_bucket, CLOUDMIG_STATUS_BUCKET_SRCPATH,
-                                   json_type_string, (void*)&str);
-    if (ret != EXIT_SUCCESS)
-        goto end;
-
-    ret = _bucket_json_check_field(json_bucket, CLOUDMIG_STATUS_BUCKET_DSTPATH,
-                                   json_type_string, (void*)&str);
-    if (ret != EXIT_SUCCESS)
-        goto end;
-
-    ret = _bucket_json_check_field(json_bucket, CLOUDMIG_STATUS_BUCKET_N_OBJS,
-                                   json_type_int, (void*)&n_objs);
-    if (ret != EXIT_SUCCESS)
-        goto end;
-
-    ret = _bucket_json_check_field(json_bucket, CLOUDMIG_STATUS_BUCKET_N_BYTES,
-                                   json_type_int, (void*)&fullsize);
-    if (ret != EXIT_SUCCESS)
-        goto end;
-
-    /* Check that the aggregation of sizes/n_objects is consistent with total fields */
-    ret = _bucket_json_check_field(json_bucket, CLOUDMIG_STATUS_BUCKET_OBJECTS,
-                                   json_type_array, (void*)&objects);
-    if (ret != EXIT_SUCCESS)
-        goto end;
-
-    if (json_object_array_length(objects) != n_objs)
+    if ((unsigned int)json_object_array_length(objects) != count)
     {
         PRINTERR("[Loading Bucket Status] JSON Array does not contain"
-                 " as many objects as expected: %i"
-                 " for an 'objects_total' of %"PRIu64".\n",
-                 json_object_array_length(objects), n_objs);
+                 " as many objects as expected: %i for %u.\n",
+                 json_object_array_length(objects), count);
         ret = EXIT_FAILURE;
         goto end;
     }
 
-    for (int i=0; i < n_objs; ++i)
+    for (unsigned int i=0; i < count; ++i)
     {
         obj = json_object_array_get_idx(objects, i);
         if (obj == NULL)
         {
             PRINTERR("[Loading Bucket Status] Could not retrieve "
-                     "object at index %i of array.", i);
+                     "object at index %u of array.", i);
             ret = EXIT_FAILURE;
             goto end;
         }
@@ -610,16 +810,6 @@ _bucket_json_check(struct json_object *json_bucket,
         aggregated_size += entry_sz;
     }
 
-    if (aggregated_size != fullsize)
-    {
-        PRINTERR("[Loading Bucket Status] Total size of bucket does not "
-                 "match the aggregate of the size of the objects.\n");
-        ret = EXIT_FAILURE;
-        goto end;
-    }
-
-    if (n_objsp)
-        *n_objsp = n_objs;
     if (n_bytesp)
         *n_bytesp = aggregated_size;
 
@@ -629,57 +819,234 @@ end:
     return ret;
 }
 
-struct bucket_status*
-status_bucket_new()
+/*
+ * Checks the common fields of a bucket status, whichever its format.
+ */
+static int
+_bucket_json_check_header(struct json_object *json_bucket,
+                          uint64_t *n_objsp, uint64_t *n_bytesp)
 {
-    struct bucket_status    *ret = NULL;
-    struct bucket_status    *bst = NULL;
+    int                 ret;
+    char                *str = NULL;
 
-    bst = calloc(1, sizeof(*bst));
-    if (bst == NULL)
-    {
-        PRINTERR("Could not allocate bucket status.\n");
+    ret = _bucket_json_check_field(json_bucket, CLOUDMIG_STATUS_BUCKET_SRCPATH,
+                                   json_type_string, (void*)&str);
+    if (ret != EXIT_SUCCESS)
         goto end;
-    }
 
-    if (pthread_mutex_init(&bst->lock, NULL) == -1)
+    ret = _bucket_json_check_field(json_bucket, CLOUDMIG_STATUS_BUCKET_DSTPATH,
+                                   json_type_string, (void*)&str);
+    if (ret != EXIT_SUCCESS)
         goto end;
-    bst->lock_inited = 1;
 
-    ret = bst;
-    bst = NULL;
+    ret = _bucket_json_check_field(json_bucket, CLOUDMIG_STATUS_BUCKET_N_OBJS,
+                                   json_type_int, (void*)n_objsp);
+    if (ret != EXIT_SUCCESS)
+        goto end;
 
-end:
-    if (bst)
-        status_bucket_free(bst);
+    ret = _bucket_json_check_field(json_bucket, CLOUDMIG_STATUS_BUCKET_N_BYTES,
+                                   json_type_int, (void*)n_bytesp);
+    if (ret != EXIT_SUCCESS)
+        goto end;
 
-    return ret;
-}
+    if (*n_objsp > UINT_MAX)
+    {
+        PRINTERR("[Loading Bucket Status] Too many objects in bucket status:"
+                 " %"PRIu64".\n", *n_objsp);
+        ret = EXIT_FAILURE;
+        goto end;
+    }
 
-void
-status_bucket_free(struct bucket_status *bst)
-{
-    if (bst->json)
-        json_object_put(bst->json);
-    if (bst->path)
-        free(bst->path);
-    pthread_mutex_destroy(&bst->lock);
+    ret = EXIT_SUCCESS;
 
-    free(bst);
+end:
+    return ret;
 }
 
-int
-status_bucket_dup_paths(struct bucket_status *bst,
-                        char **statusp, char **srcp)
+/*
+ * Checks a bucket status in the single file format (all entries within the
+ * bucket status file), as written by the previous versions.
+ */
+static int
+_bucket_json_check(struct json_object *json_bucket,
+                   uint64_t *n_objsp, uint64_t *n_bytesp)
 {
-    int     ret = EXIT_FAILURE;
-    bool    bucket_locked = false;
-    char    *ststr = NULL;
-    char    *srcstr = NULL;
-    struct json_object  *obj = NULL;
-
+    int                 ret;
+    struct json_object  *objects = NULL;
+    uint64_t            n_objs = 0;
+    uint64_t            fullsize = 0;
+    uint64_t            aggregated_size = 0;
+
+    /*
+     * Here is the following json format we use:
+     * Status
+     *   -> srcpath (bucket source path)
+     *   -> dstpath (bucket destination path)
+     *   -> objects_done
+     *   -> objects_total
+     *   -> bytes_done
+     *   -> bytes_total
+     *   -> objects = [
+     *        -> path (File path within bucket)
+     *        -> Size
+     *        -> Offset (Current amount of bytes migrated)
+     *      ] (array of entries as described within brackets)
+     */
+    ret = _bucket_json_check_header(json_bucket, &n_objs, &fullsize);
+    if (ret != EXIT_SUCCESS)
+        goto end;
+
+    /* Check that the aggregation of sizes/n_objects is consistent with total fields */
+    ret = _bucket_json_check_field(json_bucket, CLOUDMIG_STATUS_BUCKET_OBJECTS,
+                                   json_type_array, (void*)&objects);
+    if (ret != EXIT_SUCCESS)
+        goto end;
+
+    ret = _bucket_segment_check(objects, n_objs, &aggregated_size);
+    if (ret != EXIT_SUCCESS)
+        goto end;
+
+    if (aggregated_size != fullsize)
+    {
+        PRINTERR("[Loading Bucket Status] Total size of bucket does not "
+                 "match the aggregate of the size of the objects.\n");
+        ret = EXIT_FAILURE;
+        goto end;
+    }
+
+    if (n_objsp)
+        *n_objsp = n_objs;
+    if (n_bytesp)
+        *n_bytesp = aggregated_size;
+
+    ret = EXIT_SUCCESS;
+
+end:
+    return ret;
+}
+
+/*
+ * Checks a bucket status manifest: the header fields, plus the description of
+ * the segments holding the entries. The segments themselves are only checked
+ * when they get loaded.
+ */
+static int
+_bucket_manifest_check(struct json_object *json_bucket,
+                       uint64_t *n_objsp, uint64_t *n_bytesp,
+                       uint64_t *segment_sizep, uint64_t *n_segmentsp)
+{
+    int                 ret;
+
+    ret = _bucket_json_check_header(json_bucket, n_objsp, n_bytesp);
+    if (ret != EXIT_SUCCESS)
+        goto end;
+
+    ret = _bucket_json_check_field(json_bucket, CLOUDMIG_STATUS_BUCKET_SEGSIZE,
+                                   json_type_int, (void*)segment_sizep);
+    if (ret != EXIT_SUCCESS)
+        goto end;
+
+    ret = _bucket_json_check_field(json_bucket, CLOUDMIG_STATUS_BUCKET_SEGMENTS,
+                                   json_type_int, (void*)n_segmentsp);
+    if (ret != EXIT_SUCCESS)
+        goto end;
+
+    if (*segment_sizep == 0 || *segment_sizep > UINT_MAX
+        || *n_segmentsp != (*n_objsp + *segment_sizep - 1) / *segment_sizep)
+    {
+        PRINTERR("[Loading Bucket Status] Inconsistent segments description:"
+                 " %"PRIu64" segments of %"PRIu64" entries for %"PRIu64" entries.\n",
+                 *n_segmentsp, *segment_sizep, *n_objsp);
+        ret = EXIT_FAILURE;
+        goto end;
+    }
+
+    ret = EXIT_SUCCESS;
+
+end:
+    return ret;
+}
+
+struct bucket_status*
+status_bucket_new()
+{
+    struct bucket_status    *ret = NULL;
+    struct bucket_status    *bst = NULL;
+
+    bst = calloc(1, sizeof(*bst));
+    if (bst == NULL)
+    {
+        PRINTERR("Could not allocate bucket status.\n");
+        goto end;
+    }
+
+    if (pthread_mutex_init(&bst->lock, NULL) == -1)
+        goto end;
+    bst->lock_inited = 1;
+
+    if (pthread_mutex_init(&bst->states_lock, NULL) == -1)
+        goto end;
+    bst->states_lock_inited = 1;
+
+    bst->segment_size = CLOUDMIG_STATUS_SEGMENT_SIZE;
+
+    ret = bst;
+    bst = NULL;
+
+end:
+    if (bst)
+        status_bucket_free(bst);
+
+    return ret;
+}
+
+void
+status_bucket_free(struct bucket_status *bst)
+{
+    if (bst->segments)
+    {
+        for (unsigned int i=0; i < bst->n_segments; ++i)
+            _bucket_segment_release(&bst->segments[i]);
+        free(bst->segments);
+    }
+    if (bst->outbuf.data)
+        free(bst->outbuf.data);
+    if (bst->json)
+        json_object_put(bst->json);
+    if (bst->states)
+        json_object_put(bst->states);
+    if (bst->partial)
+        free(bst->partial);
+    _bucket_index_free(bst);
+    if (bst->claims)
+    {
+        free(bst->claims->ranges);
+        free(bst->claims);
+    }
+    if (bst->path)
+        free(bst->path);
+    if (bst->states_lock_inited)
+        pthread_mutex_destroy(&bst->states_lock);
+    pthread_mutex_destroy(&bst->lock);
+
+    free(bst);
+}
+
+int
+status_bucket_dup_paths(struct bucket_status *bst,
+                        char **statusp, char **srcp)
+{
+    int     ret = EXIT_FAILURE;
+    bool    bucket_locked = false;
+    char    *ststr = NULL;
+    char    *srcstr = NULL;
+    struct json_object  *obj = NULL;
+
     _bucket_lock(bst);
     bucket_locked = true;
+
+    if (srcp && _bucket_ensure_loaded(bst) != EXIT_SUCCESS)
+        goto end;
     
     if (statusp)
         ststr = strdup(bst->path);
@@ -726,455 +1093,2812 @@ end:
     return ret;
 }
 
-struct bucket_status*
-status_bucket_load(dpl_ctx_t *status_ctx,
-                   char *storepath, char *name,
-                   uint64_t *countp, uint64_t *sizep)
+/*
+ * Segments are stored within the bucket's directory, next to the intermediary
+ * states of the entries.
+ */
+static char*
+_bucket_segment_path(struct bucket_status *bst, unsigned int seg)
 {
-    struct bucket_status    *ret = NULL;
-    int                     iret;
-    dpl_status_t            dplret;
-    struct bucket_status    *sbucket = NULL;
-    char                    *path = NULL;
-    struct json_tokener     *tok = NULL;
-    struct json_object      *obj = NULL;
-    char                    *buffer = NULL;
-    unsigned int            bufsize = 0;
-    uint64_t                count = 0;
-    uint64_t                size = 0;
-
-    cloudmig_log(DEBUG_LVL, "[Loading Bucket Status] "
-                 "Loading status for bucket from file %s/%s...\n", storepath, name);
-
-    sbucket = status_bucket_new();
-    if (sbucket == NULL)
-        goto end;
+    char    *path = NULL;
 
-    tok = json_tokener_new();
-    if (tok == NULL)
+    if (asprintf(&path, "%.*s/"CLOUDMIG_STATUS_SEGMENT_PREFIX"%u"CLOUDMIG_STATUS_BUCKET_FILEEXT,
+                 (int)(strlen(bst->path) - strlen(CLOUDMIG_STATUS_BUCKET_FILEEXT)),
+                 bst->path, seg) <= 0)
     {
-        PRINTERR("[Loading Bucket Status] Could not allocate JSON tokener.\n");
-        goto end;
+        PRINTERR("Could not allocate memory for bucket segment path.\n");
+        return NULL;
     }
 
-    iret = asprintf(&path, "%s/%s", storepath, name);
-    if (iret <= 0)
+    return path;
+}
+
+static unsigned int
+_bucket_segment_count(struct bucket_status *bst, unsigned int seg)
+{
+    if (seg < bst->n_segments - 1)
+        return bst->segment_size;
+    return bst->n_entries - seg * bst->segment_size;
+}
+
+static int
+_bucket_segment_emit(void *data, const char *path,
+                     const struct bucket_entry *entry)
+{
+    return _bucket_segment_push(data, path, entry);
+}
+
+/*
+ * Reads the entries of a segment from the status store, parsing them as the
+ * segment is being fetched.
+ */
+static int
+_bucket_segment_fetch(struct bucket_status *bst, unsigned int seg)
+{
+    int                     ret;
+    char                    *path = NULL;
+    struct status_stream    *stream = NULL;
+
+    path = _bucket_segment_path(bst, seg);
+    if (path == NULL)
     {
-        PRINTERR("[Loading Bucket Status] Could not allocate path.\n");
+        ret = EXIT_FAILURE;
         goto end;
     }
 
-    dplret = dpl_fget(status_ctx, path,
-                      NULL/*option*/, NULL/*condition*/, NULL/*range*/,
-                      &buffer, &bufsize,
-                      NULL/*MD*/, NULL/*sysmd*/);
-    if (dplret != DPL_SUCCESS)
+    cloudmig_log(DEBUG_LVL, "[Loading Bucket Status] Loading segment %s...\n", path);
+
+    stream = status_stream_new(&_bucket_segment_emit, &bst->segments[seg]);
+    if (stream == NULL)
     {
-        PRINTERR("[Loading Bucket Status] Could not get file: %s.\n",
-                 dpl_status_str(dplret));
+        ret = EXIT_FAILURE;
         goto end;
     }
 
-    obj = json_tokener_parse_ex(tok, buffer, bufsize);
-    if (obj == NULL)
+    ret = status_stream_load(bst->status_ctx, path,
+                             CLOUDMIG_STATUS_FETCH_SIZE, stream);
+    if (ret != EXIT_SUCCESS)
     {
-        PRINTERR("[Loading Bucket Status] Could not parse JSON.\n");
+        PRINTERR("[Loading Bucket Status] Could not load segment %s.\n", path);
         goto end;
     }
 
-    iret = _bucket_json_check(obj, &count, &size);
-    if (iret != EXIT_SUCCESS)
+    ret = EXIT_SUCCESS;
+
+end:
+    if (ret != EXIT_SUCCESS)
+        _bucket_segment_release(&bst->segments[seg]);
+    if (stream)
+        status_stream_free(stream);
+    if (path)
+        free(path);
+
+    return ret;
+}
+
+/*
+ * Loads the entries of a segment from the status store.
+ * The bucket status lock must be held by the caller.
+ */
+static int
+_bucket_segment_load(struct bucket_status *bst, unsigned int seg)
+{
+    if (_bucket_segment_fetch(bst, seg) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+
+    if (bst->segments[seg].n_entries != _bucket_segment_count(bst, seg))
     {
-        PRINTERR("[Loading Bucket Status] Status for bucket %s seems erroneous.\n",
-                 name);
-        goto end;
+        PRINTERR("[Loading Bucket Status] Segment %u of %s holds %u entries"
+                 " instead of %u.\n", seg, bst->path,
+                 bst->segments[seg].n_entries, _bucket_segment_count(bst, seg));
+        _bucket_segment_release(&bst->segments[seg]);
+        return EXIT_FAILURE;
     }
 
-    sbucket->json = obj;
-    obj = NULL;
+    bst->segments[seg].loaded = true;
+    bst->segments[seg].dirty = false;
 
-    sbucket->path = path;
-    path = NULL;
+    return EXIT_SUCCESS;
+}
 
-    ret = sbucket;
-    sbucket = NULL;
+/*
+ * Serializes a segment of the bucket status into buf.
+ *
+ * The paths are written front-coded, as they are held in memory. The output
+ * is formatted as json_object_to_json_string() would format the equivalent
+ * json tree.
+ */
+static int
+_bucket_segment_serialize(struct bucket_segment *seg, struct status_buffer *buf)
+{
+    struct bucket_entry     *entry = NULL;
+    const char              *suffix = NULL;
 
-    if (countp)
-        *countp = count;
-    if (sizep)
-        *sizep = size;
+    buf->len = 0;
+    if (_bucket_buffer_reserve(buf, 64) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+    BUFFER_PUT_LITERAL(buf, "{ \"" CLOUDMIG_STATUS_BUCKET_OBJECTS "\": [");
 
-    cloudmig_log(DEBUG_LVL, "[Loading Bucket Status] Loaded bucket status.\n");
+    for (unsigned int i=0; i < seg->n_entries; ++i)
+    {
+        entry = &seg->entries[i];
+        suffix = seg->paths.data + entry->path;
+        // Escaped suffix, plus the keys and the printed numbers
+        if (_bucket_buffer_reserve(buf, 6 * strlen(suffix) + 224)
+            != EXIT_SUCCESS)
+            return EXIT_FAILURE;
+
+        if (i != 0)
+            BUFFER_PUT_LITERAL(buf, ",");
+        BUFFER_PUT_LITERAL(buf, " { \"" CLOUDMIG_STATUS_BUCKETENTRY_PREFIX "\": ");
+        buf->len += sprintf(buf->data + buf->len, "%"PRIu32, entry->prefix);
+        BUFFER_PUT_LITERAL(buf, ", \"" CLOUDMIG_STATUS_BUCKETENTRY_SUFFIX "\": \"");
+        _bucket_buffer_put_string(buf, suffix);
+        BUFFER_PUT_LITERAL(buf, "\", \"" CLOUDMIG_STATUS_BUCKETENTRY_SIZE "\": ");
+        buf->len += sprintf(buf->data + buf->len, "%"PRId64, (int64_t)entry->size);
+        BUFFER_PUT_LITERAL(buf, ", \"" CLOUDMIG_STATUS_BUCKETENTRY_DONE "\": ");
+        if (entry->done)
+            BUFFER_PUT_LITERAL(buf, "true");
+        else
+            BUFFER_PUT_LITERAL(buf, "false");
+        BUFFER_PUT_LITERAL(buf, ", \"" CLOUDMIG_STATUS_BUCKETENTRY_TYPE "\": ");
+        buf->len += sprintf(buf->data + buf->len, "%d", (int32_t)entry->type);
+        BUFFER_PUT_LITERAL(buf, ", \"" CLOUDMIG_STATUS_BUCKETENTRY_MTIME "\": ");
+        buf->len += sprintf(buf->data + buf->len, "%"PRId64, entry->mtime);
+        // Only written when set, as few entries are ever deleted.
+        if (entry->deleted)
+            BUFFER_PUT_LITERAL(buf, ", \"" CLOUDMIG_STATUS_BUCKETENTRY_DELETED "\": true");
+        BUFFER_PUT_LITERAL(buf, " }");
+    }
 
-end:
-    if (buffer)
-        free(buffer);
-    if (tok)
-        json_tokener_free(tok);
-    if (path)
-        free(path);
-    if (obj)
-        json_object_put(obj);
+    if (_bucket_buffer_reserve(buf, 8) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+    BUFFER_PUT_LITERAL(buf, " ] }");
 
-    return ret;
+    return EXIT_SUCCESS;
 }
 
-int 
-_bucket_recurse(dpl_ctx_t *src_ctx,
-                struct bucket_status *bst,
-                char *dirpath,
-                int baselen,
-                uint64_t    *added_countp,
-                uint64_t    *added_sizep)
+/*
+ * Serializes and uploads a segment of the bucket status, using buf as the
+ * output buffer.
+ */
+static int
+_bucket_segment_upload(dpl_ctx_t *status_ctx, struct bucket_status *bst,
+                       unsigned int seg, struct status_buffer *buf)
 {
-    int             ret;
-    dpl_status_t    dplret;
-    char            *subpath = NULL;
-    void            *dir_hdl = NULL;
-    dpl_dirent_t    dirent;
-    uint64_t        added_count = 0;
-    uint64_t        added_size = 0;
-    char            *curpath = NULL;
+    int                     ret;
+    dpl_status_t            dplret;
+    char                    *path = NULL;
 
-    dplret = dpl_opendir(src_ctx, dirpath, &dir_hdl);
-    if (dplret != DPL_SUCCESS)
+    path = _bucket_segment_path(bst, seg);
+    if (path == NULL)
     {
-        PRINTERR("[Creating Bucket Status] Could not open directory %s: %s\n",
-                 dirpath, dpl_status_str(dplret));
         ret = EXIT_FAILURE;
         goto end;
     }
 
-    while (!dpl_eof(dir_hdl))
+    ret = _bucket_segment_serialize(&bst->segments[seg], buf);
+    if (ret != EXIT_SUCCESS)
+        goto end;
+
+    dplret = status_codec_put(status_ctx, path, buf->data, buf->len);
+    if (dplret != DPL_SUCCESS)
     {
-        dplret = dpl_readdir(dir_hdl, &dirent);
-        if (dplret != DPL_SUCCESS)
-        {
-            PRINTERR("[Creating Bucket Status] Could not read directory %s: %s\n",
-                     dirpath, dpl_status_str(dplret));
-            ret = EXIT_FAILURE;
-            goto end;
-        }
-
-        ret = asprintf(&curpath, "%s%s", dirpath, dirent.name);
-        if (ret <= 0)
-        {
-            PRINTERR("[Creating Bucket Status] "
-                     "Could not allocate memory to compute full path.\n");
-            ret = EXIT_FAILURE;
-            goto end;
-        }
-
-        if (strcmp(dirent.name, ".") && strcmp(dirent.name, ".."))
-        {
-            ret = _bucket_add_entry(bst, &curpath[baselen], dirent.size, dirent.type);
-            if (ret != EXIT_SUCCESS)
-            {
-                ret = EXIT_FAILURE;
-                goto end;
-            }
-
-            if (DPL_FTYPE_DIR == dirent.type)
-            {
-                dplret = _bucket_recurse(src_ctx, bst, curpath, baselen, &added_count, &added_size);
-                if (dplret != DPL_SUCCESS)
-                {
-                    ret = EXIT_FAILURE;
-                    goto end;
-                }
-            }
-
-            added_count += 1;
-            added_size += dirent.size;
-        }
-
-        free(curpath);
-        curpath = NULL;
+        PRINTERR("[Uploading Bucket Status] "
+                 "Could not upload bucket status segment %s: %s.\n",
+                 path, dpl_status_str(dplret));
+        ret = EXIT_FAILURE;
+        goto end;
     }
 
-    *added_countp += added_count;
-    *added_sizep += added_size;
+    bst->segments[seg].dirty = false;
 
     ret = EXIT_SUCCESS;
 
 end:
-    if (dir_hdl)
-        dpl_closedir(dir_hdl);
-    if (subpath)
-        free(subpath);
-    if (curpath)
-        free(curpath);
+    if (path)
+        free(path);
 
     return ret;
 }
 
-struct bucket_status*
-status_bucket_create(dpl_ctx_t *status_ctx, dpl_ctx_t *src_ctx,
-                     char *storepath, char *srcpath, char *dstpath,
-                     uint64_t *countp, uint64_t *sizep)
+/*
+ * Share of the dirty segments of a bucket status serialized and uploaded by
+ * one thread: every step-th segment, starting from the first.
+ */
+struct segment_uploader
 {
-    struct bucket_status    *ret = NULL;
-    int                     iret;
-    dpl_status_t            dplret = DPL_SUCCESS;
-    struct bucket_status    *sbucket = NULL;
-    uint64_t                added_count = 0;
-    uint64_t                added_size = 0;
-    char                    *bcktdir = NULL;
-    // Bucket status' raw data
-    const char              *filebuf = NULL;
-
-    cloudmig_log(DEBUG_LVL, "[Creating Bucket Status] "
-                 "Creating status file for bucket '%s'...\n", srcpath);
-
-    sbucket = status_bucket_new();
-    if (sbucket == NULL)
-        goto end;
+    dpl_ctx_t               *status_ctx;
+    struct bucket_status    *bst;
+    unsigned int            first;
+    unsigned int            step;
+    int                     ret;
+};
 
-    iret = _bucket_set_paths(sbucket, storepath, srcpath, dstpath);
-    if (iret != EXIT_SUCCESS)
-        goto end;
+static void*
+_bucket_segment_uploader(void *arg)
+{
+    struct segment_uploader *up = arg;
+    struct bucket_segment   *seg = NULL;
+    struct status_buffer    buf = { NULL, 0, 0 };
 
-    iret = asprintf(&bcktdir, "%.*s",
-                    (int)(strlen(sbucket->path)
-                          - strlen(CLOUDMIG_STATUS_BUCKET_FILEEXT)),
-                    sbucket->path);
-    if (iret <= 0)
+    up->ret = EXIT_SUCCESS;
+    for (unsigned int i=up->first; i < up->bst->n_segments; i += up->step)
     {
-        PRINTERR("[Creating Bucket Status] "
-                 "Could not allocate memory for bucket dir path.\n");
-        goto end;
+        seg = &up->bst->segments[i];
+        if (!seg->loaded || !seg->dirty)
+            continue ;
+        if (_bucket_segment_upload(up->status_ctx, up->bst, i, &buf)
+            != EXIT_SUCCESS)
+        {
+            up->ret = EXIT_FAILURE;
+            break ;
+        }
     }
 
-    iret = _bucket_recurse(src_ctx, sbucket, srcpath, strlen(srcpath), &added_count, &added_size);
-    if (iret != EXIT_SUCCESS)
-        goto end;
+    free(buf.data);
 
-    iret = _bucket_set_infos(sbucket, added_count, added_size);
-    if (iret != EXIT_SUCCESS)
-        goto end;
+    return NULL;
+}
 
-    filebuf = json_object_to_json_string(sbucket->json);
-    if (filebuf == NULL)
-        goto end;
+/*
+ * Serializes and uploads the dirty segments of a bucket status on up to
+ * CLOUDMIG_STATUS_UPLOAD_THREADS threads (ie: after a status creation, when
+ * all of them are dirty). Each thread works with its own output buffer.
+ * The bucket status lock must be held by the caller.
+ */
+static int
+_bucket_segments_upload_parallel(dpl_ctx_t *status_ctx,
+                                 struct bucket_status *bst,
+                                 unsigned int n_threads)
+{
+    int                     ret = EXIT_SUCCESS;
+    pthread_t               threads[CLOUDMIG_STATUS_UPLOAD_THREADS];
+    bool                    started[CLOUDMIG_STATUS_UPLOAD_THREADS];
+    struct segment_uploader ups[CLOUDMIG_STATUS_UPLOAD_THREADS];
 
-    if ((dplret = dpl_fput(status_ctx, sbucket->path,
-                           NULL, NULL, NULL, // opt, cond, range
-                           NULL, NULL, // md, sysmd
-                           (char*)filebuf, strlen(filebuf))) != DPL_SUCCESS)
+    for (unsigned int t=0; t < n_threads; ++t)
     {
-        PRINTERR("%s: Could not create bucket %s's status file at %s: %s\n",
-                 __FUNCTION__, srcpath, sbucket->path, dpl_status_str(dplret));
-        goto end;
+        ups[t].status_ctx = status_ctx;
+        ups[t].bst = bst;
+        ups[t].first = t;
+        ups[t].step = n_threads;
+        ups[t].ret = EXIT_FAILURE;
+        started[t] = (pthread_create(&threads[t], NULL,
+                                     &_bucket_segment_uploader, &ups[t]) == 0);
+        // Fallback on the current thread if no thread could be spawned
+        if (!started[t])
+            _bucket_segment_uploader(&ups[t]);
     }
 
-    if ((dplret = dpl_mkdir(status_ctx, bcktdir, NULL/*MD*/, NULL/*sysmd*/)))
+    for (unsigned int t=0; t < n_threads; ++t)
     {
-        PRINTERR("[Creating Bucket Status] Could not mkdir '%s': %s.\n",
-                 bcktdir, dpl_status_str(dplret));
-        goto end;
+        if (started[t])
+            pthread_join(threads[t], NULL);
+        if (ups[t].ret != EXIT_SUCCESS)
+            ret = EXIT_FAILURE;
     }
 
-    cloudmig_log(DEBUG_LVL, "[Creating Bucket Status] Bucket %s: SUCCESS.\n",
-                 srcpath);
-
-    *countp = added_count;
-    *sizep = added_size;
-
-    ret = sbucket;
-    sbucket = NULL;
-
-end:
-    if (sbucket != NULL)
-        status_bucket_free(sbucket);
-    if (bcktdir)
-        free(bcktdir);
-
     return ret;
 }
 
-void
-status_bucket_delete(dpl_ctx_t *status_ctx, struct bucket_status *bst)
+/*
+ * Retrieves an entry, loading its segment if needed.
+ * The bucket status lock must be held by the caller.
+ */
+static struct bucket_entry*
+_bucket_entry(struct bucket_status *bst, unsigned int idx)
 {
-    _bucket_lock(bst);
+    unsigned int    seg;
+
+    if (idx >= bst->n_entries)
     {
-        char *dot = strrchr(bst->path, '.');
-        *dot = 0;
-        delete_directory(status_ctx, "Status Bucketdir", bst->path);
-        *dot = '.';
+        PRINTERR("[Bucket Status] Entry %u out of range (%u entries).\n",
+                 idx, bst->n_entries);
+        return NULL;
     }
-    delete_file(status_ctx, "Status Bucket", bst->path);
-    _bucket_unlock(bst);
-}
-
-void
-status_bucket_get(struct bucket_status *bst)
-{
-    _bucket_lock(bst);
-    bst->refcount += 1;
-    _bucket_unlock(bst);
-}
 
-void
-status_bucket_release(struct bucket_status *bst)
-{
-    _bucket_lock(bst);
-    assert(bst->refcount > 0);
-    bst->refcount -= 1;
-    _bucket_unlock(bst);
-}
+    seg = idx / bst->segment_size;
+    if (!bst->segments[seg].loaded
+        && _bucket_segment_load(bst, seg) != EXIT_SUCCESS)
+        return NULL;
 
-void
-status_bucket_reset_iteration(struct bucket_status *bst)
-{
-    _bucket_lock(bst);
-    bst->next_entry = 0;
-    _bucket_unlock(bst);
+    return &bst->segments[seg].entries[idx % bst->segment_size];
 }
 
+/*
+ * Splits a bucket status in the single file format into segments, and stores
+ * it in the segmented format, the manifest being written last.
+ */
 static int
-_bucket_entry_load(dpl_ctx_t *status_ctx, struct file_transfer_state *filestate)
+_bucket_convert(dpl_ctx_t *status_ctx, struct bucket_status *bst,
+                const char *bcktdir, uint64_t count)
 {
-    int                 ret = EXIT_FAILURE;
-    dpl_status_t        dplret;
-    char                *buffer = NULL;
-    unsigned int        bufsize;
-    struct json_tokener *tokener = NULL;
-    struct json_object  *json = NULL;
-    struct json_object  *srcstate = NULL;
-    struct json_object  *dststate = NULL;
-    struct json_object  *objoff = NULL;
-
-    dplret = dpl_fget(status_ctx, filestate->status_path,
-                      NULL/*option*/, NULL/*condition*/, NULL/*range*/,
-                      &buffer, &bufsize,
-                      NULL/*MD*/, NULL/*sysmd*/);
-    if (dplret != DPL_SUCCESS)
-    {
-        if (dplret != DPL_ENOENT)
-        {
-            PRINTERR("[Bucket Status Loading Object] Could not get state file.\n");
-            ret = EXIT_FAILURE;
-            goto end;
-        }
+    int                     ret;
+    dpl_status_t            dplret;
+    struct json_object      *objects = NULL;
+    struct json_object      *obj = NULL;
+    struct json_object      *field = NULL;
+    struct bucket_entry     entry;
 
-        // No intermediary state, not an error.
-        ret = EXIT_SUCCESS;
-        goto end;
-    }
+    cloudmig_log(INFO_LVL, "[Loading Bucket Status] "
+                 "Converting bucket status %s into segments...\n", bst->path);
 
-    tokener = json_tokener_new();
-    if (tokener == NULL)
+    if (json_object_object_get_ex(bst->json, CLOUDMIG_STATUS_BUCKET_OBJECTS,
+                                  &objects) == FALSE)
     {
-        PRINTERR("[Bucket Status Loading Object] Could not allocate JSON tokener.\n");
         ret = EXIT_FAILURE;
         goto end;
     }
+    json_object_get(objects);
+    json_object_object_del(bst->json, CLOUDMIG_STATUS_BUCKET_OBJECTS);
 
-    json = json_tokener_parse_ex(tokener, buffer, bufsize);
-    if (json == NULL)
+    for (uint64_t i=0; i < count; ++i)
     {
-        PRINTERR("[Bucket Status Loading Object] Could not parse JSON.\n");
-        ret = EXIT_FAILURE;
-        goto end;
-    }
+        if (i % bst->segment_size == 0)
+        {
+            ret = _bucket_segment_append(bst);
+            if (ret != EXIT_SUCCESS)
+                goto end;
+        }
 
-    if (json_object_object_get_ex(json, "offset", &objoff) == FALSE)
-    {
-        PRINTERR("[Bucket Status Loading Object] Could find 'offset' field in JSON.\n");
-        ret = EXIT_FAILURE;
-        goto end;
+        memset(&entry, 0, sizeof(entry));
+        // The fields were checked along with the whole status
+        obj = json_object_array_get_idx(objects, i);
+        json_object_object_get_ex(obj, CLOUDMIG_STATUS_BUCKETENTRY_SIZE, &field);
+        entry.size = json_object_get_int64(field);
+        json_object_object_get_ex(obj, CLOUDMIG_STATUS_BUCKETENTRY_TYPE, &field);
+        entry.type = json_object_get_int(field);
+        json_object_object_get_ex(obj, CLOUDMIG_STATUS_BUCKETENTRY_DONE, &field);
+        entry.done = json_object_get_boolean(field);
+        json_object_object_get_ex(obj, CLOUDMIG_STATUS_BUCKETENTRY_PATH, &field);
+
+        ret = _bucket_segment_push(&bst->segments[bst->n_segments - 1],
+                                   json_object_get_string(field), &entry);
+        if (ret != EXIT_SUCCESS)
+            goto end;
+        bst->n_entries += 1;
     }
 
-    if (json_object_object_get_ex(json, "rstatus", &srcstate) == FALSE)
-    {
-        PRINTERR("[Bucket Status Loading Object] Could find 'rstatus' field in JSON.\n");
-        ret = EXIT_FAILURE;
+    ret = _bucket_set_segments(bst);
+    if (ret != EXIT_SUCCESS)
         goto end;
-    }
 
-    if (json_object_object_get_ex(json, "wstatus", &dststate) == FALSE)
+    dplret = dpl_mkdir(status_ctx, bcktdir, NULL/*MD*/, NULL/*sysmd*/);
+    if (dplret != DPL_SUCCESS && dplret != DPL_EEXIST)
     {
-        PRINTERR("[Bucket Status Loading Object] Could find 'wstatus' field in JSON.\n");
+        PRINTERR("[Loading Bucket Status] Could not mkdir '%s': %s.\n",
+                 bcktdir, dpl_status_str(dplret));
         ret = EXIT_FAILURE;
         goto end;
     }
 
-    filestate->fixed.offset = json_object_get_int64(objoff);
-    filestate->rstatus = json_object_get(srcstate);
-    filestate->wstatus = json_object_get(dststate);
+    ret = _bucket_upload(status_ctx, bst);
+    if (ret != EXIT_SUCCESS)
+        goto end;
 
     ret = EXIT_SUCCESS;
 
 end:
-    if (buffer)
-        free(buffer);
-    if (json)
-        json_object_put(json);
+    if (objects)
+        json_object_put(objects);
 
     return ret;
 }
 
+/*
+ * Drops the manifest and the segments of a bucket status, as if it had not
+ * been loaded yet.
+ * The bucket status lock must be held by the caller.
+ */
+static void
+_bucket_manifest_unload(struct bucket_status *bst)
+{
+    if (bst->segments)
+    {
+        for (unsigned int i=0; i < bst->n_segments; ++i)
+            _bucket_segment_release(&bst->segments[i]);
+        free(bst->segments);
+        bst->segments = NULL;
+    }
+    bst->n_segments = 0;
+    bst->n_entries = 0;
+    if (bst->json)
+        json_object_put(bst->json);
+    bst->json = NULL;
+    bst->loaded = false;
+    bst->complete = false;
+    bst->n_partial = 0;
+    bst->partial_known = false;
+    _bucket_index_free(bst);
+}
 
-int
-status_bucket_entry_update(dpl_ctx_t *status_ctx,
-                           struct file_transfer_state *filestate)
+/*
+ * Loads the manifest of a bucket status opened with status_bucket_open().
+ * The bucket status lock must be held by the caller.
+ */
+static int
+_bucket_manifest_load(struct bucket_status *bst,
+                      uint64_t *countp, uint64_t *sizep)
 {
     int                     ret;
     dpl_status_t            dplret;
-    struct json_object      *json = NULL;
-    struct json_object      *field = NULL;
-    const char              *filebuf = NULL;
+    struct json_tokener     *tok = NULL;
+    struct json_object      *obj = NULL;
+    char                    *buffer = NULL;
+    unsigned int            bufsize = 0;
+    uint64_t                count = 0;
+    uint64_t                size = 0;
+    uint64_t                done = 0;
+    uint64_t                segment_size = 0;
+    uint64_t                n_segments = 0;
+    bool                    legacy = false;
+    char                    *bcktdir = NULL;
+    struct json_object      *leased_done = NULL;
+    uint64_t                idx;
 
-    json = json_object_new_object();
-    if (json == NULL)
+    cloudmig_log(DEBUG_LVL, "[Loading Bucket Status] "
+                 "Loading status for bucket from file %s...\n", bst->path);
+
+    tok = json_tokener_new();
+    if (tok == NULL)
     {
-        PRINTERR("[Bucket Status Entry Update] "
-                 "Could not allocate json object.\n");
+        PRINTERR("[Loading Bucket Status] Could not allocate JSON tokener.\n");
         ret = EXIT_FAILURE;
         goto end;
     }
 
-    field = json_object_new_int64(filestate->fixed.offset);
-    if (field == NULL)
+    dplret = status_codec_get(bst->status_ctx, bst->path, &buffer, &bufsize);
+    if (dplret != DPL_SUCCESS)
     {
-        PRINTERR("[Bucket Status Entry Update] "
-                 "Could not allocate json object.\n");
+        PRINTERR("[Loading Bucket Status] Could not get file: %s.\n",
+                 dpl_status_str(dplret));
         ret = EXIT_FAILURE;
         goto end;
     }
-    json_object_object_add(json, "offset", field);
-    field = NULL;
-
-    json_object_object_add(json, "rstatus", json_object_get(filestate->rstatus));
-    json_object_object_add(json, "wstatus", json_object_get(filestate->wstatus));
 
-    filebuf = json_object_to_json_string(json);
-    if (filebuf == NULL)
+    obj = json_tokener_parse_ex(tok, buffer, bufsize);
+    if (obj == NULL)
     {
-        PRINTERR("[Bucket Status Entry Update] "
-                 "Could not allocate json string representation.\n");
+        PRINTERR("[Loading Bucket Status] Could not parse JSON.\n");
         ret = EXIT_FAILURE;
         goto end;
     }
 
-    dplret = dpl_fput(status_ctx, filestate->status_path,
-                      NULL/*options*/, NULL/*condition*/, NULL/*range*/,
-                      NULL/*MD*/, NULL/*sysmd*/,
-                      (char*)filebuf, strlen(filebuf));
-    if (dplret != DPL_SUCCESS)
+    /*
+     * Only the manifest of the status is loaded here, the segments holding
+     * the entries are loaded when first accessed. The statuses written by the
+     * previous versions hold all the entries though: they are checked and
+     * converted once and for all.
+     */
+    legacy = json_object_object_get_ex(obj, CLOUDMIG_STATUS_BUCKET_OBJECTS, NULL);
+    if (legacy)
+        ret = _bucket_json_check(obj, &count, &size);
+    else
+        ret = _bucket_manifest_check(obj, &count, &size, &segment_size, &n_segments);
+    if (ret != EXIT_SUCCESS)
     {
-        PRINTERR("[Bucket Status Entry Update] "
-                 "Could not upload new JSON bucket status %s.\n",
-                 filestate->status_path);
-        ret = EXIT_FAILURE;
+        PRINTERR("[Loading Bucket Status] Status %s seems erroneous.\n",
+                 bst->path);
         goto end;
     }
 
+    bst->json = obj;
+    obj = NULL;
+
+    bcktdir = _bucket_dirpath(bst->path);
+    if (bcktdir == NULL)
+    {
+        ret = EXIT_FAILURE;
+        goto end;
+    }
+
+    if (legacy)
+    {
+        ret = _bucket_convert(bst->status_ctx, bst, bcktdir, count);
+        if (ret != EXIT_SUCCESS)
+        {
+            PRINTERR("[Loading Bucket Status] "
+                     "Could not convert status %s.\n", bst->path);
+            goto end;
+        }
+    }
+    else
+    {
+        bst->n_entries = count;
+        bst->segment_size = segment_size;
+        bst->n_segments = n_segments;
+        bst->segments = calloc(n_segments ? n_segments : 1,
+                               sizeof(*bst->segments));
+        if (bst->segments == NULL)
+        {
+            PRINTERR("[Loading Bucket Status] Could not allocate segments.\n");
+            ret = EXIT_FAILURE;
+            goto end;
+        }
+
+        /*
+         * The manifest records that all the entries are done once they are:
+         * such a bucket status is never iterated again.
+         */
+        if (json_object_object_get_ex(bst->json, CLOUDMIG_STATUS_BUCKET_OBJSDONE, &obj)
+            && json_object_is_type(obj, json_type_int))
+            done = json_object_get_int64(obj);
+        obj = NULL;
+        bst->complete = (done == count);
+
+        /*
+         * The manifests written by the previous versions have no index of the
+         * partial entries: it is rebuilt from the states on their first use.
+         */
+        if (json_object_object_get_ex(bst->json, CLOUDMIG_STATUS_BUCKET_PARTIAL, &obj))
+        {
+            ret = _bucket_partial_load(bst, obj, count);
+            if (ret != EXIT_SUCCESS)
+            {
+                obj = NULL;
+                goto end;
+            }
+        }
+        obj = NULL;
+    }
+
+    /*
+     * Entries completed by cooperative processes are only recorded within
+     * their leases: report them into the bucket status.
+     */
+    if (bst->cooperative)
+    {
+        leased_done = status_lease_merge(bst->status_ctx, bcktdir);
+        if (leased_done == NULL)
+        {
+            ret = EXIT_FAILURE;
+            goto end;
+        }
+    }
+    for (int i=0; leased_done && i < json_object_array_length(leased_done); ++i)
+    {
+        idx = json_object_get_int64(json_object_array_get_idx(leased_done, i));
+        if (idx >= count
+            || _bucket_entry_set_done(bst, idx) != EXIT_SUCCESS)
+        {
+            PRINTERR("[Loading Bucket Status] "
+                     "Invalid entry %"PRIu64" in leases of %s.\n", idx, bcktdir);
+            ret = EXIT_FAILURE;
+            goto end;
+        }
+    }
+
+    bst->loaded = true;
+
+    if (countp)
+        *countp = count;
+    if (sizep)
+        *sizep = size;
+
+    cloudmig_log(DEBUG_LVL, "[Loading Bucket Status] Loaded bucket status%s.\n",
+                 bst->complete ? " (complete)" : "");
+
+    ret = EXIT_SUCCESS;
+
+end:
+    if (ret != EXIT_SUCCESS)
+        _bucket_manifest_unload(bst);
+    if (leased_done)
+        json_object_put(leased_done);
+    if (bcktdir)
+        free(bcktdir);
+    if (buffer)
+        free(buffer);
+    if (tok)
+        json_tokener_free(tok);
+    if (obj)
+        json_object_put(obj);
+
+    return ret;
+}
+
+/*
+ * Loads the manifest of a bucket status on its first use.
+ * The bucket status lock must be held by the caller.
+ */
+static int
+_bucket_ensure_loaded(struct bucket_status *bst)
+{
+    if (bst->loaded)
+        return EXIT_SUCCESS;
+
+    return _bucket_manifest_load(bst, NULL, NULL);
+}
+
+struct bucket_status*
+status_bucket_open(dpl_ctx_t *status_ctx, char *storepath, char *name,
+                   bool complete, bool cooperative)
+{
+    struct bucket_status    *ret = NULL;
+    struct bucket_status    *sbucket = NULL;
+
+    sbucket = status_bucket_new();
+    if (sbucket == NULL)
+        goto end;
+    sbucket->status_ctx = status_ctx;
+    sbucket->complete = complete;
+    sbucket->cooperative = cooperative;
+
+    if (asprintf(&sbucket->path, "%s/%s", storepath, name) <= 0)
+    {
+        PRINTERR("[Loading Bucket Status] Could not allocate path.\n");
+        sbucket->path = NULL;
+        goto end;
+    }
+
+    ret = sbucket;
+    sbucket = NULL;
+
+end:
+    if (sbucket)
+        status_bucket_free(sbucket);
+
+    return ret;
+}
+
+struct bucket_status*
+status_bucket_load(dpl_ctx_t *status_ctx,
+                   char *storepath, char *name,
+                   bool cooperative,
+                   uint64_t *countp, uint64_t *sizep)
+{
+    struct bucket_status    *ret = NULL;
+    struct bucket_status    *sbucket = NULL;
+
+    sbucket = status_bucket_open(status_ctx, storepath, name, false, cooperative);
+    if (sbucket == NULL)
+        goto end;
+
+    if (_bucket_manifest_load(sbucket, countp, sizep) != EXIT_SUCCESS)
+        goto end;
+
+    ret = sbucket;
+    sbucket = NULL;
+
+end:
+    if (sbucket)
+        status_bucket_free(sbucket);
+
+    return ret;
+}
+
+typedef int (*bucket_visit_t)(void *data, char *path, const dpl_dirent_t *dirent);
+
+/*
+ * Directories left to list by the recursive listing. They are listed last in
+ * first out, the subdirectories of a directory being pushed in reverse, so
+ * that they are listed in the order they were found.
+ */
+struct bucket_frontier
+{
+    char                    **dirs;
+    unsigned int            n_dirs;
+    unsigned int            size;
+};
+
+typedef int (*bucket_checkpoint_t)(void *data, const struct bucket_frontier *frontier);
+
+static int
+_bucket_frontier_push(struct bucket_frontier *frontier, char *dirpath)
+{
+    char            **dirs = NULL;
+    unsigned int    size;
+
+    if (frontier->n_dirs == frontier->size)
+    {
+        size = frontier->size ? frontier->size * 2 : 64;
+        dirs = realloc(frontier->dirs, sizeof(*dirs) * size);
+        if (dirs == NULL)
+        {
+            PRINTERR("[Creating Bucket Status] Could not grow directory list.\n");
+            return EXIT_FAILURE;
+        }
+        frontier->dirs = dirs;
+        frontier->size = size;
+    }
+    frontier->dirs[frontier->n_dirs++] = dirpath;
+
+    return EXIT_SUCCESS;
+}
+
+static void
+_bucket_frontier_release(struct bucket_frontier *frontier)
+{
+    for (unsigned int i=0; i < frontier->n_dirs; ++i)
+        free(frontier->dirs[i]);
+    free(frontier->dirs);
+    memset(frontier, 0, sizeof(*frontier));
+}
+
+/*
+ * Lists one directory, calling visit for each entry found with its path
+ * relative to the bucket, and adding its subdirectories to the frontier.
+ * The entries filtered out are skipped, and so are the subtrees of the
+ * directories filtered out.
+ */
+static int
+_bucket_list_dir(const struct bucket_crawl *crawl,
+                 const char *dirpath,
+                 int baselen,
+                 struct bucket_frontier *frontier,
+                 bucket_visit_t visit,
+                 void *data)
+{
+    int             ret;
+    dpl_status_t    dplret;
+    void            *dir_hdl = NULL;
+    dpl_dirent_t    dirent;
+    char            *curpath = NULL;
+    unsigned int    first = frontier->n_dirs;
+    char            *tmp = NULL;
+
+    dplret = dpl_opendir(crawl->src_ctx, dirpath, &dir_hdl);
+    if (dplret != DPL_SUCCESS)
+    {
+        PRINTERR("[Creating Bucket Status] Could not open directory %s: %s\n",
+                 dirpath, dpl_status_str(dplret));
+        ret = EXIT_FAILURE;
+        goto end;
+    }
+
+    while (!dpl_eof(dir_hdl))
+    {
+        dplret = dpl_readdir(dir_hdl, &dirent);
+        if (dplret != DPL_SUCCESS)
+        {
+            PRINTERR("[Creating Bucket Status] Could not read directory %s: %s\n",
+                     dirpath, dpl_status_str(dplret));
+            ret = EXIT_FAILURE;
+            goto end;
+        }
+
+        ret = asprintf(&curpath, "%s%s", dirpath, dirent.name);
+        if (ret <= 0)
+        {
+            PRINTERR("[Creating Bucket Status] "
+                     "Could not allocate memory to compute full path.\n");
+            ret = EXIT_FAILURE;
+            goto end;
+        }
+
+        if (strcmp(dirent.name, ".") && strcmp(dirent.name, "..")
+            && filter_match(crawl->filter, &curpath[baselen], dirent.type,
+                            dirent.size, dirent.last_modified))
+        {
+            ret = visit(data, &curpath[baselen], &dirent);
+            if (ret != EXIT_SUCCESS)
+            {
+                ret = EXIT_FAILURE;
+                goto end;
+            }
+
+            if (DPL_FTYPE_DIR == dirent.type)
+            {
+                ret = _bucket_frontier_push(frontier, curpath);
+                if (ret != EXIT_SUCCESS)
+                    goto end;
+                curpath = NULL;
+            }
+        }
+
+        free(curpath);
+        curpath = NULL;
+    }
+
+    for (unsigned int i=first, j=frontier->n_dirs - 1; i < frontier->n_dirs && i < j; ++i, --j)
+    {
+        tmp = frontier->dirs[i];
+        frontier->dirs[i] = frontier->dirs[j];
+        frontier->dirs[j] = tmp;
+    }
+
+    ret = EXIT_SUCCESS;
+
+end:
+    if (dir_hdl)
+        dpl_closedir(dir_hdl);
+    if (curpath)
+        free(curpath);
+
+    return ret;
+}
+
+/*
+ * Lists the directories of the frontier and their subdirectories, until none
+ * is left. The checkpoint callback, if any, is called between two
+ * directories, when the entries visited are exactly those of the directories
+ * listed so far.
+ */
+static int
+_bucket_recurse(const struct bucket_crawl *crawl,
+                struct bucket_frontier *frontier,
+                int baselen,
+                bucket_visit_t visit,
+                bucket_checkpoint_t checkpoint,
+                void *data)
+{
+    int             ret;
+    char            *dirpath = NULL;
+
+    while (frontier->n_dirs > 0)
+    {
+        dirpath = frontier->dirs[--frontier->n_dirs];
+        ret = _bucket_list_dir(crawl, dirpath, baselen, frontier, visit, data);
+        free(dirpath);
+        if (ret != EXIT_SUCCESS)
+            return EXIT_FAILURE;
+
+        if (checkpoint && checkpoint(data, frontier) != EXIT_SUCCESS)
+            return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Returns the length of the directories of path already visited, curdir
+ * being the directory of the previous path, with its trailing '/'.
+ */
+static size_t
+_bucket_common_dirs(const struct status_buffer *curdir, const char *path,
+                    size_t dirlen)
+{
+    size_t  common = 0;
+
+    while (common < curdir->len && common < dirlen
+           && curdir->data[common] == path[common])
+        ++common;
+    if (common < curdir->len)
+        while (common > 0 && path[common - 1] != '/')
+            --common;
+
+    return common;
+}
+
+/*
+ * Appends the entry of a directory found within a flat listing.
+ */
+static int
+_bucket_flat_visit_dir(struct status_buffer *buf, const char *path, size_t len,
+                       time_t mtime, bucket_visit_t visit, void *data)
+{
+    dpl_dirent_t    dirent;
+
+    buf->len = 0;
+    if (_bucket_buffer_reserve(buf, len + 1) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+    memcpy(buf->data, path, len);
+    buf->data[len] = 0;
+
+    memset(&dirent, 0, sizeof(dirent));
+    dirent.type = DPL_FTYPE_DIR;
+    dirent.last_modified = mtime;
+
+    return visit(data, buf->data, &dirent);
+}
+
+/*
+ * Lists the source with a single listing of the whole bucket, without
+ * delimiter, instead of one listing per directory. Its pagination is left to
+ * the backend.
+ *
+ * Object stores only hold directories as the prefixes of the paths of their
+ * objects, so their entries are synthesized. An object store lists its
+ * objects in lexicographic order, in which the objects of a directory are
+ * contiguous: each directory is then visited once, right before its first
+ * object, as done by _bucket_recurse.
+ *
+ * The source path is made of the bucket name, optionally followed by a ':'
+ * or a '/' and the prefix of the objects to list.
+ */
+static int
+_bucket_flat_list(const struct bucket_crawl *crawl, const char *srcpath,
+                  bucket_visit_t visit, void *data)
+{
+    int                     ret = EXIT_FAILURE;
+    dpl_status_t            dplret;
+    dpl_vec_t               *objects = NULL;
+    dpl_object_t            *obj = NULL;
+    dpl_dirent_t            dirent;
+    char                    *bucket = NULL;
+    const char              *prefix = NULL;
+    const char              *sep = NULL;
+    size_t                  prefixlen;
+    const char              *path = NULL;
+    const char              *prev = NULL;
+    size_t                  len;
+    size_t                  dirlen;
+    size_t                  common;
+    size_t                  kept;
+    const char              *filterprefix = NULL;
+    size_t                  filterlen;
+    char                    *listprefix = NULL;
+    struct status_buffer    curdir = { NULL, 0, 0 };
+    struct status_buffer    pruned = { NULL, 0, 0 };
+    struct status_buffer    buf = { NULL, 0, 0 };
+
+    while (*srcpath == '/')
+        ++srcpath;
+    sep = strpbrk(srcpath, ":/");
+    bucket = strndup(srcpath, sep ? (size_t)(sep - srcpath) : strlen(srcpath));
+    if (bucket == NULL)
+    {
+        PRINTERR("[Creating Bucket Status] Could not allocate bucket name.\n");
+        goto end;
+    }
+    prefix = sep ? sep + 1 : "";
+    while (*prefix == '/')
+        ++prefix;
+    prefixlen = strlen(prefix);
+
+    // Only the objects the filter may keep are listed.
+    filterprefix = filter_prefix(crawl->filter, &filterlen);
+    if (asprintf(&listprefix, "%s%.*s", prefix, (int)filterlen, filterprefix) < 0)
+    {
+        PRINTERR("[Creating Bucket Status] Could not allocate listing prefix.\n");
+        listprefix = NULL;
+        goto end;
+    }
+
+    dplret = dpl_list_bucket(crawl->src_ctx, bucket, *listprefix ? listprefix : NULL,
+                             NULL, -1, &objects, NULL);
+    if (dplret != DPL_SUCCESS)
+    {
+        PRINTERR("[Creating Bucket Status] Could not list bucket %s: %s\n",
+                 bucket, dpl_status_str(dplret));
+        goto end;
+    }
+
+    if (_bucket_buffer_reserve(&curdir, 1) != EXIT_SUCCESS)
+        goto end;
+
+    for (int i=0; i < objects->n_items; ++i)
+    {
+        obj = (dpl_object_t*)objects->items[i]->ptr;
+        if (strncmp(obj->path, prefix, prefixlen) != 0 || obj->path[prefixlen] == 0)
+            continue ;
+        path = obj->path + prefixlen;
+
+        if (prev && strcmp(prev, path) >= 0)
+        {
+            PRINTERR("[Creating Bucket Status] The listing of bucket %s is not"
+                     " ordered: it can only be listed recursively.\n", bucket);
+            goto end;
+        }
+        prev = path;
+
+        // The objects within a directory filtered out are contiguous.
+        if (pruned.len && strncmp(path, pruned.data, pruned.len) == 0)
+            continue ;
+        pruned.len = 0;
+
+        // The directory of the object, with its trailing '/'
+        len = strlen(path);
+        dirlen = len;
+        while (dirlen > 0 && path[dirlen - 1] != '/')
+            --dirlen;
+
+        // Only the directories not shared with the previous object are new.
+        common = _bucket_common_dirs(&curdir, path, dirlen);
+        kept = common;
+        for (size_t end=common; end < dirlen; ++end)
+        {
+            if (path[end] != '/')
+                continue ;
+            buf.len = 0;
+            if (_bucket_buffer_reserve(&buf, end + 2) != EXIT_SUCCESS)
+                goto end;
+            memcpy(buf.data, path, end + 1);
+            buf.data[end + 1] = 0;
+            if (!filter_match(crawl->filter, buf.data, DPL_FTYPE_DIR, 0, 0))
+            {
+                if (_bucket_buffer_reserve(&pruned, end + 1) != EXIT_SUCCESS)
+                    goto end;
+                memcpy(pruned.data, path, end + 1);
+                pruned.len = end + 1;
+                break ;
+            }
+            // An object named after its directory stands for it.
+            if (_bucket_flat_visit_dir(&buf, path, end + 1,
+                                       end + 1 == len ? obj->last_modified : 0,
+                                       visit, data) != EXIT_SUCCESS)
+                goto end;
+            kept = end + 1;
+        }
+
+        // Only the directories visited are shared with the next objects.
+        curdir.len = 0;
+        if (_bucket_buffer_reserve(&curdir, dirlen + 1) != EXIT_SUCCESS)
+            goto end;
+        memcpy(curdir.data, path, kept);
+        curdir.len = kept;
+
+        if (pruned.len || dirlen == len)
+            continue ;
+        if (!filter_match(crawl->filter, path, DPL_FTYPE_REG,
+                          obj->size, obj->last_modified))
+            continue ;
+
+        buf.len = 0;
+        if (_bucket_buffer_reserve(&buf, len + 1) != EXIT_SUCCESS)
+            goto end;
+        memcpy(buf.data, path, len + 1);
+
+        memset(&dirent, 0, sizeof(dirent));
+        dirent.type = DPL_FTYPE_REG;
+        dirent.size = obj->size;
+        dirent.last_modified = obj->last_modified;
+        if (visit(data, buf.data, &dirent) != EXIT_SUCCESS)
+            goto end;
+    }
+
+    ret = EXIT_SUCCESS;
+
+end:
+    if (objects)
+        dpl_vec_objects_free(objects);
+    free(bucket);
+    free(listprefix);
+    free(curdir.data);
+    free(pruned.data);
+    free(buf.data);
+
+    return ret;
+}
+
+static int
+_bucket_crawl(const struct bucket_crawl *crawl, char *srcpath,
+              bucket_visit_t visit, void *data)
+{
+    int                     ret;
+    struct bucket_frontier  frontier = { NULL, 0, 0 };
+    char                    *dirpath = NULL;
+
+    if (crawl->listing == LISTING_FLAT)
+        return _bucket_flat_list(crawl, srcpath, visit, data);
+
+    dirpath = strdup(srcpath);
+    if (dirpath == NULL || _bucket_frontier_push(&frontier, dirpath) != EXIT_SUCCESS)
+    {
+        PRINTERR("[Creating Bucket Status] Could not allocate source path.\n");
+        free(dirpath);
+        return EXIT_FAILURE;
+    }
+
+    ret = _bucket_recurse(crawl, &frontier, strlen(srcpath),
+                          visit, NULL, data);
+    _bucket_frontier_release(&frontier);
+
+    return ret;
+}
+
+struct bucket_listing
+{
+    struct bucket_status    *bst;
+    uint64_t                count;
+    uint64_t                size;
+    dpl_ctx_t               *status_ctx;        // where to checkpoint, if any
+    int                     baselen;            // length of the source path
+    time_t                  last_checkpoint;
+    bool                    checkpointed;       // a checkpoint is in the store
+};
+
+#define CLOUDMIG_LISTING_INITIALIZER    { NULL, 0, 0, NULL, 0, 0, false }
+
+static int
+_bucket_create_visit(void *data, char *path, const dpl_dirent_t *dirent)
+{
+    struct bucket_listing   *listing = data;
+
+    if (_bucket_add_entry(listing->bst, path, dirent->size, dirent->type,
+                          dirent->last_modified) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+
+    listing->count += 1;
+    listing->size += dirent->size;
+
+    return EXIT_SUCCESS;
+}
+
+/*
+ * The progress of a recursive listing is stored next to the segments, until
+ * the manifest is: it holds the number of entries listed so far, and the
+ * directories left to list, relative to the source path.
+ */
+static char*
+_bucket_listing_path(struct bucket_status *bst)
+{
+    char    *path = NULL;
+
+    if (asprintf(&path, "%.*s/"CLOUDMIG_STATUS_LISTING_FILE,
+                 (int)(strlen(bst->path) - strlen(CLOUDMIG_STATUS_BUCKET_FILEEXT)),
+                 bst->path) <= 0)
+    {
+        PRINTERR("Could not allocate memory for bucket listing path.\n");
+        return NULL;
+    }
+
+    return path;
+}
+
+/*
+ * Uploads the segments listed so far, then the directories left to list.
+ * The entries of the checkpoint are then exactly those of the segments, even
+ * though a later checkpoint may have been interrupted while uploading them.
+ */
+static int
+_bucket_listing_checkpoint(void *data, const struct bucket_frontier *frontier)
+{
+    int                     ret = EXIT_FAILURE;
+    struct bucket_listing   *listing = data;
+    struct bucket_status    *bst = listing->bst;
+    time_t                  now = time(NULL);
+    struct json_object      *jsckpt = NULL;
+    struct json_object      *jspending = NULL;
+    struct json_object      *jsobj = NULL;
+    char                    *path = NULL;
+    char                    *filebuf = NULL;
+
+    if (now - listing->last_checkpoint < CLOUDMIG_STATUS_LISTING_PERIOD)
+        return EXIT_SUCCESS;
+
+    for (unsigned int i=0; i < bst->n_segments; ++i)
+    {
+        if (bst->segments[i].dirty
+            && _bucket_segment_upload(listing->status_ctx, bst, i,
+                                      &bst->outbuf) != EXIT_SUCCESS)
+            goto end;
+    }
+
+    jsckpt = json_object_new_object();
+    jspending = json_object_new_array();
+    if (jsckpt == NULL || jspending == NULL)
+        goto nomem;
+    json_object_object_add(jsckpt, CLOUDMIG_STATUS_LISTING_PENDING, jspending);
+
+    jsobj = json_object_new_int64(bst->n_entries);
+    if (jsobj == NULL)
+        goto nomem;
+    json_object_object_add(jsckpt, CLOUDMIG_STATUS_LISTING_ENTRIES, jsobj);
+    jsobj = json_object_new_int64(listing->count);
+    if (jsobj == NULL)
+        goto nomem;
+    json_object_object_add(jsckpt, CLOUDMIG_STATUS_LISTING_OBJECTS, jsobj);
+    jsobj = json_object_new_int64(listing->size);
+    if (jsobj == NULL)
+        goto nomem;
+    json_object_object_add(jsckpt, CLOUDMIG_STATUS_LISTING_BYTES, jsobj);
+
+    // Kept in the order of the frontier, so that the listing resumes as is.
+    for (unsigned int i=0; i < frontier->n_dirs; ++i)
+    {
+        jsobj = json_object_new_string(&frontier->dirs[i][listing->baselen]);
+        if (jsobj == NULL)
+            goto nomem;
+        json_object_array_add(jspending, jsobj);
+    }
+
+    path = _bucket_listing_path(bst);
+    filebuf = strdup(json_object_to_json_string(jsckpt));
+    if (path == NULL || filebuf == NULL)
+        goto nomem;
+
+    ret = _bucket_state_write(listing->status_ctx, bst, path, filebuf);
+    if (ret != EXIT_SUCCESS)
+        goto end;
+
+    cloudmig_log(DEBUG_LVL, "[Creating Bucket Status] Listing checkpoint: "
+                 "%u entries, %u directories left.\n",
+                 bst->n_entries, frontier->n_dirs);
+    listing->last_checkpoint = now;
+    listing->checkpointed = true;
+
+    ret = EXIT_SUCCESS;
+    goto end;
+
+nomem:
+    PRINTERR("[Creating Bucket Status] "
+             "Could not allocate the listing checkpoint.\n");
+    ret = EXIT_FAILURE;
+
+end:
+    if (jsckpt)
+        json_object_put(jsckpt);
+    if (filebuf)
+        free(filebuf);
+    if (path)
+        free(path);
+
+    return ret;
+}
+
+/*
+ * Restores the entries and the directories left to list from the checkpoint
+ * of an interrupted listing. Only the last segment, which may have grown
+ * since, is loaded: it is cut back to the entries of the checkpoint.
+ *
+ * @return  EXIT_FAILURE if the checkpoint does not match the segments stored.
+ */
+static int
+_bucket_listing_restore(struct bucket_listing *listing,
+                        struct json_object *jsckpt,
+                        const char *srcpath,
+                        struct bucket_frontier *frontier)
+{
+    struct bucket_status    *bst = listing->bst;
+    struct bucket_segment   *seg = NULL;
+    struct json_object      *jspending = NULL;
+    uint64_t                n_entries;
+    unsigned int            count = 0;
+    size_t                  off;
+    char                    *dirpath = NULL;
+
+    if (_bucket_json_check_field(jsckpt, CLOUDMIG_STATUS_LISTING_ENTRIES,
+                                 json_type_int, &n_entries) != EXIT_SUCCESS
+        || _bucket_json_check_field(jsckpt, CLOUDMIG_STATUS_LISTING_OBJECTS,
+                                    json_type_int, &listing->count) != EXIT_SUCCESS
+        || _bucket_json_check_field(jsckpt, CLOUDMIG_STATUS_LISTING_BYTES,
+                                    json_type_int, &listing->size) != EXIT_SUCCESS
+        || _bucket_json_check_field(jsckpt, CLOUDMIG_STATUS_LISTING_PENDING,
+                                    json_type_array, &jspending) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+
+    while (bst->n_entries < n_entries)
+    {
+        if (_bucket_segment_append(bst) != EXIT_SUCCESS)
+            return EXIT_FAILURE;
+        seg = &bst->segments[bst->n_segments - 1];
+        seg->loaded = false;
+        seg->dirty = false;
+        count = n_entries - bst->n_entries;
+        if (count > bst->segment_size)
+            count = bst->segment_size;
+        bst->n_entries += count;
+    }
+
+    // Only a partial segment is appended to when the listing resumes.
+    if (seg && count < bst->segment_size)
+    {
+        if (_bucket_segment_fetch(bst, bst->n_segments - 1) != EXIT_SUCCESS)
+            return EXIT_FAILURE;
+        if (seg->n_entries < count)
+        {
+            PRINTERR("[Creating Bucket Status] Segment %u of %s holds %u entries"
+                     " instead of at least %u.\n", bst->n_segments - 1,
+                     bst->path, seg->n_entries, count);
+            return EXIT_FAILURE;
+        }
+        if (count < seg->n_entries)
+        {
+            seg->paths.len = seg->entries[count].path;
+            seg->n_entries = count;
+        }
+        seg->last.len = 0;
+        if (_bucket_segment_path_get(seg, count - 1, &seg->last, &off) != EXIT_SUCCESS)
+            return EXIT_FAILURE;
+        seg->last.len -= 1;
+        seg->loaded = true;
+        seg->dirty = true;
+    }
+
+    for (int i=0; i < json_object_array_length(jspending); ++i)
+    {
+        if (asprintf(&dirpath, "%s%s", srcpath,
+                     json_object_get_string(json_object_array_get_idx(jspending, i))) <= 0)
+        {
+            PRINTERR("[Creating Bucket Status] Could not allocate directory path.\n");
+            return EXIT_FAILURE;
+        }
+        if (_bucket_frontier_push(frontier, dirpath) != EXIT_SUCCESS)
+        {
+            free(dirpath);
+            return EXIT_FAILURE;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Lists a source recursively, resuming from the checkpoint of an interrupted
+ * listing if any, and checkpointing the listing periodically. A directory is
+ * the unit of the checkpoints, as a directory listing can not be resumed.
+ */
+static int
+_bucket_listing_run(struct bucket_listing *listing,
+                    const struct bucket_crawl *crawl, const char *srcpath)
+{
+    int                     ret = EXIT_FAILURE;
+    struct bucket_status    *bst = listing->bst;
+    struct bucket_frontier  frontier = { NULL, 0, 0 };
+    struct json_object      *jsckpt = NULL;
+    char                    *path = NULL;
+    char                    *dirpath = NULL;
+
+    path = _bucket_listing_path(bst);
+    if (path == NULL)
+        goto end;
+
+    if (_bucket_state_read(listing->status_ctx, path, &jsckpt) != EXIT_SUCCESS)
+        goto end;
+    if (jsckpt)
+    {
+        listing->checkpointed = true;
+        if (_bucket_listing_restore(listing, jsckpt, srcpath, &frontier)
+            == EXIT_SUCCESS)
+        {
+            cloudmig_log(INFO_LVL, "[Creating Bucket Status] Resuming the listing"
+                         " of %s: %u entries, %u directories left.\n",
+                         srcpath, bst->n_entries, frontier.n_dirs);
+        }
+        else
+        {
+            cloudmig_log(WARN_LVL, "[Creating Bucket Status] Discarding the"
+                         " listing checkpoint of %s.\n", srcpath);
+            for (unsigned int i=0; i < bst->n_segments; ++i)
+                _bucket_segment_release(&bst->segments[i]);
+            bst->n_segments = 0;
+            bst->n_entries = 0;
+            listing->count = 0;
+            listing->size = 0;
+            _bucket_frontier_release(&frontier);
+            json_object_put(jsckpt);
+            jsckpt = NULL;
+        }
+    }
+    if (jsckpt == NULL)
+    {
+        dirpath = strdup(srcpath);
+        if (dirpath == NULL || _bucket_frontier_push(&frontier, dirpath) != EXIT_SUCCESS)
+        {
+            PRINTERR("[Creating Bucket Status] Could not allocate source path.\n");
+            free(dirpath);
+            goto end;
+        }
+    }
+
+    listing->baselen = strlen(srcpath);
+    listing->last_checkpoint = time(NULL);
+    ret = _bucket_recurse(crawl, &frontier, listing->baselen,
+                          &_bucket_create_visit, &_bucket_listing_checkpoint,
+                          listing);
+
+end:
+    _bucket_frontier_release(&frontier);
+    if (jsckpt)
+        json_object_put(jsckpt);
+    if (path)
+        free(path);
+
+    return ret;
+}
+
+/*
+ * An inventory lists the objects of a source bucket, one per line, as
+ * tab-separated fields:
+ *
+ *   path  size  type  [checksum]
+ *
+ * The path is relative to the bucket, the directories ending with a '/', the
+ * size is in bytes and the type is one of "file", "dir" or "symlink". The
+ * checksum is accepted for compatibility with the inventory tools, but
+ * unused. Empty lines are skipped.
+ *
+ * The inventory is read line by line: only the front-coded segments it fills
+ * are ever held in memory.
+ */
+#define CLOUDMIG_INVENTORY_BUFSIZE  (1024*1024)
+
+static int
+_bucket_inventory_type(const char *name, dpl_ftype_t *typep)
+{
+    if (strcmp(name, "file") == 0)
+        *typep = DPL_FTYPE_REG;
+    else if (strcmp(name, "dir") == 0)
+        *typep = DPL_FTYPE_DIR;
+    else if (strcmp(name, "symlink") == 0)
+        *typep = DPL_FTYPE_SYMLINK;
+    else
+        return EXIT_FAILURE;
+
+    return EXIT_SUCCESS;
+}
+
+/*
+ * The inventories of object stores hold no directories: the directories of
+ * an object are added before it, when not added before, so that they are
+ * migrated before their children. This relies on the inventory being sorted,
+ * as it is then the case of the paths of any directory.
+ *
+ * @return  1 if the entry is a directory already added, 0 if it is to be
+ *          added, -1 on failure
+ */
+static int
+_bucket_inventory_parents(struct bucket_listing *listing,
+                          struct status_buffer *prev,
+                          struct status_buffer *curdir,
+                          const char *path, dpl_ftype_t type, bool *sortedp)
+{
+    size_t      len = strlen(path);
+    size_t      dirlen = len;
+    size_t      common;
+    char        *dir = NULL;
+
+    if (prev->len && strcmp(prev->data, path) >= 0)
+    {
+        *sortedp = false;
+        return 0;
+    }
+    prev->len = 0;
+    if (_bucket_buffer_reserve(prev, len + 1) != EXIT_SUCCESS)
+        return -1;
+    memcpy(prev->data, path, len + 1);
+    prev->len = len + 1;
+
+    while (dirlen > 0 && path[dirlen - 1] != '/')
+        --dirlen;
+    common = _bucket_common_dirs(curdir, path, dirlen);
+
+    curdir->len = 0;
+    if (_bucket_buffer_reserve(curdir, dirlen + 1) != EXIT_SUCCESS)
+        return -1;
+    memcpy(curdir->data, path, dirlen);
+    curdir->len = dirlen;
+
+    // The directory of the entry itself, if any, is added below.
+    if (type == DPL_FTYPE_DIR && dirlen == len && common < dirlen)
+        --dirlen;
+    else if (type == DPL_FTYPE_DIR && dirlen == len)
+        return 1;
+
+    dir = curdir->data;
+    for (size_t end=common; end < dirlen; ++end)
+    {
+        if (dir[end] != '/')
+            continue ;
+        dir[end + 1] = 0;
+        if (_bucket_add_entry(listing->bst, dir, 0, DPL_FTYPE_DIR, 0)
+            != EXIT_SUCCESS)
+            return -1;
+        dir[end + 1] = path[end + 1];
+        listing->count += 1;
+    }
+
+    return 0;
+}
+
+static int
+_bucket_inventory_read(struct bucket_listing *listing,
+                       struct cloudmig_filter *filter, const char *invpath)
+{
+    int                     ret = EXIT_FAILURE;
+    FILE                    *inv = NULL;
+    char                    *line = NULL;
+    size_t                  linesize = 0;
+    ssize_t                 len;
+    uint64_t                lineno = 0;
+    char                    *fields[4];
+    int                     n_fields;
+    char                    *end = NULL;
+    unsigned long long      size;
+    dpl_ftype_t             type;
+    int                     iret;
+    bool                    sorted = true;
+    struct status_buffer    prev = { NULL, 0, 0 };
+    struct status_buffer    curdir = { NULL, 0, 0 };
+
+    inv = fopen(invpath, "r");
+    if (inv == NULL)
+    {
+        PRINTERR("[Creating Bucket Status] Could not open inventory %s: %s.\n",
+                 invpath, strerror(errno));
+        goto end;
+    }
+    (void)setvbuf(inv, NULL, _IOFBF, CLOUDMIG_INVENTORY_BUFSIZE);
+
+    while ((len = getline(&line, &linesize, inv)) != -1)
+    {
+        ++lineno;
+        if (len > 0 && line[len - 1] == '\n')
+            line[--len] = 0;
+        if (len > 0 && line[len - 1] == '\r')
+            line[--len] = 0;
+        if (len == 0)
+            continue ;
+
+        fields[0] = line;
+        for (n_fields = 1; n_fields < 4; ++n_fields)
+        {
+            fields[n_fields] = strchr(fields[n_fields - 1], '\t');
+            if (fields[n_fields] == NULL)
+                break ;
+            *fields[n_fields]++ = 0;
+        }
+
+        if (n_fields < 3 || *fields[0] == 0)
+        {
+            PRINTERR("[Creating Bucket Status] %s:%"PRIu64": "
+                     "Expected a path, a size and a type.\n", invpath, lineno);
+            goto end;
+        }
+
+        errno = 0;
+        size = strtoull(fields[1], &end, 10);
+        if (*fields[1] == 0 || *fields[1] == '-' || *end != 0 || errno == ERANGE)
+        {
+            PRINTERR("[Creating Bucket Status] %s:%"PRIu64": "
+                     "Invalid size '%s'.\n", invpath, lineno, fields[1]);
+            goto end;
+        }
+
+        if (_bucket_inventory_type(fields[2], &type) != EXIT_SUCCESS)
+        {
+            PRINTERR("[Creating Bucket Status] %s:%"PRIu64": "
+                     "Invalid type '%s'.\n", invpath, lineno, fields[2]);
+            goto end;
+        }
+
+        // The modification time is unknown: a resync only compares the sizes.
+        if (!filter_match_tree(filter, fields[0], type, size, 0))
+            continue ;
+
+        if (sorted)
+        {
+            iret = _bucket_inventory_parents(listing, &prev, &curdir,
+                                             fields[0], type, &sorted);
+            if (iret < 0)
+                goto end;
+            if (iret > 0)
+                continue ;
+            if (!sorted)
+                cloudmig_log(WARN_LVL, "[Creating Bucket Status] %s:%"PRIu64": "
+                             "Inventory not sorted, the directories of the"
+                             " objects are not added anymore.\n", invpath, lineno);
+        }
+
+        if (_bucket_add_entry(listing->bst, fields[0], size, type, 0)
+            != EXIT_SUCCESS)
+            goto end;
+        listing->count += 1;
+        listing->size += size;
+    }
+
+    if (ferror(inv))
+    {
+        PRINTERR("[Creating Bucket Status] Could not read inventory %s: %s.\n",
+                 invpath, strerror(errno));
+        goto end;
+    }
+
+    ret = EXIT_SUCCESS;
+
+end:
+    free(line);
+    free(prev.data);
+    free(curdir.data);
+    if (inv)
+        fclose(inv);
+
+    return ret;
+}
+
+struct bucket_status*
+status_bucket_create(dpl_ctx_t *status_ctx, const struct bucket_crawl *crawl,
+                     char *storepath, char *srcpath, char *dstpath,
+                     const char *inventory,
+                     uint64_t *countp, uint64_t *sizep)
+{
+    struct bucket_status    *ret = NULL;
+    int                     iret;
+    dpl_status_t            dplret = DPL_SUCCESS;
+    struct bucket_status    *sbucket = NULL;
+    struct bucket_listing   listing = CLOUDMIG_LISTING_INITIALIZER;
+    char                    *bcktdir = NULL;
+    char                    *ckptpath = NULL;
+
+    cloudmig_log(DEBUG_LVL, "[Creating Bucket Status] "
+                 "Creating status file for bucket '%s'...\n", srcpath);
+
+    sbucket = status_bucket_new();
+    if (sbucket == NULL)
+        goto end;
+    sbucket->status_ctx = status_ctx;
+
+    iret = _bucket_set_paths(sbucket, storepath, srcpath, dstpath);
+    if (iret != EXIT_SUCCESS)
+        goto end;
+
+    bcktdir = _bucket_dirpath(sbucket->path);
+    if (bcktdir == NULL)
+        goto end;
+
+    /*
+     * The segments are stored within the bucket's directory, and the manifest
+     * is uploaded last: a bucket status only exists once complete. Until
+     * then, a recursive listing is checkpointed there too.
+     */
+    dplret = dpl_mkdir(status_ctx, bcktdir, NULL/*MD*/, NULL/*sysmd*/);
+    if (dplret != DPL_SUCCESS && dplret != DPL_EEXIST)
+    {
+        PRINTERR("[Creating Bucket Status] Could not mkdir '%s': %s.\n",
+                 bcktdir, dpl_status_str(dplret));
+        goto end;
+    }
+
+    listing.bst = sbucket;
+    listing.status_ctx = status_ctx;
+    if (inventory)
+        iret = _bucket_inventory_read(&listing, crawl->filter, inventory);
+    else if (crawl->listing == LISTING_RECURSIVE)
+        iret = _bucket_listing_run(&listing, crawl, srcpath);
+    else
+        iret = _bucket_crawl(crawl, srcpath, &_bucket_create_visit, &listing);
+    if (iret != EXIT_SUCCESS)
+        goto end;
+
+    iret = _bucket_set_infos(sbucket, listing.count, listing.size);
+    if (iret != EXIT_SUCCESS)
+        goto end;
+    sbucket->loaded = true;
+    sbucket->partial_known = true;
+
+    if (_bucket_upload(status_ctx, sbucket) != EXIT_SUCCESS)
+    {
+        PRINTERR("%s: Could not create bucket %s's status file at %s.\n",
+                 __FUNCTION__, srcpath, sbucket->path);
+        goto end;
+    }
+
+    if (listing.checkpointed)
+    {
+        ckptpath = _bucket_listing_path(sbucket);
+        if (ckptpath)
+            _bucket_state_unlink(status_ctx, sbucket, ckptpath);
+    }
+
+    cloudmig_log(DEBUG_LVL, "[Creating Bucket Status] Bucket %s: SUCCESS.\n",
+                 srcpath);
+
+    *countp = listing.count;
+    *sizep = listing.size;
+
+    ret = sbucket;
+    sbucket = NULL;
+
+end:
+    if (sbucket != NULL)
+        status_bucket_free(sbucket);
+    if (bcktdir)
+        free(bcktdir);
+    if (ckptpath)
+        free(ckptpath);
+
+    return ret;
+}
+
+void
+status_bucket_delete(dpl_ctx_t *status_ctx, struct bucket_status *bst)
+{
+    char    *segpath = NULL;
+
+    _bucket_lock(bst);
+    segpath = _bucket_states_path(bst);
+    if (segpath)
+        delete_file(status_ctx, "Status Bucket States", segpath);
+    free(segpath);
+    // Without a manifest, the segments can not be known: delete what we can.
+    (void)_bucket_ensure_loaded(bst);
+    for (unsigned int i=0; i < bst->n_segments; ++i)
+    {
+        segpath = _bucket_segment_path(bst, i);
+        if (segpath)
+            delete_file(status_ctx, "Status Bucket Segment", segpath);
+        free(segpath);
+    }
+    {
+        char *dot = strrchr(bst->path, '.');
+        *dot = 0;
+        delete_directory(status_ctx, "Status Bucketdir", bst->path);
+        *dot = '.';
+    }
+    delete_file(status_ctx, "Status Bucket", bst->path);
+    _bucket_unlock(bst);
+}
+
+bool
+status_bucket_complete(struct bucket_status *bst)
+{
+    bool    complete;
+
+    _bucket_lock(bst);
+    complete = bst->complete;
+    _bucket_unlock(bst);
+
+    return complete;
+}
+
+void
+status_bucket_get(struct bucket_status *bst)
+{
+    _bucket_lock(bst);
+    bst->refcount += 1;
+    _bucket_unlock(bst);
+}
+
+void
+status_bucket_release(struct bucket_status *bst)
+{
+    _bucket_lock(bst);
+    assert(bst->refcount > 0);
+    bst->refcount -= 1;
+    _bucket_unlock(bst);
+}
+
+void
+status_bucket_reset_iteration(struct bucket_status *bst)
+{
+    _bucket_lock(bst);
+    bst->next_entry = 0;
+    if (bst->claims)
+        bst->claims->split = false;
+    _bucket_unlock(bst);
+}
+
+int
+status_bucket_claims_init(struct bucket_status *bst, int n_workers)
+{
+    struct bucket_claims    *claims = NULL;
+
+    claims = calloc(1, sizeof(*claims));
+    if (claims == NULL)
+        goto err;
+    claims->ranges = calloc(n_workers, sizeof(*claims->ranges));
+    if (claims->ranges == NULL)
+        goto err;
+    claims->n_ranges = n_workers;
+
+    _bucket_lock(bst);
+    bst->claims = claims;
+    _bucket_unlock(bst);
+
+    return EXIT_SUCCESS;
+
+err:
+    PRINTERR("[Bucket Status] Could not allocate the claim ranges.\n");
+    if (claims)
+        free(claims);
+
+    return EXIT_FAILURE;
+}
+
+/*
+ * The entries having an intermediary state are also indexed in memory, and
+ * the index is persisted within the manifest: resuming a bucket only looks up
+ * the states of the entries it holds, and the table of the states of a bucket
+ * without any partial entry is never even loaded.
+ */
+static bool
+_bucket_partial_find(struct bucket_status *bst, unsigned int idx,
+                     unsigned int *posp)
+{
+    unsigned int    lo = 0;
+    unsigned int    hi = bst->n_partial;
+    unsigned int    mid;
+
+    while (lo < hi)
+    {
+        mid = lo + (hi - lo) / 2;
+        if (bst->partial[mid] < idx)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if (posp)
+        *posp = lo;
+
+    return lo < bst->n_partial && bst->partial[lo] == idx;
+}
+
+/*
+ * Adds an entry to the index of the partial entries.
+ * @return  1 if added, 0 if already in it, -1 on failure
+ */
+static int
+_bucket_partial_add(struct bucket_status *bst, unsigned int idx)
+{
+    unsigned int    pos;
+    unsigned int    size;
+    unsigned int    *partial = NULL;
+
+    if (_bucket_partial_find(bst, idx, &pos))
+        return 0;
+
+    if (bst->n_partial == bst->partial_size)
+    {
+        size = bst->partial_size ? bst->partial_size * 2 : 16;
+        partial = realloc(bst->partial, sizeof(*partial) * size);
+        if (partial == NULL)
+        {
+            PRINTERR("[Bucket Status] Could not grow index of partial entries.\n");
+            return -1;
+        }
+        bst->partial = partial;
+        bst->partial_size = size;
+    }
+
+    memmove(&bst->partial[pos + 1], &bst->partial[pos],
+            sizeof(*bst->partial) * (bst->n_partial - pos));
+    bst->partial[pos] = idx;
+    bst->n_partial += 1;
+
+    return 1;
+}
+
+static void
+_bucket_partial_del(struct bucket_status *bst, unsigned int idx)
+{
+    unsigned int    pos;
+
+    if (!_bucket_partial_find(bst, idx, &pos))
+        return ;
+
+    memmove(&bst->partial[pos], &bst->partial[pos + 1],
+            sizeof(*bst->partial) * (bst->n_partial - pos - 1));
+    bst->n_partial -= 1;
+    bst->manifest_dirty = true;
+}
+
+/*
+ * Reads the index of the partial entries from the manifest.
+ */
+static int
+_bucket_partial_load(struct bucket_status *bst, struct json_object *array,
+                     uint64_t count)
+{
+    struct json_object  *item = NULL;
+    int64_t             idx;
+
+    if (!json_object_is_type(array, json_type_array))
+    {
+        PRINTERR("[Loading Bucket Status] "
+                 "Field '"CLOUDMIG_STATUS_BUCKET_PARTIAL"' is not an array.\n");
+        return EXIT_FAILURE;
+    }
+
+    for (int i=0; i < json_object_array_length(array); ++i)
+    {
+        item = json_object_array_get_idx(array, i);
+        idx = json_object_get_int64(item);
+        if (!json_object_is_type(item, json_type_int)
+            || idx < 0 || (uint64_t)idx >= count)
+        {
+            PRINTERR("[Loading Bucket Status] Invalid partial entry.\n");
+            return EXIT_FAILURE;
+        }
+        if (_bucket_partial_add(bst, idx) == -1)
+            return EXIT_FAILURE;
+    }
+    bst->partial_known = true;
+
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Records the index of the partial entries within the manifest.
+ */
+static int
+_bucket_set_partial(struct bucket_status *bst)
+{
+    struct json_object  *array = NULL;
+    struct json_object  *item = NULL;
+
+    array = json_object_new_array();
+    if (array == NULL)
+        goto err;
+
+    for (unsigned int i=0; i < bst->n_partial; ++i)
+    {
+        item = json_object_new_int64(bst->partial[i]);
+        if (item == NULL)
+            goto err;
+        json_object_array_add(array, item);
+    }
+
+    json_object_object_del(bst->json, CLOUDMIG_STATUS_BUCKET_PARTIAL);
+    json_object_object_add(bst->json, CLOUDMIG_STATUS_BUCKET_PARTIAL, array);
+
+    return EXIT_SUCCESS;
+
+err:
+    PRINTERR("[Uploading Bucket Status] Could not create JSON array.\n");
+    if (array)
+        json_object_put(array);
+    return EXIT_FAILURE;
+}
+
+/*
+ * The intermediary states of the entries being transferred are kept within a
+ * single table per bucket status, indexed by entry: only the entries known to
+ * be partial have a state, and claiming an entry only looks it up in memory.
+ *
+ * In cooperative mode, other processes update the states of their own entries
+ * concurrently: each entry then keeps its own state file instead.
+ */
+static char*
+_bucket_states_path(struct bucket_status *bst)
+{
+    char    *path = NULL;
+
+    if (asprintf(&path, "%.*s/"CLOUDMIG_STATUS_STATES_FILE,
+                 (int)(strlen(bst->path) - strlen(CLOUDMIG_STATUS_BUCKET_FILEEXT)),
+                 bst->path) <= 0)
+    {
+        PRINTERR("Could not allocate memory for bucket states path.\n");
+        return NULL;
+    }
+
+    return path;
+}
+
+/*
+ * Reads a state file. A missing file is not an error: *jsonp is then NULL.
+ */
+static int
+_bucket_state_read(dpl_ctx_t *status_ctx, const char *path,
+                   struct json_object **jsonp)
+{
+    int                 ret = EXIT_FAILURE;
+    dpl_status_t        dplret;
+    char                *buffer = NULL;
+    unsigned int        bufsize;
+    struct json_tokener *tokener = NULL;
+
+    *jsonp = NULL;
+
+    dplret = status_codec_get(status_ctx, path, &buffer, &bufsize);
+    if (dplret != DPL_SUCCESS)
+    {
+        if (dplret != DPL_ENOENT)
+        {
+            PRINTERR("[Bucket Status Loading Object] "
+                     "Could not get state file %s: %s.\n",
+                     path, dpl_status_str(dplret));
+            ret = EXIT_FAILURE;
+            goto end;
+        }
+
+        // No intermediary state, not an error.
+        ret = EXIT_SUCCESS;
+        goto end;
+    }
+
+    tokener = json_tokener_new();
+    if (tokener == NULL)
+    {
+        PRINTERR("[Bucket Status Loading Object] Could not allocate JSON tokener.\n");
+        ret = EXIT_FAILURE;
+        goto end;
+    }
+
+    *jsonp = json_tokener_parse_ex(tokener, buffer, bufsize);
+    if (*jsonp == NULL)
+    {
+        PRINTERR("[Bucket Status Loading Object] Could not parse JSON.\n");
+        ret = EXIT_FAILURE;
+        goto end;
+    }
+
+    ret = EXIT_SUCCESS;
+
+end:
+    if (tokener)
+        json_tokener_free(tokener);
+    if (buffer)
+        free(buffer);
+
+    return ret;
+}
+
+/*
+ * Writes a state file, through the status log if enabled.
+ */
+static int
+_bucket_state_write(dpl_ctx_t *status_ctx, struct bucket_status *bst,
+                    const char *path, const char *filebuf)
+{
+    dpl_status_t    dplret;
+
+    if (bst->wal)
+        return status_wal_put(bst->wal, path, filebuf);
+
+    dplret = status_codec_put(status_ctx, path, filebuf, strlen(filebuf));
+    if (dplret != DPL_SUCCESS)
+    {
+        PRINTERR("[Bucket Status Entry Update] "
+                 "Could not upload state file %s: %s.\n",
+                 path, dpl_status_str(dplret));
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+static void
+_bucket_state_unlink(dpl_ctx_t *status_ctx, struct bucket_status *bst,
+                     const char *path)
+{
+    dpl_status_t            dplret;
+
+    if (bst->wal)
+    {
+        (void)status_wal_unlink(bst->wal, path);
+        return ;
+    }
+
+    dplret = dpl_unlink(status_ctx, path);
+    if (dplret != DPL_SUCCESS)
+    {
+        if (dplret != DPL_ENOENT)
+        {
+            cloudmig_log(WARN_LVL, "[Bucket Status Entry Complete] "
+                         "Could not delete the temp status file %s: %s",
+                         path, dpl_status_str(dplret));
+        }
+    }
+}
+
+/*
+ * Copies a state, so that the table never shares objects with the
+ * filestates, which the workers modify without holding the bucket lock.
+ */
+static struct json_object*
+_bucket_state_copy(struct json_object *state)
+{
+    struct json_object  *copy = NULL;
+
+    copy = json_tokener_parse(json_object_to_json_string(state));
+    if (copy == NULL)
+        PRINTERR("[Bucket Status Entry Update] Could not copy entry state.\n");
+
+    return copy;
+}
+
+static int
+_bucket_state_parse(struct json_object *json,
+                    struct file_transfer_state *filestate)
+{
+    struct json_object  *srcstate = NULL;
+    struct json_object  *dststate = NULL;
+    struct json_object  *objoff = NULL;
+
+    if (json_object_object_get_ex(json, "offset", &objoff) == FALSE)
+    {
+        PRINTERR("[Bucket Status Loading Object] Could find 'offset' field in JSON.\n");
+        return EXIT_FAILURE;
+    }
+
+    if (json_object_object_get_ex(json, "rstatus", &srcstate) == FALSE)
+    {
+        PRINTERR("[Bucket Status Loading Object] Could find 'rstatus' field in JSON.\n");
+        return EXIT_FAILURE;
+    }
+
+    if (json_object_object_get_ex(json, "wstatus", &dststate) == FALSE)
+    {
+        PRINTERR("[Bucket Status Loading Object] Could find 'wstatus' field in JSON.\n");
+        return EXIT_FAILURE;
+    }
+
+    filestate->fixed.offset = json_object_get_int64(objoff);
+    filestate->rstatus = json_object_get(srcstate);
+    filestate->wstatus = json_object_get(dststate);
+
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Imports into the table the states written as one file per entry by the
+ * previous versions, and removes those files once the table is saved.
+ * The bucket status lock must be held by the caller.
+ */
+static int
+_bucket_states_import(struct bucket_status *bst, const char *statespath)
+{
+    int                 ret = EXIT_FAILURE;
+    dpl_status_t        dplret;
+    dpl_dirent_t        dirent;
+    void                *dir_hdl = NULL;
+    char                *bcktdir = NULL;
+    char                *path = NULL;
+    char                *end = NULL;
+    char                key[32];
+    unsigned long       idx;
+    struct json_object  *imported = NULL;
+    struct json_object  *state = NULL;
+    struct json_object  *field = NULL;
+    const char          *filebuf = NULL;
+
+    bcktdir = _bucket_dirpath(bst->path);
+    if (bcktdir == NULL)
+        goto end;
+
+    imported = json_object_new_array();
+    if (imported == NULL)
+    {
+        PRINTERR("[Bucket Status States] Could not allocate JSON array.\n");
+        goto end;
+    }
+
+    dplret = dpl_opendir(bst->status_ctx, bcktdir, &dir_hdl);
+    if (dplret != DPL_SUCCESS)
+    {
+        // No bucket directory means that no state was ever written.
+        if (dplret == DPL_ENOENT)
+            ret = EXIT_SUCCESS;
+        else
+            PRINTERR("[Bucket Status States] Could not list %s: %s.\n",
+                     bcktdir, dpl_status_str(dplret));
+        goto end;
+    }
+
+    while (!dpl_eof(dir_hdl))
+    {
+        dplret = dpl_readdir(dir_hdl, &dirent);
+        if (dplret != DPL_SUCCESS)
+        {
+            PRINTERR("[Bucket Status States] Could not list %s: %s.\n",
+                     bcktdir, dpl_status_str(dplret));
+            goto end;
+        }
+
+        // Those states were named after their entry: "<idx>.json"
+        idx = strtoul(dirent.name, &end, 10);
+        if (end == dirent.name || strcmp(end, CLOUDMIG_STATUS_BUCKET_FILEEXT) != 0
+            || idx >= bst->n_entries)
+            continue ;
+
+        if (asprintf(&path, "%s/%s", bcktdir, dirent.name) <= 0)
+        {
+            path = NULL;
+            PRINTERR("[Bucket Status States] Could not allocate state path.\n");
+            goto end;
+        }
+
+        if (_bucket_state_read(bst->status_ctx, path, &state) != EXIT_SUCCESS)
+            goto end;
+        if (state)
+        {
+            snprintf(key, sizeof(key), "%lu", idx);
+            json_object_object_add(bst->states, key, state);
+            state = NULL;
+
+            field = json_object_new_string(path);
+            if (field == NULL)
+            {
+                PRINTERR("[Bucket Status States] Could not allocate JSON string.\n");
+                goto end;
+            }
+            json_object_array_add(imported, field);
+        }
+        free(path);
+        path = NULL;
+    }
+
+    if (json_object_array_length(imported) > 0)
+    {
+        filebuf = json_object_to_json_string(bst->states);
+        if (filebuf == NULL
+            || _bucket_state_write(bst->status_ctx, bst, statespath, filebuf) != EXIT_SUCCESS)
+            goto end;
+
+        for (int i=0; i < json_object_array_length(imported); ++i)
+            _bucket_state_unlink(bst->status_ctx, bst,
+                json_object_get_string(json_object_array_get_idx(imported, i)));
+
+        cloudmig_log(INFO_LVL, "[Bucket Status States] "
+                     "Imported %i intermediary states into %s.\n",
+                     json_object_array_length(imported), statespath);
+    }
+
+    ret = EXIT_SUCCESS;
+
+end:
+    if (dir_hdl)
+        dpl_closedir(dir_hdl);
+    if (path)
+        free(path);
+    if (imported)
+        json_object_put(imported);
+    if (bcktdir)
+        free(bcktdir);
+
+    return ret;
+}
+
+/*
+ * Loads the table of the intermediary states on its first use.
+ * The bucket status lock must be held by the caller.
+ */
+static int
+_bucket_states_load(struct bucket_status *bst)
+{
+    int                 ret = EXIT_FAILURE;
+    char                *path = NULL;
+    struct json_object  *states = NULL;
+
+    if (bst->states)
+        return EXIT_SUCCESS;
+
+    path = _bucket_states_path(bst);
+    if (path == NULL)
+        goto end;
+
+    if (_bucket_state_read(bst->status_ctx, path, &states) != EXIT_SUCCESS)
+        goto end;
+
+    if (states == NULL)
+    {
+        bst->states = json_object_new_object();
+        if (bst->states == NULL)
+        {
+            PRINTERR("[Bucket Status States] Could not allocate JSON object.\n");
+            goto end;
+        }
+        if (_bucket_states_import(bst, path) != EXIT_SUCCESS)
+        {
+            json_object_put(bst->states);
+            bst->states = NULL;
+            goto end;
+        }
+    }
+    else if (!json_object_is_type(states, json_type_object))
+    {
+        PRINTERR("[Bucket Status States] States %s seem erroneous.\n", path);
+        goto end;
+    }
+    else
+    {
+        bst->states = states;
+        states = NULL;
+    }
+
+    // The index may predate some states, or not have been recorded at all.
+    json_object_object_foreach(bst->states, key, val)
+    {
+        (void)val;
+        switch (_bucket_partial_add(bst, strtoul(key, NULL, 10)))
+        {
+        case -1:
+            goto end;
+        case 1:
+            bst->manifest_dirty = true;
+            break ;
+        }
+    }
+    bst->partial_known = true;
+
+    ret = EXIT_SUCCESS;
+
+end:
+    if (states)
+        json_object_put(states);
+    if (path)
+        free(path);
+
+    return ret;
+}
+
+/*
+ * Uploads the table of the intermediary states, if it changed. The uploads are
+ * serialized, so that an older table can never overwrite a newer one.
+ *
+ * The whole table is uploaded at once: unless forced, the changes are only
+ * uploaded once per period, and not while another thread uploads them. The
+ * changes left behind are uploaded by a later checkpoint, or the last flush.
+ */
+static int
+_bucket_states_save(dpl_ctx_t *status_ctx, struct bucket_status *bst, bool force)
+{
+    int     ret = EXIT_FAILURE;
+    char    *path = NULL;
+    char    *filebuf = NULL;
+    bool    due;
+
+    _bucket_lock(bst);
+    due = bst->states_dirty
+          && (force || time(NULL) - bst->states_saved >= CLOUDMIG_STATUS_STATES_PERIOD);
+    _bucket_unlock(bst);
+    if (!due)
+        return EXIT_SUCCESS;
+
+    if (force)
+        pthread_mutex_lock(&bst->states_lock);
+    else if (pthread_mutex_trylock(&bst->states_lock) != 0)
+        return EXIT_SUCCESS;
+
+    path = _bucket_states_path(bst);
+    if (path == NULL)
+        goto end;
+
+    _bucket_lock(bst);
+    if (!bst->states_dirty)
+    {
+        _bucket_unlock(bst);
+        ret = EXIT_SUCCESS;
+        goto end;
+    }
+    /*
+     * The index must list every entry of the states uploaded, or their states
+     * would be ignored when resuming: it is uploaded first. The status log
+     * records it instead, before the states (see status_wal_partial).
+     */
+    if (bst->partial_dirty && bst->wal == NULL
+        && _bucket_upload(status_ctx, bst) != EXIT_SUCCESS)
+    {
+        _bucket_unlock(bst);
+        goto end;
+    }
+    filebuf = strdup(json_object_to_json_string(bst->states));
+    if (filebuf)
+    {
+        bst->states_dirty = false;
+        bst->states_saved = time(NULL);
+    }
+    _bucket_unlock(bst);
+    if (filebuf == NULL)
+    {
+        PRINTERR("[Bucket Status Entry Update] "
+                 "Could not allocate json string representation.\n");
+        goto end;
+    }
+
+    ret = _bucket_state_write(status_ctx, bst, path, filebuf);
+    if (ret != EXIT_SUCCESS)
+    {
+        _bucket_lock(bst);
+        bst->states_dirty = true;
+        _bucket_unlock(bst);
+    }
+
+end:
+    pthread_mutex_unlock(&bst->states_lock);
+    if (filebuf)
+        free(filebuf);
+    if (path)
+        free(path);
+
+    return ret;
+}
+
+static int
+_bucket_entry_load(dpl_ctx_t *status_ctx, struct bucket_status *bst,
+                   struct file_transfer_state *filestate)
+{
+    int                 ret = EXIT_FAILURE;
+    struct json_object  *json = NULL;
+    struct json_object  *state = NULL;
+    char                key[16];
+
+    if (bst->leases)
+    {
+        ret = _bucket_state_read(status_ctx, filestate->status_path, &json);
+        if (ret == EXIT_SUCCESS && json)
+            ret = _bucket_state_parse(json, filestate);
+        goto end;
+    }
+
+    _bucket_lock(bst);
+    // Only the entries within the index may have a state to resume from.
+    if (bst->partial_known
+        && !_bucket_partial_find(bst, filestate->state_idx, NULL))
+    {
+        _bucket_unlock(bst);
+        ret = EXIT_SUCCESS;
+        goto end;
+    }
+    ret = _bucket_states_load(bst);
+    snprintf(key, sizeof(key), "%u", filestate->state_idx);
+    if (ret == EXIT_SUCCESS
+        && json_object_object_get_ex(bst->states, key, &state))
+    {
+        json = _bucket_state_copy(state);
+        ret = json ? _bucket_state_parse(json, filestate) : EXIT_FAILURE;
+    }
+    _bucket_unlock(bst);
+
+end:
+    if (json)
+        json_object_put(json);
+
+    return ret;
+}
+
+
+int
+status_bucket_entry_update(dpl_ctx_t *status_ctx,
+                           struct file_transfer_state *filestate)
+{
+    int                     ret;
+    struct bucket_status    *bst = filestate->bst;
+    struct json_object      *json = NULL;
+    struct json_object      *field = NULL;
+    const char              *filebuf = NULL;
+    char                    key[16];
+    unsigned int            idx;
+    bool                    new_partial = false;
+
+    json = json_object_new_object();
+    if (json == NULL)
+    {
+        PRINTERR("[Bucket Status Entry Update] "
+                 "Could not allocate json object.\n");
+        ret = EXIT_FAILURE;
+        goto end;
+    }
+
+    field = json_object_new_int64(filestate->fixed.offset);
+    if (field == NULL)
+    {
+        PRINTERR("[Bucket Status Entry Update] "
+                 "Could not allocate json object.\n");
+        ret = EXIT_FAILURE;
+        goto end;
+    }
+    json_object_object_add(json, "offset", field);
+    field = NULL;
+
+    json_object_object_add(json, "rstatus", json_object_get(filestate->rstatus));
+    json_object_object_add(json, "wstatus", json_object_get(filestate->wstatus));
+
+    if (bst->leases)
+    {
+        filebuf = json_object_to_json_string(json);
+        if (filebuf == NULL)
+        {
+            PRINTERR("[Bucket Status Entry Update] "
+                     "Could not allocate json string representation.\n");
+            ret = EXIT_FAILURE;
+            goto end;
+        }
+        ret = _bucket_state_write(status_ctx, bst, filestate->status_path, filebuf);
+        goto end;
+    }
+
+    field = _bucket_state_copy(json);
+    if (field == NULL)
+    {
+        ret = EXIT_FAILURE;
+        goto end;
+    }
+
+    /*
+     * The first checkpoint of an entry adds it to the index, which is
+     * persisted before the states: an index listing an entry without a state
+     * is harmless, the contrary would lose the state.
+     */
+    _bucket_lock(bst);
+    ret = _bucket_states_load(bst);
+    if (ret == EXIT_SUCCESS)
+    {
+        snprintf(key, sizeof(key), "%u", filestate->state_idx);
+        json_object_object_add(bst->states, key, field);
+        field = NULL;
+        bst->states_dirty = true;
+
+        switch (_bucket_partial_add(bst, filestate->state_idx))
+        {
+        case -1:
+            ret = EXIT_FAILURE;
+            break ;
+        case 1:
+            bst->manifest_dirty = true;
+            bst->partial_dirty = true;
+            new_partial = true;
+            break ;
+        }
+    }
+    _bucket_unlock(bst);
+    if (ret != EXIT_SUCCESS)
+        goto end;
+
+    if (new_partial && bst->wal)
+    {
+        idx = filestate->state_idx;
+        ret = status_wal_partial(bst->wal, bst, &idx, 1);
+        if (ret != EXIT_SUCCESS)
+            goto end;
+    }
+
+    ret = _bucket_states_save(status_ctx, bst, false);
+
+end:
+    if (field)
+        json_object_put(field);
+    if (json)
+        json_object_put(json);
+
+    return ret;
+}
+
+/*
+ * Flags the entry as done within the in-memory status.
+ * The bucket status lock must be held by the caller.
+ */
+static int
+_bucket_entry_set_done(struct bucket_status *bst, int idx)
+{
+    int                     ret;
+    struct bucket_entry     *entry = NULL;
+
+    entry = _bucket_entry(bst, idx);
+    if (entry == NULL)
+    {
+        PRINTERR("[Bucket Status Entry Complete] "
+                 "Could not find entry %i.\n", idx);
+        ret = EXIT_FAILURE;
+        goto end;
+    }
+
+    if (!entry->done)
+    {
+        entry->done = true;
+        bst->segments[idx / bst->segment_size].n_done += 1;
+    }
+    bst->segments[idx / bst->segment_size].dirty = true;
+
+    ret = EXIT_SUCCESS;
+
+end:
+    return ret;
+}
+
+/*
+ * Once all the entries are known to be done, records it within the manifest,
+ * so that the next runs can skip the bucket without loading its segments.
+ * The bucket status lock must be held by the caller.
+ */
+static int
+_bucket_check_complete(struct bucket_status *bst)
+{
+    int                     ret;
+    uint64_t                n_done = 0;
+    struct json_object      *total = NULL;
+    struct json_object      *jsobjs = NULL;
+    struct json_object      *jsbytes = NULL;
+
+    if (bst->complete)
+    {
+        ret = EXIT_SUCCESS;
+        goto end;
+    }
+
+    // Entries not loaded may still be pending.
+    for (unsigned int i=0; i < bst->n_segments; ++i)
+    {
+        if (!bst->segments[i].loaded)
+        {
+            ret = EXIT_SUCCESS;
+            goto end;
+        }
+        n_done += bst->segments[i].n_done;
+    }
+    if (n_done < bst->n_entries)
+    {
+        ret = EXIT_SUCCESS;
+        goto end;
+    }
+
+    json_object_object_get_ex(bst->json, CLOUDMIG_STATUS_BUCKET_N_OBJS, &total);
+    jsobjs = json_object_new_int64(json_object_get_int64(total));
+    json_object_object_get_ex(bst->json, CLOUDMIG_STATUS_BUCKET_N_BYTES, &total);
+    jsbytes = json_object_new_int64(json_object_get_int64(total));
+    if (jsobjs == NULL || jsbytes == NULL)
+    {
+        PRINTERR("[Uploading Bucket Status] Could not create JSON int.\n");
+        ret = EXIT_FAILURE;
+        goto end;
+    }
+
+    json_object_object_del(bst->json, CLOUDMIG_STATUS_BUCKET_OBJSDONE);
+    json_object_object_add(bst->json, CLOUDMIG_STATUS_BUCKET_OBJSDONE, jsobjs);
+    json_object_object_del(bst->json, CLOUDMIG_STATUS_BUCKET_BYTESDONE);
+    json_object_object_add(bst->json, CLOUDMIG_STATUS_BUCKET_BYTESDONE, jsbytes);
+    jsobjs = NULL;
+    jsbytes = NULL;
+
+    bst->complete = true;
+    bst->manifest_dirty = true;
+
+    cloudmig_log(DEBUG_LVL, "[Uploading Bucket Status] "
+                 "All the entries of %s are done.\n", bst->path);
+
+    ret = EXIT_SUCCESS;
+
+end:
+    if (jsobjs)
+        json_object_put(jsobjs);
+    if (jsbytes)
+        json_object_put(jsbytes);
+
+    return ret;
+}
+
+/*
+ * Uploads the segments of the bucket status modified since their last upload,
+ * and then the manifest if needed.
+ * The bucket status lock must be held by the caller.
+ */
+static int
+_bucket_upload(dpl_ctx_t *status_ctx, struct bucket_status *bst)
+{
+    int                     ret;
+    dpl_status_t            dplret;
+    const char              *filebuf = NULL;
+    unsigned int            n_dirty = 0;
+
+    ret = _bucket_check_complete(bst);
+    if (ret != EXIT_SUCCESS)
+        goto end;
+
+    for (unsigned int i=0; i < bst->n_segments; ++i)
+    {
+        if (bst->segments[i].loaded && bst->segments[i].dirty)
+            ++n_dirty;
+    }
+
+    if (n_dirty > 1)
+    {
+        if (n_dirty > CLOUDMIG_STATUS_UPLOAD_THREADS)
+            n_dirty = CLOUDMIG_STATUS_UPLOAD_THREADS;
+        ret = _bucket_segments_upload_parallel(status_ctx, bst, n_dirty);
+        if (ret != EXIT_SUCCESS)
+            goto end;
+    }
+    else
+    {
+        for (unsigned int i=0; i < bst->n_segments; ++i)
+        {
+            if (!bst->segments[i].loaded || !bst->segments[i].dirty)
+                continue ;
+            ret = _bucket_segment_upload(status_ctx, bst, i, &bst->outbuf);
+            if (ret != EXIT_SUCCESS)
+                goto end;
+        }
+    }
+
+    if (bst->manifest_dirty)
+    {
+        if (bst->partial_known)
+        {
+            ret = _bucket_set_partial(bst);
+            if (ret != EXIT_SUCCESS)
+                goto end;
+        }
+
+        filebuf = json_object_to_json_string(bst->json);
+        if (filebuf == NULL)
+        {
+            PRINTERR("[Uploading Bucket Status] "
+                     "Could not allocate json string representation.\n");
+            ret = EXIT_FAILURE;
+            goto end;
+        }
+
+        dplret = status_codec_put(status_ctx, bst->path,
+                                  filebuf, strlen(filebuf));
+        if (dplret != DPL_SUCCESS)
+        {
+            PRINTERR("[Uploading Bucket Status] "
+                     "Could not upload bucket status manifest %s: %s.\n",
+                     bst->path, dpl_status_str(dplret));
+            ret = EXIT_FAILURE;
+            goto end;
+        }
+        bst->manifest_dirty = false;
+        bst->partial_dirty = false;
+    }
+
     ret = EXIT_SUCCESS;
 
-end:
-    if (json)
-        json_object_put(json);
+end:
+    return ret;
+}
+
+/*
+ * Unlink temp status (if any)
+ * We do it last, because if a previous operation fails,
+ * we may still have a temp status; helping us avoid having to upload again.
+ */
+static void
+_bucket_entry_unlink_state(dpl_ctx_t *status_ctx,
+                           struct file_transfer_state *filestate)
+{
+    struct bucket_status    *bst = filestate->bst;
+    bool                    removed = false;
+    char                    key[16];
+
+    if (bst->leases)
+    {
+        _bucket_state_unlink(status_ctx, bst, filestate->status_path);
+        return ;
+    }
+
+    snprintf(key, sizeof(key), "%u", filestate->state_idx);
+    _bucket_lock(bst);
+    if (bst->states && json_object_object_get_ex(bst->states, key, NULL))
+    {
+        json_object_object_del(bst->states, key);
+        bst->states_dirty = true;
+        removed = true;
+    }
+    // Persisted with the next upload of the manifest.
+    _bucket_partial_del(bst, filestate->state_idx);
+    _bucket_unlock(bst);
+
+    if (removed && _bucket_states_save(status_ctx, bst, false) != EXIT_SUCCESS)
+        cloudmig_log(WARN_LVL, "[Bucket Status Entry Complete] "
+                     "Could not remove the state of %s.\n", filestate->obj_path);
+}
+
+int
+status_bucket_mark_done(struct bucket_status *bst, unsigned int idx)
+{
+    int     ret;
+
+    _bucket_lock(bst);
+    ret = _bucket_ensure_loaded(bst);
+    if (ret == EXIT_SUCCESS)
+        ret = _bucket_entry_set_done(bst, idx);
+    _bucket_unlock(bst);
+
+    return ret;
+}
+
+int
+status_bucket_mark_partial(struct bucket_status *bst, unsigned int idx)
+{
+    int     ret;
+
+    _bucket_lock(bst);
+    ret = _bucket_ensure_loaded(bst);
+    // Without an index, the states are all looked at anyway.
+    if (ret == EXIT_SUCCESS && bst->partial_known)
+    {
+        switch (_bucket_partial_add(bst, idx))
+        {
+        case -1:
+            ret = EXIT_FAILURE;
+            break ;
+        case 1:
+            bst->manifest_dirty = true;
+            bst->partial_dirty = true;
+            break ;
+        }
+    }
+    _bucket_unlock(bst);
+
+    return ret;
+}
+
+int
+status_bucket_flush(dpl_ctx_t *status_ctx, struct bucket_status *bst)
+{
+    int     ret;
+
+    _bucket_lock(bst);
+    // A status never loaded was never modified either.
+    ret = bst->loaded ? _bucket_upload(status_ctx, bst) : EXIT_SUCCESS;
+    _bucket_unlock(bst);
+
+    if (ret == EXIT_SUCCESS)
+        ret = _bucket_states_save(status_ctx, bst, true);
 
     return ret;
 }
@@ -1184,13 +3908,9 @@ status_bucket_entry_complete(dpl_ctx_t *status_ctx,
                              struct file_transfer_state *filestate)
 {
     int                     ret;
-    dpl_status_t            dplret;
     struct bucket_status    *bst = filestate->bst;
     bool                    bucket_locked = false;
-    struct json_object      *objects = NULL;
-    struct json_object      *object = NULL;
-    struct json_object      *field = NULL;
-    const char              *filebuf = NULL;
+    unsigned int            idx;
 
     cloudmig_log(DEBUG_LVL, "[Bucket Status Entry Complete] "
                  "Saving completion of object '%s'...\n",
@@ -1202,114 +3922,223 @@ status_bucket_entry_complete(dpl_ctx_t *status_ctx,
     /*
      * Update json (in memory)
      */
-    if (json_object_object_get_ex(bst->json, CLOUDMIG_STATUS_BUCKET_OBJECTS, &objects) == FALSE
-        || !json_object_is_type(objects, json_type_array))
-    {
-        PRINTERR("[Bucket Status Entry Complete] "
-                 "Bad JSON format, could not find '%s' array.\n",
-                 CLOUDMIG_STATUS_BUCKET_OBJECTS);
-        ret = EXIT_FAILURE;
+    ret = _bucket_entry_set_done(bst, filestate->state_idx);
+    if (ret != EXIT_SUCCESS)
         goto end;
-    }
 
-    object = json_object_array_get_idx(objects, filestate->state_idx);
-    if (object == NULL)
+    /*
+     * Upload new json status, unless it is shared with cooperative processes:
+     * the completion is then recorded within the entry's lease.
+     */
+    if (bst->leases == NULL && bst->wal == NULL)
     {
-        PRINTERR("[Bucket Status Entry Complete] "
-                 "Bad JSON format, could not find object for entry.\n");
-        ret = EXIT_FAILURE;
-        goto end;
+        ret = _bucket_upload(status_ctx, bst);
+        if (ret != EXIT_SUCCESS)
+            goto end;
     }
 
-    field = json_object_new_boolean(TRUE);
-    if (field == NULL)
+    _bucket_unlock(bst);
+    bucket_locked = false;
+
+    idx = filestate->state_idx;
+    if (bst->leases)
     {
-        PRINTERR("[Bucket Status Entry Complete] "
-                 "Could not allocate new value.\n");
-        ret = EXIT_FAILURE;
-        goto end;
+        ret = status_lease_record_done(bst->leases, bst, &idx, 1);
+        if (ret != EXIT_SUCCESS)
+            goto end;
     }
-    json_object_object_del(object, CLOUDMIG_STATUS_BUCKETENTRY_DONE);
-    json_object_object_add(object, CLOUDMIG_STATUS_BUCKETENTRY_DONE, field);
-    
-
-    /*
-     * Upload new json status.
-     */
-    filebuf = json_object_to_json_string(bst->json);
-    if (filebuf == NULL)
+    else if (bst->wal)
     {
-        PRINTERR("[Bucket Status Entry Complete] "
-                 "Could not allocate json string representation.\n");
-        ret = EXIT_FAILURE;
-        goto end;
+        ret = status_wal_done(bst->wal, bst, &idx, 1);
+        if (ret != EXIT_SUCCESS)
+            goto end;
     }
 
-    dplret = dpl_fput(status_ctx, bst->path,
-                      NULL/*options*/, NULL/*condition*/, NULL/*range*/,
-                      NULL/*MD*/, NULL/*sysmd*/,
-                      (char*)filebuf, strlen(filebuf));
-    if (dplret != DPL_SUCCESS)
+    _bucket_entry_unlink_state(status_ctx, filestate);
+
+    ret = EXIT_SUCCESS;
+
+end:
+    if (bucket_locked)
+        _bucket_unlock(bst);
+
+    return ret;
+}
+
+int
+status_bucket_entries_complete(dpl_ctx_t *status_ctx,
+                               struct file_transfer_state **filestates,
+                               int n_entries)
+{
+    int                     ret = EXIT_SUCCESS;
+    struct bucket_status    *bst = NULL;
+    unsigned int            *idxs = NULL;
+    int                     n_idxs = 0;
+
+    cloudmig_log(DEBUG_LVL, "[Bucket Status Entry Complete] "
+                 "Saving completion of %i objects...\n", n_entries);
+
+    idxs = calloc(n_entries, sizeof(*idxs));
+    if (idxs == NULL)
     {
         PRINTERR("[Bucket Status Entry Complete] "
-                 "Could not upload new JSON bucket status %s.\n",
-                 bst->path);
-        ret = EXIT_FAILURE;
-        goto end;
+                 "Could not allocate entry indexes.\n");
+        return EXIT_FAILURE;
     }
 
-    _bucket_unlock(bst);
-    bucket_locked = false;
-
     /*
-     * Unlink temp status (if any)
-     * We do it last, because if a previous operation fails,
-     * we may still have a temp status; helping us avoid having to upload again.
+     * The entries may span multiple buckets: upload each bucket status once,
+     * after flagging all of its entries from the batch.
      */
-    dplret = dpl_unlink(status_ctx, filestate->status_path);
-    if (dplret != DPL_SUCCESS)
+    for (int i=0; i < n_entries; ++i)
     {
-        if (dplret != DPL_ENOENT)
+        bool    seen = false;
+
+        bst = filestates[i]->bst;
+        for (int j=0; j < i && !seen; ++j)
+            seen = (filestates[j]->bst == bst);
+        if (seen)
+            continue ;
+
+        n_idxs = 0;
+        _bucket_lock(bst);
+        for (int j=i; j < n_entries; ++j)
         {
-            cloudmig_log(WARN_LVL, "[Bucket Status Entry Complete] "
-                         "Could not delete the temp status file %s: %s",
-                         filestate->status_path, dpl_status_str(dplret));
+            if (filestates[j]->bst != bst)
+                continue ;
+            if (_bucket_entry_set_done(bst, filestates[j]->state_idx) != EXIT_SUCCESS)
+                ret = EXIT_FAILURE;
+            idxs[n_idxs++] = filestates[j]->state_idx;
         }
+        if (bst->leases == NULL && bst->wal == NULL
+            && _bucket_upload(status_ctx, bst) != EXIT_SUCCESS)
+            ret = EXIT_FAILURE;
+        _bucket_unlock(bst);
+
+        if (bst->leases
+            && status_lease_record_done(bst->leases, bst, idxs, n_idxs) != EXIT_SUCCESS)
+            ret = EXIT_FAILURE;
+        else if (bst->leases == NULL && bst->wal
+                 && status_wal_done(bst->wal, bst, idxs, n_idxs) != EXIT_SUCCESS)
+            ret = EXIT_FAILURE;
     }
 
-    ret = EXIT_SUCCESS;
+    /*
+     * Only the entries resumed from an intermediary state may have a temp
+     * status to remove: avoid one useless request per object for the others.
+     */
+    for (int i=0; i < n_entries; ++i)
+    {
+        if (filestates[i]->fixed.offset != 0
+            || filestates[i]->rstatus || filestates[i]->wstatus)
+            _bucket_entry_unlink_state(status_ctx, filestates[i]);
+    }
 
-end:
-    if (bucket_locked)
-        _bucket_unlock(bst);
+    free(idxs);
 
     return ret;
 }
+
+/*
+ * Appends the concatenation of a location and of the object path held at
+ * obj_off to the buffer, which was reserved beforehand.
+ */
+static size_t
+_bucket_entry_path_join(struct status_buffer *buf, const char *location,
+                        size_t obj_off, size_t objlen)
+{
+    size_t  off = buf->len;
+    size_t  loclen = strlen(location);
+
+    memcpy(buf->data + off, location, loclen);
+    memcpy(buf->data + off + loclen, buf->data + obj_off, objlen + 1);
+    buf->len += loclen + objlen + 1;
+
+    return off;
+}
+
+/*
+ * Materializes the paths of an entry within the paths buffer of the filestate,
+ * which is reused from one claimed entry to the next.
+ * The bucket status lock must be held by the caller.
+ */
+static int
+_bucket_entry_paths(struct bucket_status *bst, unsigned int idx,
+                    const char *srcpath, const char *dstpath,
+                    struct file_transfer_state *filestate)
+{
+    struct status_buffer    *buf = &filestate->paths;
+    size_t                  obj_off;
+    size_t                  src_off;
+    size_t                  dst_off;
+    size_t                  status_off;
+    size_t                  objlen;
+
+    buf->len = 0;
+    if (_bucket_segment_path_get(&bst->segments[idx / bst->segment_size],
+                                 idx % bst->segment_size, buf, &obj_off)
+        != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+    objlen = buf->len - obj_off - 1;
+
+    if (_bucket_buffer_reserve(buf, strlen(srcpath) + strlen(dstpath)
+                                    + 2 * objlen + strlen(bst->path) + 16)
+        != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+
+    /*
+     * Compute source and destination paths. The object path lives in the
+     * same buffer, hence the copies rather than a sprintf of the buffer into
+     * itself.
+     */
+    src_off = _bucket_entry_path_join(buf, srcpath, obj_off, objlen);
+    dst_off = _bucket_entry_path_join(buf, dstpath, obj_off, objlen);
+
+    // Compute state path
+    status_off = buf->len;
+    buf->len += sprintf(buf->data + status_off, "%.*s/%u%s",
+                        (int)(strlen(bst->path)
+                              - strlen(CLOUDMIG_STATUS_BUCKET_FILEEXT)),
+                        bst->path, idx, CLOUDMIG_STATUS_BUCKET_FILEEXT) + 1;
+
+    filestate->obj_path = buf->data + obj_off;
+    filestate->src_path = buf->data + src_off;
+    filestate->dst_path = buf->data + dst_off;
+    filestate->status_path = buf->data + status_off;
+
+    return EXIT_SUCCESS;
+}
+
 static int
 status_bucket_next_ex(dpl_ctx_t *status_ctx,
                       struct bucket_status *bst,
                       struct file_transfer_state *filestate,
                       int (*select)(uint64_t, bool),
-                      int do_load)
+                      int do_load,
+                      unsigned int *cursor,
+                      const unsigned int *end)
 {
     int                     ret;
     bool                    found = false;
     bool                    bucket_locked = false;
     unsigned int            cur_entry = 0;
-    struct json_object      *objects = NULL;
-    struct json_object      *obj = NULL;
+    struct bucket_entry     *entry = NULL;
     struct json_object      *objfield = NULL;
-    uint64_t                n_objects = 0;
     dpl_ftype_t             objtype = DPL_FTYPE_UNDEF;
     uint64_t                objsize = 0;
     bool                    objdone = 0;
-    const char              *objname = NULL;
     const char              *srcpath = NULL;
     const char              *dstpath = NULL;
 
     _bucket_lock(bst);
     bucket_locked = true;
 
+    if (_bucket_ensure_loaded(bst) != EXIT_SUCCESS)
+    {
+        ret = -1;
+        goto end;
+    }
+
     if (json_object_object_get_ex(bst->json,
                                   CLOUDMIG_STATUS_BUCKET_SRCPATH,
                                   &objfield) == FALSE
@@ -1334,90 +4163,29 @@ status_bucket_next_ex(dpl_ctx_t *status_ctx,
     }
     dstpath = json_object_get_string(objfield);
 
-    if (json_object_object_get_ex(bst->json,
-                                  CLOUDMIG_STATUS_BUCKET_OBJECTS,
-                                  &objects) == FALSE
-        || !json_object_is_type(objects, json_type_array))
-    {
-        PRINTERR("[Bucket Status Next Entry] "
-                 "Could not find object array within bucket's json status.\n");
-        ret = -1;
-        goto end;
-    }
-    n_objects = json_object_array_length(objects);
-    
     /*
-     * loop on the bucket state for each entry, until the end.
-     * The loop automatically advances the next_entry index within the bucket
-     * state descriptor.
+     * loop on the bucket state for each entry, until the end (of the bucket,
+     * or of the range given). The loop automatically advances the cursor,
+     * which the bucket lock protects.
      */
-    for (; bst->next_entry < n_objects;)
+    for (; *cursor < bst->n_entries && (end == NULL || *cursor < *end);)
     {
-        obj = json_object_array_get_idx(objects, bst->next_entry);
-        if (obj == NULL || !json_object_is_type(obj, json_type_object))
-        {
-            PRINTERR("[Bucket Status Next Entry] "
-                     "Could not find object within bucket's json status: "
-                     "Erroneous array index.\n");
-            ret = -1;
-            goto end;
-        }
-
-        if (json_object_object_get_ex(obj,
-                                      CLOUDMIG_STATUS_BUCKETENTRY_SIZE,
-                                      &objfield) == FALSE
-            || !json_object_is_type(objfield, json_type_int))
-        {
-            PRINTERR("[Bucket Status Next Entry] "
-                     "Could not find object '%s' within item's json status.\n",
-                     CLOUDMIG_STATUS_BUCKETENTRY_SIZE);
-            ret = -1;
-            goto end;
-        }
-        objsize = json_object_get_int64(objfield);
-
-        if (json_object_object_get_ex(obj,
-                                      CLOUDMIG_STATUS_BUCKETENTRY_DONE,
-                                      &objfield) == FALSE
-            || !json_object_is_type(objfield, json_type_boolean))
-        {
-            PRINTERR("[Bucket Status Next Entry] "
-                     "Could not find object '%s' within item's json status.\n",
-                     CLOUDMIG_STATUS_BUCKETENTRY_DONE);
-            ret = -1;
-            goto end;
-        }
-        objdone = json_object_get_boolean(objfield);
-
-        if (json_object_object_get_ex(obj,
-                                      CLOUDMIG_STATUS_BUCKETENTRY_TYPE,
-                                      &objfield) == FALSE
-            || !json_object_is_type(objfield, json_type_int))
-        {
-            PRINTERR("[Bucket Status Next Entry] "
-                     "Could not find object '%s' within item's json status.\n",
-                     CLOUDMIG_STATUS_BUCKETENTRY_TYPE);
-            ret = -1;
-            goto end;
-        }
-        objtype = (dpl_ftype_t)json_object_get_int(objfield);
-
-        if (json_object_object_get_ex(obj,
-                                      CLOUDMIG_STATUS_BUCKETENTRY_PATH,
-                                      &objfield) == FALSE
-            || !json_object_is_type(objfield, json_type_string))
+        entry = _bucket_entry(bst, *cursor);
+        if (entry == NULL)
         {
             PRINTERR("[Bucket Status Next Entry] "
-                     "Could not find object '%s' within item's json status.\n",
-                     CLOUDMIG_STATUS_BUCKETENTRY_PATH);
+                     "Could not find entry %u within bucket's status.\n",
+                     *cursor);
             ret = -1;
             goto end;
         }
-        objname = json_object_get_string(objfield);
+        objsize = entry->size;
+        objdone = entry->done;
+        objtype = (dpl_ftype_t)entry->type;
 
-        // We got all the pointers needed, advance next entry automatically.
-        cur_entry = bst->next_entry;
-        bst->next_entry += 1;
+        // We got all the pointers needed, advance the cursor automatically.
+        cur_entry = *cursor;
+        *cursor += 1;
 
         /*
          * Check if this file has yet to be transfered
@@ -1438,45 +4206,11 @@ status_bucket_next_ex(dpl_ctx_t *status_ctx,
              *
              * Then, try and load a possible saved state for those files (if any)
              */
-            filestate->obj_path = strdup(objname);
-            if (filestate->obj_path == NULL)
-            {
-                PRINTERR("[Bucket Status Next Entry] "
-                         "Could not dup relative file path : %s.\n", strerror(errno));
-                ret = -1;
-                goto end;
-            }
-
-            // Compute source path
-            if (asprintf(&filestate->src_path, "%s%s", srcpath, objname) == -1)
+            if (_bucket_entry_paths(bst, cur_entry, srcpath, dstpath,
+                                    filestate) != EXIT_SUCCESS)
             {
                 PRINTERR("[Bucket Status Next Entry] "
-                         "Could not compute intermediary status file path: %s.\n",
-                         strerror(errno));
-                ret = -1;
-                goto end;
-            }
-
-            // Compute destination path
-            if (asprintf(&filestate->dst_path, "%s%s", dstpath, objname) == -1)
-            {
-                PRINTERR("[Bucket Status Next Entry] "
-                         "Could not compute intermediary status file path: %s.\n",
-                         strerror(errno));
-                ret = -1;
-                goto end;
-            }
-
-            // Compute state path
-            if (asprintf(&filestate->status_path, "%.*s/%i%s",
-                         (int)(strlen(bst->path)
-                               - strlen(CLOUDMIG_STATUS_BUCKET_FILEEXT)),
-                         bst->path, cur_entry,
-                         CLOUDMIG_STATUS_BUCKET_FILEEXT) == -1)
-            {
-                PRINTERR("[Bucket Status Next Entry] "
-                         "Could not compute intermediary status file path: %s.\n",
-                         strerror(errno));
+                         "Could not compute the paths of entry %u.\n", cur_entry);
                 ret = -1;
                 goto end;
             }
@@ -1498,64 +4232,304 @@ status_bucket_next_ex(dpl_ctx_t *status_ctx,
             // (Adds additional info if upload was interrupted)
             if (do_load)
             {
-                if (_bucket_entry_load(status_ctx, filestate) != EXIT_SUCCESS)
+                if (_bucket_entry_load(status_ctx, bst, filestate) != EXIT_SUCCESS)
                 {
                     ret = -1;
                     goto end;
                 }
             }
 
-            cloudmig_log(DEBUG_LVL, "[Bucket Status Next Entry]: "
-                         "Next file: %s...\n", filestate->obj_path);
+            cloudmig_log(DEBUG_LVL, "[Bucket Status Next Entry]: "
+                         "Next file: %s...\n", filestate->obj_path);
+
+            break ;
+        }
+
+    }
+
+    if (!found)
+    {
+        ret = 0;
+    }
+    else
+    {
+        bst->refcount += 1;
+        filestate->bst = bst;
+        ret = 1;
+    }
+
+end:
+    if (bucket_locked)
+        _bucket_unlock(bst);
+
+    if (ret != 1)
+    {
+        filestate->obj_path = NULL;
+        filestate->src_path = NULL;
+        filestate->dst_path = NULL;
+        filestate->status_path = NULL;
+    }
+
+    return ret;
+}
+
+static int _bucket_entry_incomplete(uint64_t size, bool done) { (void)size; return !done; }
+
+/*
+ * Checks whether all the entries of a range are done.
+ */
+static bool
+_bucket_range_done(struct bucket_status *bst, unsigned int start, unsigned int count)
+{
+    bool                    done = false;
+    struct bucket_entry     *entry = NULL;
+
+    _bucket_lock(bst);
+    for (unsigned int i=start; i < start + count; ++i)
+    {
+        entry = _bucket_entry(bst, i);
+        if (entry == NULL || !entry->done)
+            goto end;
+    }
+    done = true;
+
+end:
+    _bucket_unlock(bst);
+
+    return done;
+}
+
+static void
+_bucket_lease_finish(struct bucket_status *bst, struct status_lease *lease)
+{
+    status_lease_finish(bst->leases, lease,
+                        _bucket_range_done(bst, lease->start, lease->count));
+}
+
+/*
+ * Cooperative mode: the entries are only handed out from the ranges leased by
+ * the process, leasing a new range whenever the current one is exhausted.
+ */
+static int
+_bucket_next_leased_entry(dpl_ctx_t *status_ctx,
+                          struct bucket_status *bst,
+                          struct file_transfer_state *filestate)
+{
+    int                     ret;
+    struct status_lease     *lease = NULL;
+    unsigned int            n_entries = 0;
+    unsigned int            cursor;
+    unsigned int            end;
+    char                    *bcktdir = NULL;
+
+    for (;;)
+    {
+        lease = status_lease_active(bst->leases, bst);
+        if (lease == NULL)
+        {
+            _bucket_lock(bst);
+            n_entries = bst->n_entries;
+            _bucket_unlock(bst);
+
+            bcktdir = _bucket_dirpath(bst->path);
+            if (bcktdir == NULL)
+            {
+                ret = -1;
+                goto end;
+            }
+
+            ret = status_lease_acquire(bst->leases, bst, bcktdir, n_entries, &lease);
+            if (ret != 1)
+                goto end;
 
-            break ;
+            // Skip the entries completed under the previous holders of the lease
+            _bucket_lock(bst);
+            for (int i=0; i < json_object_array_length(lease->done); ++i)
+                (void)_bucket_entry_set_done(bst,
+                        json_object_get_int64(json_object_array_get_idx(lease->done, i)));
+            _bucket_unlock(bst);
+
+            free(bcktdir);
+            bcktdir = NULL;
         }
 
+        _bucket_lock(bst);
+        bst->next_entry = lease->cursor;
+        _bucket_unlock(bst);
+
+        end = lease->start + lease->count;
+        ret = status_bucket_next_ex(status_ctx, bst, filestate,
+                                    &_bucket_entry_incomplete, 1,
+                                    &bst->next_entry, &end);
+        if (ret == -1)
+            goto end;
+
+        _bucket_lock(bst);
+        cursor = bst->next_entry;
+        _bucket_unlock(bst);
+
+        if (status_lease_handout(bst->leases, lease, cursor, ret == 1))
+            _bucket_lease_finish(bst, lease);
+        if (ret == 1)
+            goto end;
     }
 
-    if (!found)
+end:
+    if (bcktdir)
+        free(bcktdir);
+
+    return ret;
+}
+
+/*
+ * Returns the first entry of [idx, end) starting a directory, so that a range
+ * of claims does not split a directory from the entries that follow it, or
+ * idx if none does within the next CLOUDMIG_STATUS_CLAIM_ALIGN entries.
+ */
+static unsigned int
+_bucket_claims_align(struct bucket_status *bst, unsigned int idx, unsigned int end)
+{
+    struct bucket_entry     *entry = NULL;
+
+    for (unsigned int i=idx; i < end && i - idx < CLOUDMIG_STATUS_CLAIM_ALIGN; ++i)
     {
-        ret = 0;
+        entry = _bucket_entry(bst, i);
+        if (entry == NULL)
+            break ;
+        if (entry->type == DPL_FTYPE_DIR)
+            return i;
     }
-    else
+
+    return idx;
+}
+
+/*
+ * Splits the entries left in the pass evenly between the workers.
+ * The bucket must be locked.
+ */
+static void
+_bucket_claims_split(struct bucket_status *bst)
+{
+    struct bucket_claims    *claims = bst->claims;
+    unsigned int            start = bst->next_entry;
+    unsigned int            bound;
+    uint64_t                count;
+
+    if (start > bst->n_entries)
+        start = bst->n_entries;
+    count = bst->n_entries - start;
+
+    bound = start;
+    for (int i=0; i < claims->n_ranges; ++i)
     {
-        bst->refcount += 1;
-        filestate->bst = bst;
-        ret = 1;
+        claims->ranges[i].next = bound;
+        if (i + 1 == claims->n_ranges)
+            bound = bst->n_entries;
+        else if (start + count * (i + 1) / claims->n_ranges > bound)
+            bound = _bucket_claims_align(bst,
+                                         start + count * (i + 1) / claims->n_ranges,
+                                         bst->n_entries);
+        claims->ranges[i].end = bound;
     }
+    claims->split = true;
+}
 
-end:
-    if (bucket_locked)
-        _bucket_unlock(bst);
+/*
+ * Hands the second half of the largest range left over to the worker.
+ * The bucket must be locked. Returns false if no entry is left to claim.
+ */
+static bool
+_bucket_claims_steal(struct bucket_status *bst, int worker)
+{
+    struct bucket_claims    *claims = bst->claims;
+    struct claim_range      *victim = NULL;
+    unsigned int            left = 0;
+    unsigned int            cut;
 
-    if (ret != 1)
+    for (int i=0; i < claims->n_ranges; ++i)
     {
-        if (filestate->obj_path)
-            free(filestate->obj_path);
-        filestate->obj_path = NULL;
-        if (filestate->src_path)
-            free(filestate->src_path);
-        filestate->src_path = NULL;
-        if (filestate->dst_path)
-            free(filestate->dst_path);
-        filestate->dst_path = NULL;
-        if (filestate->status_path)
-            free(filestate->status_path);
-        filestate->status_path = NULL;
+        if (claims->ranges[i].end - claims->ranges[i].next > left)
+        {
+            victim = &claims->ranges[i];
+            left = victim->end - victim->next;
+        }
     }
+    if (victim == NULL)
+        return false;
 
-    return ret;
+    cut = _bucket_claims_align(bst, victim->next + left / 2, victim->end);
+    claims->ranges[worker].next = cut;
+    claims->ranges[worker].end = victim->end;
+    victim->end = cut;
+
+    return true;
 }
 
-static int _bucket_entry_incomplete(uint64_t size, bool done) { (void)size; return !done; }
+/*
+ * Locality claim policy: each worker claims the entries of its own range, and
+ * steals from the others once it is exhausted.
+ */
+static int
+_bucket_next_claimed_entry(dpl_ctx_t *status_ctx,
+                           struct bucket_status *bst,
+                           int worker,
+                           struct file_transfer_state *filestate)
+{
+    int                     ret;
+    bool                    stolen;
+    struct claim_range      *range = &bst->claims->ranges[worker];
+
+    _bucket_lock(bst);
+    if (!bst->claims->split)
+        _bucket_claims_split(bst);
+    _bucket_unlock(bst);
+
+    for (;;)
+    {
+        ret = status_bucket_next_ex(status_ctx, bst, filestate,
+                                    &_bucket_entry_incomplete, 1,
+                                    &range->next, &range->end);
+        if (ret != 0)
+            return ret;
+
+        _bucket_lock(bst);
+        stolen = _bucket_claims_steal(bst, worker);
+        _bucket_unlock(bst);
+        if (!stolen)
+            return 0;
+    }
+}
 
 int
 status_bucket_next_incomplete_entry(dpl_ctx_t *status_ctx,
                                     struct bucket_status *bst,
+                                    int worker,
                                     struct file_transfer_state *filestate)
 {
+    int     ret;
+    bool    complete;
+
+    /*
+     * A complete bucket status is skipped without loading its segments, or
+     * even its manifest when the digest summary already says so.
+     */
+    _bucket_lock(bst);
+    ret = bst->complete ? EXIT_SUCCESS : _bucket_ensure_loaded(bst);
+    complete = bst->complete;
+    _bucket_unlock(bst);
+    if (ret != EXIT_SUCCESS)
+        return -1;
+    if (complete)
+        return 0;
+
+    if (bst->leases)
+        return _bucket_next_leased_entry(status_ctx, bst, filestate);
+    if (bst->claims && worker < bst->claims->n_ranges)
+        return _bucket_next_claimed_entry(status_ctx, bst, worker, filestate);
+
     return status_bucket_next_ex(status_ctx, bst, filestate,
-                             &_bucket_entry_incomplete, 1);
+                             &_bucket_entry_incomplete, 1,
+                             &bst->next_entry, NULL);
 }
 
 static int _bucket_entry_all(uint64_t size, bool done) { (void)size; (void)done; return 1; }
@@ -1566,12 +4540,14 @@ status_bucket_next_entry(dpl_ctx_t *status_ctx,
                          struct file_transfer_state *filestate)
 {
     return status_bucket_next_ex(status_ctx, bst, filestate,
-                             &_bucket_entry_all, 0);
+                             &_bucket_entry_all, 0, &bst->next_entry, NULL);
 }
 
 void
 status_bucket_release_entry(struct file_transfer_state *filestate)
 {
+    struct status_lease     *lease = NULL;
+
     _bucket_lock(filestate->bst);
 
     if (filestate->rstatus)
@@ -1581,26 +4557,448 @@ status_bucket_release_entry(struct file_transfer_state *filestate)
     if (filestate->wstatus)
         json_object_put(filestate->wstatus);
     filestate->wstatus = NULL;
-    
-    if (filestate->status_path)
-        free(filestate->status_path);
+
+    // The paths live in the filestate's buffer, kept for the next claim.
     filestate->status_path = NULL;
-    
-    if (filestate->obj_path)
-        free(filestate->obj_path);
     filestate->obj_path = NULL;
-
-    if (filestate->src_path)
-        free(filestate->src_path);
     filestate->src_path = NULL;
-
-    if (filestate->dst_path)
-        free(filestate->dst_path);
     filestate->dst_path = NULL;
 
     filestate->bst->refcount -= 1;
     
     _bucket_unlock(filestate->bst);
+
+    if (filestate->bst->leases)
+    {
+        lease = status_lease_find(filestate->bst->leases, filestate->bst,
+                                  filestate->state_idx);
+        if (lease && status_lease_put(filestate->bst->leases, lease))
+            _bucket_lease_finish(filestate->bst, lease);
+    }
+
     filestate->bst = NULL;
 }
 
+void
+status_bucket_clear_entry(struct file_transfer_state *filestate)
+{
+    if (filestate->paths.data)
+        free(filestate->paths.data);
+    memset(&filestate->paths, 0, sizeof(filestate->paths));
+}
+
+
+/*
+ * State of the merge of a new listing of the source into a bucket status.
+ */
+struct bucket_merge
+{
+    struct bucket_status        *bst;
+    struct status_buffer        buf;
+    unsigned int                n_listed;       // Nb of entries before the merge
+    bool                        *seen;          // Listed again, by entry
+    bool                        states_dirty;
+    struct bucket_resync        *stats;
+};
+
+static uint64_t
+_bucket_path_hash(const char *path)
+{
+    uint64_t    hash = 14695981039346656037ULL;
+
+    for (const unsigned char *c = (const unsigned char*)path; *c; ++c)
+        hash = (hash ^ *c) * 1099511628211ULL;
+
+    return hash;
+}
+
+static void
+_bucket_index_free(struct bucket_status *bst)
+{
+    if (bst->index == NULL)
+        return ;
+    free(bst->index->hashes);
+    free(bst->index->idxs);
+    free(bst->index);
+    bst->index = NULL;
+}
+
+static void
+_bucket_index_insert(struct bucket_index *index, uint64_t hash, unsigned int idx)
+{
+    size_t  slot;
+
+    for (slot = hash & index->mask; index->idxs[slot];
+         slot = (slot + 1) & index->mask)
+        ;
+    index->hashes[slot] = hash;
+    index->idxs[slot] = idx + 1;
+}
+
+/*
+ * Grows the index for it to hold n_entries at half load at most. The entries
+ * already indexed are moved by their hashes, without rebuilding their paths.
+ */
+static int
+_bucket_index_reserve(struct bucket_index *index, unsigned int n_entries)
+{
+    struct bucket_index     grown;
+    size_t                  size = index->hashes ? index->mask + 1 : 16;
+
+    if (index->hashes && size >= 2 * (size_t)n_entries)
+        return EXIT_SUCCESS;
+    while (size < 2 * (size_t)n_entries)
+        size *= 2;
+
+    grown.hashes = calloc(size, sizeof(*grown.hashes));
+    grown.idxs = calloc(size, sizeof(*grown.idxs));
+    if (grown.hashes == NULL || grown.idxs == NULL)
+    {
+        PRINTERR("[Resyncing Bucket Status] Could not allocate path index.\n");
+        free(grown.hashes);
+        free(grown.idxs);
+        return EXIT_FAILURE;
+    }
+    grown.mask = size - 1;
+    grown.n_indexed = index->n_indexed;
+
+    if (index->hashes)
+    {
+        for (size_t slot=0; slot <= index->mask; ++slot)
+            if (index->idxs[slot])
+                _bucket_index_insert(&grown, index->hashes[slot],
+                                     index->idxs[slot] - 1);
+        free(index->hashes);
+        free(index->idxs);
+    }
+    *index = grown;
+
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Indexes the entries of the bucket status added since its previous resync,
+ * or all of them for the first one, loading their segments. The paths of the
+ * entries never change (a deleted entry is only flagged), so that the index
+ * is kept along with the bucket status, and the next resyncs only rebuild the
+ * paths of the entries they added.
+ * The bucket status lock must be held by the caller.
+ */
+static int
+_bucket_index_update(struct bucket_status *bst, struct status_buffer *buf)
+{
+    struct bucket_index     *index = bst->index;
+    struct bucket_segment   *seg = NULL;
+    struct bucket_entry     *entry = NULL;
+    const char              *suffix = NULL;
+    size_t                  len;
+    size_t                  off;
+    unsigned int            i;
+
+    if (index == NULL)
+    {
+        index = calloc(1, sizeof(*index));
+        if (index == NULL)
+        {
+            PRINTERR("[Resyncing Bucket Status] Could not allocate path index.\n");
+            return EXIT_FAILURE;
+        }
+        bst->index = index;
+    }
+
+    if (_bucket_index_reserve(index, bst->n_entries) != EXIT_SUCCESS)
+        goto err;
+
+    for (unsigned int idx=index->n_indexed; idx < bst->n_entries; ++idx)
+    {
+        seg = &bst->segments[idx / bst->segment_size];
+        i = idx % bst->segment_size;
+        if (!seg->loaded
+            && _bucket_segment_load(bst, idx / bst->segment_size) != EXIT_SUCCESS)
+            goto err;
+
+        if (idx == index->n_indexed || i == 0)
+        {
+            buf->len = 0;
+            if (_bucket_segment_path_get(seg, i, buf, &off) != EXIT_SUCCESS)
+                goto err;
+        }
+        else
+        {
+            // The following paths are rebuilt in order, each from the previous one.
+            entry = &seg->entries[i];
+            suffix = seg->paths.data + entry->path;
+            len = strlen(suffix);
+            buf->len = entry->prefix;
+            if (_bucket_buffer_reserve(buf, len + 1) != EXIT_SUCCESS)
+                goto err;
+            memcpy(buf->data + buf->len, suffix, len + 1);
+            buf->len += len;
+        }
+
+        _bucket_index_insert(index, _bucket_path_hash(buf->data), idx);
+    }
+    index->n_indexed = bst->n_entries;
+
+    return EXIT_SUCCESS;
+
+err:
+    // Rebuilt from scratch by the next resync.
+    _bucket_index_free(bst);
+    return EXIT_FAILURE;
+}
+
+/*
+ * @return  the index of the entry, -1 if not found, -2 on failure
+ */
+static int64_t
+_bucket_index_find(struct bucket_status *bst, const char *path,
+                   struct status_buffer *buf)
+{
+    struct bucket_index     *index = bst->index;
+    uint64_t        hash = _bucket_path_hash(path);
+    unsigned int    idx;
+    size_t          off;
+
+    for (size_t slot = hash & index->mask; index->idxs[slot];
+         slot = (slot + 1) & index->mask)
+    {
+        if (index->hashes[slot] != hash)
+            continue ;
+
+        idx = index->idxs[slot] - 1;
+        buf->len = 0;
+        if (_bucket_segment_path_get(&bst->segments[idx / bst->segment_size],
+                                     idx % bst->segment_size, buf, &off)
+            != EXIT_SUCCESS)
+            return -2;
+        if (strcmp(buf->data + off, path) == 0)
+            return idx;
+    }
+
+    return -1;
+}
+
+/*
+ * An entry that changed at the source can not be resumed from its state.
+ * The bucket status lock must be held by the caller.
+ */
+static int
+_bucket_merge_drop_state(struct bucket_merge *merge, unsigned int idx)
+{
+    struct bucket_status    *bst = merge->bst;
+    char                    key[16];
+
+    if (bst->partial_known && !_bucket_partial_find(bst, idx, NULL))
+        return EXIT_SUCCESS;
+
+    if (_bucket_states_load(bst) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+
+    snprintf(key, sizeof(key), "%u", idx);
+    if (json_object_object_get_ex(bst->states, key, NULL))
+    {
+        json_object_object_del(bst->states, key);
+        bst->states_dirty = true;
+        merge->states_dirty = true;
+    }
+    _bucket_partial_del(bst, idx);
+
+    return EXIT_SUCCESS;
+}
+
+static int
+_bucket_merge_visit(void *data, char *path, const dpl_dirent_t *dirent)
+{
+    struct bucket_merge     *merge = data;
+    struct bucket_status    *bst = merge->bst;
+    struct bucket_segment   *seg = NULL;
+    struct bucket_entry     *entry = NULL;
+    int64_t                 idx;
+
+    idx = _bucket_index_find(bst, path, &merge->buf);
+    if (idx == -2)
+        return EXIT_FAILURE;
+
+    if (idx == -1)
+    {
+        if (_bucket_add_entry(bst, path, dirent->size, dirent->type,
+                              dirent->last_modified) != EXIT_SUCCESS)
+            return EXIT_FAILURE;
+        merge->stats->added += 1;
+        return EXIT_SUCCESS;
+    }
+
+    merge->seen[idx] = true;
+    seg = &bst->segments[idx / bst->segment_size];
+    entry = &seg->entries[idx % bst->segment_size];
+
+    // The entries listed by the previous versions have no mtime yet.
+    if (!entry->deleted
+        && entry->size == dirent->size
+        && entry->type == (uint32_t)dirent->type
+        && (entry->mtime == 0 || entry->mtime == dirent->last_modified))
+    {
+        if (entry->mtime != dirent->last_modified)
+        {
+            entry->mtime = dirent->last_modified;
+            seg->dirty = true;
+        }
+        merge->stats->unchanged += 1;
+        return EXIT_SUCCESS;
+    }
+
+    entry->size = dirent->size;
+    entry->mtime = dirent->last_modified;
+    entry->type = dirent->type;
+    entry->deleted = false;
+    if (entry->done)
+    {
+        entry->done = false;
+        seg->n_done -= 1;
+    }
+    seg->dirty = true;
+    merge->stats->modified += 1;
+
+    return _bucket_merge_drop_state(merge, idx);
+}
+
+int
+status_bucket_resync(dpl_ctx_t *status_ctx, const struct bucket_crawl *crawl,
+                     struct bucket_status *bst, struct bucket_resync *stats)
+{
+    int                     ret = EXIT_FAILURE;
+    bool                    bucket_locked = false;
+    struct bucket_merge     merge;
+    struct bucket_segment   *seg = NULL;
+    struct bucket_entry     *entry = NULL;
+    struct json_object      *objfield = NULL;
+    char                    *srcpath = NULL;
+    unsigned int            first_pending = UINT_MAX;
+
+    memset(&merge, 0, sizeof(merge));
+    memset(stats, 0, sizeof(*stats));
+    merge.bst = bst;
+    merge.stats = stats;
+
+    _bucket_lock(bst);
+    bucket_locked = true;
+
+    if (_bucket_ensure_loaded(bst) != EXIT_SUCCESS)
+        goto end;
+
+    if (json_object_object_get_ex(bst->json, CLOUDMIG_STATUS_BUCKET_SRCPATH,
+                                  &objfield) == FALSE
+        || !json_object_is_type(objfield, json_type_string))
+    {
+        PRINTERR("[Resyncing Bucket Status] "
+                 "Could not find src path within bucket's json status.\n");
+        goto end;
+    }
+    srcpath = strdup(json_object_get_string(objfield));
+    if (srcpath == NULL)
+    {
+        PRINTERR("[Resyncing Bucket Status] Could not allocate src path.\n");
+        goto end;
+    }
+
+    cloudmig_log(DEBUG_LVL, "[Resyncing Bucket Status] "
+                 "Merging a new listing of %s into %s...\n", srcpath, bst->path);
+
+    merge.n_listed = bst->n_entries;
+    merge.seen = calloc(merge.n_listed ? merge.n_listed : 1, sizeof(*merge.seen));
+    if (merge.seen == NULL)
+    {
+        PRINTERR("[Resyncing Bucket Status] Could not allocate entry flags.\n");
+        goto end;
+    }
+
+    if (_bucket_index_update(bst, &merge.buf) != EXIT_SUCCESS)
+        goto end;
+
+    if (_bucket_crawl(crawl, srcpath, &_bucket_merge_visit, &merge) != EXIT_SUCCESS)
+        goto end;
+
+    /*
+     * The entries not listed anymore are flagged, and settled: they count as
+     * done, for no bytes. They are reset if they ever come back.
+     */
+    for (unsigned int idx=0; idx < merge.n_listed; ++idx)
+    {
+        seg = &bst->segments[idx / bst->segment_size];
+        entry = &seg->entries[idx % bst->segment_size];
+        if (merge.seen[idx] || entry->deleted)
+            continue ;
+
+        entry->deleted = true;
+        entry->size = 0;
+        if (!entry->done)
+        {
+            entry->done = true;
+            seg->n_done += 1;
+        }
+        seg->dirty = true;
+        stats->deleted += 1;
+
+        if (_bucket_merge_drop_state(&merge, idx) != EXIT_SUCCESS)
+            goto end;
+    }
+
+    for (unsigned int idx=0; idx < bst->n_entries; ++idx)
+    {
+        entry = &bst->segments[idx / bst->segment_size].entries[idx % bst->segment_size];
+        stats->objects += 1;
+        stats->bytes += entry->size;
+        if (entry->done)
+        {
+            stats->done_objects += 1;
+            stats->done_bytes += entry->size;
+        }
+        else if (first_pending == UINT_MAX)
+            first_pending = idx;
+    }
+
+    /*
+     * Only the segments holding changed entries are uploaded, along with the
+     * manifest when the totals changed.
+     */
+    if (stats->added || stats->modified || stats->deleted)
+    {
+        if (_bucket_set_infos(bst, stats->objects, stats->bytes) != EXIT_SUCCESS)
+            goto end;
+        bst->complete = false;
+    }
+    /*
+     * The iteration resumes from the first entry left to migrate, which also
+     * retries the entries that failed since the previous listing.
+     */
+    bst->next_entry = first_pending == UINT_MAX ? bst->n_entries : first_pending;
+    if (bst->claims)
+        bst->claims->split = false;
+
+    if (_bucket_upload(status_ctx, bst) != EXIT_SUCCESS)
+        goto end;
+    stats->complete = bst->complete;
+
+    _bucket_unlock(bst);
+    bucket_locked = false;
+
+    if (merge.states_dirty && _bucket_states_save(status_ctx, bst, true) != EXIT_SUCCESS)
+        goto end;
+
+    cloudmig_log(INFO_LVL, "[Resyncing Bucket Status] %s: %"PRIu64" added,"
+                 " %"PRIu64" modified, %"PRIu64" deleted, %"PRIu64" unchanged.\n",
+                 srcpath, stats->added, stats->modified, stats->deleted,
+                 stats->unchanged);
+
+    ret = EXIT_SUCCESS;
+
+end:
+    if (bucket_locked)
+        _bucket_unlock(bst);
+    free(merge.buf.data);
+    free(merge.seen);
+    free(srcpath);
+
+    return ret;
+}
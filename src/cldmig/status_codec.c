@@ -0,0 +1,421 @@
+// Copyright (c) 2015, David Pineau
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of the copyright holder nor the names of its contributors
+//    may be used to endorse or promote products derived from this software
+//    without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER AND CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_ZLIB
+# include <zlib.h>
+#endif
+
+#include <droplet.h>
+#include <droplet/vfs.h>
+
+#include "cloudmig.h"
+#include "status.h"
+#include "status_codec.h"
+
+#define CODEC_GZIP_WBITS    (15 + 16)   // Default window, gzip format
+#define CODEC_GZIP_MAGIC    0x1f        // First byte of the gzip format
+
+static bool                         codec_compress = false;
+static struct status_codec_stats    codec_stats = { 0, 0, 0, 0 };
+static pthread_mutex_t              codec_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void
+status_codec_setup(bool compress)
+{
+    codec_compress = compress;
+}
+
+void
+status_codec_stats(struct status_codec_stats *stats)
+{
+    pthread_mutex_lock(&codec_lock);
+    *stats = codec_stats;
+    pthread_mutex_unlock(&codec_lock);
+}
+
+static void
+_codec_account(uint64_t *raw, uint64_t raw_len,
+               uint64_t *stored, uint64_t stored_len)
+{
+    pthread_mutex_lock(&codec_lock);
+    *raw += raw_len;
+    *stored += stored_len;
+    pthread_mutex_unlock(&codec_lock);
+}
+
+#ifdef HAVE_ZLIB
+static int
+_codec_compress(const char *data, size_t len, char **outp, size_t *outlenp)
+{
+    int         ret = EXIT_FAILURE;
+    int         zret;
+    z_stream    zs;
+    bool        zs_inited = false;
+    char        *out = NULL;
+    size_t      outsize;
+
+    memset(&zs, 0, sizeof(zs));
+    zret = deflateInit2(&zs, CLOUDMIG_STATUS_COMPRESSION_LEVEL, Z_DEFLATED,
+                        CODEC_GZIP_WBITS, 8, Z_DEFAULT_STRATEGY);
+    if (zret != Z_OK)
+    {
+        PRINTERR("[Status Codec] Could not initialize compression: %s.\n",
+                 zError(zret));
+        goto end;
+    }
+    zs_inited = true;
+
+    outsize = deflateBound(&zs, len);
+    out = malloc(outsize);
+    if (out == NULL)
+    {
+        PRINTERR("[Status Codec] Could not allocate compression buffer.\n");
+        goto end;
+    }
+
+    zs.next_in = (Bytef*)data;
+    zs.avail_in = len;
+    zs.next_out = (Bytef*)out;
+    zs.avail_out = outsize;
+    zret = deflate(&zs, Z_FINISH);
+    if (zret != Z_STREAM_END)
+    {
+        PRINTERR("[Status Codec] Could not compress status data: %s.\n",
+                 zError(zret));
+        goto end;
+    }
+
+    *outp = out;
+    *outlenp = zs.total_out;
+    out = NULL;
+
+    ret = EXIT_SUCCESS;
+
+end:
+    if (out)
+        free(out);
+    if (zs_inited)
+        deflateEnd(&zs);
+
+    return ret;
+}
+#else
+/*
+ * The options reject the compression when built without zlib.
+ */
+static int
+_codec_compress(const char *data, size_t len, char **outp, size_t *outlenp)
+{
+    (void)data;
+    (void)len;
+    (void)outp;
+    (void)outlenp;
+    PRINTERR("[Status Codec] Could not compress status data:"
+             " cloudmig was built without zlib.\n");
+    return EXIT_FAILURE;
+}
+#endif
+
+dpl_status_t
+status_codec_put(dpl_ctx_t *status_ctx, const char *path,
+                 const char *data, size_t len)
+{
+    dpl_status_t    dplret;
+    char            *out = NULL;
+    size_t          outlen = len;
+
+    if (codec_compress
+        && _codec_compress(data, len, &out, &outlen) != EXIT_SUCCESS)
+        return DPL_FAILURE;
+
+    dplret = dpl_fput(status_ctx, (char*)path,
+                      NULL/*options*/, NULL/*condition*/, NULL/*range*/,
+                      NULL/*MD*/, NULL/*sysmd*/,
+                      out ? out : (char*)data, outlen);
+    if (dplret == DPL_SUCCESS)
+        _codec_account(&codec_stats.put_raw, len,
+                       &codec_stats.put_stored, outlen);
+
+    if (out)
+        free(out);
+
+    return dplret;
+}
+
+
+struct status_decoder
+{
+    status_decoder_sink_t   sink;
+    void                    *data;
+
+    bool                    started;
+    bool                    compressed;
+    bool                    finished;       // End of the compressed data
+#ifdef HAVE_ZLIB
+    z_stream                zs;
+    bool                    zs_inited;
+#endif
+};
+
+struct status_decoder*
+status_decoder_new(status_decoder_sink_t sink, void *data)
+{
+    struct status_decoder   *decoder = NULL;
+
+    decoder = calloc(1, sizeof(*decoder));
+    if (decoder == NULL)
+    {
+        PRINTERR("[Status Codec] Could not allocate decoder.\n");
+        return NULL;
+    }
+    decoder->sink = sink;
+    decoder->data = data;
+
+    return decoder;
+}
+
+void
+status_decoder_free(struct status_decoder *decoder)
+{
+#ifdef HAVE_ZLIB
+    if (decoder->zs_inited)
+        inflateEnd(&decoder->zs);
+#endif
+    free(decoder);
+}
+
+#ifdef HAVE_ZLIB
+static int
+_decoder_inflate(struct status_decoder *decoder, const char *buf, size_t len,
+                 uint64_t *rawp)
+{
+    int         ret = EXIT_SUCCESS;
+    int         zret;
+    char        out[16384];
+    size_t      outlen;
+
+    if (!decoder->zs_inited)
+    {
+        zret = inflateInit2(&decoder->zs, CODEC_GZIP_WBITS);
+        if (zret != Z_OK)
+        {
+            PRINTERR("[Status Codec] Could not initialize decompression: %s.\n",
+                     zError(zret));
+            return EXIT_FAILURE;
+        }
+        decoder->zs_inited = true;
+    }
+
+    decoder->zs.next_in = (Bytef*)buf;
+    decoder->zs.avail_in = len;
+    do
+    {
+        decoder->zs.next_out = (Bytef*)out;
+        decoder->zs.avail_out = sizeof(out);
+        zret = inflate(&decoder->zs, Z_NO_FLUSH);
+        if (zret != Z_OK && zret != Z_STREAM_END && zret != Z_BUF_ERROR)
+        {
+            PRINTERR("[Status Codec] Could not decompress status data: %s.\n",
+                     zError(zret));
+            ret = EXIT_FAILURE;
+            goto end;
+        }
+
+        outlen = sizeof(out) - decoder->zs.avail_out;
+        *rawp += outlen;
+        if (outlen != 0)
+        {
+            ret = decoder->sink(decoder->data, out, outlen);
+            if (ret != EXIT_SUCCESS)
+                goto end;
+        }
+
+        if (zret == Z_STREAM_END)
+        {
+            decoder->finished = true;
+            if (decoder->zs.avail_in != 0)
+            {
+                PRINTERR("[Status Codec] Trailing data after compressed status.\n");
+                ret = EXIT_FAILURE;
+                goto end;
+            }
+            break ;
+        }
+        if (zret == Z_BUF_ERROR)
+            break ;
+    } while (decoder->zs.avail_in != 0 || decoder->zs.avail_out == 0);
+
+end:
+    return ret;
+}
+#else
+static int
+_decoder_inflate(struct status_decoder *decoder, const char *buf, size_t len,
+                 uint64_t *rawp)
+{
+    (void)decoder;
+    (void)buf;
+    (void)len;
+    (void)rawp;
+    PRINTERR("[Status Codec] Could not read a compressed status file:"
+             " cloudmig was built without zlib.\n");
+    return EXIT_FAILURE;
+}
+#endif
+
+int
+status_decoder_feed(struct status_decoder *decoder, const char *buf, size_t len)
+{
+    int         ret = EXIT_SUCCESS;
+    uint64_t    raw = 0;
+
+    if (len == 0)
+        return EXIT_SUCCESS;
+
+    if (!decoder->started)
+    {
+        decoder->started = true;
+        decoder->compressed = ((unsigned char)buf[0] == CODEC_GZIP_MAGIC);
+    }
+
+    if (!decoder->compressed)
+    {
+        raw = len;
+        ret = decoder->sink(decoder->data, buf, len);
+        goto end;
+    }
+
+    if (decoder->finished)
+    {
+        PRINTERR("[Status Codec] Trailing data after compressed status.\n");
+        ret = EXIT_FAILURE;
+        goto end;
+    }
+
+    ret = _decoder_inflate(decoder, buf, len, &raw);
+
+end:
+    _codec_account(&codec_stats.get_raw, raw,
+                   &codec_stats.get_stored, len);
+
+    return ret;
+}
+
+int
+status_decoder_end(struct status_decoder *decoder)
+{
+    if (decoder->compressed && !decoder->finished)
+    {
+        PRINTERR("[Status Codec] Truncated compressed status.\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+static int
+_codec_buffer_append(void *data, const char *buf, size_t len)
+{
+    struct status_buffer    *out = data;
+    char                    *grown = NULL;
+    size_t                  size;
+
+    if (out->len + len > out->size)
+    {
+        size = out->size ? out->size : 4096;
+        while (size < out->len + len)
+            size *= 2;
+        grown = realloc(out->data, size);
+        if (grown == NULL)
+        {
+            PRINTERR("[Status Codec] Could not allocate decompression buffer.\n");
+            return EXIT_FAILURE;
+        }
+        out->data = grown;
+        out->size = size;
+    }
+    memcpy(out->data + out->len, buf, len);
+    out->len += len;
+
+    return EXIT_SUCCESS;
+}
+
+dpl_status_t
+status_codec_get(dpl_ctx_t *status_ctx, const char *path,
+                 char **datap, unsigned int *lenp)
+{
+    dpl_status_t            dplret;
+    char                    *buffer = NULL;
+    unsigned int            buflen = 0;
+    struct status_decoder   *decoder = NULL;
+    struct status_buffer    out = { NULL, 0, 0 };
+
+    dplret = dpl_fget(status_ctx, (char*)path,
+                      NULL/*option*/, NULL/*condition*/, NULL/*range*/,
+                      &buffer, &buflen,
+                      NULL/*MD*/, NULL/*sysmd*/);
+    if (dplret != DPL_SUCCESS)
+        goto end;
+
+    // Uncompressed data is handed out as is.
+    if (buflen == 0 || (unsigned char)buffer[0] != CODEC_GZIP_MAGIC)
+    {
+        _codec_account(&codec_stats.get_raw, buflen,
+                       &codec_stats.get_stored, buflen);
+        *datap = buffer;
+        *lenp = buflen;
+        buffer = NULL;
+        goto end;
+    }
+
+    decoder = status_decoder_new(&_codec_buffer_append, &out);
+    if (decoder == NULL
+        || status_decoder_feed(decoder, buffer, buflen) != EXIT_SUCCESS
+        || status_decoder_end(decoder) != EXIT_SUCCESS)
+    {
+        PRINTERR("[Status Codec] Could not decompress status file %s.\n", path);
+        dplret = DPL_FAILURE;
+        goto end;
+    }
+
+    *datap = out.data;
+    *lenp = out.len;
+    out.data = NULL;
+
+end:
+    if (decoder)
+        status_decoder_free(decoder);
+    if (out.data)
+        free(out.data);
+    if (buffer)
+        free(buffer);
+
+    return dplret;
+}
@@ -30,13 +30,17 @@
 #include <droplet/vfs.h>
 
 #include "cloudmig.h"
+#include "status_codec.h"
 #include "status_digest.h"
+#include "status_wal.h"
 #include "utils.h"
 
 #define CLOUDMIG_STATUS_DIGEST_BYTES        "bytes"
 #define CLOUDMIG_STATUS_DIGEST_DONE_BYTES   "done_bytes"
 #define CLOUDMIG_STATUS_DIGEST_OBJECTS      "objects"
 #define CLOUDMIG_STATUS_DIGEST_DONE_OBJECTS "done_objects"
+#define CLOUDMIG_STATUS_DIGEST_BUCKETS      "buckets"
+#define CLOUDMIG_STATUS_DIGEST_DONE         "done"
 
 static void
 _digest_lock(struct status_digest *digest)
@@ -50,8 +54,66 @@ _digest_unlock(struct status_digest *digest)
     pthread_mutex_unlock(&digest->lock);
 }
 
+static __thread int     _digest_shard_id = -1;
+static int              _digest_next_shard = 0;
+
+/*
+ * Each thread sticks to one shard, picked in turn on its first update.
+ */
+static struct digest_shard*
+_digest_shard(struct status_digest *digest)
+{
+    if (_digest_shard_id == -1)
+        _digest_shard_id = __atomic_fetch_add(&_digest_next_shard, 1, __ATOMIC_RELAXED)
+                           % CLOUDMIG_STATUS_DIGEST_SHARDS;
+
+    return &digest->shards[_digest_shard_id];
+}
+
+/*
+ * Sums the progress accounted within the shards to the one loaded.
+ * The digest lock must be held by the caller.
+ */
+static uint64_t
+_digest_done(struct status_digest *digest, enum digest_field field)
+{
+    uint64_t    value;
+
+    value = (field == DIGEST_DONE_BYTES) ? digest->fixed.done_bytes
+                                         : digest->fixed.done_objects;
+    for (int i=0; i < CLOUDMIG_STATUS_DIGEST_SHARDS; ++i)
+    {
+        value += __atomic_load_n((field == DIGEST_DONE_BYTES)
+                                 ? &digest->shards[i].done_bytes
+                                 : &digest->shards[i].done_objects,
+                                 __ATOMIC_RELAXED);
+    }
+
+    return value;
+}
+
+/*
+ * Copies a bucket summary, whose progress is updated without the lock.
+ * The digest lock must be held by the caller.
+ */
+static void
+_digest_bucket_copy(struct status_digest *digest, int bucket,
+                    struct digest_bucket *summary)
+{
+    struct digest_bucket    *src = &digest->buckets[bucket];
+
+    summary->name = src->name;
+    summary->bytes = src->bytes;
+    summary->objects = src->objects;
+    summary->done_bytes = __atomic_load_n(&src->done_bytes, __ATOMIC_RELAXED);
+    summary->done_objects = __atomic_load_n(&src->done_objects, __ATOMIC_RELAXED);
+    summary->done = __atomic_load_n(&src->done, __ATOMIC_RELAXED);
+}
+
 struct status_digest*
-status_digest_new(dpl_ctx_t *status_ctx, const char *storepath, uint64_t refresh_frequency)
+status_digest_new(dpl_ctx_t *status_ctx, const char *storepath,
+                  uint64_t refresh_frequency,
+                  time_t min_interval, time_t max_interval)
 {
     struct status_digest    *ret = NULL;
     struct status_digest    *digest = NULL;
@@ -64,12 +126,14 @@ status_digest_new(dpl_ctx_t *status_ctx, const char *storepath, uint64_t refresh
         goto end;
     }
 
-    digest = calloc(1, sizeof(*digest));
-    if (digest == NULL)
+    // malloc() does not guarantee the alignment of the shards.
+    if (posix_memalign((void**)&digest, CLOUDMIG_CACHE_LINE, sizeof(*digest)) != 0)
     {
+        digest = NULL;
         PRINTERR("[Allocating Status Digest] Could not allocate status digest.\n");
         goto end;
     }
+    memset(digest, 0, sizeof(*digest));
 
     if (pthread_mutex_init(&digest->lock, NULL) == -1)
     {
@@ -78,11 +142,20 @@ status_digest_new(dpl_ctx_t *status_ctx, const char *storepath, uint64_t refresh
     }
     digest->lock_inited = 1;
 
+    if (pthread_cond_init(&digest->cond, NULL) != 0)
+    {
+        PRINTERR("[Allocating Status Digest] Could not intialize condition.\n");
+        goto end;
+    }
+    digest->cond_inited = 1;
+
     digest->path = path;
     path = NULL;
     
     digest->status_ctx = status_ctx;
     digest->refresh_frequency = refresh_frequency;
+    digest->min_interval = min_interval;
+    digest->max_interval = max_interval;
 
     ret = digest;
     digest = NULL;
@@ -99,18 +172,151 @@ end:
 void
 status_digest_free(struct status_digest *digest)
 {
+    for (int i=0; i < digest->n_buckets; ++i)
+        free(digest->buckets[i].name);
+    if (digest->buckets)
+        free(digest->buckets);
     if (digest->path)
         free(digest->path);
+    if (digest->cond_inited)
+        pthread_cond_destroy(&digest->cond);
+    if (digest->lock_inited)
+        pthread_mutex_destroy(&digest->lock);
     free(digest);
 }
 
+/*
+ * Finds the summary of a bucket status, or adds an empty one.
+ * The digest lock must be held by the caller.
+ */
+static int
+_digest_bucket(struct status_digest *digest, const char *name, bool create)
+{
+    struct digest_bucket    *buckets = NULL;
+
+    for (int i=0; i < digest->n_buckets; ++i)
+    {
+        if (strcmp(digest->buckets[i].name, name) == 0)
+            return i;
+    }
+
+    if (!create)
+        return -1;
+
+    buckets = realloc(digest->buckets, sizeof(*buckets) * (digest->n_buckets + 1));
+    if (buckets == NULL)
+    {
+        PRINTERR("[Status Digest] Could not allocate bucket summary.\n");
+        return -1;
+    }
+    digest->buckets = buckets;
+
+    memset(&buckets[digest->n_buckets], 0, sizeof(*buckets));
+    buckets[digest->n_buckets].name = strdup(name);
+    if (buckets[digest->n_buckets].name == NULL)
+    {
+        PRINTERR("[Status Digest] Could not allocate bucket summary.\n");
+        return -1;
+    }
+
+    return digest->n_buckets++;
+}
+
+/*
+ * Parses the summaries of the bucket statuses. Those are missing from the
+ * digests written by the previous versions, which is not an error.
+ */
+static int
+_digest_parse_buckets(struct status_digest *digest, struct json_object *json)
+{
+    int                     ret;
+    struct json_object      *field = NULL;
+    struct digest_bucket    *bucket = NULL;
+    int                     idx;
+
+    json_object_object_foreach(json, name, jsbucket)
+    {
+        if (!json_object_is_type(jsbucket, json_type_object))
+        {
+            PRINTERR("[Loading Status Digest] "
+                     "Invalid summary for bucket status %s.\n", name);
+            ret = EXIT_FAILURE;
+            goto end;
+        }
+
+        idx = _digest_bucket(digest, name, true);
+        if (idx == -1)
+        {
+            ret = EXIT_FAILURE;
+            goto end;
+        }
+        bucket = &digest->buckets[idx];
+
+        if (json_object_object_get_ex(jsbucket, CLOUDMIG_STATUS_DIGEST_OBJECTS, &field))
+            bucket->objects = json_object_get_int64(field);
+        if (json_object_object_get_ex(jsbucket, CLOUDMIG_STATUS_DIGEST_DONE_OBJECTS, &field))
+            bucket->done_objects = json_object_get_int64(field);
+        if (json_object_object_get_ex(jsbucket, CLOUDMIG_STATUS_DIGEST_BYTES, &field))
+            bucket->bytes = json_object_get_int64(field);
+        if (json_object_object_get_ex(jsbucket, CLOUDMIG_STATUS_DIGEST_DONE_BYTES, &field))
+            bucket->done_bytes = json_object_get_int64(field);
+        if (json_object_object_get_ex(jsbucket, CLOUDMIG_STATUS_DIGEST_DONE, &field))
+            bucket->done = json_object_get_boolean(field);
+    }
+
+    ret = EXIT_SUCCESS;
+
+end:
+    return ret;
+}
+
+static struct json_object*
+_digest_bucket_json(struct digest_bucket *bucket)
+{
+    struct json_object  *ret = NULL;
+    struct json_object  *json = NULL;
+    struct json_object  *values[5] = { NULL, NULL, NULL, NULL, NULL };
+
+    json = json_object_new_object();
+    values[0] = json_object_new_int64(bucket->objects);
+    values[1] = json_object_new_int64(bucket->done_objects);
+    values[2] = json_object_new_int64(bucket->bytes);
+    values[3] = json_object_new_int64(bucket->done_bytes);
+    values[4] = json_object_new_boolean(bucket->done);
+    for (int i=0; i < 5; ++i)
+    {
+        if (values[i] == NULL)
+            goto end;
+    }
+    if (json == NULL)
+        goto end;
+
+    json_object_object_add(json, CLOUDMIG_STATUS_DIGEST_OBJECTS, values[0]);
+    json_object_object_add(json, CLOUDMIG_STATUS_DIGEST_DONE_OBJECTS, values[1]);
+    json_object_object_add(json, CLOUDMIG_STATUS_DIGEST_BYTES, values[2]);
+    json_object_object_add(json, CLOUDMIG_STATUS_DIGEST_DONE_BYTES, values[3]);
+    json_object_object_add(json, CLOUDMIG_STATUS_DIGEST_DONE, values[4]);
+    memset(values, 0, sizeof(values));
+
+    ret = json;
+    json = NULL;
+
+end:
+    for (int i=0; i < 5; ++i)
+    {
+        if (values[i])
+            json_object_put(values[i]);
+    }
+    if (json)
+        json_object_put(json);
+
+    return ret;
+}
+
 int
-status_digest_download(struct status_digest *digest, int *regenerate)
+status_digest_parse(struct status_digest *digest, const char *buffer, unsigned int bufsize)
 {
     int                     ret;
-    dpl_status_t            dplret;
-    char                    *buffer = NULL;
-    unsigned int            bufsize = 0;
     struct json_tokener     *tokener = NULL;
     struct json_object      *json = NULL;
     struct json_object      *field = NULL;
@@ -119,8 +325,6 @@ status_digest_download(struct status_digest *digest, int *regenerate)
     uint64_t                objects = 0;
     uint64_t                done_objects = 0;
 
-    *regenerate = 0;
-
     tokener = json_tokener_new();
     if (tokener == NULL)
     {
@@ -129,24 +333,6 @@ status_digest_download(struct status_digest *digest, int *regenerate)
         goto end;
     }
 
-    dplret = dpl_fget(digest->status_ctx, digest->path,
-                      NULL/*option*/, NULL/*condition*/, NULL/*range*/,
-                      &buffer, &bufsize,
-                      NULL/*MD*/, NULL/*sysmd*/);
-    if (dplret != DPL_SUCCESS)
-    {
-        if (dplret == DPL_ENOENT)
-        {
-            *regenerate = 1;
-            ret = EXIT_SUCCESS;
-            goto end;
-        }
-        PRINTERR("[Loading Status Digest] Could not read status digest %s: %s.\n",
-                 digest->path, dpl_status_str(dplret));
-        ret = EXIT_FAILURE;
-        goto end;
-    }
-
     json = json_tokener_parse_ex(tokener, buffer, bufsize);
     if (json == NULL)
     {
@@ -201,13 +387,18 @@ status_digest_download(struct status_digest *digest, int *regenerate)
     digest->fixed.done_objects = done_objects;
     digest->fixed.bytes = bytes;
     digest->fixed.done_bytes = done_bytes;
+    memset(digest->shards, 0, sizeof(digest->shards));
+    if (json_object_object_get_ex(json, CLOUDMIG_STATUS_DIGEST_BUCKETS, &field))
+        ret = _digest_parse_buckets(digest, field);
+    else
+        ret = EXIT_SUCCESS;
     _digest_unlock(digest);
+    if (ret != EXIT_SUCCESS)
+        goto end;
 
     ret = EXIT_SUCCESS;
 
 end:
-    if (buffer)
-        free(buffer);
     if (json)
         json_object_put(json);
     if (tokener)
@@ -216,6 +407,41 @@ end:
     return ret;
 }
 
+int
+status_digest_download(struct status_digest *digest, int *regenerate)
+{
+    int                     ret;
+    dpl_status_t            dplret;
+    char                    *buffer = NULL;
+    unsigned int            bufsize = 0;
+
+    *regenerate = 0;
+
+    dplret = status_codec_get(digest->status_ctx, digest->path,
+                              &buffer, &bufsize);
+    if (dplret != DPL_SUCCESS)
+    {
+        if (dplret == DPL_ENOENT)
+        {
+            *regenerate = 1;
+            ret = EXIT_SUCCESS;
+            goto end;
+        }
+        PRINTERR("[Loading Status Digest] Could not read status digest %s: %s.\n",
+                 digest->path, dpl_status_str(dplret));
+        ret = EXIT_FAILURE;
+        goto end;
+    }
+
+    ret = status_digest_parse(digest, buffer, bufsize);
+
+end:
+    if (buffer)
+        free(buffer);
+
+    return ret;
+}
+
 int
 status_digest_upload(struct status_digest *digest)
 {
@@ -226,21 +452,48 @@ status_digest_upload(struct status_digest *digest)
     struct json_object  *done_bytes = NULL;
     struct json_object  *objects = NULL;
     struct json_object  *done_objects = NULL;
+    struct json_object  *buckets = NULL;
+    struct json_object  *summary = NULL;
+    struct digest_bucket copy;
     const char          *filebuf = NULL;
+    uint64_t            changes;
+    int                 n_buckets_done;
+    uint64_t            uploaded_bytes;
+    uint64_t            uploaded_objects;
 
     _digest_lock(digest);
+
+    // The changes made from now on are left to the next upload.
+    changes = __atomic_load_n(&digest->refresh_count, __ATOMIC_RELAXED);
+    n_buckets_done = __atomic_load_n(&digest->buckets_done, __ATOMIC_RELAXED);
+    uploaded_bytes = _digest_done(digest, DIGEST_DONE_BYTES);
+    uploaded_objects = _digest_done(digest, DIGEST_DONE_OBJECTS);
+
     cloudmig_log(INFO_LVL, "Uploading digest: %lu/%lu objs, %lu/%lu bytes\n",
-                 digest->fixed.done_objects, digest->fixed.objects,
-                 digest->fixed.done_bytes, digest->fixed.bytes);
+                 uploaded_objects, digest->fixed.objects,
+                 uploaded_bytes, digest->fixed.bytes);
     json = json_object_new_object();
     bytes = json_object_new_int64(digest->fixed.bytes);
-    done_bytes = json_object_new_int64(digest->fixed.done_bytes);
+    done_bytes = json_object_new_int64(uploaded_bytes);
     objects = json_object_new_int64(digest->fixed.objects);
-    done_objects = json_object_new_int64(digest->fixed.done_objects);
+    done_objects = json_object_new_int64(uploaded_objects);
+    buckets = json_object_new_object();
+    for (int i=0; buckets != NULL && i < digest->n_buckets; ++i)
+    {
+        _digest_bucket_copy(digest, i, &copy);
+        summary = _digest_bucket_json(&copy);
+        if (summary == NULL)
+        {
+            json_object_put(buckets);
+            buckets = NULL;
+            break ;
+        }
+        json_object_object_add(buckets, digest->buckets[i].name, summary);
+    }
     _digest_unlock(digest);
 
     if (json == NULL || bytes == NULL || done_bytes == NULL
-        || objects == NULL || done_objects == NULL)
+        || objects == NULL || done_objects == NULL || buckets == NULL)
     {
         PRINTERR("[Uploading Status Digest] "
                  "Could not allocate json items.\n");
@@ -251,10 +504,12 @@ status_digest_upload(struct status_digest *digest)
     json_object_object_add(json, CLOUDMIG_STATUS_DIGEST_DONE_OBJECTS, done_objects);
     json_object_object_add(json, CLOUDMIG_STATUS_DIGEST_BYTES, bytes);
     json_object_object_add(json, CLOUDMIG_STATUS_DIGEST_DONE_BYTES, done_bytes);
+    json_object_object_add(json, CLOUDMIG_STATUS_DIGEST_BUCKETS, buckets);
     objects = NULL;
     done_objects = NULL;
     bytes = NULL;
     done_bytes = NULL;
+    buckets = NULL;
 
     filebuf = json_object_to_json_string(json);
     if (filebuf == NULL)
@@ -265,10 +520,14 @@ status_digest_upload(struct status_digest *digest)
         goto end;
     }
 
-    if ((dplret = dpl_fput(digest->status_ctx, digest->path,
-                           NULL, NULL, NULL, // opt, cond, range
-                           NULL, NULL, // md, sysmd
-                           (char*)filebuf, strlen(filebuf))) != DPL_SUCCESS)
+    if (digest->wal)
+    {
+        ret = status_wal_put(digest->wal, digest->path, filebuf);
+        if (ret != EXIT_SUCCESS)
+            goto end;
+    }
+    else if ((dplret = status_codec_put(digest->status_ctx, digest->path,
+                                        filebuf, strlen(filebuf))) != DPL_SUCCESS)
     {
         PRINTERR("[Uploading Status Digest] "
                  "Could not create digest status file : %s\n",
@@ -280,6 +539,15 @@ status_digest_upload(struct status_digest *digest)
     cloudmig_log(INFO_LVL, "[Uploading Status Digest] "
                  " Uploaded digest: %s\n", filebuf);
 
+    _digest_lock(digest);
+    __atomic_fetch_sub(&digest->refresh_count, changes, __ATOMIC_RELAXED);
+    __atomic_fetch_sub(&digest->buckets_done, n_buckets_done, __ATOMIC_RELAXED);
+    digest->last_upload = time(NULL);
+    digest->last_done_bytes = uploaded_bytes;
+    digest->last_done_objects = uploaded_objects;
+    digest->n_uploads += 1;
+    _digest_unlock(digest);
+
     ret = EXIT_SUCCESS;
 
 end:
@@ -293,6 +561,8 @@ end:
         json_object_put(objects);
     if (done_objects)
         json_object_put(done_objects);
+    if (buckets)
+        json_object_put(buckets);
 
     return ret;
 }
@@ -317,13 +587,13 @@ status_digest_get(struct status_digest *digest, enum digest_field field)
         value = digest->fixed.objects;
         break ;
     case DIGEST_DONE_OBJECTS:
-        value = digest->fixed.done_objects;
+        value = _digest_done(digest, DIGEST_DONE_OBJECTS);
         break ;
     case DIGEST_BYTES:
         value = digest->fixed.bytes;
         break ;
     case DIGEST_DONE_BYTES:
-        value = digest->fixed.done_bytes;
+        value = _digest_done(digest, DIGEST_DONE_BYTES);
         break ;
     default:
         assert(0);
@@ -337,34 +607,225 @@ void
 status_digest_add(struct status_digest *digest,
                   enum digest_field field, uint64_t value)
 {
-    int     do_upload = 0;
+    status_digest_bucket_add(digest, -1, field, value);
+}
+
+int
+status_digest_bucket(struct status_digest *digest, const char *name, bool create)
+{
+    int     idx;
+
+    _digest_lock(digest);
+    idx = _digest_bucket(digest, name, create);
+    _digest_unlock(digest);
+
+    return idx;
+}
+
+void
+status_digest_bucket_get(struct status_digest *digest, int bucket,
+                         struct digest_bucket *summary)
+{
+    _digest_lock(digest);
+    _digest_bucket_copy(digest, bucket, summary);
+    _digest_unlock(digest);
+}
+
+void
+status_digest_bucket_set(struct status_digest *digest, int bucket,
+                         uint64_t objects, uint64_t bytes, bool done)
+{
+    struct digest_bucket    *summary = NULL;
+
+    _digest_lock(digest);
+    summary = &digest->buckets[bucket];
+    summary->objects = objects;
+    summary->bytes = bytes;
+    summary->done = done;
+    if (done)
+    {
+        summary->done_objects = objects;
+        summary->done_bytes = bytes;
+    }
+    _digest_unlock(digest);
+}
+
+void
+status_digest_bucket_resync(struct status_digest *digest, int bucket,
+                            const struct digest_bucket *totals)
+{
+    struct digest_bucket    *summary = NULL;
 
     _digest_lock(digest);
+    summary = &digest->buckets[bucket];
+
+    // The counters may decrease, but never below zero as a whole.
+    digest->fixed.objects += totals->objects - summary->objects;
+    digest->fixed.bytes += totals->bytes - summary->bytes;
+    digest->fixed.done_objects += totals->done_objects - summary->done_objects;
+    digest->fixed.done_bytes += totals->done_bytes - summary->done_bytes;
+
+    summary->objects = totals->objects;
+    summary->bytes = totals->bytes;
+    summary->done_objects = totals->done_objects;
+    summary->done_bytes = totals->done_bytes;
+    summary->done = totals->done;
+    _digest_unlock(digest);
+}
+
+/*
+ * Accounts for value in the global counters, and in the summary of the given
+ * bucket status (unless -1).
+ *
+ * The progress made by the workers is accounted without taking the digest
+ * lock, within the shard of the calling thread. The digest is then uploaded
+ * by the background thread, if started.
+ */
+void
+status_digest_bucket_add(struct status_digest *digest, int bucket,
+                         enum digest_field field, uint64_t value)
+{
+    struct digest_bucket    *summary = NULL;
+    uint64_t                done;
+
+    if (bucket != -1)
+        summary = &digest->buckets[bucket];
+
     switch (field)
     {
     case DIGEST_OBJECTS:
-        digest->fixed.objects += value;
+    case DIGEST_BYTES:
+        // Only accounted while loading the store.
+        _digest_lock(digest);
+        if (field == DIGEST_OBJECTS)
+            digest->fixed.objects += value;
+        else
+            digest->fixed.bytes += value;
+        if (summary && field == DIGEST_OBJECTS)
+            summary->objects += value;
+        else if (summary)
+            summary->bytes += value;
+        _digest_unlock(digest);
         break ;
     case DIGEST_DONE_OBJECTS:
-        digest->fixed.done_objects += value;
-        digest->refresh_count += value;
-        if (digest->refresh_count >= digest->refresh_frequency)
+        __atomic_fetch_add(&_digest_shard(digest)->done_objects, value, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&digest->refresh_count, value, __ATOMIC_RELAXED);
+        if (summary)
         {
-            digest->refresh_count = 0;
-            do_upload = 1;
+            done = __atomic_add_fetch(&summary->done_objects, value, __ATOMIC_RELAXED);
+            if (done >= summary->objects && done - value < summary->objects
+                && !__atomic_load_n(&summary->done, __ATOMIC_RELAXED))
+            {
+                // Make the completion of the bucket known on the next check.
+                __atomic_store_n(&summary->done, true, __ATOMIC_RELAXED);
+                __atomic_fetch_add(&digest->buckets_done, 1, __ATOMIC_RELAXED);
+            }
         }
         break ;
-    case DIGEST_BYTES:
-        digest->fixed.bytes += value;
-        break ;
     case DIGEST_DONE_BYTES:
-        digest->fixed.done_bytes += value;
+        __atomic_fetch_add(&_digest_shard(digest)->done_bytes, value, __ATOMIC_RELAXED);
+        if (summary)
+            __atomic_fetch_add(&summary->done_bytes, value, __ATOMIC_RELAXED);
         break ;
     default:
         assert(0);
     }
+}
+
+/*
+ * Tells whether the digest is due for an upload, according to its policy.
+ */
+static bool
+_digest_upload_due(struct status_digest *digest)
+{
+    bool        due = false;
+    time_t      elapsed;
+
+    _digest_lock(digest);
+
+    elapsed = time(NULL) - digest->last_upload;
+    if (elapsed < digest->min_interval)
+        goto end;
+
+    if (__atomic_load_n(&digest->refresh_count, __ATOMIC_RELAXED) >= digest->refresh_frequency
+        || __atomic_load_n(&digest->buckets_done, __ATOMIC_RELAXED) > 0)
+        due = true;
+    else if (elapsed >= digest->max_interval)
+        due = (_digest_done(digest, DIGEST_DONE_BYTES) != digest->last_done_bytes
+               || _digest_done(digest, DIGEST_DONE_OBJECTS) != digest->last_done_objects);
+
+end:
+    _digest_unlock(digest);
+
+    return due;
+}
+
+static void*
+_digest_main_loop(struct status_digest *digest)
+{
+    struct timespec     ts = {0, 0};
+
+    _digest_lock(digest);
+    while (!digest->stop)
+    {
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_sec += CLOUDMIG_STATUS_DIGEST_PERIOD;
+        pthread_cond_timedwait(&digest->cond, &digest->lock, &ts);
+        if (digest->stop)
+            break ;
+        _digest_unlock(digest);
+
+        if (_digest_upload_due(digest))
+            (void)status_digest_upload(digest);
+
+        _digest_lock(digest);
+    }
+    _digest_unlock(digest);
+
+    return NULL;
+}
+
+int
+status_digest_start(struct status_digest *digest)
+{
+    if (pthread_create(&digest->thread, NULL,
+                       (void*(*)(void*))_digest_main_loop, digest) != 0)
+    {
+        PRINTERR("[Status Digest] Could not start upload thread.\n");
+        return EXIT_FAILURE;
+    }
+    digest->started = 1;
+
+    return EXIT_SUCCESS;
+}
+
+void
+status_digest_stop(struct status_digest *digest)
+{
+    if (!digest->started)
+        return ;
+
+    _digest_lock(digest);
+    digest->stop = 1;
+    pthread_cond_signal(&digest->cond);
+    _digest_unlock(digest);
+    pthread_join(digest->thread, NULL);
+    digest->started = 0;
+
+    // Whatever the policy, leave the digest up to date on the way out.
+    if (status_digest_upload(digest) != EXIT_SUCCESS)
+        cloudmig_log(WARN_LVL, "[Status Digest] Could not upload the digest"
+                     " on shutdown.\n");
+}
+
+uint64_t
+status_digest_uploads(struct status_digest *digest)
+{
+    uint64_t    n_uploads;
+
+    _digest_lock(digest);
+    n_uploads = digest->n_uploads;
     _digest_unlock(digest);
 
-    if (do_upload)
-        status_digest_upload(digest);
+    return n_uploads;
 }
@@ -0,0 +1,1295 @@
+// Copyright (c) 2015, David Pineau
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of the copyright holder nor the names of its contributors
+//    may be used to endorse or promote products derived from this software
+//    without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER AND CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <droplet.h>
+#include <droplet/vfs.h>
+
+#include "cloudmig.h"
+#include "status.h"
+#include "status_lease.h"
+
+#define CLOUDMIG_LEASE_PREFIX           "lease."
+#define CLOUDMIG_LEASE_RECORD           "record.json"
+#define CLOUDMIG_STORE_LOCK             ".cloudmig.lock"
+
+#define CLOUDMIG_LEASE_OWNER            "owner"
+#define CLOUDMIG_LEASE_EXPIRES          "expires"
+#define CLOUDMIG_LEASE_COUNT            "count"
+#define CLOUDMIG_LEASE_COMPLETE         "complete"
+#define CLOUDMIG_LEASE_DONE             "done"
+
+/*
+ * Content of a lease record, as read from the status store.
+ */
+struct lease_record
+{
+    time_t              expires;
+    unsigned int        count;
+    bool                complete;
+    struct json_object  *done;
+};
+
+static void
+_lease_table_lock(struct lease_table *table)
+{
+    pthread_mutex_lock(&table->lock);
+}
+
+static void
+_lease_table_unlock(struct lease_table *table)
+{
+    pthread_mutex_unlock(&table->lock);
+}
+
+static void
+_lease_free(struct status_lease *lease)
+{
+    if (lease->path)
+        free(lease->path);
+    if (lease->record)
+        free(lease->record);
+    if (lease->done)
+        json_object_put(lease->done);
+    free(lease);
+}
+
+static char*
+_lease_path(const char *bucketdir, unsigned int start, unsigned int gen)
+{
+    char    *path = NULL;
+
+    if (asprintf(&path, "%s/"CLOUDMIG_LEASE_PREFIX"%u.%u",
+                 bucketdir, start, gen) <= 0)
+    {
+        PRINTERR("[Status Lease] Could not allocate lease path.\n");
+        return NULL;
+    }
+
+    return path;
+}
+
+/*
+ * Serializes the lease record. The table lock must be held by the caller.
+ *
+ * @return the record, to be freed by the caller, or NULL on error
+ */
+static char*
+_lease_serialize(struct lease_table *table, struct status_lease *lease)
+{
+    char                *ret = NULL;
+    struct json_object  *json = NULL;
+    struct json_object  *field = NULL;
+    const char          *filebuf = NULL;
+
+    json = json_object_new_object();
+    if (json == NULL)
+        goto alloc_err;
+
+    field = json_object_new_string(table->owner);
+    if (field == NULL)
+        goto alloc_err;
+    json_object_object_add(json, CLOUDMIG_LEASE_OWNER, field);
+
+    field = json_object_new_int64(lease->expires);
+    if (field == NULL)
+        goto alloc_err;
+    json_object_object_add(json, CLOUDMIG_LEASE_EXPIRES, field);
+
+    field = json_object_new_int64(lease->count);
+    if (field == NULL)
+        goto alloc_err;
+    json_object_object_add(json, CLOUDMIG_LEASE_COUNT, field);
+
+    field = json_object_new_boolean(lease->complete);
+    if (field == NULL)
+        goto alloc_err;
+    json_object_object_add(json, CLOUDMIG_LEASE_COMPLETE, field);
+
+    json_object_object_add(json, CLOUDMIG_LEASE_DONE, json_object_get(lease->done));
+
+    filebuf = json_object_to_json_string(json);
+    if (filebuf == NULL || (ret = strdup(filebuf)) == NULL)
+        goto alloc_err;
+
+    goto end;
+
+alloc_err:
+    PRINTERR("[Status Lease] Could not allocate lease record.\n");
+
+end:
+    if (json)
+        json_object_put(json);
+
+    return ret;
+}
+
+/*
+ * Uploads the lease record. The table lock must be held by the caller, and is
+ * released during the upload.
+ *
+ * A record already being uploaded by another thread is only flagged dirty:
+ * that thread uploads it again once done, so that the uploads of a record
+ * never cross each other, and the last one holds the latest state.
+ */
+static int
+_lease_sync(struct lease_table *table, struct status_lease *lease)
+{
+    int                 ret = EXIT_SUCCESS;
+    dpl_status_t        dplret;
+    char                *filebuf = NULL;
+
+    if (lease->uploading)
+    {
+        lease->dirty = true;
+        return EXIT_SUCCESS;
+    }
+
+    lease->uploading = true;
+    do
+    {
+        lease->dirty = false;
+        filebuf = _lease_serialize(table, lease);
+        if (filebuf == NULL)
+        {
+            ret = EXIT_FAILURE;
+            break ;
+        }
+
+        _lease_table_unlock(table);
+        dplret = dpl_fput(table->status_ctx, lease->record,
+                          NULL/*options*/, NULL/*condition*/, NULL/*range*/,
+                          NULL/*MD*/, NULL/*sysmd*/,
+                          filebuf, strlen(filebuf));
+        _lease_table_lock(table);
+
+        free(filebuf);
+        if (dplret != DPL_SUCCESS)
+        {
+            PRINTERR("[Status Lease] Could not upload lease record %s: %s.\n",
+                     lease->record, dpl_status_str(dplret));
+            ret = EXIT_FAILURE;
+        }
+    } while (lease->dirty);
+    lease->uploading = false;
+    pthread_cond_broadcast(&table->idle);
+
+    return ret;
+}
+
+/*
+ * Waits for the other threads to be done with the lease. The table lock must
+ * be held by the caller.
+ */
+static void
+_lease_wait_idle(struct lease_table *table, struct status_lease *lease)
+{
+    while (lease->busy > 0 || lease->uploading)
+        pthread_cond_wait(&table->idle, &table->lock);
+}
+
+/*
+ * Reads a lease record.
+ *
+ * @return  1 - Record read
+ *          0 - No record (yet) for the lease
+ *         -1 - An error occurred, see log
+ */
+static int
+_lease_read(dpl_ctx_t *status_ctx, const char *leasepath, struct lease_record *record)
+{
+    int                 ret;
+    dpl_status_t        dplret;
+    char                *path = NULL;
+    char                *buffer = NULL;
+    unsigned int        bufsize = 0;
+    struct json_tokener *tok = NULL;
+    struct json_object  *json = NULL;
+    struct json_object  *field = NULL;
+
+    if (asprintf(&path, "%s/"CLOUDMIG_LEASE_RECORD, leasepath) <= 0)
+    {
+        PRINTERR("[Status Lease] Could not allocate lease record path.\n");
+        ret = -1;
+        goto end;
+    }
+
+    dplret = dpl_fget(status_ctx, path,
+                      NULL/*option*/, NULL/*condition*/, NULL/*range*/,
+                      &buffer, &bufsize,
+                      NULL/*MD*/, NULL/*sysmd*/);
+    if (dplret != DPL_SUCCESS)
+    {
+        if (dplret == DPL_ENOENT)
+        {
+            ret = 0;
+            goto end;
+        }
+        PRINTERR("[Status Lease] Could not read lease record %s: %s.\n",
+                 path, dpl_status_str(dplret));
+        ret = -1;
+        goto end;
+    }
+
+    tok = json_tokener_new();
+    if (tok == NULL)
+    {
+        PRINTERR("[Status Lease] Could not allocate JSON tokener.\n");
+        ret = -1;
+        goto end;
+    }
+
+    json = json_tokener_parse_ex(tok, buffer, bufsize);
+    if (json == NULL)
+    {
+        PRINTERR("[Status Lease] Could not parse lease record %s.\n", path);
+        ret = -1;
+        goto end;
+    }
+
+    if (json_object_object_get_ex(json, CLOUDMIG_LEASE_EXPIRES, &field) == FALSE
+        || !json_object_is_type(field, json_type_int))
+        goto format_err;
+    record->expires = json_object_get_int64(field);
+
+    if (json_object_object_get_ex(json, CLOUDMIG_LEASE_COUNT, &field) == FALSE
+        || !json_object_is_type(field, json_type_int))
+        goto format_err;
+    record->count = json_object_get_int64(field);
+
+    if (json_object_object_get_ex(json, CLOUDMIG_LEASE_COMPLETE, &field) == FALSE
+        || !json_object_is_type(field, json_type_boolean))
+        goto format_err;
+    record->complete = json_object_get_boolean(field);
+
+    if (json_object_object_get_ex(json, CLOUDMIG_LEASE_DONE, &field) == FALSE
+        || !json_object_is_type(field, json_type_array))
+        goto format_err;
+    record->done = json_object_get(field);
+
+    ret = 1;
+    goto end;
+
+format_err:
+    PRINTERR("[Status Lease] Bad format for lease record %s.\n", path);
+    ret = -1;
+
+end:
+    if (json)
+        json_object_put(json);
+    if (tok)
+        json_tokener_free(tok);
+    if (buffer)
+        free(buffer);
+    if (path)
+        free(path);
+
+    return ret;
+}
+
+/*
+ * Attempts to lease one range of entries.
+ *
+ * @return  1 - Lease acquired
+ *          0 - The range is complete, or held by another process
+ *         -1 - An error occurred, see log
+ */
+static int
+_lease_try(struct lease_table *table, struct bucket_status *bst,
+           const char *bucketdir, unsigned int range, unsigned int n_entries,
+           struct status_lease **leasep)
+{
+    int                 ret;
+    dpl_status_t        dplret;
+    dpl_sysmd_t         sysmd;
+    struct status_lease *lease = NULL;
+    struct lease_record record = { 0, 0, false, NULL };
+    char                *path = NULL;
+    unsigned int        start = range * table->range_size;
+    unsigned int        count = n_entries - start < table->range_size
+                                ? n_entries - start : table->range_size;
+    unsigned int        gen;
+    time_t              now = time(NULL);
+
+    /*
+     * Find the latest generation of the lease of the range.
+     * Generations only grow when leases are stolen, so there are few.
+     */
+    memset(&sysmd, 0, sizeof(sysmd));
+    for (gen = 0; ; ++gen)
+    {
+        if (path)
+            free(path);
+        path = _lease_path(bucketdir, start, gen);
+        if (path == NULL)
+        {
+            ret = -1;
+            goto end;
+        }
+
+        dplret = dpl_getattr(table->status_ctx, path, NULL/*md*/, &sysmd);
+        if (dplret == DPL_ENOENT)
+            break ;
+        if (dplret != DPL_SUCCESS)
+        {
+            PRINTERR("[Status Lease] Could not stat lease %s: %s.\n",
+                     path, dpl_status_str(dplret));
+            ret = -1;
+            goto end;
+        }
+    }
+
+    if (gen > 0)
+    {
+        char    *prevpath = _lease_path(bucketdir, start, gen - 1);
+
+        if (prevpath == NULL)
+        {
+            ret = -1;
+            goto end;
+        }
+        ret = _lease_read(table->status_ctx, prevpath, &record);
+        free(prevpath);
+        if (ret == -1)
+            goto end;
+        if (ret == 0)
+        {
+            // Holder died before writing its record: expire from its creation
+            record.expires = sysmd.mtime + table->ttl;
+            record.count = count;
+        }
+
+        if (record.complete)
+        {
+            ret = 0;
+            goto end;
+        }
+        if (record.expires > now)
+        {
+            if (bst->lease_scan.held_elsewhere == 0
+                || record.expires < bst->lease_scan.earliest_expiry)
+                bst->lease_scan.earliest_expiry = record.expires;
+            bst->lease_scan.held_elsewhere += 1;
+            ret = 0;
+            goto end;
+        }
+        if (record.count != count)
+        {
+            PRINTERR("[Status Lease] Lease %s was made for %u entries instead "
+                     "of %u: all processes must use the same lease size.\n",
+                     path, record.count, count);
+            ret = -1;
+            goto end;
+        }
+    }
+
+    dplret = dpl_mkdir(table->status_ctx, path, NULL/*MD*/, NULL/*sysmd*/);
+    if (dplret != DPL_SUCCESS)
+    {
+        if (dplret == DPL_EEXIST)
+        {
+            // Another process was faster.
+            if (bst->lease_scan.held_elsewhere == 0
+                || now + table->ttl < bst->lease_scan.earliest_expiry)
+                bst->lease_scan.earliest_expiry = now + table->ttl;
+            bst->lease_scan.held_elsewhere += 1;
+            ret = 0;
+            goto end;
+        }
+        PRINTERR("[Status Lease] Could not create lease %s: %s.\n",
+                 path, dpl_status_str(dplret));
+        ret = -1;
+        goto end;
+    }
+
+    lease = calloc(1, sizeof(*lease));
+    if (lease == NULL)
+    {
+        PRINTERR("[Status Lease] Could not allocate lease.\n");
+        ret = -1;
+        goto end;
+    }
+    lease->bst = bst;
+    lease->path = path;
+    path = NULL;
+    lease->start = start;
+    lease->count = count;
+    lease->gen = gen;
+    lease->cursor = start;
+    lease->expires = now + table->ttl;
+
+    // Take over the completions recorded by the previous holder.
+    lease->done = record.done ? json_object_get(record.done) : json_object_new_array();
+    if (lease->done == NULL
+        || asprintf(&lease->record, "%s/"CLOUDMIG_LEASE_RECORD, lease->path) <= 0)
+    {
+        lease->record = NULL;
+        PRINTERR("[Status Lease] Could not allocate lease data.\n");
+        ret = -1;
+        goto end;
+    }
+
+    // Not visible to the other threads until it is added to the table.
+    _lease_table_lock(table);
+    ret = _lease_sync(table, lease);
+    if (ret == EXIT_SUCCESS)
+    {
+        lease->next = table->leases;
+        table->leases = lease;
+        table->n_acquired += 1;
+        if (gen > 0)
+            table->n_stolen += 1;
+    }
+    _lease_table_unlock(table);
+    if (ret != EXIT_SUCCESS)
+    {
+        ret = -1;
+        goto end;
+    }
+
+    cloudmig_log(INFO_LVL, "[Status Lease] Leased entries %u to %u of %s"
+                 " (generation %u).\n", start, start + count - 1, bucketdir, gen);
+
+    *leasep = lease;
+    lease = NULL;
+    ret = 1;
+
+end:
+    if (lease)
+        _lease_free(lease);
+    if (record.done)
+        json_object_put(record.done);
+    if (path)
+        free(path);
+
+    return ret;
+}
+
+int
+status_lease_acquire(struct lease_table *table, struct bucket_status *bst,
+                     const char *bucketdir, unsigned int n_entries,
+                     struct status_lease **leasep)
+{
+    int                 ret;
+    struct lease_scan   *scan = &bst->lease_scan;
+    unsigned int        n_ranges;
+    bool                wrapped = false;
+
+    n_ranges = (n_entries + table->range_size - 1) / table->range_size;
+
+    for (;;)
+    {
+        if (scan->next_range >= n_ranges)
+        {
+            /*
+             * Ranges held by other processes may have expired since they were
+             * seen: scan again once the earliest of them could be stolen.
+             */
+            if (scan->held_elsewhere == 0 || wrapped
+                || time(NULL) < scan->earliest_expiry)
+            {
+                if (scan->held_elsewhere)
+                    cloudmig_log(INFO_LVL, "[Status Lease] %u ranges of %s are "
+                                 "still leased by other processes.\n",
+                                 scan->held_elsewhere, bucketdir);
+                return 0;
+            }
+            scan->next_range = 0;
+            scan->held_elsewhere = 0;
+            wrapped = true;
+        }
+
+        ret = _lease_try(table, bst, bucketdir, scan->next_range, n_entries, leasep);
+        scan->next_range += 1;
+        if (ret != 0)
+            return ret;
+    }
+}
+
+struct status_lease*
+status_lease_active(struct lease_table *table, struct bucket_status *bst)
+{
+    struct status_lease *lease = NULL;
+
+    _lease_table_lock(table);
+    for (lease = table->leases; lease != NULL; lease = lease->next)
+    {
+        if (lease->bst == bst && !lease->lost && !lease->finishing
+            && lease->cursor < lease->start + lease->count)
+            break ;
+    }
+    _lease_table_unlock(table);
+
+    return lease;
+}
+
+struct status_lease*
+status_lease_find(struct lease_table *table, struct bucket_status *bst,
+                  unsigned int idx)
+{
+    struct status_lease *lease = NULL;
+
+    _lease_table_lock(table);
+    for (lease = table->leases; lease != NULL; lease = lease->next)
+    {
+        if (lease->bst == bst
+            && idx >= lease->start && idx < lease->start + lease->count)
+            break ;
+    }
+    _lease_table_unlock(table);
+
+    return lease;
+}
+
+bool
+status_lease_handout(struct lease_table *table, struct status_lease *lease,
+                     unsigned int cursor, bool found)
+{
+    bool    do_finish = false;
+
+    _lease_table_lock(table);
+    lease->cursor = cursor;
+    if (found)
+        lease->pending += 1;
+    // A lost lease must not hand out more entries.
+    if (!found || lease->lost)
+        lease->cursor = lease->start + lease->count;
+    if (lease->cursor >= lease->start + lease->count
+        && lease->pending == 0 && !lease->finishing)
+    {
+        lease->finishing = true;
+        do_finish = true;
+    }
+    _lease_table_unlock(table);
+
+    return do_finish;
+}
+
+bool
+status_lease_put(struct lease_table *table, struct status_lease *lease)
+{
+    bool    do_finish = false;
+
+    _lease_table_lock(table);
+    lease->pending -= 1;
+    if (lease->cursor >= lease->start + lease->count
+        && lease->pending == 0 && !lease->finishing)
+    {
+        lease->finishing = true;
+        do_finish = true;
+    }
+    _lease_table_unlock(table);
+
+    return do_finish;
+}
+
+int
+status_lease_record_done(struct lease_table *table, struct bucket_status *bst,
+                         const unsigned int *idxs, int n_idxs)
+{
+    int                 ret = EXIT_SUCCESS;
+    struct status_lease *lease = NULL;
+    struct json_object  *jsidx = NULL;
+
+    _lease_table_lock(table);
+    for (lease = table->leases; lease != NULL; lease = lease->next)
+    {
+        bool    dirty = false;
+
+        if (lease->bst != bst)
+            continue ;
+
+        for (int i=0; i < n_idxs; ++i)
+        {
+            if (idxs[i] < lease->start || idxs[i] >= lease->start + lease->count)
+                continue ;
+            jsidx = json_object_new_int64(idxs[i]);
+            if (jsidx == NULL)
+            {
+                PRINTERR("[Status Lease] Could not allocate entry index.\n");
+                ret = EXIT_FAILURE;
+                continue ;
+            }
+            json_object_array_add(lease->done, jsidx);
+            dirty = true;
+        }
+
+        /*
+         * Even if the lease was stolen, the record keeps the completions from
+         * being lost: all generations are merged when loading the status.
+         * The lease cannot be finished while the lock is released to upload.
+         */
+        if (dirty)
+        {
+            lease->busy += 1;
+            if (_lease_sync(table, lease) != EXIT_SUCCESS)
+                ret = EXIT_FAILURE;
+            lease->busy -= 1;
+            pthread_cond_broadcast(&table->idle);
+        }
+    }
+    _lease_table_unlock(table);
+
+    return ret;
+}
+
+void
+status_lease_finish(struct lease_table *table, struct status_lease *lease,
+                    bool complete)
+{
+    struct status_lease **prevp = NULL;
+
+    _lease_table_lock(table);
+
+    if (!lease->lost)
+    {
+        // An incomplete range is released to be retried by any process.
+        if (!complete)
+            lease->expires = 0;
+        lease->complete = complete;
+        (void)_lease_sync(table, lease);
+        cloudmig_log(INFO_LVL, "[Status Lease] %s entries %u to %u of lease %s.\n",
+                     complete ? "Completed" : "Released",
+                     lease->start, lease->start + lease->count - 1, lease->path);
+    }
+
+    // The final record must be uploaded before the lease goes away.
+    _lease_wait_idle(table, lease);
+
+    for (prevp = &table->leases; *prevp != NULL; prevp = &(*prevp)->next)
+    {
+        if (*prevp == lease)
+        {
+            *prevp = lease->next;
+            break ;
+        }
+    }
+
+    _lease_table_unlock(table);
+
+    _lease_free(lease);
+}
+
+static int _lease_store_lock_renew(struct lease_table *table, const char *path);
+
+/*
+ * Renews the leases held, and detects the ones stolen by other processes.
+ * The table lock must be held by the caller, and is released during the
+ * requests to the status store: the leases renewed are pinned meanwhile.
+ */
+static void
+_lease_renew_all(struct lease_table *table)
+{
+    struct status_lease *lease = NULL;
+    struct status_lease **held = NULL;
+    bool                *stolen = NULL;
+    int                 n_held = 0;
+    char                *nextpath = NULL;
+    char                *bucketdir = NULL;
+    char                *slash = NULL;
+    char                *lockpath = NULL;
+
+    for (lease = table->leases; lease != NULL; lease = lease->next)
+        n_held += 1;
+    held = calloc(n_held + 1, sizeof(*held));
+    stolen = calloc(n_held + 1, sizeof(*stolen));
+    if (held == NULL || stolen == NULL)
+    {
+        PRINTERR("[Status Lease] Could not allocate the leases to renew.\n");
+        goto end;
+    }
+
+    n_held = 0;
+    for (lease = table->leases; lease != NULL; lease = lease->next)
+    {
+        if (lease->lost || lease->finishing)
+            continue ;
+        lease->busy += 1;
+        held[n_held++] = lease;
+    }
+    if (table->store_lock)
+    {
+        lockpath = strdup(table->store_lock);
+        if (lockpath)
+            table->refreshing = true;
+    }
+
+    _lease_table_unlock(table);
+
+    for (int i=0; i < n_held; ++i)
+    {
+        bucketdir = strdup(held[i]->path);
+        if (bucketdir == NULL)
+            continue ;
+        slash = strrchr(bucketdir, '/');
+        if (slash)
+            *slash = '\0';
+        nextpath = _lease_path(bucketdir, held[i]->start, held[i]->gen + 1);
+        free(bucketdir);
+        if (nextpath == NULL)
+            continue ;
+
+        stolen[i] = (dpl_getattr(table->status_ctx, nextpath,
+                                 NULL/*md*/, NULL/*sysmd*/) == DPL_SUCCESS);
+        free(nextpath);
+    }
+
+    if (lockpath && _lease_store_lock_renew(table, lockpath) != EXIT_SUCCESS)
+        cloudmig_log(WARN_LVL, "[Status Lease] Could not renew the status store lock.\n");
+
+    _lease_table_lock(table);
+
+    if (lockpath)
+        table->refreshing = false;
+
+    for (int i=0; i < n_held; ++i)
+    {
+        lease = held[i];
+        if (stolen[i] && !lease->lost)
+        {
+            cloudmig_log(WARN_LVL, "[Status Lease] Lease %s was taken over by"
+                         " another process.\n", lease->path);
+            lease->lost = true;
+            table->n_lost += 1;
+        }
+        // A lease finished meanwhile already uploaded its final record.
+        else if (!lease->lost && !lease->finishing)
+        {
+            lease->expires = time(NULL) + table->ttl;
+            if (_lease_sync(table, lease) != EXIT_SUCCESS)
+                cloudmig_log(WARN_LVL, "[Status Lease] Could not renew lease %s.\n",
+                             lease->path);
+        }
+        lease->busy -= 1;
+    }
+    pthread_cond_broadcast(&table->idle);
+
+end:
+    if (held)
+        free(held);
+    if (stolen)
+        free(stolen);
+    if (lockpath)
+        free(lockpath);
+}
+
+static void*
+_lease_renewer_loop(struct lease_table *table)
+{
+    struct timespec     ts = {0, 0};
+    time_t              period;
+
+    // Renew well before the expiry, to survive a failed renewal.
+    period = table->ttl / 3 > 0 ? table->ttl / 3 : 1;
+
+    _lease_table_lock(table);
+    while (!table->stop)
+    {
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_sec += period;
+        pthread_cond_timedwait(&table->cond, &table->lock, &ts);
+        if (table->stop)
+            break ;
+        _lease_renew_all(table);
+    }
+    _lease_table_unlock(table);
+
+    return NULL;
+}
+
+struct lease_table*
+status_lease_table_new(dpl_ctx_t *status_ctx, unsigned int range_size, time_t ttl)
+{
+    struct lease_table  *ret = NULL;
+    struct lease_table  *table = NULL;
+    char                hostname[HOST_NAME_MAX + 1];
+
+    table = calloc(1, sizeof(*table));
+    if (table == NULL)
+    {
+        PRINTERR("[Status Lease] Could not allocate lease table.\n");
+        goto end;
+    }
+    table->status_ctx = status_ctx;
+    table->range_size = range_size;
+    table->ttl = ttl;
+
+    if (gethostname(hostname, sizeof(hostname)) == -1)
+        strcpy(hostname, "localhost");
+    hostname[HOST_NAME_MAX] = '\0';
+    if (asprintf(&table->owner, "%s:%i", hostname, (int)getpid()) <= 0)
+    {
+        table->owner = NULL;
+        PRINTERR("[Status Lease] Could not allocate lease owner.\n");
+        goto end;
+    }
+
+    if (pthread_mutex_init(&table->lock, NULL) != 0)
+    {
+        PRINTERR("[Status Lease] Could not initialize lock.\n");
+        goto end;
+    }
+    table->lock_inited = 1;
+
+    if (pthread_cond_init(&table->cond, NULL) != 0)
+    {
+        PRINTERR("[Status Lease] Could not initialize condition.\n");
+        goto end;
+    }
+    table->cond_inited = 1;
+
+    if (pthread_cond_init(&table->idle, NULL) != 0)
+    {
+        PRINTERR("[Status Lease] Could not initialize condition.\n");
+        goto end;
+    }
+    table->idle_inited = 1;
+
+    if (pthread_create(&table->renewer, NULL,
+                       (void*(*)(void*))_lease_renewer_loop, table) != 0)
+    {
+        PRINTERR("[Status Lease] Could not start lease renewing thread.\n");
+        goto end;
+    }
+    table->started = 1;
+
+    cloudmig_log(INFO_LVL, "[Status Lease] Cooperative migration as %s: "
+                 "leasing %u entries for %lis.\n",
+                 table->owner, range_size, (long)ttl);
+
+    ret = table;
+    table = NULL;
+
+end:
+    if (table)
+        status_lease_table_free(table);
+
+    return ret;
+}
+
+void
+status_lease_table_free(struct lease_table *table)
+{
+    struct status_lease *lease = NULL;
+
+    if (table->started)
+    {
+        _lease_table_lock(table);
+        table->stop = 1;
+        pthread_cond_signal(&table->cond);
+        _lease_table_unlock(table);
+        pthread_join(table->renewer, NULL);
+    }
+
+    // No other thread uses the table anymore.
+    _lease_table_lock(table);
+    while (table->leases)
+    {
+        lease = table->leases;
+        table->leases = lease->next;
+        if (!lease->lost)
+        {
+            lease->expires = 0;
+            lease->complete = false;
+            (void)_lease_sync(table, lease);
+        }
+        _lease_free(lease);
+    }
+    _lease_table_unlock(table);
+
+    if (table->owner)
+        cloudmig_log(INFO_LVL, "[Status Lease] Leases: %llu acquired"
+                     " (%llu taken over), %llu lost.\n",
+                     (unsigned long long)table->n_acquired,
+                     (unsigned long long)table->n_stolen,
+                     (unsigned long long)table->n_lost);
+
+    if (table->cond_inited)
+        pthread_cond_destroy(&table->cond);
+    if (table->idle_inited)
+        pthread_cond_destroy(&table->idle);
+    if (table->store_lock)
+        free(table->store_lock);
+    if (table->lock_inited)
+        pthread_mutex_destroy(&table->lock);
+    if (table->owner)
+        free(table->owner);
+    free(table);
+}
+
+struct json_object*
+status_lease_merge(dpl_ctx_t *status_ctx, const char *bucketdir)
+{
+    struct json_object  *ret = NULL;
+    struct json_object  *done = NULL;
+    struct lease_record record = { 0, 0, false, NULL };
+    dpl_status_t        dplret;
+    dpl_dirent_t        dirent;
+    void                *dir_hdl = NULL;
+    char                *path = NULL;
+    int                 namelen;
+
+    done = json_object_new_array();
+    if (done == NULL)
+    {
+        PRINTERR("[Status Lease] Could not allocate JSON array.\n");
+        goto end;
+    }
+
+    dplret = dpl_opendir(status_ctx, bucketdir, &dir_hdl);
+    if (dplret != DPL_SUCCESS)
+    {
+        // No bucket directory means that nothing was ever leased.
+        if (dplret == DPL_ENOENT)
+        {
+            ret = done;
+            done = NULL;
+            goto end;
+        }
+        PRINTERR("[Status Lease] Could not list leases of %s: %s.\n",
+                 bucketdir, dpl_status_str(dplret));
+        goto end;
+    }
+
+    while (!dpl_eof(dir_hdl))
+    {
+        dplret = dpl_readdir(dir_hdl, &dirent);
+        if (dplret != DPL_SUCCESS)
+        {
+            PRINTERR("[Status Lease] Could not list leases of %s: %s.\n",
+                     bucketdir, dpl_status_str(dplret));
+            goto end;
+        }
+
+        if (strncmp(dirent.name, CLOUDMIG_LEASE_PREFIX,
+                    strlen(CLOUDMIG_LEASE_PREFIX)) != 0)
+            continue ;
+
+        namelen = strlen(dirent.name);
+        if (namelen > 0 && dirent.name[namelen - 1] == '/')
+            namelen -= 1;
+        if (asprintf(&path, "%s/%.*s", bucketdir, namelen, dirent.name) <= 0)
+        {
+            path = NULL;
+            PRINTERR("[Status Lease] Could not allocate lease path.\n");
+            goto end;
+        }
+
+        if (_lease_read(status_ctx, path, &record) == -1)
+            goto end;
+        free(path);
+        path = NULL;
+
+        if (record.done)
+        {
+            for (int i=0; i < json_object_array_length(record.done); ++i)
+                json_object_array_add(done,
+                    json_object_get(json_object_array_get_idx(record.done, i)));
+            json_object_put(record.done);
+            record.done = NULL;
+        }
+    }
+
+    ret = done;
+    done = NULL;
+
+end:
+    if (dir_hdl)
+        dpl_closedir(dir_hdl);
+    if (path)
+        free(path);
+    if (done)
+        json_object_put(done);
+
+    return ret;
+}
+
+/*
+ * Uploads the record of the status store lock, in the format of the lease
+ * records so that it is read the same way.
+ */
+static int
+_lease_store_lock_put(struct lease_table *table, const char *path, time_t expires)
+{
+    int                 ret = EXIT_FAILURE;
+    dpl_status_t        dplret;
+    struct status_lease lock;
+    char                *recordpath = NULL;
+    char                *filebuf = NULL;
+
+    memset(&lock, 0, sizeof(lock));
+    lock.expires = expires;
+    lock.done = json_object_new_array();
+    if (lock.done == NULL)
+    {
+        PRINTERR("[Status Lease] Could not allocate JSON array.\n");
+        goto end;
+    }
+
+    if (asprintf(&recordpath, "%s/"CLOUDMIG_LEASE_RECORD, path) <= 0)
+    {
+        recordpath = NULL;
+        PRINTERR("[Status Lease] Could not allocate store lock record path.\n");
+        goto end;
+    }
+
+    // The owner is only read, and does not need the table lock.
+    filebuf = _lease_serialize(table, &lock);
+    if (filebuf == NULL)
+        goto end;
+
+    dplret = dpl_fput(table->status_ctx, recordpath,
+                      NULL/*options*/, NULL/*condition*/, NULL/*range*/,
+                      NULL/*MD*/, NULL/*sysmd*/,
+                      filebuf, strlen(filebuf));
+    if (dplret != DPL_SUCCESS)
+    {
+        PRINTERR("[Status Lease] Could not upload store lock record %s: %s.\n",
+                 recordpath, dpl_status_str(dplret));
+        goto end;
+    }
+
+    ret = EXIT_SUCCESS;
+
+end:
+    if (filebuf)
+        free(filebuf);
+    if (recordpath)
+        free(recordpath);
+    if (lock.done)
+        json_object_put(lock.done);
+
+    return ret;
+}
+
+static int
+_lease_store_lock_renew(struct lease_table *table, const char *path)
+{
+    return _lease_store_lock_put(table, path, time(NULL) + table->ttl);
+}
+
+/*
+ * Removes the status store lock, along with its record.
+ */
+static void
+_lease_store_lock_remove(dpl_ctx_t *status_ctx, const char *path)
+{
+    char    *recordpath = NULL;
+
+    if (asprintf(&recordpath, "%s/"CLOUDMIG_LEASE_RECORD, path) > 0)
+    {
+        (void)dpl_unlink(status_ctx, recordpath);
+        free(recordpath);
+    }
+    (void)dpl_rmdir(status_ctx, path);
+}
+
+/*
+ * Builds the path of one generation of the status store lock.
+ */
+static char*
+_lease_store_lock_path(const char *storepath, unsigned int gen)
+{
+    char    *path = NULL;
+
+    if (asprintf(&path, "%s/"CLOUDMIG_STORE_LOCK".%u", storepath, gen) <= 0)
+    {
+        PRINTERR("[Status Lease] Could not allocate store lock path.\n");
+        return NULL;
+    }
+
+    return path;
+}
+
+/*
+ * Attempts to take the status store lock.
+ *
+ * As for the leases, breaking a stale lock creates its next generation instead
+ * of removing it: the exclusive creation lets a single process take over, and
+ * the others find the new generation held. Only the latest generation is ever
+ * released, so that the generations always form a sequence from 0.
+ *
+ * @return  1 - Lock acquired, its path is returned through pathp
+ *          0 - The lock is held by another process
+ *         -1 - An error occurred, see log
+ */
+static int
+_lease_store_lock_try(struct lease_table *table, const char *storepath, char **pathp)
+{
+    int                 ret;
+    dpl_status_t        dplret;
+    dpl_sysmd_t         sysmd;
+    struct lease_record record = { 0, 0, false, NULL };
+    char                *path = NULL;
+    unsigned int        gen;
+
+    memset(&sysmd, 0, sizeof(sysmd));
+    for (gen = 0; ; ++gen)
+    {
+        if (path)
+            free(path);
+        path = _lease_store_lock_path(storepath, gen);
+        if (path == NULL)
+        {
+            ret = -1;
+            goto end;
+        }
+
+        dplret = dpl_getattr(table->status_ctx, path, NULL/*md*/, &sysmd);
+        if (dplret == DPL_ENOENT)
+            break ;
+        if (dplret != DPL_SUCCESS)
+        {
+            PRINTERR("[Status Lease] Could not stat store lock %s: %s.\n",
+                     path, dpl_status_str(dplret));
+            ret = -1;
+            goto end;
+        }
+    }
+
+    if (gen > 0)
+    {
+        char    *prevpath = _lease_store_lock_path(storepath, gen - 1);
+
+        if (prevpath == NULL)
+        {
+            ret = -1;
+            goto end;
+        }
+        ret = _lease_read(table->status_ctx, prevpath, &record);
+        free(prevpath);
+        if (record.done)
+        {
+            json_object_put(record.done);
+            record.done = NULL;
+        }
+        if (ret == -1)
+            goto end;
+        if (ret == 0)
+            // Holder died before writing its record: expire from its creation
+            record.expires = sysmd.mtime + table->ttl;
+
+        if (record.expires >= time(NULL))
+        {
+            ret = 0;
+            goto end;
+        }
+        cloudmig_log(WARN_LVL, "[Status Lease] Breaking stale status store lock.\n");
+    }
+
+    dplret = dpl_mkdir(table->status_ctx, path, NULL/*MD*/, NULL/*sysmd*/);
+    if (dplret != DPL_SUCCESS)
+    {
+        if (dplret == DPL_EEXIST)
+        {
+            // Another process was faster.
+            ret = 0;
+            goto end;
+        }
+        PRINTERR("[Status Lease] Could not lock status store: %s.\n",
+                 dpl_status_str(dplret));
+        ret = -1;
+        goto end;
+    }
+
+    *pathp = path;
+    path = NULL;
+    ret = 1;
+
+end:
+    if (path)
+        free(path);
+
+    return ret;
+}
+
+int
+status_lease_lock_store(struct lease_table *table, const char *storepath)
+{
+    int                 ret;
+    char                *path = NULL;
+    bool                waiting = false;
+
+    while ((ret = _lease_store_lock_try(table, storepath, &path)) == 0)
+    {
+        if (!waiting)
+            cloudmig_log(INFO_LVL, "[Status Lease] Waiting for another process"
+                         " to set up the status store...\n");
+        waiting = true;
+        sleep(1);
+    }
+    if (ret == -1)
+    {
+        ret = EXIT_FAILURE;
+        goto end;
+    }
+
+    ret = _lease_store_lock_renew(table, path);
+    if (ret != EXIT_SUCCESS)
+    {
+        _lease_store_lock_remove(table->status_ctx, path);
+        goto end;
+    }
+
+    // From now on, the renewing thread keeps the lock alive.
+    _lease_table_lock(table);
+    table->store_lock = path;
+    path = NULL;
+    _lease_table_unlock(table);
+
+end:
+    if (path)
+        free(path);
+
+    return ret;
+}
+
+void
+status_lease_unlock_store(struct lease_table *table)
+{
+    char            *path = NULL;
+
+    // Do not let a renewal recreate the record of a released lock.
+    _lease_table_lock(table);
+    while (table->refreshing)
+        pthread_cond_wait(&table->idle, &table->lock);
+    path = table->store_lock;
+    table->store_lock = NULL;
+    _lease_table_unlock(table);
+
+    if (path == NULL)
+        return ;
+
+    _lease_store_lock_remove(table->status_ctx, path);
+    free(path);
+}
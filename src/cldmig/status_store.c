@@ -24,6 +24,8 @@
 // ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
 // POSSIBILITY OF SUCH DAMAGE.
 
+#include <errno.h>
+#include <unistd.h>
 #include <droplet.h>
 #include <droplet/vfs.h>
 
@@ -31,6 +33,8 @@
 #include "status_store.h"
 #include "status_bucket.h"
 #include "status_digest.h"
+#include "status_lease.h"
+#include "status_wal.h"
 #include "utils.h"
 
 
@@ -232,29 +236,34 @@ err:
     return found;
 }
 
+/*
+ * Makes room for n_more bucket statuses in the status' table.
+ */
 static int
-_buckets_autoexpand(struct cloudmig_status *status)
+_buckets_autoexpand(struct cloudmig_status *status, int n_more)
 {
     int                     ret;
+    int                     n_buckets;
     struct bucket_status    **tmp = NULL;
 
-    if (status->n_loaded < status->n_buckets)
+    if (status->n_loaded + n_more <= status->n_buckets)
     {
         ret = EXIT_SUCCESS;
         goto end;
     }
 
-    tmp = realloc(status->buckets, sizeof(*status->buckets) * (status->n_buckets + 10));
+    n_buckets = status->n_loaded + n_more + 10;
+    tmp = realloc(status->buckets, sizeof(*status->buckets) * n_buckets);
     if (tmp == NULL)
     {
         ret = EXIT_FAILURE;
         goto end;
     }
 
-    for (int i=status->n_buckets; i < status->n_buckets+10; ++i)
+    for (int i=status->n_buckets; i < n_buckets; ++i)
         tmp[i] = NULL;
 
-    status->n_buckets += 10;
+    status->n_buckets = n_buckets;
     status->buckets = tmp;
     tmp = NULL;
 
@@ -282,7 +291,8 @@ status_store_entry_update(struct cloudmig_ctx *ctx,
         goto end;
     }
 
-    status_digest_add(ctx->status->digest, DIGEST_DONE_BYTES, done_chunk_size);
+    status_digest_bucket_add(ctx->status->digest, filestate->bst->summary,
+                             DIGEST_DONE_BYTES, done_chunk_size);
 
 end:
     return ret;
@@ -302,19 +312,336 @@ status_store_entry_complete(struct cloudmig_ctx *ctx,
         goto end;
     }
 
-    status_digest_add(ctx->status->digest, DIGEST_DONE_OBJECTS, 1);
+    status_digest_bucket_add(ctx->status->digest, filestate->bst->summary,
+                             DIGEST_DONE_OBJECTS, 1);
+
+end:
+    return ret;
+}
+
+int
+status_store_entries_complete(struct cloudmig_ctx *ctx,
+                              struct file_transfer_state **filestates,
+                              int n_entries)
+{
+    int ret;
+
+    if (n_entries == 0)
+        return EXIT_SUCCESS;
+
+    ret = status_bucket_entries_complete(ctx->status_ctx, filestates, n_entries);
+    if (ret != EXIT_SUCCESS)
+    {
+        cloudmig_log(WARN_LVL, "[Migrating] Could not register "
+                     "end of migration for a batch of %i objects\n", n_entries);
+        goto end;
+    }
+
+    for (int i=0; i < n_entries; ++i)
+        status_digest_bucket_add(ctx->status->digest, filestates[i]->bst->summary,
+                                 DIGEST_DONE_OBJECTS, 1);
 
 end:
     return ret;
 }
 
+/*
+ * A bucket status to load (or open) from the status store, or to create from
+ * the configuration.
+ */
+struct bucket_job
+{
+    char                    *name;          // status file to load, if any
+    int                     config_index;   // configured bucket to create otherwise
+    int                     summary;        // within the digest, -1 if none yet
+    struct bucket_status    *bst;
+    uint64_t                count;
+    uint64_t                size;
+    bool                    resynced;
+    struct bucket_resync    resync;
+};
+
+/*
+ * The jobs are shared by a bounded pool of threads, each job filling its own
+ * slot: the ordering of the buckets does not depend on the scheduling.
+ */
+struct bucket_loader
+{
+    struct cloudmig_ctx     *ctx;
+    int                     regen_digest;
+    struct bucket_job       *jobs;
+    int                     n_jobs;
+    int                     next_job;
+    pthread_mutex_t         lock;
+    int                     ret;
+};
+
+static void
+_status_crawl(struct cloudmig_ctx *ctx, struct bucket_crawl *crawl)
+{
+    crawl->src_ctx = ctx->src_ctx;
+    crawl->listing = ctx->options.listing;
+    crawl->filter = ctx->options.filter;
+}
+
+/*
+ * Merges a new listing of the source into an existing bucket status.
+ */
+static int
+_bucket_job_resync(struct bucket_loader *loader, struct bucket_job *job)
+{
+    struct cloudmig_ctx     *ctx = loader->ctx;
+    struct timespec         start;
+    struct timespec         end;
+    struct bucket_crawl     crawl;
+
+    if (!(ctx->options.flags & RESYNC_MIGRATION))
+        return EXIT_SUCCESS;
+
+    _status_crawl(ctx, &crawl);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (status_bucket_resync(ctx->status_ctx, &crawl,
+                             job->bst, &job->resync) != EXIT_SUCCESS)
+    {
+        PRINTERR("[Loading Status Store] Could not resync status file %s.\n",
+                 job->name);
+        return EXIT_FAILURE;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    job->resynced = true;
+
+    cloudmig_log(INFO_LVL, "[Loading Status Store] Resynced bucket status %s"
+                 " (%"PRIu64" objects) in %li ms.\n",
+                 job->name, job->resync.objects,
+                 (long)((end.tv_sec - start.tv_sec) * 1000
+                        + (end.tv_nsec - start.tv_nsec) / 1000000));
+
+    return EXIT_SUCCESS;
+}
+
+/*
+ * The inventory of a source bucket is named after it within the inventory
+ * directory, with a ".tsv" extension.
+ *
+ * @return  the path of the inventory, NULL if there is none or on failure
+ */
+static char*
+_bucket_job_inventory(struct cloudmig_ctx *ctx, struct bucket_job *job, bool *errorp)
+{
+    char    *invpath = NULL;
+
+    *errorp = false;
+    if (ctx->options.inventory_dir == NULL)
+        return NULL;
+
+    if (asprintf(&invpath, "%s/%s.tsv", ctx->options.inventory_dir,
+                 ctx->options.src_buckets[job->config_index]) <= 0)
+    {
+        PRINTERR("[Loading Status Store] Could not allocate inventory path.\n");
+        *errorp = true;
+        return NULL;
+    }
+
+    if (access(invpath, R_OK) != 0)
+    {
+        cloudmig_log(WARN_LVL, "[Loading Status Store] No inventory %s (%s):"
+                     " listing source bucket %s.\n", invpath, strerror(errno),
+                     ctx->options.src_buckets[job->config_index]);
+        free(invpath);
+        return NULL;
+    }
+
+    return invpath;
+}
+
+static int
+_bucket_job_run(struct bucket_loader *loader, struct bucket_job *job)
+{
+    struct cloudmig_ctx     *ctx = loader->ctx;
+    struct timespec         start;
+    struct timespec         end;
+    struct digest_bucket    summary;
+    char                    *inventory = NULL;
+    bool                    error;
+    struct bucket_crawl     crawl;
+
+    /*
+     * Opening is free: only the loads and creates are worth timing.
+     * A bucket status can only be opened when summarized within the digest,
+     * which also tells whether it can be skipped altogether. The summaries
+     * are not trusted with that in cooperative mode, since the digest is then
+     * updated concurrently by every process.
+     */
+    if (job->name && !loader->regen_digest && job->summary != -1)
+    {
+        status_digest_bucket_get(ctx->status->digest, job->summary, &summary);
+        job->bst = status_bucket_open(ctx->status_ctx,
+                                      ctx->status->store_path, job->name,
+                                      summary.done
+                                      && !(ctx->options.flags & COOPERATIVE_MIGRATION),
+                                      ctx->options.flags & COOPERATIVE_MIGRATION);
+        if (job->bst == NULL)
+            return EXIT_FAILURE;
+        return _bucket_job_resync(loader, job);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (job->name)
+    {
+        job->bst = status_bucket_load(ctx->status_ctx,
+                                      ctx->status->store_path, job->name,
+                                      ctx->options.flags & COOPERATIVE_MIGRATION,
+                                      &job->count, &job->size);
+        if (job->bst == NULL)
+        {
+            PRINTERR("[Loading Status Store] Could not load status file %s.\n",
+                     job->name);
+            return EXIT_FAILURE;
+        }
+    }
+    else
+    {
+        inventory = _bucket_job_inventory(ctx, job, &error);
+        if (error)
+            return EXIT_FAILURE;
+        _status_crawl(ctx, &crawl);
+        job->bst = status_bucket_create(ctx->status_ctx, &crawl,
+                                        ctx->status->store_path,
+                                        ctx->options.src_buckets[job->config_index],
+                                        ctx->options.dst_buckets[job->config_index],
+                                        inventory, &job->count, &job->size);
+        free(inventory);
+        if (job->bst == NULL)
+        {
+            PRINTERR("[Loading Status Store] "
+                     "Could not create status for source bucket %s.\n",
+                     ctx->options.src_buckets[job->config_index]);
+            return EXIT_FAILURE;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    cloudmig_log(INFO_LVL, "[Loading Status Store] %s bucket status %s"
+                 " (%"PRIu64" objects) in %li ms.\n",
+                 job->name ? "Loaded" : "Created",
+                 job->name ? job->name : ctx->options.src_buckets[job->config_index],
+                 job->count,
+                 (long)((end.tv_sec - start.tv_sec) * 1000
+                        + (end.tv_nsec - start.tv_nsec) / 1000000));
+
+    // A bucket status just created has nothing to merge.
+    return job->name ? _bucket_job_resync(loader, job) : EXIT_SUCCESS;
+}
+
+static void*
+_bucket_loader(void *arg)
+{
+    struct bucket_loader    *loader = arg;
+    struct bucket_job       *job = NULL;
+
+    for (;;)
+    {
+        // Stop handing out jobs after the first failure.
+        pthread_mutex_lock(&loader->lock);
+        job = NULL;
+        if (loader->ret == EXIT_SUCCESS && loader->next_job < loader->n_jobs)
+            job = &loader->jobs[loader->next_job++];
+        pthread_mutex_unlock(&loader->lock);
+
+        if (job == NULL)
+            break ;
+
+        if (_bucket_job_run(loader, job) != EXIT_SUCCESS)
+        {
+            pthread_mutex_lock(&loader->lock);
+            loader->ret = EXIT_FAILURE;
+            pthread_mutex_unlock(&loader->lock);
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Runs the jobs on up to CLOUDMIG_STATUS_LOAD_THREADS threads.
+ */
+static int
+_buckets_load_parallel(struct bucket_loader *loader)
+{
+    int                     n_threads;
+    pthread_t               threads[CLOUDMIG_STATUS_LOAD_THREADS];
+    bool                    started[CLOUDMIG_STATUS_LOAD_THREADS];
+
+    n_threads = loader->n_jobs;
+    if (n_threads > CLOUDMIG_STATUS_LOAD_THREADS)
+        n_threads = CLOUDMIG_STATUS_LOAD_THREADS;
+
+    for (int t=0; t < n_threads; ++t)
+    {
+        started[t] = (pthread_create(&threads[t], NULL,
+                                     &_bucket_loader, loader) == 0);
+        // Fallback on the current thread if no thread could be spawned
+        if (!started[t])
+            _bucket_loader(loader);
+    }
+
+    for (int t=0; t < n_threads; ++t)
+    {
+        if (started[t])
+            pthread_join(threads[t], NULL);
+    }
+
+    return loader->ret;
+}
+
+static int
+_bucket_job_add(struct bucket_loader *loader, const char *name, int config_index)
+{
+    struct bucket_job       *jobs = NULL;
+    char                    *namedup = NULL;
+
+    if (name)
+    {
+        namedup = strdup(name);
+        if (namedup == NULL)
+        {
+            PRINTERR("[Loading Status Store] Could not allocate bucket job.\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    jobs = realloc(loader->jobs, sizeof(*jobs) * (loader->n_jobs + 1));
+    if (jobs == NULL)
+    {
+        PRINTERR("[Loading Status Store] Could not allocate bucket job.\n");
+        free(namedup);
+        return EXIT_FAILURE;
+    }
+    loader->jobs = jobs;
+
+    memset(&jobs[loader->n_jobs], 0, sizeof(*jobs));
+    jobs[loader->n_jobs].name = namedup;
+    jobs[loader->n_jobs].config_index = config_index;
+    jobs[loader->n_jobs].summary = name ? status_digest_bucket(loader->ctx->status->digest,
+                                                               name, false)
+                                        : -1;
+    loader->n_jobs += 1;
+
+    return EXIT_SUCCESS;
+}
+
 /*
  * This function lists the status files on the status store, and updates
  * the store by adding bucket migrations status missing on the store, using
  * the configuration as a reference.
  *
- * On the way, it loads each configuration file, included those not asked
- * by the configuration, but that were present on the status storage.
+ * On the way, it opens each configuration file, included those not asked
+ * by the configuration, but that were present on the status storage. They
+ * are only loaded when the migration reaches them, unless the digest has to
+ * be regenerated from their contents, or does not summarize them yet.
+ *
+ * The loads and creates are run in parallel, the statuses found on the store
+ * coming first, in listing order, followed by the created ones.
  */
 static int
 status_store_do_load_update(struct cloudmig_ctx *ctx, int regen_digest)
@@ -324,13 +651,27 @@ status_store_do_load_update(struct cloudmig_ctx *ctx, int regen_digest)
     void            *dir_hdl = NULL;
     dpl_dirent_t    dirent;
     dpl_status_t    dplret;
-    uint64_t        addcount, addsize;
     bool            cmperror = 0;
+    struct bucket_loader loader;
+    bool            loader_inited = false;
+    struct bucket_job *job = NULL;
+    struct digest_bucket summary;
 
     cloudmig_log(INFO_LVL, "[Loading Status Store] "
                  "Loading and updating store...\n");
 
     memset(config_found, 0, sizeof(config_found));
+    memset(&loader, 0, sizeof(loader));
+    loader.ctx = ctx;
+    loader.regen_digest = regen_digest;
+    loader.ret = EXIT_SUCCESS;
+
+    if (pthread_mutex_init(&loader.lock, NULL) != 0)
+    {
+        PRINTERR("[Loading Status Store] Could not initialize mutex.\n");
+        goto err;
+    }
+    loader_inited = true;
 
     dplret = dpl_opendir(ctx->status_ctx, ctx->status->store_path, &dir_hdl);
     if (dplret != DPL_SUCCESS)
@@ -385,27 +726,8 @@ status_store_do_load_update(struct cloudmig_ctx *ctx, int regen_digest)
         if (dirent.type == DPL_FTYPE_REG
             && strcmp(dirent.name, ".cloudmig") != 0)
         {
-            ret = _buckets_autoexpand(ctx->status);
-            if (ret != EXIT_SUCCESS)
-                goto err;
-
-            ctx->status->buckets[ctx->status->n_loaded]
-                = status_bucket_load(ctx->status_ctx,
-                                     ctx->status->store_path, dirent.name,
-                                     &addcount, &addsize);
-            if (ctx->status->buckets[ctx->status->n_loaded] == NULL)
-            {
-                PRINTERR("[Loading Status Store] Could not load status file %s.\n",
-                         dirent.name);
-                ret = EXIT_FAILURE;
+            if (_bucket_job_add(&loader, dirent.name, -1) != EXIT_SUCCESS)
                 goto err;
-            }
-            if (regen_digest)
-            {
-                status_digest_add(ctx->status->digest, DIGEST_OBJECTS, addcount);
-                status_digest_add(ctx->status->digest, DIGEST_BYTES, addsize);
-            }
-            ctx->status->n_loaded++;
         }
     }
 
@@ -418,32 +740,58 @@ status_store_do_load_update(struct cloudmig_ctx *ctx, int regen_digest)
         cloudmig_log(DEBUG_LVL, "[Loading Status Store] "
                      "Attempting to create one bucket status: %s -> loaded=%i\n",
                      ctx->options.src_buckets[bucket], config_found[bucket]);
-        if (!config_found[bucket])
+        if (!config_found[bucket]
+            && _bucket_job_add(&loader, NULL, bucket) != EXIT_SUCCESS)
+            goto err;
+    }
+
+    if (_buckets_autoexpand(ctx->status, loader.n_jobs) != EXIT_SUCCESS)
+        goto err;
+
+    if (_buckets_load_parallel(&loader) != EXIT_SUCCESS)
+        goto err;
+
+    for (int i=0; i < loader.n_jobs; ++i)
+    {
+        job = &loader.jobs[i];
+
+        // Summarize the bucket statuses that were loaded or created.
+        if (job->name == NULL || regen_digest || job->summary == -1)
         {
-            ret = _buckets_autoexpand(ctx->status);
-            if (ret != EXIT_SUCCESS)
+            job->summary = status_digest_bucket(ctx->status->digest,
+                                                strrchr(job->bst->path, '/') + 1,
+                                                true);
+            if (job->summary == -1)
                 goto err;
+            status_digest_bucket_set(ctx->status->digest, job->summary,
+                                     job->count, job->size,
+                                     status_bucket_complete(job->bst));
+        }
+        if (job->name == NULL || regen_digest)
+        {
+            status_digest_add(ctx->status->digest, DIGEST_OBJECTS, job->count);
+            status_digest_add(ctx->status->digest, DIGEST_BYTES, job->size);
+        }
+        if (job->resynced)
+        {
+            summary.objects = job->resync.objects;
+            summary.bytes = job->resync.bytes;
+            summary.done_objects = job->resync.done_objects;
+            summary.done_bytes = job->resync.done_bytes;
+            summary.done = job->resync.complete;
+            status_digest_bucket_resync(ctx->status->digest, job->summary, &summary);
+        }
 
-            addcount = addsize = 0;
-            ctx->status->buckets[ctx->status->n_loaded]
-                = status_bucket_create(ctx->status_ctx, ctx->src_ctx,
-                                       ctx->status->store_path,
-                                       ctx->options.src_buckets[bucket],
-                                       ctx->options.dst_buckets[bucket],
-                                       &addcount, &addsize);
-            if (ctx->status->buckets[ctx->status->n_loaded] == NULL)
-            {
-                PRINTERR("[Loading Status Store] "
-                         "Could not create status for source bucket %s.\n",
-                         ctx->options.src_buckets[bucket]);
-                ret = EXIT_FAILURE;
-                goto err;
-            }
-            ctx->status->n_loaded++;
+        status_digest_bucket_get(ctx->status->digest, job->summary, &summary);
+        cloudmig_log(INFO_LVL, "[Loading Status Store] Bucket status %s:"
+                     " %"PRIu64"/%"PRIu64" objects, %"PRIu64"/%"PRIu64" bytes done%s.\n",
+                     summary.name, summary.done_objects, summary.objects,
+                     summary.done_bytes, summary.bytes,
+                     summary.done ? " (complete)" : "");
 
-            status_digest_add(ctx->status->digest, DIGEST_OBJECTS, addcount);
-            status_digest_add(ctx->status->digest, DIGEST_BYTES, addsize);
-        }
+        job->bst->summary = job->summary;
+        ctx->status->buckets[ctx->status->n_loaded++] = job->bst;
+        job->bst = NULL;
     }
 
     cloudmig_log(INFO_LVL, "[Loading Status Store] "
@@ -455,6 +803,16 @@ err:
     if (dir_hdl)
         dpl_closedir(dir_hdl);
 
+    for (int i=0; i < loader.n_jobs; ++i)
+    {
+        if (loader.jobs[i].bst)
+            status_bucket_free(loader.jobs[i].bst);
+        free(loader.jobs[i].name);
+    }
+    free(loader.jobs);
+    if (loader_inited)
+        pthread_mutex_destroy(&loader.lock);
+
     return ret;
 }
 
@@ -470,6 +828,7 @@ int status_store_load(struct cloudmig_ctx* ctx, char *src_host, char *dst_host,
     int             ret = EXIT_SUCCESS;
     int             regen_digest = 0;
     char            *storename = NULL;
+    bool            store_locked = false;
 
     cloudmig_log(INFO_LVL, "[Loading Status] Starting status loading...\n");
 
@@ -495,9 +854,32 @@ int status_store_load(struct cloudmig_ctx* ctx, char *src_host, char *dst_host,
         goto end;
     }
 
+    /*
+     * Cooperating processes must not create the missing bucket statuses
+     * concurrently: the first one to come does it, the others wait for it.
+     */
+    if (ctx->options.flags & COOPERATIVE_MIGRATION)
+    {
+        ctx->status->leases = status_lease_table_new(ctx->status_ctx,
+                                                     ctx->options.lease_size,
+                                                     ctx->options.lease_duration);
+        if (ctx->status->leases == NULL)
+        {
+            ret = EXIT_FAILURE;
+            goto end;
+        }
+
+        ret = status_lease_lock_store(ctx->status->leases, ctx->status->store_path);
+        if (ret != EXIT_SUCCESS)
+            goto end;
+        store_locked = true;
+    }
+
     ctx->status->digest = status_digest_new(ctx->status_ctx,
                                             ctx->status->store_path,
-                                            50 /*upload digest every 50 object*/);
+                                            ctx->options.digest_changes,
+                                            ctx->options.digest_min_interval,
+                                            ctx->options.digest_max_interval);
     if (ctx->status->digest == NULL)
     {
         ret = EXIT_FAILURE;
@@ -526,12 +908,52 @@ int status_store_load(struct cloudmig_ctx* ctx, char *src_host, char *dst_host,
         goto end;
     }
 
+    for (int i=0; i < ctx->status->n_loaded; ++i)
+        ctx->status->buckets[i]->leases = ctx->status->leases;
+
+    if (ctx->options.claim_policy == CLAIM_LOCALITY)
+    {
+        for (int i=0; i < ctx->status->n_loaded; ++i)
+        {
+            ret = status_bucket_claims_init(ctx->status->buckets[i],
+                                            ctx->options.nb_threads);
+            if (ret != EXIT_SUCCESS)
+                goto end;
+        }
+    }
+
+    /*
+     * From now on, the status mutations go through the local status log,
+     * starting with the ones a previous run could not replicate.
+     */
+    if (ctx->options.status_log)
+    {
+        ctx->status->wal = status_wal_open(ctx->status_ctx, ctx->options.status_log);
+        if (ctx->status->wal == NULL
+            || status_wal_recover(ctx->status->wal, ctx->status) != EXIT_SUCCESS
+            || status_wal_start(ctx->status->wal, CLOUDMIG_STATUS_LOG_PERIOD) != EXIT_SUCCESS)
+        {
+            ret = EXIT_FAILURE;
+            goto end;
+        }
+
+        ctx->status->digest->wal = ctx->status->wal;
+        for (int i=0; i < ctx->status->n_loaded; ++i)
+            ctx->status->buckets[i]->wal = ctx->status->wal;
+    }
+
+    ret = status_digest_start(ctx->status->digest);
+    if (ret != EXIT_SUCCESS)
+        goto end;
+
     cloudmig_log(INFO_LVL, "[Loading Status] Status loading"
                  " done with success.\n");
 
     ret = EXIT_SUCCESS;
 
 end:
+    if (store_locked)
+        status_lease_unlock_store(ctx->status->leases);
     if (storename)
         free(storename);
 
@@ -558,7 +980,7 @@ status_store_delete(struct cloudmig_ctx *ctx)
 }
 
 int
-status_store_next_incomplete_entry(struct cloudmig_ctx *ctx,
+status_store_next_incomplete_entry(struct cloudmig_ctx *ctx, int worker,
                                    struct file_transfer_state *filestate)
 {
     int                     ret = 0;
@@ -577,7 +999,8 @@ status_store_next_incomplete_entry(struct cloudmig_ctx *ctx,
             goto end;
         }
 
-        ret = status_bucket_next_incomplete_entry(ctx->status_ctx, bst, filestate);
+        ret = status_bucket_next_incomplete_entry(ctx->status_ctx, bst,
+                                                  worker, filestate);
         if (ret == -1)
             goto end;
         else if (ret == 1) // found, stop looking.
@@ -637,6 +1060,12 @@ status_store_release_entry(struct file_transfer_state *filestate)
     status_bucket_release_entry(filestate);
 }
 
+void
+status_store_clear_entry(struct file_transfer_state *filestate)
+{
+    status_bucket_clear_entry(filestate);
+}
+
 void
 status_store_reset_iteration(struct cloudmig_ctx *ctx)
 {
@@ -650,6 +1079,59 @@ status_store_reset_iteration(struct cloudmig_ctx *ctx)
     _status_unlock(ctx->status);
 }
 
+int
+status_store_resync(struct cloudmig_ctx *ctx, struct bucket_resync *changes)
+{
+    int                     ret = EXIT_FAILURE;
+    struct bucket_status    *bst = NULL;
+    struct bucket_resync    resync;
+    struct digest_bucket    summary;
+    struct bucket_crawl     crawl;
+
+    memset(changes, 0, sizeof(*changes));
+    _status_crawl(ctx, &crawl);
+
+    _status_lock(ctx->status);
+
+    for (int i = 0; i < ctx->status->n_loaded; ++i)
+    {
+        bst = ctx->status->buckets[i];
+        if (status_bucket_resync(ctx->status_ctx, &crawl,
+                                 bst, &resync) != EXIT_SUCCESS)
+        {
+            PRINTERR("[Resyncing Status Store] Could not resync status file %s.\n",
+                     bst->path);
+            goto end;
+        }
+
+        summary.objects = resync.objects;
+        summary.bytes = resync.bytes;
+        summary.done_objects = resync.done_objects;
+        summary.done_bytes = resync.done_bytes;
+        summary.done = resync.complete;
+        status_digest_bucket_resync(ctx->status->digest, bst->summary, &summary);
+
+        changes->added += resync.added;
+        changes->modified += resync.modified;
+        changes->deleted += resync.deleted;
+        changes->unchanged += resync.unchanged;
+        changes->objects += resync.objects;
+        changes->bytes += resync.bytes;
+        changes->done_objects += resync.done_objects;
+        changes->done_bytes += resync.done_bytes;
+    }
+    changes->complete = (changes->done_objects == changes->objects);
+
+    ctx->status->cur_bucket = 0;
+
+    ret = EXIT_SUCCESS;
+
+end:
+    _status_unlock(ctx->status);
+
+    return ret;
+}
+
 struct cloudmig_status*
 status_store_new()
 {
@@ -682,10 +1164,38 @@ end:
 void
 status_store_free(struct cloudmig_status *status)
 {
+    struct bucket_status    *bst = NULL;
 
     if (status->store_path)
         free(status->store_path);
 
+    // The digest may be uploaded through the status log.
+    if (status->digest)
+        status_digest_stop(status->digest);
+
+    /*
+     * The last checkpoints may not have been uploaded yet, nor the index of
+     * the partial entries they refer to. The manifests shared by cooperative
+     * processes are never uploaded.
+     */
+    for (int i=0; status->buckets && i < status->n_buckets; ++i)
+    {
+        bst = status->buckets[i];
+        if (bst == NULL || bst->leases || (!bst->states && !bst->manifest_dirty))
+            continue ;
+        if (status_bucket_flush(bst->status_ctx, bst) != EXIT_SUCCESS)
+            cloudmig_log(WARN_LVL, "[Status Store] Could not save the"
+                         " intermediary states of %s.\n", bst->path);
+    }
+
+    // Replicate the last status mutations while the buckets are still there.
+    if (status->wal)
+        status_wal_close(status->wal);
+
+    // Release the leases first, so that other processes can take over.
+    if (status->leases)
+        status_lease_table_free(status->leases);
+
     if (status->digest)
         status_digest_free(status->digest);
 
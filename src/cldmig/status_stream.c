@@ -0,0 +1,761 @@
+// Copyright (c) 2015, David Pineau
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of the copyright holder nor the names of its contributors
+//    may be used to endorse or promote products derived from this software
+//    without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER AND CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <ctype.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <droplet.h>
+#include <droplet/vfs.h>
+
+#include "cloudmig.h"
+#include "status.h"
+#include "status_codec.h"
+#include "status_stream.h"
+
+/*
+ * The stream only understands the format of the bucket status segments:
+ *   { "objects": [ { "prefix": N, "suffix": "...", "size": N, "type": N,
+ *                    "done": bool, "mtime": N, "deleted": bool }, ... ] }
+ * where the path of an entry is made of the prefix first bytes of the path of
+ * the previous entry, followed by the suffix. The entries may also hold their
+ * whole path, as a "path" member. The "mtime" and "deleted" members are
+ * optional. Any other member is skipped.
+ */
+enum stream_level
+{
+    LEVEL_START = 0,    // before the root object
+    LEVEL_ROOT,         // within the root object
+    LEVEL_OBJECTS,      // within the array of entries
+    LEVEL_ENTRY,        // within an entry
+    LEVEL_END,          // after the root object
+};
+
+enum stream_lex
+{
+    LEX_NONE = 0,
+    LEX_STRING,
+    LEX_ESCAPE,
+    LEX_UNICODE,
+    LEX_LITERAL,
+};
+
+#define STREAM_FIELD_PATH   (1 << 0)
+#define STREAM_FIELD_SIZE   (1 << 1)
+#define STREAM_FIELD_TYPE   (1 << 2)
+#define STREAM_FIELD_DONE   (1 << 3)
+#define STREAM_FIELD_PREFIX (1 << 4)
+#define STREAM_FIELD_SUFFIX (1 << 5)
+#define STREAM_FIELDS_CODED (STREAM_FIELD_PREFIX | STREAM_FIELD_SUFFIX)
+#define STREAM_FIELDS_ALL   (STREAM_FIELD_SIZE | STREAM_FIELD_TYPE \
+                             | STREAM_FIELD_DONE)
+
+struct status_stream
+{
+    status_stream_emit_t    emit;
+    void                    *data;
+
+    uint64_t                offset;         // Nb of bytes parsed, for errors
+    bool                    failed;
+
+    // Lexer
+    enum stream_lex         lex;
+    char                    *tok;
+    size_t                  toklen;
+    size_t                  tokcap;
+    unsigned int            ucs;            // \u escape being decoded
+    int                     ucs_digits;
+    unsigned int            ucs_high;       // pending high surrogate
+
+    // Parser
+    enum stream_level       level;
+    unsigned int            skip;           // depth within a skipped value
+    bool                    have_key;
+    bool                    have_colon;
+    char                    key[16];        // empty if unknown
+
+    struct bucket_entry     entry;
+    unsigned int            fields;
+    uint64_t                prefix;
+    struct status_buffer    suffix;
+    struct status_buffer    path;           // Path of the last entry
+};
+
+static int
+_stream_error(struct status_stream *stream, const char *msg)
+{
+    PRINTERR("[Status Stream] %s at byte %"PRIu64".\n", msg, stream->offset);
+    stream->failed = true;
+    return EXIT_FAILURE;
+}
+
+static int
+_stream_tok_add(struct status_stream *stream, char c)
+{
+    char    *tok = NULL;
+
+    if (stream->toklen + 1 >= stream->tokcap)
+    {
+        tok = realloc(stream->tok, stream->tokcap ? stream->tokcap * 2 : 64);
+        if (tok == NULL)
+            return _stream_error(stream, "Could not allocate token");
+        stream->tok = tok;
+        stream->tokcap = stream->tokcap ? stream->tokcap * 2 : 64;
+    }
+    stream->tok[stream->toklen++] = c;
+    stream->tok[stream->toklen] = 0;
+
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Encodes a code point from a \u escape sequence as UTF-8.
+ */
+static int
+_stream_tok_add_ucs(struct status_stream *stream, unsigned int cp)
+{
+    int     ret = EXIT_SUCCESS;
+
+    if (cp < 0x80)
+        ret = _stream_tok_add(stream, cp);
+    else if (cp < 0x800)
+    {
+        ret |= _stream_tok_add(stream, 0xC0 | (cp >> 6));
+        ret |= _stream_tok_add(stream, 0x80 | (cp & 0x3F));
+    }
+    else if (cp < 0x10000)
+    {
+        ret |= _stream_tok_add(stream, 0xE0 | (cp >> 12));
+        ret |= _stream_tok_add(stream, 0x80 | ((cp >> 6) & 0x3F));
+        ret |= _stream_tok_add(stream, 0x80 | (cp & 0x3F));
+    }
+    else
+    {
+        ret |= _stream_tok_add(stream, 0xF0 | (cp >> 18));
+        ret |= _stream_tok_add(stream, 0x80 | ((cp >> 12) & 0x3F));
+        ret |= _stream_tok_add(stream, 0x80 | ((cp >> 6) & 0x3F));
+        ret |= _stream_tok_add(stream, 0x80 | (cp & 0x3F));
+    }
+
+    return ret;
+}
+
+/*
+ * Sets the content of buf from offset off onwards.
+ */
+static int
+_stream_buf_set(struct status_stream *stream, struct status_buffer *buf,
+                size_t off, const char *str, size_t len)
+{
+    char    *data = NULL;
+    size_t  size;
+
+    if (off + len + 1 > buf->size)
+    {
+        size = buf->size ? buf->size : 64;
+        while (size < off + len + 1)
+            size *= 2;
+        data = realloc(buf->data, size);
+        if (data == NULL)
+            return _stream_error(stream, "Could not allocate entry path");
+        buf->data = data;
+        buf->size = size;
+    }
+    memcpy(buf->data + off, str, len);
+    buf->data[off + len] = 0;
+    buf->len = off + len;
+
+    return EXIT_SUCCESS;
+}
+
+static void
+_stream_reset_member(struct status_stream *stream)
+{
+    stream->have_key = false;
+    stream->have_colon = false;
+    stream->key[0] = 0;
+}
+
+static int
+_stream_entry_field(struct status_stream *stream, bool is_string)
+{
+    char    *end = NULL;
+
+    if (strcmp(stream->key, "path") == 0)
+    {
+        if (!is_string)
+            return _stream_error(stream, "Entry path is not a string");
+        if (_stream_buf_set(stream, &stream->path, 0,
+                            stream->tok ? stream->tok : "", stream->toklen))
+            return EXIT_FAILURE;
+        stream->fields |= STREAM_FIELD_PATH;
+    }
+    else if (strcmp(stream->key, "prefix") == 0)
+    {
+        if (is_string)
+            return _stream_error(stream, "Entry prefix is not an integer");
+        stream->prefix = strtoull(stream->tok, &end, 10);
+        if (*end != 0)
+            return _stream_error(stream, "Entry prefix is not an integer");
+        stream->fields |= STREAM_FIELD_PREFIX;
+    }
+    else if (strcmp(stream->key, "suffix") == 0)
+    {
+        if (!is_string)
+            return _stream_error(stream, "Entry suffix is not a string");
+        if (_stream_buf_set(stream, &stream->suffix, 0,
+                            stream->tok ? stream->tok : "", stream->toklen))
+            return EXIT_FAILURE;
+        stream->fields |= STREAM_FIELD_SUFFIX;
+    }
+    else if (strcmp(stream->key, "size") == 0)
+    {
+        if (is_string)
+            return _stream_error(stream, "Entry size is not an integer");
+        stream->entry.size = strtoull(stream->tok, &end, 10);
+        if (*end != 0)
+            return _stream_error(stream, "Entry size is not an integer");
+        stream->fields |= STREAM_FIELD_SIZE;
+    }
+    else if (strcmp(stream->key, "type") == 0)
+    {
+        if (is_string)
+            return _stream_error(stream, "Entry type is not an integer");
+        stream->entry.type = strtoul(stream->tok, &end, 10);
+        if (*end != 0)
+            return _stream_error(stream, "Entry type is not an integer");
+        stream->fields |= STREAM_FIELD_TYPE;
+    }
+    else if (strcmp(stream->key, "done") == 0)
+    {
+        if (is_string
+            || (strcmp(stream->tok, "true") && strcmp(stream->tok, "false")))
+            return _stream_error(stream, "Entry done flag is not a boolean");
+        stream->entry.done = (strcmp(stream->tok, "true") == 0);
+        stream->fields |= STREAM_FIELD_DONE;
+    }
+    else if (strcmp(stream->key, "mtime") == 0)
+    {
+        if (is_string)
+            return _stream_error(stream, "Entry mtime is not an integer");
+        stream->entry.mtime = strtoll(stream->tok, &end, 10);
+        if (*end != 0)
+            return _stream_error(stream, "Entry mtime is not an integer");
+    }
+    else if (strcmp(stream->key, "deleted") == 0)
+    {
+        if (is_string
+            || (strcmp(stream->tok, "true") && strcmp(stream->tok, "false")))
+            return _stream_error(stream, "Entry deleted flag is not a boolean");
+        stream->entry.deleted = (strcmp(stream->tok, "true") == 0);
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Handles a complete string or literal token.
+ */
+static int
+_stream_scalar(struct status_stream *stream, bool is_string)
+{
+    int     ret = EXIT_SUCCESS;
+
+    if (stream->skip)
+        return EXIT_SUCCESS;
+
+    if (stream->level != LEVEL_ROOT && stream->level != LEVEL_ENTRY)
+        return _stream_error(stream, "Unexpected value");
+
+    if (!stream->have_key)
+    {
+        if (!is_string)
+            return _stream_error(stream, "Expected a member name");
+        stream->have_key = true;
+        if (stream->toklen < sizeof(stream->key))
+            memcpy(stream->key, stream->tok ? stream->tok : "", stream->toklen + 1);
+        return EXIT_SUCCESS;
+    }
+    if (!stream->have_colon)
+        return _stream_error(stream, "Expected ':'");
+
+    if (stream->level == LEVEL_ENTRY)
+        ret = _stream_entry_field(stream, is_string);
+    _stream_reset_member(stream);
+
+    return ret;
+}
+
+static int
+_stream_struct(struct status_stream *stream, char c)
+{
+    int     ret;
+
+    if (stream->skip)
+    {
+        if (c == '{' || c == '[')
+            stream->skip += 1;
+        else if (c == '}' || c == ']')
+        {
+            stream->skip -= 1;
+            if (stream->skip == 0)
+                _stream_reset_member(stream);
+        }
+        return EXIT_SUCCESS;
+    }
+
+    switch (c)
+    {
+    case '{':
+        if (stream->level == LEVEL_START)
+            stream->level = LEVEL_ROOT;
+        else if (stream->level == LEVEL_OBJECTS)
+        {
+            stream->level = LEVEL_ENTRY;
+            memset(&stream->entry, 0, sizeof(stream->entry));
+            stream->fields = 0;
+        }
+        else if ((stream->level == LEVEL_ROOT || stream->level == LEVEL_ENTRY)
+                 && stream->have_colon
+                 && strcmp(stream->key, "objects") != 0)
+        {
+            stream->skip = 1;
+            return EXIT_SUCCESS;
+        }
+        else
+            return _stream_error(stream, "Unexpected object");
+        _stream_reset_member(stream);
+        break ;
+    case '[':
+        if (stream->level == LEVEL_ROOT && stream->have_colon
+            && strcmp(stream->key, "objects") == 0)
+        {
+            stream->level = LEVEL_OBJECTS;
+            _stream_reset_member(stream);
+        }
+        else if ((stream->level == LEVEL_ROOT || stream->level == LEVEL_ENTRY)
+                 && stream->have_colon)
+            stream->skip = 1;
+        else
+            return _stream_error(stream, "Unexpected array");
+        break ;
+    case '}':
+        if (stream->have_key)
+            return _stream_error(stream, "Member without a value");
+        if (stream->level == LEVEL_ENTRY)
+        {
+            if ((stream->fields & STREAM_FIELDS_ALL) != STREAM_FIELDS_ALL)
+                return _stream_error(stream, "Incomplete entry");
+            if (!(stream->fields & STREAM_FIELD_PATH))
+            {
+                if ((stream->fields & STREAM_FIELDS_CODED) != STREAM_FIELDS_CODED)
+                    return _stream_error(stream, "Incomplete entry");
+                if (stream->prefix > stream->path.len)
+                    return _stream_error(stream, "Entry prefix out of range");
+                if (_stream_buf_set(stream, &stream->path, stream->prefix,
+                                    stream->suffix.data, stream->suffix.len))
+                    return EXIT_FAILURE;
+            }
+            ret = stream->emit(stream->data, stream->path.data, &stream->entry);
+            if (ret != EXIT_SUCCESS)
+            {
+                stream->failed = true;
+                return EXIT_FAILURE;
+            }
+            stream->level = LEVEL_OBJECTS;
+        }
+        else if (stream->level == LEVEL_ROOT)
+            stream->level = LEVEL_END;
+        else
+            return _stream_error(stream, "Unexpected end of object");
+        break ;
+    case ']':
+        if (stream->level != LEVEL_OBJECTS)
+            return _stream_error(stream, "Unexpected end of array");
+        stream->level = LEVEL_ROOT;
+        _stream_reset_member(stream);
+        break ;
+    case ':':
+        if ((stream->level != LEVEL_ROOT && stream->level != LEVEL_ENTRY)
+            || !stream->have_key || stream->have_colon)
+            return _stream_error(stream, "Unexpected ':'");
+        stream->have_colon = true;
+        break ;
+    case ',':
+        if (stream->level != LEVEL_ROOT && stream->level != LEVEL_ENTRY
+            && stream->level != LEVEL_OBJECTS)
+            return _stream_error(stream, "Unexpected ','");
+        if (stream->have_key)
+            return _stream_error(stream, "Member without a value");
+        break ;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+static int
+_stream_hexval(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+int
+status_stream_feed(struct status_stream *stream, const char *buf, size_t len)
+{
+    int     ret = EXIT_SUCCESS;
+    char    c;
+    int     hex;
+
+    if (stream->failed)
+        return EXIT_FAILURE;
+
+    for (size_t i=0; i < len && ret == EXIT_SUCCESS; ++i, ++stream->offset)
+    {
+        c = buf[i];
+
+        switch (stream->lex)
+        {
+        case LEX_STRING:
+            if (c == '"')
+            {
+                stream->lex = LEX_NONE;
+                ret = _stream_scalar(stream, true);
+            }
+            else if (c == '\\')
+                stream->lex = LEX_ESCAPE;
+            else
+                ret = _stream_tok_add(stream, c);
+            continue ;
+        case LEX_ESCAPE:
+            stream->lex = LEX_STRING;
+            switch (c)
+            {
+            case '"': case '\\': case '/':
+                ret = _stream_tok_add(stream, c);
+                break ;
+            case 'b': ret = _stream_tok_add(stream, '\b'); break ;
+            case 'f': ret = _stream_tok_add(stream, '\f'); break ;
+            case 'n': ret = _stream_tok_add(stream, '\n'); break ;
+            case 'r': ret = _stream_tok_add(stream, '\r'); break ;
+            case 't': ret = _stream_tok_add(stream, '\t'); break ;
+            case 'u':
+                stream->lex = LEX_UNICODE;
+                stream->ucs = 0;
+                stream->ucs_digits = 0;
+                break ;
+            default:
+                ret = _stream_error(stream, "Invalid escape sequence");
+            }
+            continue ;
+        case LEX_UNICODE:
+            hex = _stream_hexval(c);
+            if (hex < 0)
+            {
+                ret = _stream_error(stream, "Invalid unicode escape sequence");
+                continue ;
+            }
+            stream->ucs = stream->ucs * 16 + hex;
+            if (++stream->ucs_digits < 4)
+                continue ;
+            stream->lex = LEX_STRING;
+            if (stream->ucs >= 0xD800 && stream->ucs < 0xDC00)
+                stream->ucs_high = stream->ucs;
+            else if (stream->ucs >= 0xDC00 && stream->ucs < 0xE000 && stream->ucs_high)
+            {
+                ret = _stream_tok_add_ucs(stream, 0x10000
+                                          + ((stream->ucs_high - 0xD800) << 10)
+                                          + (stream->ucs - 0xDC00));
+                stream->ucs_high = 0;
+            }
+            else
+                ret = _stream_tok_add_ucs(stream, stream->ucs);
+            continue ;
+        case LEX_LITERAL:
+            if (isalnum((unsigned char)c) || c == '-' || c == '+' || c == '.')
+            {
+                ret = _stream_tok_add(stream, c);
+                continue ;
+            }
+            // The literal ends here: handle it, then the current character.
+            stream->lex = LEX_NONE;
+            ret = _stream_scalar(stream, false);
+            if (ret != EXIT_SUCCESS)
+                continue ;
+            break ;
+        case LEX_NONE:
+            break ;
+        }
+
+        if (isspace((unsigned char)c))
+            continue ;
+        if (stream->level == LEVEL_END)
+        {
+            ret = _stream_error(stream, "Trailing data");
+            continue ;
+        }
+
+        if (c == '"')
+        {
+            stream->lex = LEX_STRING;
+            stream->toklen = 0;
+            if (stream->tok)
+                stream->tok[0] = 0;
+        }
+        else if (isalnum((unsigned char)c) || c == '-')
+        {
+            stream->lex = LEX_LITERAL;
+            stream->toklen = 0;
+            ret = _stream_tok_add(stream, c);
+        }
+        else if (strchr("{}[]:,", c) != NULL && c != 0)
+            ret = _stream_struct(stream, c);
+        else
+            ret = _stream_error(stream, "Unexpected character");
+    }
+
+    return ret;
+}
+
+int
+status_stream_end(struct status_stream *stream)
+{
+    if (stream->failed)
+        return EXIT_FAILURE;
+    if (stream->level != LEVEL_END || stream->lex != LEX_NONE)
+        return _stream_error(stream, "Truncated data");
+    return EXIT_SUCCESS;
+}
+
+struct status_stream*
+status_stream_new(status_stream_emit_t emit, void *data)
+{
+    struct status_stream    *stream = NULL;
+
+    stream = calloc(1, sizeof(*stream));
+    if (stream == NULL)
+    {
+        PRINTERR("[Status Stream] Could not allocate stream.\n");
+        return NULL;
+    }
+    stream->emit = emit;
+    stream->data = data;
+
+    return stream;
+}
+
+void
+status_stream_free(struct status_stream *stream)
+{
+    if (stream->tok)
+        free(stream->tok);
+    if (stream->suffix.data)
+        free(stream->suffix.data);
+    if (stream->path.data)
+        free(stream->path.data);
+    free(stream);
+}
+
+
+/*
+ * The ranges are fetched by a dedicated thread, handing them out one at a
+ * time: the next range is fetched while the current one is parsed.
+ */
+struct stream_fetcher
+{
+    dpl_ctx_t           *status_ctx;
+    const char          *path;
+    size_t              range_size;
+
+    pthread_mutex_t     lock;
+    pthread_cond_t      cond;
+    char                *ready;
+    unsigned int        ready_len;
+    bool                eof;
+    bool                failed;
+    bool                stop;
+    unsigned int        n_ranges;
+};
+
+static void*
+_stream_fetch_thread(void *arg)
+{
+    struct stream_fetcher   *fetcher = arg;
+    dpl_status_t            dplret;
+    dpl_range_t             range;
+    char                    *buffer = NULL;
+    unsigned int            buflen = 0;
+    uint64_t                offset = 0;
+    bool                    last = false;
+
+    while (!last)
+    {
+        range.start = offset;
+        range.end = offset + fetcher->range_size - 1;
+        buffer = NULL;
+        buflen = 0;
+
+        dplret = dpl_fget(fetcher->status_ctx, fetcher->path,
+                          NULL/*option*/, NULL/*condition*/, &range,
+                          &buffer, &buflen,
+                          NULL/*MD*/, NULL/*sysmd*/);
+        if (dplret != DPL_SUCCESS && dplret != DPL_ERANGEUNAVAIL)
+            PRINTERR("[Status Stream] Could not get range %"PRIu64"-%"PRIu64
+                     " of %s: %s.\n", (uint64_t)range.start, (uint64_t)range.end,
+                     fetcher->path, dpl_status_str(dplret));
+
+        /*
+         * A short range is the last one. So is the whole file, if the backend
+         * does not support ranges.
+         */
+        last = (dplret != DPL_SUCCESS || buflen != fetcher->range_size);
+
+        pthread_mutex_lock(&fetcher->lock);
+        while (fetcher->ready && !fetcher->stop)
+            pthread_cond_wait(&fetcher->cond, &fetcher->lock);
+        if (fetcher->stop)
+        {
+            pthread_mutex_unlock(&fetcher->lock);
+            break ;
+        }
+        if (dplret == DPL_SUCCESS)
+        {
+            fetcher->ready = buffer;
+            fetcher->ready_len = buflen;
+            fetcher->n_ranges += 1;
+            buffer = NULL;
+        }
+        fetcher->failed = (dplret != DPL_SUCCESS && dplret != DPL_ERANGEUNAVAIL);
+        fetcher->eof = last;
+        pthread_cond_signal(&fetcher->cond);
+        pthread_mutex_unlock(&fetcher->lock);
+
+        offset += buflen;
+    }
+
+    if (buffer)
+        free(buffer);
+
+    return NULL;
+}
+
+static int
+_stream_sink(void *data, const char *buf, size_t len)
+{
+    return status_stream_feed(data, buf, len);
+}
+
+int
+status_stream_load(dpl_ctx_t *status_ctx, const char *path,
+                   size_t range_size, struct status_stream *stream)
+{
+    int                     ret = EXIT_FAILURE;
+    struct stream_fetcher   fetcher;
+    pthread_t               thread;
+    bool                    started = false;
+    char                    *buffer = NULL;
+    unsigned int            buflen = 0;
+    struct status_decoder   *decoder = NULL;
+
+    // The ranges are those of the file as stored, possibly compressed.
+    decoder = status_decoder_new(&_stream_sink, stream);
+    if (decoder == NULL)
+        return EXIT_FAILURE;
+
+    memset(&fetcher, 0, sizeof(fetcher));
+    fetcher.status_ctx = status_ctx;
+    fetcher.path = path;
+    fetcher.range_size = range_size;
+    pthread_mutex_init(&fetcher.lock, NULL);
+    pthread_cond_init(&fetcher.cond, NULL);
+
+    if (pthread_create(&thread, NULL, &_stream_fetch_thread, &fetcher) != 0)
+    {
+        PRINTERR("[Status Stream] Could not start fetching thread.\n");
+        goto end;
+    }
+    started = true;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&fetcher.lock);
+        while (fetcher.ready == NULL && !fetcher.eof && !fetcher.failed)
+            pthread_cond_wait(&fetcher.cond, &fetcher.lock);
+        buffer = fetcher.ready;
+        buflen = fetcher.ready_len;
+        fetcher.ready = NULL;
+        pthread_cond_signal(&fetcher.cond);
+        pthread_mutex_unlock(&fetcher.lock);
+
+        if (buffer == NULL)
+            break ;
+
+        ret = status_decoder_feed(decoder, buffer, buflen);
+        free(buffer);
+        buffer = NULL;
+        if (ret != EXIT_SUCCESS)
+            goto end;
+    }
+
+    if (fetcher.failed)
+    {
+        ret = EXIT_FAILURE;
+        goto end;
+    }
+
+    ret = status_decoder_end(decoder);
+    if (ret != EXIT_SUCCESS)
+        goto end;
+
+    ret = status_stream_end(stream);
+
+    cloudmig_log(DEBUG_LVL, "[Status Stream] Loaded %s in %u ranges.\n",
+                 path, fetcher.n_ranges);
+
+end:
+    if (started)
+    {
+        pthread_mutex_lock(&fetcher.lock);
+        fetcher.stop = true;
+        pthread_cond_signal(&fetcher.cond);
+        pthread_mutex_unlock(&fetcher.lock);
+        pthread_join(thread, NULL);
+    }
+    if (fetcher.ready)
+        free(fetcher.ready);
+    pthread_cond_destroy(&fetcher.cond);
+    pthread_mutex_destroy(&fetcher.lock);
+    status_decoder_free(decoder);
+
+    return ret;
+}
@@ -0,0 +1,1121 @@
+// Copyright (c) 2015, David Pineau
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of the copyright holder nor the names of its contributors
+//    may be used to endorse or promote products derived from this software
+//    without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER AND CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <droplet.h>
+#include <droplet/vfs.h>
+
+#include "cloudmig.h"
+#include "status.h"
+#include "status_bucket.h"
+#include "status_codec.h"
+#include "status_digest.h"
+#include "status_wal.h"
+
+#define CLOUDMIG_WAL_SEQ        "seq"
+#define CLOUDMIG_WAL_OP         "op"
+#define CLOUDMIG_WAL_PATH       "path"
+#define CLOUDMIG_WAL_DATA       "data"
+#define CLOUDMIG_WAL_IDXS       "idxs"
+#define CLOUDMIG_WAL_UPTO       "upto"
+
+#define CLOUDMIG_WAL_OP_PUT     "put"
+#define CLOUDMIG_WAL_OP_UNLINK  "unlink"
+#define CLOUDMIG_WAL_OP_DONE    "done"
+#define CLOUDMIG_WAL_OP_PARTIAL "partial"
+#define CLOUDMIG_WAL_OP_SYNCED  "synced"
+
+/*
+ * Pending mutation of a status file. Only the latest one matters for a given
+ * path, so they are coalesced.
+ */
+struct wal_op
+{
+    struct wal_op   *next;
+    char            *path;
+    char            *data;      // NULL for an unlink
+};
+
+/*
+ * Completion (or first checkpoint) read from the log, to be applied once the
+ * status is loaded.
+ */
+struct wal_done
+{
+    struct wal_done *next;
+    char            *path;
+    unsigned int    idx;
+    bool            partial;    // entry checkpointed, not completed
+};
+
+struct status_wal
+{
+    dpl_ctx_t               *status_ctx;
+    char                    *path;
+    int                     fd;
+
+    pthread_mutex_t         lock;
+    int                     lock_inited;
+    pthread_mutex_t         push_lock;  // serializes the replications
+    int                     push_lock_inited;
+    pthread_cond_t          cond;
+    int                     cond_inited;
+    pthread_t               thread;
+    int                     started;
+    int                     stop;
+    time_t                  period;
+
+    uint64_t                next_seq;
+    uint64_t                n_records;  // records within the log
+    struct wal_op           *ops;
+    struct bucket_status    **buckets;  // buckets with pending completions
+    int                     n_buckets;
+    int                     max_buckets;
+    struct wal_done         *dones;
+
+    time_t                  pending_since;
+    time_t                  max_lag;
+    uint64_t                n_recovered;
+};
+
+static void
+_wal_lock(struct status_wal *wal)
+{
+    pthread_mutex_lock(&wal->lock);
+}
+
+static void
+_wal_unlock(struct status_wal *wal)
+{
+    pthread_mutex_unlock(&wal->lock);
+}
+
+static void
+_wal_op_free(struct wal_op *op)
+{
+    if (op->path)
+        free(op->path);
+    if (op->data)
+        free(op->data);
+    free(op);
+}
+
+static void
+_wal_ops_free(struct wal_op *ops)
+{
+    struct wal_op   *next = NULL;
+
+    for (; ops != NULL; ops = next)
+    {
+        next = ops->next;
+        _wal_op_free(ops);
+    }
+}
+
+/*
+ * Registers a pending mutation, superseding the previous one on the same path.
+ * The log lock must be held by the caller.
+ */
+static int
+_wal_op_set(struct status_wal *wal, const char *path, const char *data)
+{
+    struct wal_op   *op = NULL;
+
+    for (op = wal->ops; op != NULL; op = op->next)
+    {
+        if (strcmp(op->path, path) == 0)
+            break ;
+    }
+
+    if (op == NULL)
+    {
+        op = calloc(1, sizeof(*op));
+        if (op == NULL || (op->path = strdup(path)) == NULL)
+            goto err;
+        op->next = wal->ops;
+        wal->ops = op;
+    }
+    else if (op->data)
+    {
+        free(op->data);
+        op->data = NULL;
+    }
+
+    if (data && (op->data = strdup(data)) == NULL)
+        goto err;
+
+    return EXIT_SUCCESS;
+
+err:
+    PRINTERR("[Status Log] Could not allocate pending mutation.\n");
+    if (op && op->path == NULL)
+        free(op);
+    return EXIT_FAILURE;
+}
+
+/*
+ * Registers a bucket status with pending completions.
+ * The log lock must be held by the caller.
+ */
+static int
+_wal_bucket_set(struct status_wal *wal, struct bucket_status *bst)
+{
+    struct bucket_status    **tmp = NULL;
+
+    for (int i=0; i < wal->n_buckets; ++i)
+    {
+        if (wal->buckets[i] == bst)
+            return EXIT_SUCCESS;
+    }
+
+    if (wal->n_buckets == wal->max_buckets)
+    {
+        tmp = realloc(wal->buckets, sizeof(*tmp) * (wal->max_buckets + 10));
+        if (tmp == NULL)
+        {
+            PRINTERR("[Status Log] Could not allocate pending buckets.\n");
+            return EXIT_FAILURE;
+        }
+        wal->buckets = tmp;
+        wal->max_buckets += 10;
+    }
+    wal->buckets[wal->n_buckets++] = bst;
+
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Appends a record to the log, and syncs it to disk.
+ * The log lock must be held by the caller.
+ */
+static int
+_wal_append(struct status_wal *wal, struct json_object *record)
+{
+    int                 ret;
+    struct json_object  *seq = NULL;
+    const char          *line = NULL;
+    size_t              len;
+    size_t              written = 0;
+    ssize_t             wret;
+
+    seq = json_object_new_int64(wal->next_seq);
+    if (seq == NULL)
+    {
+        PRINTERR("[Status Log] Could not allocate record sequence.\n");
+        ret = EXIT_FAILURE;
+        goto end;
+    }
+    json_object_object_add(record, CLOUDMIG_WAL_SEQ, seq);
+
+    // json-c escapes the newlines, so that one record is one line.
+    line = json_object_to_json_string(record);
+    if (line == NULL)
+    {
+        PRINTERR("[Status Log] Could not allocate record string.\n");
+        ret = EXIT_FAILURE;
+        goto end;
+    }
+
+    len = strlen(line);
+    while (written < len + 1)
+    {
+        if (written < len)
+            wret = write(wal->fd, line + written, len - written);
+        else
+            wret = write(wal->fd, "\n", 1);
+        if (wret == -1)
+        {
+            if (errno == EINTR)
+                continue ;
+            PRINTERR("[Status Log] Could not write to %s: %s.\n",
+                     wal->path, strerror(errno));
+            ret = EXIT_FAILURE;
+            goto end;
+        }
+        written += wret;
+    }
+
+    if (fsync(wal->fd) == -1)
+    {
+        PRINTERR("[Status Log] Could not sync %s: %s.\n",
+                 wal->path, strerror(errno));
+        ret = EXIT_FAILURE;
+        goto end;
+    }
+
+    wal->next_seq += 1;
+    wal->n_records += 1;
+    if (wal->pending_since == 0)
+        wal->pending_since = time(NULL);
+
+    ret = EXIT_SUCCESS;
+
+end:
+    return ret;
+}
+
+static struct json_object*
+_wal_record_new(const char *op, const char *path)
+{
+    struct json_object  *record = NULL;
+    struct json_object  *field = NULL;
+
+    record = json_object_new_object();
+    if (record == NULL)
+        goto err;
+
+    field = json_object_new_string(op);
+    if (field == NULL)
+        goto err;
+    json_object_object_add(record, CLOUDMIG_WAL_OP, field);
+
+    if (path)
+    {
+        field = json_object_new_string(path);
+        if (field == NULL)
+            goto err;
+        json_object_object_add(record, CLOUDMIG_WAL_PATH, field);
+    }
+
+    return record;
+
+err:
+    PRINTERR("[Status Log] Could not allocate record.\n");
+    if (record)
+        json_object_put(record);
+    return NULL;
+}
+
+int
+status_wal_put(struct status_wal *wal, const char *path, const char *data)
+{
+    int                 ret;
+    struct json_object  *record = NULL;
+    struct json_object  *field = NULL;
+
+    record = _wal_record_new(CLOUDMIG_WAL_OP_PUT, path);
+    if (record == NULL)
+    {
+        ret = EXIT_FAILURE;
+        goto end;
+    }
+
+    field = json_object_new_string(data);
+    if (field == NULL)
+    {
+        PRINTERR("[Status Log] Could not allocate record data.\n");
+        ret = EXIT_FAILURE;
+        goto end;
+    }
+    json_object_object_add(record, CLOUDMIG_WAL_DATA, field);
+
+    _wal_lock(wal);
+    ret = _wal_append(wal, record);
+    if (ret == EXIT_SUCCESS)
+        ret = _wal_op_set(wal, path, data);
+    _wal_unlock(wal);
+
+end:
+    if (record)
+        json_object_put(record);
+
+    return ret;
+}
+
+int
+status_wal_unlink(struct status_wal *wal, const char *path)
+{
+    int                 ret;
+    struct json_object  *record = NULL;
+
+    record = _wal_record_new(CLOUDMIG_WAL_OP_UNLINK, path);
+    if (record == NULL)
+        return EXIT_FAILURE;
+
+    _wal_lock(wal);
+    ret = _wal_append(wal, record);
+    if (ret == EXIT_SUCCESS)
+        ret = _wal_op_set(wal, path, NULL);
+    _wal_unlock(wal);
+
+    json_object_put(record);
+
+    return ret;
+}
+
+/*
+ * Records entries of a bucket status, whose manifest is then uploaded by the
+ * next replication.
+ */
+static int
+_wal_entries(struct status_wal *wal, const char *op, struct bucket_status *bst,
+             const unsigned int *idxs, int n_idxs)
+{
+    int                 ret;
+    struct json_object  *record = NULL;
+    struct json_object  *array = NULL;
+    struct json_object  *field = NULL;
+
+    record = _wal_record_new(op, bst->path);
+    if (record == NULL)
+    {
+        ret = EXIT_FAILURE;
+        goto end;
+    }
+
+    array = json_object_new_array();
+    if (array == NULL)
+        goto alloc_err;
+    json_object_object_add(record, CLOUDMIG_WAL_IDXS, array);
+    for (int i=0; i < n_idxs; ++i)
+    {
+        field = json_object_new_int64(idxs[i]);
+        if (field == NULL)
+            goto alloc_err;
+        json_object_array_add(array, field);
+    }
+
+    _wal_lock(wal);
+    ret = _wal_append(wal, record);
+    if (ret == EXIT_SUCCESS)
+        ret = _wal_bucket_set(wal, bst);
+    _wal_unlock(wal);
+    goto end;
+
+alloc_err:
+    PRINTERR("[Status Log] Could not allocate record indexes.\n");
+    ret = EXIT_FAILURE;
+
+end:
+    if (record)
+        json_object_put(record);
+
+    return ret;
+}
+
+int
+status_wal_done(struct status_wal *wal, struct bucket_status *bst,
+                const unsigned int *idxs, int n_idxs)
+{
+    return _wal_entries(wal, CLOUDMIG_WAL_OP_DONE, bst, idxs, n_idxs);
+}
+
+int
+status_wal_partial(struct status_wal *wal, struct bucket_status *bst,
+                   const unsigned int *idxs, int n_idxs)
+{
+    return _wal_entries(wal, CLOUDMIG_WAL_OP_PARTIAL, bst, idxs, n_idxs);
+}
+
+/*
+ * Rewrites the log with only the records past the replicated sequence, which
+ * are the ones recorded during the replication. The log lock must be held by
+ * the caller.
+ */
+static int
+_wal_compact(struct status_wal *wal, uint64_t upto)
+{
+    int                 ret;
+    FILE                *file = NULL;
+    FILE                *out = NULL;
+    char                *tmppath = NULL;
+    char                *line = NULL;
+    size_t              linesize = 0;
+    struct json_object  *record = NULL;
+    struct json_object  *field = NULL;
+    int                 fd = -1;
+
+    // Everything was replicated: start over with an empty log.
+    if (wal->next_seq - 1 == upto)
+    {
+        if (ftruncate(wal->fd, 0) == -1)
+        {
+            cloudmig_log(WARN_LVL, "[Status Log] Could not truncate %s: %s.\n",
+                         wal->path, strerror(errno));
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+
+    if (asprintf(&tmppath, "%s.tmp", wal->path) <= 0)
+    {
+        tmppath = NULL;
+        PRINTERR("[Status Log] Could not allocate compacted log path.\n");
+        ret = EXIT_FAILURE;
+        goto end;
+    }
+
+    file = fopen(wal->path, "r");
+    out = fopen(tmppath, "w");
+    if (file == NULL || out == NULL)
+    {
+        cloudmig_log(WARN_LVL, "[Status Log] Could not compact %s: %s.\n",
+                     wal->path, strerror(errno));
+        ret = EXIT_FAILURE;
+        goto end;
+    }
+
+    // All the records are complete, since the appends are held meanwhile.
+    while (getline(&line, &linesize, file) != -1)
+    {
+        record = json_tokener_parse(line);
+        if (record
+            && json_object_object_get_ex(record, CLOUDMIG_WAL_SEQ, &field) == TRUE
+            && (uint64_t)json_object_get_int64(field) <= upto)
+        {
+            json_object_put(record);
+            record = NULL;
+            continue ;
+        }
+        if (record)
+        {
+            json_object_put(record);
+            record = NULL;
+        }
+        if (fputs(line, out) == EOF)
+            goto write_err;
+    }
+
+    if (fflush(out) == EOF || fsync(fileno(out)) == -1)
+        goto write_err;
+
+    // The renaming atomically replaces the log with its compacted version.
+    fd = open(tmppath, O_WRONLY|O_APPEND);
+    if (fd == -1 || rename(tmppath, wal->path) == -1)
+        goto write_err;
+    close(wal->fd);
+    wal->fd = fd;
+    fd = -1;
+
+    ret = EXIT_SUCCESS;
+    goto end;
+
+write_err:
+    cloudmig_log(WARN_LVL, "[Status Log] Could not compact %s: %s.\n",
+                 wal->path, strerror(errno));
+    ret = EXIT_FAILURE;
+
+end:
+    if (fd != -1)
+        close(fd);
+    if (out)
+    {
+        fclose(out);
+        if (ret != EXIT_SUCCESS)
+            (void)unlink(tmppath);
+    }
+    if (file)
+        fclose(file);
+    if (line)
+        free(line);
+    if (tmppath)
+        free(tmppath);
+
+    return ret;
+}
+
+/*
+ * Pushes the pending mutations to the status store. Mutations recorded in the
+ * meantime are left for the next replication.
+ */
+static int
+_wal_replicate(struct status_wal *wal)
+{
+    int                     ret = EXIT_SUCCESS;
+    dpl_status_t            dplret;
+    struct wal_op           *ops = NULL;
+    struct wal_op           *op = NULL;
+    struct wal_op           *failed = NULL;
+    struct bucket_status    **buckets = NULL;
+    int                     n_buckets = 0;
+    int                     n_ops = 0;
+    uint64_t                upto;
+    time_t                  since;
+    time_t                  lag;
+    struct json_object      *record = NULL;
+    struct json_object      *field = NULL;
+
+    pthread_mutex_lock(&wal->push_lock);
+
+    _wal_lock(wal);
+    ops = wal->ops;
+    wal->ops = NULL;
+    buckets = wal->buckets;
+    n_buckets = wal->n_buckets;
+    wal->buckets = NULL;
+    wal->n_buckets = 0;
+    wal->max_buckets = 0;
+    upto = wal->next_seq - 1;
+    since = wal->pending_since;
+    wal->pending_since = 0;
+    _wal_unlock(wal);
+
+    // Only drop the records left by the previous replication, if any.
+    if (ops == NULL && n_buckets == 0)
+    {
+        _wal_lock(wal);
+        if (wal->next_seq - 1 == upto && wal->n_records)
+        {
+            (void)_wal_compact(wal, upto);
+            wal->n_records = 0;
+        }
+        _wal_unlock(wal);
+        goto end;
+    }
+
+    while (ops != NULL)
+    {
+        op = ops;
+        ops = op->next;
+        ++n_ops;
+
+        if (op->data)
+            dplret = status_codec_put(wal->status_ctx, op->path,
+                                      op->data, strlen(op->data));
+        else
+        {
+            dplret = dpl_unlink(wal->status_ctx, op->path);
+            if (dplret == DPL_ENOENT)
+                dplret = DPL_SUCCESS;
+        }
+
+        if (dplret != DPL_SUCCESS)
+        {
+            cloudmig_log(WARN_LVL, "[Status Log] Could not replicate %s: %s.\n",
+                         op->path, dpl_status_str(dplret));
+            op->next = failed;
+            failed = op;
+            continue ;
+        }
+        _wal_op_free(op);
+    }
+
+    for (int i=0; i < n_buckets; ++i)
+    {
+        if (status_bucket_flush(wal->status_ctx, buckets[i]) != EXIT_SUCCESS)
+        {
+            ret = EXIT_FAILURE;
+            break ;
+        }
+        buckets[i] = NULL;
+    }
+
+    _wal_lock(wal);
+    if (failed || ret != EXIT_SUCCESS)
+    {
+        // Keep the failed mutations for the next attempt, unless superseded.
+        while (failed != NULL)
+        {
+            op = failed;
+            failed = op->next;
+            for (ops = wal->ops; ops != NULL; ops = ops->next)
+            {
+                if (strcmp(ops->path, op->path) == 0)
+                    break ;
+            }
+            if (ops == NULL)
+            {
+                op->next = wal->ops;
+                wal->ops = op;
+            }
+            else
+                _wal_op_free(op);
+        }
+        for (int i=0; i < n_buckets; ++i)
+        {
+            if (buckets[i])
+                (void)_wal_bucket_set(wal, buckets[i]);
+        }
+        if (wal->pending_since == 0 || since < wal->pending_since)
+            wal->pending_since = since;
+        ret = EXIT_FAILURE;
+    }
+    else
+    {
+        lag = time(NULL) - since;
+        if (lag > wal->max_lag)
+            wal->max_lag = lag;
+
+        /*
+         * Keep the log from growing: only the records past the replicated
+         * ones are kept. Should that fail, a record of the replication keeps
+         * the next run from replaying the others.
+         */
+        if (_wal_compact(wal, upto) == EXIT_SUCCESS)
+            wal->n_records = wal->next_seq - 1 - upto;
+        else if ((record = _wal_record_new(CLOUDMIG_WAL_OP_SYNCED, NULL)) != NULL
+                 && (field = json_object_new_int64(upto)) != NULL)
+        {
+            json_object_object_add(record, CLOUDMIG_WAL_UPTO, field);
+            (void)_wal_append(wal, record);
+        }
+
+        cloudmig_log(DEBUG_LVL, "[Status Log] Replicated %i files and %i bucket"
+                     " statuses (lag: %lis).\n", n_ops, n_buckets, (long)lag);
+    }
+    _wal_unlock(wal);
+
+end:
+    pthread_mutex_unlock(&wal->push_lock);
+    if (record)
+        json_object_put(record);
+    if (buckets)
+        free(buckets);
+    _wal_ops_free(ops);
+
+    return ret;
+}
+
+int
+status_wal_flush(struct status_wal *wal)
+{
+    return _wal_replicate(wal);
+}
+
+static void*
+_wal_main_loop(struct status_wal *wal)
+{
+    struct timespec     ts = {0, 0};
+
+    _wal_lock(wal);
+    while (!wal->stop)
+    {
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_sec += wal->period;
+        pthread_cond_timedwait(&wal->cond, &wal->lock, &ts);
+        if (wal->stop)
+            break ;
+        _wal_unlock(wal);
+
+        (void)_wal_replicate(wal);
+
+        _wal_lock(wal);
+    }
+    _wal_unlock(wal);
+
+    return NULL;
+}
+
+/*
+ * Reads back one record of a previous run.
+ *
+ * @return  1 - Record applied
+ *          0 - Record already replicated
+ *         -1 - Invalid record
+ */
+static int
+_wal_read_record(struct status_wal *wal, struct json_object *record, uint64_t synced)
+{
+    struct json_object  *field = NULL;
+    struct wal_done     *done = NULL;
+    const char          *op = NULL;
+    const char          *path = NULL;
+    uint64_t            seq;
+
+    if (json_object_object_get_ex(record, CLOUDMIG_WAL_SEQ, &field) == FALSE
+        || !json_object_is_type(field, json_type_int))
+        return -1;
+    seq = json_object_get_int64(field);
+    if (seq >= wal->next_seq)
+        wal->next_seq = seq + 1;
+    if (seq <= synced)
+        return 0;
+
+    if (json_object_object_get_ex(record, CLOUDMIG_WAL_OP, &field) == FALSE
+        || !json_object_is_type(field, json_type_string))
+        return -1;
+    op = json_object_get_string(field);
+
+    if (strcmp(op, CLOUDMIG_WAL_OP_SYNCED) == 0)
+        return 0;
+
+    if (json_object_object_get_ex(record, CLOUDMIG_WAL_PATH, &field) == FALSE
+        || !json_object_is_type(field, json_type_string))
+        return -1;
+    path = json_object_get_string(field);
+
+    if (strcmp(op, CLOUDMIG_WAL_OP_PUT) == 0)
+    {
+        if (json_object_object_get_ex(record, CLOUDMIG_WAL_DATA, &field) == FALSE
+            || !json_object_is_type(field, json_type_string))
+            return -1;
+        return _wal_op_set(wal, path, json_object_get_string(field)) == EXIT_SUCCESS ? 1 : -1;
+    }
+    if (strcmp(op, CLOUDMIG_WAL_OP_UNLINK) == 0)
+        return _wal_op_set(wal, path, NULL) == EXIT_SUCCESS ? 1 : -1;
+    if (strcmp(op, CLOUDMIG_WAL_OP_DONE) == 0
+        || strcmp(op, CLOUDMIG_WAL_OP_PARTIAL) == 0)
+    {
+        if (json_object_object_get_ex(record, CLOUDMIG_WAL_IDXS, &field) == FALSE
+            || !json_object_is_type(field, json_type_array))
+            return -1;
+        for (int i=0; i < json_object_array_length(field); ++i)
+        {
+            done = calloc(1, sizeof(*done));
+            if (done == NULL || (done->path = strdup(path)) == NULL)
+            {
+                if (done)
+                    free(done);
+                return -1;
+            }
+            done->idx = json_object_get_int64(json_object_array_get_idx(field, i));
+            done->partial = (strcmp(op, CLOUDMIG_WAL_OP_PARTIAL) == 0);
+            done->next = wal->dones;
+            wal->dones = done;
+        }
+        return 1;
+    }
+
+    return -1;
+}
+
+/*
+ * Reads back the records of a previous run that were not replicated.
+ */
+static int
+_wal_read(struct status_wal *wal)
+{
+    int                 ret;
+    FILE                *file = NULL;
+    char                *line = NULL;
+    size_t              linesize = 0;
+    ssize_t             linelen;
+    struct json_object  **records = NULL;
+    struct json_object  **tmp = NULL;
+    struct json_object  *field = NULL;
+    int                 n_records = 0;
+    uint64_t            synced = 0;
+    off_t               valid_len = 0;
+    int                 iret;
+
+    file = fopen(wal->path, "r");
+    if (file == NULL)
+    {
+        if (errno == ENOENT)
+        {
+            ret = EXIT_SUCCESS;
+            goto end;
+        }
+        PRINTERR("[Status Log] Could not open %s: %s.\n",
+                 wal->path, strerror(errno));
+        ret = EXIT_FAILURE;
+        goto end;
+    }
+
+    /*
+     * First pass: find up to where the log was replicated. Since records are
+     * only applied if more recent, keep them all in memory meanwhile.
+     */
+    while ((linelen = getline(&line, &linesize, file)) != -1)
+    {
+        tmp = realloc(records, sizeof(*records) * (n_records + 1));
+        if (tmp == NULL)
+        {
+            PRINTERR("[Status Log] Could not allocate records.\n");
+            ret = EXIT_FAILURE;
+            goto end;
+        }
+        records = tmp;
+
+        records[n_records] = json_tokener_parse(line);
+        if (records[n_records] == NULL)
+        {
+            // A torn write can only be the last record, which was never acknowledged.
+            if (!feof(file) && fgetc(file) != EOF)
+            {
+                PRINTERR("[Status Log] Corrupted record in %s.\n", wal->path);
+                ret = EXIT_FAILURE;
+                goto end;
+            }
+            cloudmig_log(WARN_LVL, "[Status Log] Ignoring truncated last record of %s.\n",
+                         wal->path);
+            // Drop it, for the next records not to be appended to it.
+            if (truncate(wal->path, valid_len) == -1)
+            {
+                PRINTERR("[Status Log] Could not truncate %s: %s.\n",
+                         wal->path, strerror(errno));
+                ret = EXIT_FAILURE;
+                goto end;
+            }
+            break ;
+        }
+
+        if (json_object_object_get_ex(records[n_records], CLOUDMIG_WAL_UPTO, &field) == TRUE
+            && (uint64_t)json_object_get_int64(field) > synced)
+            synced = json_object_get_int64(field);
+        n_records++;
+        valid_len += linelen;
+    }
+
+    for (int i=0; i < n_records; ++i)
+    {
+        iret = _wal_read_record(wal, records[i], synced);
+        if (iret == -1)
+        {
+            PRINTERR("[Status Log] Invalid record in %s.\n", wal->path);
+            ret = EXIT_FAILURE;
+            goto end;
+        }
+        wal->n_recovered += iret;
+    }
+
+    if (wal->n_recovered)
+        wal->pending_since = time(NULL);
+    // Even when all replicated, they are dropped by the next replication.
+    wal->n_records = n_records;
+
+    ret = EXIT_SUCCESS;
+
+end:
+    if (records)
+    {
+        for (int i=0; i < n_records; ++i)
+            json_object_put(records[i]);
+        free(records);
+    }
+    if (line)
+        free(line);
+    if (file)
+        fclose(file);
+
+    return ret;
+}
+
+struct status_wal*
+status_wal_open(dpl_ctx_t *status_ctx, const char *path)
+{
+    struct status_wal   *ret = NULL;
+    struct status_wal   *wal = NULL;
+
+    wal = calloc(1, sizeof(*wal));
+    if (wal == NULL)
+    {
+        PRINTERR("[Status Log] Could not allocate status log.\n");
+        goto end;
+    }
+    wal->fd = -1;
+    wal->status_ctx = status_ctx;
+    wal->next_seq = 1;
+
+    wal->path = strdup(path);
+    if (wal->path == NULL)
+    {
+        PRINTERR("[Status Log] Could not allocate status log path.\n");
+        goto end;
+    }
+
+    if (pthread_mutex_init(&wal->lock, NULL) != 0)
+        goto end;
+    wal->lock_inited = 1;
+    if (pthread_mutex_init(&wal->push_lock, NULL) != 0)
+        goto end;
+    wal->push_lock_inited = 1;
+    if (pthread_cond_init(&wal->cond, NULL) != 0)
+        goto end;
+    wal->cond_inited = 1;
+
+    if (_wal_read(wal) != EXIT_SUCCESS)
+        goto end;
+
+    wal->fd = open(wal->path, O_WRONLY|O_APPEND|O_CREAT, 0644);
+    if (wal->fd == -1)
+    {
+        PRINTERR("[Status Log] Could not open %s: %s.\n",
+                 wal->path, strerror(errno));
+        goto end;
+    }
+
+    ret = wal;
+    wal = NULL;
+
+end:
+    if (wal)
+        status_wal_close(wal);
+
+    return ret;
+}
+
+int
+status_wal_recover(struct status_wal *wal, struct cloudmig_status *status)
+{
+    int                     ret;
+    struct wal_done         *done = NULL;
+    struct wal_op           *op = NULL;
+    struct bucket_status    *bst = NULL;
+
+    if (wal->n_recovered == 0)
+        return EXIT_SUCCESS;
+
+    cloudmig_log(INFO_LVL, "[Status Log] Recovering %llu status mutations"
+                 " from %s...\n", (unsigned long long)wal->n_recovered, wal->path);
+
+    _wal_lock(wal);
+    while (wal->dones != NULL)
+    {
+        done = wal->dones;
+        wal->dones = done->next;
+
+        bst = NULL;
+        for (int i=0; i < status->n_loaded; ++i)
+        {
+            if (strcmp(status->buckets[i]->path, done->path) == 0)
+            {
+                bst = status->buckets[i];
+                break ;
+            }
+        }
+        if (bst == NULL)
+            cloudmig_log(WARN_LVL, "[Status Log] Ignoring completion for the "
+                         "unknown bucket status %s.\n", done->path);
+        else if ((done->partial ? status_bucket_mark_partial(bst, done->idx)
+                                : status_bucket_mark_done(bst, done->idx)) != EXIT_SUCCESS
+                 || _wal_bucket_set(wal, bst) != EXIT_SUCCESS)
+        {
+            free(done->path);
+            free(done);
+            _wal_unlock(wal);
+            return EXIT_FAILURE;
+        }
+
+        free(done->path);
+        free(done);
+    }
+
+    // The digest loaded from the store is older than the one of the log.
+    for (op = wal->ops; op != NULL; op = op->next)
+    {
+        if (op->data && strcmp(op->path, status->digest->path) == 0)
+            (void)status_digest_parse(status->digest, op->data, strlen(op->data));
+    }
+    _wal_unlock(wal);
+
+    ret = _wal_replicate(wal);
+    if (ret != EXIT_SUCCESS)
+    {
+        PRINTERR("[Status Log] Could not replicate recovered status mutations.\n");
+        return ret;
+    }
+
+    cloudmig_log(INFO_LVL, "[Status Log] Recovered status mutations.\n");
+
+    return EXIT_SUCCESS;
+}
+
+int
+status_wal_start(struct status_wal *wal, time_t period)
+{
+    wal->period = period > 0 ? period : 1;
+
+    if (pthread_create(&wal->thread, NULL,
+                       (void*(*)(void*))_wal_main_loop, wal) != 0)
+    {
+        PRINTERR("[Status Log] Could not start replication thread.\n");
+        return EXIT_FAILURE;
+    }
+    wal->started = 1;
+
+    return EXIT_SUCCESS;
+}
+
+time_t
+status_wal_lag(struct status_wal *wal)
+{
+    time_t  lag = 0;
+
+    _wal_lock(wal);
+    if (wal->pending_since)
+        lag = time(NULL) - wal->pending_since;
+    _wal_unlock(wal);
+
+    return lag;
+}
+
+time_t
+status_wal_max_lag(struct status_wal *wal)
+{
+    time_t  lag = 0;
+
+    _wal_lock(wal);
+    lag = wal->max_lag;
+    _wal_unlock(wal);
+
+    return lag;
+}
+
+void
+status_wal_close(struct status_wal *wal)
+{
+    struct wal_done *done = NULL;
+
+    if (wal->started)
+    {
+        _wal_lock(wal);
+        wal->stop = 1;
+        pthread_cond_signal(&wal->cond);
+        _wal_unlock(wal);
+        pthread_join(wal->thread, NULL);
+    }
+
+    if (wal->fd != -1)
+    {
+        if (_wal_replicate(wal) != EXIT_SUCCESS)
+            cloudmig_log(WARN_LVL, "[Status Log] Some status mutations could not"
+                         " be replicated, they will be on the next run.\n");
+        close(wal->fd);
+    }
+
+    while (wal->dones != NULL)
+    {
+        done = wal->dones;
+        wal->dones = done->next;
+        free(done->path);
+        free(done);
+    }
+    _wal_ops_free(wal->ops);
+    if (wal->buckets)
+        free(wal->buckets);
+
+    if (wal->cond_inited)
+        pthread_cond_destroy(&wal->cond);
+    if (wal->push_lock_inited)
+        pthread_mutex_destroy(&wal->push_lock);
+    if (wal->lock_inited)
+        pthread_mutex_destroy(&wal->lock);
+    if (wal->path)
+        free(wal->path);
+    free(wal);
+}
@@ -48,6 +48,10 @@ static void                 _sdirlist_remove(struct synceddir_ctx *ctx, struct s
 static void                 _sdirctx_lock(struct synceddir_ctx *ctx);
 static void                 _sdirctx_unlock(struct synceddir_ctx *ctx);
 
+static bool                 _sdirknown_find(struct synceddir_ctx *ctx, const char *path,
+                                            unsigned int *slotp);
+static void                 _sdirknown_add(struct synceddir_ctx *ctx, const char *path);
+
 struct synceddir*
 _sdir_new(struct synceddir_ctx *ctx, const char *path)
 {
@@ -111,6 +115,8 @@ _sdir_notify(struct synceddir *sdir, bool exists)
 {
     sdir->done = true;
     sdir->exists = exists;
+    if (exists)
+        _sdirknown_add(sdir->ctx, sdir->path);
     if (sdir->refcount > 1)
         pthread_cond_broadcast(&sdir->notify_cond);
 }
@@ -172,6 +178,80 @@ _sdirlist_remove(struct synceddir_ctx *ctx, struct synceddir *sdir)
     sdir->next = NULL;
 }
 
+static unsigned int
+_sdirknown_hash(const char *path)
+{
+    unsigned int    hash = 2166136261u;
+
+    while (*path)
+        hash = (hash ^ (unsigned char)*path++) * 16777619u;
+
+    return hash;
+}
+
+static bool
+_sdirknown_find(struct synceddir_ctx *ctx, const char *path, unsigned int *slotp)
+{
+    unsigned int    slot;
+
+    if (ctx->known.size == 0)
+        return false;
+
+    slot = _sdirknown_hash(path) & (ctx->known.size - 1);
+    while (ctx->known.paths[slot] != NULL)
+    {
+        if (strcmp(ctx->known.paths[slot], path) == 0)
+            return true;
+        slot = (slot + 1) & (ctx->known.size - 1);
+    }
+    if (slotp)
+        *slotp = slot;
+
+    return false;
+}
+
+/*
+ * Failing to record a directory is not an error: its existence would only
+ * be checked again.
+ */
+static void
+_sdirknown_add(struct synceddir_ctx *ctx, const char *path)
+{
+    char            **paths = NULL;
+    char            **old = ctx->known.paths;
+    unsigned int    oldsize = ctx->known.size;
+    unsigned int    size;
+    unsigned int    slot = 0;
+    char            *pathcpy = NULL;
+
+    // Kept at most half full
+    if (2 * (ctx->known.count + 1) > ctx->known.size)
+    {
+        size = ctx->known.size ? ctx->known.size * 2 : 256;
+        paths = calloc(size, sizeof(*paths));
+        if (paths == NULL)
+            return ;
+        ctx->known.paths = paths;
+        ctx->known.size = size;
+        for (unsigned int i=0; i < oldsize; ++i)
+        {
+            if (old[i] == NULL)
+                continue ;
+            (void)_sdirknown_find(ctx, old[i], &slot);
+            paths[slot] = old[i];
+        }
+        free(old);
+    }
+
+    if (_sdirknown_find(ctx, path, &slot))
+        return ;
+    pathcpy = strdup(path);
+    if (pathcpy == NULL)
+        return ;
+    ctx->known.paths[slot] = pathcpy;
+    ctx->known.count += 1;
+}
+
 static void
 _sdirctx_lock(struct synceddir_ctx *ctx)
 {
@@ -222,6 +302,9 @@ synced_dir_context_delete(struct synceddir_ctx *ctx)
         ctx->list.first = tmp->next;
         _sdir_delete(tmp);
     }
+    for (unsigned int i=0; i < ctx->known.size; ++i)
+        free(ctx->known.paths[i]);
+    free(ctx->known.paths);
     pthread_mutex_destroy(&ctx->lock);
     free(ctx);
 }
@@ -290,3 +373,15 @@ synced_dir_completion_wait(struct synceddir *sdir)
 
     return exists;
 }
+
+bool
+synced_dir_exists(struct synceddir_ctx *ctx, const char *path)
+{
+    bool    exists;
+
+    _sdirctx_lock(ctx);
+    exists = _sdirknown_find(ctx, path, NULL);
+    _sdirctx_unlock(ctx);
+
+    return exists;
+}
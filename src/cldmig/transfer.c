@@ -25,14 +25,19 @@
 // POSSIBILITY OF SUCH DAMAGE.
 
 #include <errno.h>
+#include <stdint.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "cloudmig.h"
 #include "options.h"
 
 #include "status_store.h"
+#include "status_bucket.h"
 #include "status_digest.h"
 #include "display.h"
+#include "watchdog.h"
 
 static int
 migrate_with_retries(struct cldmig_info *tinfo,
@@ -47,6 +52,8 @@ retry:
     ret = migfunc(tinfo, filestate);
     if (ret != EXIT_SUCCESS)
     {
+        // The failure may come from the watchdog interrupting a stalled call.
+        (void)watchdog_check_stalled(tinfo);
         if (++failures < n_attempts)
         {
             cloudmig_log(ERR_LVL,
@@ -63,34 +70,37 @@ retry:
 }
 
 static int
-migrate_object(struct cldmig_info *tinfo,
-               struct file_transfer_state* filestate)
+(*migration_function(struct file_transfer_state *filestate))(struct cldmig_info*, struct file_transfer_state*)
 {
-    int             failures = 0;
-    int             ret = EXIT_FAILURE;
-    int             (*migfunc)(struct cldmig_info*, struct file_transfer_state*) = NULL;
-
-    cloudmig_log(DEBUG_LVL, "[Migrating] : starting migration of file %s\n",
-                 filestate->obj_path);
-
     switch (filestate->fixed.type)
     {
     case DPL_FTYPE_DIR:
-        migfunc = &create_directory;
-        break ;
+        return &create_directory;
     case DPL_FTYPE_SYMLINK:
-        migfunc = &create_symlink;
-        break ;
+        return &create_symlink;
     case DPL_FTYPE_REG:
     default:
-        migfunc = &transfer_file;
-        break ;
+        return &transfer_file;
     }
-    ret = migrate_with_retries(tinfo, filestate, migfunc, 3);
+}
+
+static int
+migrate_object(struct cldmig_info *tinfo,
+               struct file_transfer_state* filestate)
+{
+    int             ret = EXIT_FAILURE;
+
+    cloudmig_log(DEBUG_LVL, "[Migrating] : starting migration of file %s\n",
+                 filestate->obj_path);
+
+    ret = migrate_with_retries(tinfo, filestate, migration_function(filestate), 3);
     if (ret != EXIT_SUCCESS)
         goto ret;
 
-    status_store_entry_complete(tinfo->ctx, filestate);
+    // An entry not recorded as complete is migrated again by the next run.
+    ret = status_store_entry_complete(tinfo->ctx, filestate);
+    if (ret != EXIT_SUCCESS)
+        goto ret;
     display_trigger_update(tinfo->ctx->display);
 
     cloudmig_log(INFO_LVL,
@@ -98,7 +108,7 @@ migrate_object(struct cldmig_info *tinfo,
 
 ret:
 
-    return (failures == 3);
+    return ret != EXIT_SUCCESS;
 }
 
 
@@ -113,12 +123,14 @@ migrate_worker_loop(struct cldmig_info *tinfo)
     int                         found = 0;
     struct file_transfer_state  cur_filestate = CLOUDMIG_FILESTATE_INITIALIZER;
     size_t                      nbfailures = 0;
+    int                         worker = tinfo - tinfo->ctx->tinfos;
 
     // The call allocates the buffer for the bucket, so we must free it
     // The same goes for the cur_filestate's name field.
     pthread_mutex_lock(&tinfo->lock);
     while (tinfo->stop == false
-           && (found = status_store_next_incomplete_entry(tinfo->ctx, &cur_filestate)) == 1)
+           && (found = status_store_next_incomplete_entry(tinfo->ctx, worker,
+                                                          &cur_filestate)) == 1)
     {
         /*
          * Set the thread's internal data to the current file while we're locked
@@ -127,6 +139,8 @@ migrate_worker_loop(struct cldmig_info *tinfo)
         tinfo->fsize = cur_filestate.fixed.size;
         tinfo->fdone = cur_filestate.fixed.offset;
         tinfo->fpath = cur_filestate.obj_path;
+        tinfo->transfer_gen += 1;
+        tinfo->stalled = false;
 
         pthread_mutex_unlock(&tinfo->lock);
         if (migrate_object(tinfo, &cur_filestate))
@@ -145,6 +159,167 @@ migrate_worker_loop(struct cldmig_info *tinfo)
 
     pthread_mutex_unlock(&tinfo->lock);
 
+    status_store_clear_entry(&cur_filestate);
+
+    /*
+     * Found will equal -1 only in case of fatal status error.
+     * It shall equal either 1 on program interrupt, or 0 on migration end.
+     */
+    return found != -1 ? (void*)nbfailures : (void*)-1;
+}
+
+
+/*
+ * Batched completion:
+ *
+ * Instead of saving the completion of each entry on its own, each worker
+ * claims a batch of entries, migrates them one after the other, and saves all
+ * the completions of the batch at once. For small objects, the bucket status
+ * upload done for each completion costs as much as the transfer itself.
+ *
+ * The transfers themselves are not overlapped: libdroplet only exposes
+ * blocking calls, so that a worker cannot multiplex several transfers over
+ * non-blocking connections. The transfers in flight remain bounded by the
+ * number of worker threads.
+ */
+
+/*
+ * Entries that are transfered in multiple chunks are checkpointed along the
+ * way, and thus do not benefit from the batch.
+ */
+static bool
+_batch_is_large(struct cldmig_info *tinfo, struct file_transfer_state *filestate)
+{
+    return filestate->fixed.type == DPL_FTYPE_REG
+        && filestate->fixed.size > tinfo->ctx->options.block_size;
+}
+
+static int
+_batch_migrate(struct cldmig_info *tinfo, struct file_transfer_state *filestate)
+{
+    pthread_mutex_lock(&tinfo->lock);
+    tinfo->fsize = filestate->fixed.size;
+    tinfo->fdone = filestate->fixed.offset;
+    tinfo->fpath = filestate->obj_path;
+    tinfo->transfer_gen += 1;
+    tinfo->stalled = false;
+    pthread_mutex_unlock(&tinfo->lock);
+
+    cloudmig_log(DEBUG_LVL, "[Migrating] : starting migration of file %s\n",
+                 filestate->obj_path);
+
+    return migrate_with_retries(tinfo, filestate, migration_function(filestate), 3);
+}
+
+static void
+_batch_commit(struct cldmig_info *tinfo,
+              struct file_transfer_state **done, int *n_done)
+{
+    if (*n_done == 0)
+        return ;
+
+    if (status_store_entries_complete(tinfo->ctx, done, *n_done) == EXIT_SUCCESS)
+    {
+        for (int i=0; i < *n_done; ++i)
+            cloudmig_log(INFO_LVL,
+            "[Migrating] : file %s migrated.\n", done[i]->obj_path);
+    }
+    display_trigger_update(tinfo->ctx->display);
+
+    *n_done = 0;
+}
+
+static void*
+migrate_batch_worker_loop(struct cldmig_info *tinfo)
+{
+    int                         found = 0;
+    long int                    batch = tinfo->ctx->options.commit_batch;
+    struct file_transfer_state  *filestates = NULL;
+    struct file_transfer_state  **done = NULL;
+    int                         n_claimed = 0;
+    int                         n_done = 0;
+    size_t                      nbfailures = 0;
+    int                         worker = tinfo - tinfo->ctx->tinfos;
+
+    filestates = calloc(batch, sizeof(*filestates));
+    done = calloc(batch, sizeof(*done));
+    if (filestates == NULL || done == NULL)
+    {
+        PRINTERR("[Migrating] Could not allocate the batch of entries.\n");
+        found = -1;
+        goto end;
+    }
+    // The filestates keep their paths buffers from one claim to the next
+    for (int i=0; i < batch; ++i)
+        filestates[i] = (struct file_transfer_state)CLOUDMIG_FILESTATE_INITIALIZER;
+
+    pthread_mutex_lock(&tinfo->lock);
+    while (tinfo->stop == false)
+    {
+        /*
+         * Claim entries until the batch is full. A large entry closes the
+         * batch, so that it does not delay the commit of the others.
+         */
+        for (n_claimed = 0; n_claimed < batch; ++n_claimed)
+        {
+            found = status_store_next_incomplete_entry(tinfo->ctx, worker,
+                                                       &filestates[n_claimed]);
+            if (found != 1)
+                break ;
+            if (_batch_is_large(tinfo, &filestates[n_claimed]))
+            {
+                ++n_claimed;
+                break ;
+            }
+        }
+        pthread_mutex_unlock(&tinfo->lock);
+
+        for (int i=0; i < n_claimed; ++i)
+        {
+            // Commit the small entries before starting the large one.
+            if (_batch_is_large(tinfo, &filestates[i]))
+                _batch_commit(tinfo, done, &n_done);
+
+            if (_batch_migrate(tinfo, &filestates[i]) == EXIT_SUCCESS)
+                done[n_done++] = &filestates[i];
+            else
+                ++nbfailures;
+        }
+
+        pthread_mutex_lock(&tinfo->lock);
+        tinfo->fsize = 0;
+        tinfo->fdone = 0;
+        tinfo->fpath = NULL;
+        pthread_mutex_unlock(&tinfo->lock);
+
+        _batch_commit(tinfo, done, &n_done);
+        for (int i=0; i < n_claimed; ++i)
+            status_store_release_entry(&filestates[i]);
+
+        pthread_mutex_lock(&tinfo->lock);
+        if (found != 1)
+            break ;
+    }
+
+    clear_list(&tinfo->infolist);
+
+    // Reset thread info for viewer to see inactive thread.
+    tinfo->fsize = 0;
+    tinfo->fdone = 0;
+    tinfo->fpath = NULL;
+
+    pthread_mutex_unlock(&tinfo->lock);
+
+end:
+    if (filestates)
+    {
+        for (int i=0; i < batch; ++i)
+            status_store_clear_entry(&filestates[i]);
+        free(filestates);
+    }
+    if (done)
+        free(done);
+
     /*
      * Found will equal -1 only in case of fatal status error.
      * It shall equal either 1 on program interrupt, or 0 on migration end.
@@ -164,14 +339,25 @@ migrate(struct cloudmig_ctx* ctx)
 {
     int                         nb_failures = 0;
     int                         ret;
+    struct cldmig_watchdog      *watchdog = NULL;
+
+    void                        *(*worker_loop)(struct cldmig_info*) = &migrate_worker_loop;
 
     cloudmig_log(DEBUG_LVL, "Starting migration...\n");
 
+    if (ctx->options.commit_batch > 1)
+    {
+        cloudmig_log(INFO_LVL, "Committing the completions by batches of %li entries.\n",
+                     ctx->options.commit_batch);
+        worker_loop = &migrate_batch_worker_loop;
+    }
+
     for (int i=0; i < ctx->options.nb_threads; ++i)
     {
-        ctx->tinfos[i].stop = false;
+        // Do not lose an interruption received before the workers start.
+        ctx->tinfos[i].stop = ctx->stop != 0;
         if (pthread_create(&ctx->tinfos[i].thr, NULL,
-                           (void*(*)(void*))migrate_worker_loop,
+                           (void*(*)(void*))worker_loop,
                            &ctx->tinfos[i]) == -1)
         {
             PRINTERR("Could not start worker thread %i/%i", i, ctx->options.nb_threads);
@@ -182,19 +368,25 @@ migrate(struct cloudmig_ctx* ctx)
         }
     }
 
+    // The watchdog is optional: if it cannot start, transfers are unsupervised.
+    watchdog = watchdog_create(ctx);
+
     /*
      * Join all the threads, and cumulate their error counts
      */
     for (int i=0; i < ctx->options.nb_threads; i++)
     {
-        int errcount;
-        ret = pthread_join(ctx->tinfos[i].thr, (void**)&errcount);
+        void *errcount;
+        ret = pthread_join(ctx->tinfos[i].thr, &errcount);
         if (ret != 0)
             cloudmig_log(WARN_LVL, "Could not join thread %i: %s.\n", i, strerror(errno));
         else
-            nb_failures += errcount;
+            nb_failures += (int)(intptr_t)errcount;
     }
 
+    if (watchdog)
+        watchdog_destroy(watchdog);
+
     // In any case, attempt to update the status digest before doing anything else
     (void)status_digest_upload(ctx->status->digest);
 
@@ -217,9 +409,101 @@ err:
     return nb_failures;
 }
 
+/*
+ * Continuous sync:
+ *
+ * Once the migration is done, the sources are listed again every
+ * sync_interval seconds, and each new listing is merged into the status store
+ * (see status_bucket_resync): the following pass only transfers the objects
+ * added or modified since, by the same workers as the migration.
+ *
+ * Each pass leaves the destination up-to-date with the sources as they were
+ * listed: the convergence lag is the delay between the start of that listing
+ * and the end of the pass.
+ *
+ * The deletions are not propagated: the objects deleted from the sources are
+ * only flagged within the status, and kept on the destination. They are
+ * counted within the report, for the operator to remove them if need be.
+ *
+ * The sync only ends when interrupted or on error: it then returns
+ * EXIT_FAILURE, but the report is filled with the passes done in any case.
+ */
+int
+synchronize(struct cloudmig_ctx *ctx, struct sync_report *report)
+{
+    int                     failures;
+    time_t                  pass_start;
+    time_t                  now;
+    time_t                  lag;
+    uint64_t                done_objects;
+    uint64_t                done_bytes;
+    struct bucket_resync    changes;
+
+    memset(report, 0, sizeof(*report));
+
+    pass_start = time(NULL);
+    if (migrate(ctx) != 0)
+        cloudmig_log(WARN_LVL, "[Sync] The objects that could not be migrated"
+                     " are retried by the next pass.\n");
+
+    while (!ctx->stop)
+    {
+        // A pass taking longer than the interval is followed right away.
+        while (!ctx->stop && (now = time(NULL)) < pass_start + ctx->options.sync_interval)
+            sleep(pass_start + ctx->options.sync_interval - now);
+        if (ctx->stop)
+            break ;
+
+        pass_start = time(NULL);
+        if (status_store_resync(ctx, &changes) != EXIT_SUCCESS)
+        {
+            PRINTERR("[Sync] Could not list the changes of the sources.\n");
+            return EXIT_FAILURE;
+        }
+        // An interruption during the listing must not start another pass.
+        if (ctx->stop)
+            break ;
+
+        done_objects = status_digest_get(ctx->status->digest, DIGEST_DONE_OBJECTS);
+        done_bytes = status_digest_get(ctx->status->digest, DIGEST_DONE_BYTES);
+        // The entries that failed are retried by the next pass.
+        failures = migrate(ctx);
+        done_objects = status_digest_get(ctx->status->digest, DIGEST_DONE_OBJECTS) - done_objects;
+        done_bytes = status_digest_get(ctx->status->digest, DIGEST_DONE_BYTES) - done_bytes;
+        report->passes += 1;
+        report->deleted += changes.deleted;
+
+        now = time(NULL);
+        lag = now - pass_start;
+        cloudmig_log(INFO_LVL, "[Sync] Pass %llu: %llu added, %llu modified,"
+                     " %llu deleted at the source (kept on the destination);"
+                     " %llu objects (%llu Bytes) transfered in %lis.\n",
+                     report->passes, changes.added, changes.modified,
+                     changes.deleted, done_objects, done_bytes, (long)lag);
+
+        if (failures != 0 || ctx->stop)
+        {
+            cloudmig_log(WARN_LVL, "[Sync] Pass %llu did not converge.\n",
+                         report->passes);
+            continue ;
+        }
+
+        report->converged += 1;
+        report->lag = lag;
+        if (lag > report->max_lag)
+            report->max_lag = lag;
+        cloudmig_log(INFO_LVL, "[Sync] Destination up-to-date with the sources"
+                     " as of %lis ago (convergence lag).\n", (long)lag);
+    }
+
+    return EXIT_FAILURE;
+}
+
 void
 migration_stop(struct cloudmig_ctx *ctx)
 {
+    ctx->stop = 1;
+
     for (int i=0; i < ctx->options.nb_threads; i++)
     {
         if (ctx->tinfos[i].lock_inited == 0)
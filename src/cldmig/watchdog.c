@@ -0,0 +1,289 @@
+// Copyright (c) 2011, David Pineau
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of the copyright holder nor the names of its contributors
+//    may be used to endorse or promote products derived from this software
+//    without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER AND CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include "cloudmig.h"
+#include "options.h"
+#include "watchdog.h"
+
+/*
+ * Per-worker progress sample, as last seen by the watchdog
+ */
+struct watchdog_slot
+{
+    uint32_t        transfer_gen;   // Transfer the sample was taken for
+    uint32_t        done;           // Progress as of the start of the window
+    time_t          since;          // Start of the window
+    bool            signaled;       // Stall raised, not consumed yet
+};
+
+struct cldmig_watchdog
+{
+    struct cloudmig_ctx     *ctx;
+
+    pthread_t               thread;
+    pthread_mutex_t         lock;
+    int                     lock_inited;
+    pthread_cond_t          cond;
+    int                     cond_inited;
+    int                     stop;
+    int                     started;
+
+    time_t                  window;     // in seconds
+    uint64_t                min_bytes;  // to transfer within each window
+
+    struct watchdog_slot    *slots;
+};
+
+static void
+_watchdog_lock(struct cldmig_watchdog *wd)
+{
+    pthread_mutex_lock(&wd->lock);
+}
+
+static void
+_watchdog_unlock(struct cldmig_watchdog *wd)
+{
+    pthread_mutex_unlock(&wd->lock);
+}
+
+/*
+ * Checks one worker's progress against the slot's sample.
+ *
+ * A transfer is stalled when it moved less than the minimal rate over the
+ * window (see watchdog_create), or less than what remained of the file. A
+ * healthy transfer starts a new window once the previous one elapsed. A
+ * stalled worker is signaled again at each check until it aborts the
+ * transfer, in case the signal came in-between two blocking calls.
+ */
+static void
+_watchdog_inspect(struct cldmig_watchdog *wd, int idx, time_t now)
+{
+    struct cldmig_info      *tinfo = &wd->ctx->tinfos[idx];
+    struct watchdog_slot    *slot = &wd->slots[idx];
+    bool                    do_signal = false;
+    uint64_t                expected;
+
+    pthread_mutex_lock(&tinfo->lock);
+
+    if (tinfo->fpath == NULL || tinfo->fsize == 0
+        || slot->transfer_gen != tinfo->transfer_gen
+        || tinfo->fdone < slot->done
+        || (slot->signaled && !tinfo->stalled))
+    {
+        /*
+         * Idle worker, nothing to measure (directory, empty file...), new
+         * transfer, or stall consumed by the worker (which retries the
+         * transfer from its checkpoint): start a new window.
+         */
+        goto new_window;
+    }
+
+    if (now - slot->since < wd->window)
+        goto end;
+
+    expected = wd->min_bytes;
+    if (expected > tinfo->fsize - slot->done)
+        expected = tinfo->fsize - slot->done;
+    if (tinfo->fdone - slot->done >= expected)
+        goto new_window;
+
+    if (!tinfo->stalled)
+    {
+        cloudmig_log(WARN_LVL, "[Watchdog] Transfer of %s stalled: "
+                     "%u bytes transfered in %lis (%"PRIu64" expected,"
+                     " %u/%u bytes done), aborting.\n",
+                     tinfo->fpath, tinfo->fdone - slot->done,
+                     (long)(now - slot->since), expected,
+                     tinfo->fdone, tinfo->fsize);
+        tinfo->stalled = true;
+        slot->signaled = true;
+    }
+    do_signal = true;
+    goto end;
+
+new_window:
+    slot->transfer_gen = tinfo->transfer_gen;
+    slot->done = tinfo->fdone;
+    slot->since = now;
+    slot->signaled = false;
+
+end:
+    pthread_mutex_unlock(&tinfo->lock);
+
+    /*
+     * Interrupt any blocking call the worker may be stuck in. The handler does
+     * nothing, the point is only to make the system call fail with EINTR.
+     * Droplet retries some of the interrupted calls though (e.g. polling the
+     * connection): the worker then only aborts once the call returns, which
+     * the read and write timeouts of the droplet profiles bound.
+     */
+    if (do_signal)
+        pthread_kill(tinfo->thr, CLOUDMIG_STALL_SIGNAL);
+}
+
+static void*
+_watchdog_main_loop(struct cldmig_watchdog *wd)
+{
+    struct timespec     ts = {0, 0};
+    time_t              period;
+
+    // Sample often enough to detect a stall shortly after the window elapsed.
+    period = wd->window / 4 > 0 ? wd->window / 4 : 1;
+
+    _watchdog_lock(wd);
+    while (!wd->stop)
+    {
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_sec += period;
+        pthread_cond_timedwait(&wd->cond, &wd->lock, &ts);
+        if (wd->stop)
+            break ;
+        _watchdog_unlock(wd);
+
+        for (int i=0; i < wd->ctx->options.nb_threads; ++i)
+            _watchdog_inspect(wd, i, time(NULL));
+
+        _watchdog_lock(wd);
+    }
+    _watchdog_unlock(wd);
+
+    return NULL;
+}
+
+bool
+watchdog_check_stalled(struct cldmig_info *tinfo)
+{
+    bool    stalled;
+
+    pthread_mutex_lock(&tinfo->lock);
+    stalled = tinfo->stalled;
+    tinfo->stalled = false;
+    if (stalled)
+        tinfo->stall_count += 1;
+    pthread_mutex_unlock(&tinfo->lock);
+
+    return stalled;
+}
+
+void
+watchdog_destroy(struct cldmig_watchdog *wd)
+{
+    if (wd->started)
+    {
+        _watchdog_lock(wd);
+        wd->stop = 1;
+        pthread_cond_signal(&wd->cond);
+        _watchdog_unlock(wd);
+        pthread_join(wd->thread, NULL);
+    }
+
+    if (wd->cond_inited)
+        pthread_cond_destroy(&wd->cond);
+    if (wd->lock_inited)
+        pthread_mutex_destroy(&wd->lock);
+    if (wd->slots)
+        free(wd->slots);
+
+    free(wd);
+}
+
+struct cldmig_watchdog*
+watchdog_create(struct cloudmig_ctx *ctx)
+{
+    struct cldmig_watchdog  *ret = NULL;
+    struct cldmig_watchdog  *wd = NULL;
+
+    if (ctx->options.stall_timeout <= 0)
+        goto end;
+
+    wd = calloc(1, sizeof(*wd));
+    if (wd == NULL)
+    {
+        PRINTERR("[Watchdog] Could not allocate watchdog.\n");
+        goto end;
+    }
+    wd->ctx = ctx;
+    wd->window = ctx->options.stall_timeout;
+    /*
+     * The progress only moves once a whole block is written: the bytes
+     * expected over a window are rounded down to whole blocks, and amount to
+     * one block at least (which the options ensure fits within the window).
+     */
+    wd->min_bytes = ctx->options.stall_min_rate * wd->window;
+    wd->min_bytes -= wd->min_bytes % ctx->options.block_size;
+    if (wd->min_bytes < ctx->options.block_size)
+        wd->min_bytes = ctx->options.block_size;
+
+    wd->slots = calloc(ctx->options.nb_threads, sizeof(*wd->slots));
+    if (wd->slots == NULL)
+    {
+        PRINTERR("[Watchdog] Could not allocate progress samples.\n");
+        goto end;
+    }
+
+    if (pthread_mutex_init(&wd->lock, NULL) == -1)
+    {
+        PRINTERR("[Watchdog] Could not initialize mutex.\n");
+        goto end;
+    }
+    wd->lock_inited = 1;
+
+    if (pthread_cond_init(&wd->cond, NULL) == -1)
+    {
+        PRINTERR("[Watchdog] Could not initialize cond.\n");
+        goto end;
+    }
+    wd->cond_inited = 1;
+
+    if (pthread_create(&wd->thread, NULL,
+                       (void*(*)(void*))_watchdog_main_loop, wd) != 0)
+    {
+        PRINTERR("[Watchdog] Could not start watchdog thread.\n");
+        goto end;
+    }
+    wd->started = 1;
+
+    cloudmig_log(INFO_LVL, "[Watchdog] Watching transfers: %"PRIu64" bytes"
+                 " (blocks of %lu bytes) at least every %lis (%"PRIu64" bytes/s).\n",
+                 wd->min_bytes, ctx->options.block_size, (long)wd->window,
+                 ctx->options.stall_min_rate);
+
+    ret = wd;
+    wd = NULL;
+
+end:
+    if (wd)
+        watchdog_destroy(wd);
+
+    return ret;
+}
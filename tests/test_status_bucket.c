@@ -0,0 +1,255 @@
+// Copyright (c) 2015, David Pineau
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of the copyright holder nor the names of its contributors
+//    may be used to endorse or promote products derived from this software
+//    without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER AND CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <droplet.h>
+#include <droplet/vfs.h>
+
+#include "cloudmig.h"
+#include "status.h"
+#include "status_bucket.h"
+#include "test_utils.h"
+
+#define TEST_STORE_PATH     "/store"
+#define TEST_N_DIRS         270
+#define TEST_N_FILES        250     // per directory, for two segments
+
+struct expected_entry
+{
+    char        *path;
+    uint64_t    size;
+    uint32_t    type;
+    bool        listed;         // in the inventory, else added as a parent
+};
+
+struct expected_list
+{
+    struct expected_entry   *entries;
+    unsigned int            n_entries;
+    unsigned int            size;
+};
+
+static int
+_expected_add(struct expected_list *list, const char *path,
+              uint64_t size, uint32_t type, bool listed)
+{
+    struct expected_entry   *tmp = NULL;
+
+    if (list->n_entries == list->size)
+    {
+        tmp = realloc(list->entries, sizeof(*tmp) * (list->size ? list->size * 2 : 1024));
+        if (tmp == NULL)
+            return EXIT_FAILURE;
+        list->entries = tmp;
+        list->size = list->size ? list->size * 2 : 1024;
+    }
+    tmp = &list->entries[list->n_entries];
+    tmp->path = strdup(path);
+    if (tmp->path == NULL)
+        return EXIT_FAILURE;
+    tmp->size = size;
+    tmp->type = type;
+    tmp->listed = listed;
+    list->n_entries += 1;
+
+    return EXIT_SUCCESS;
+}
+
+static void
+_expected_free(struct expected_list *list)
+{
+    for (unsigned int i=0; i < list->n_entries; ++i)
+        free(list->entries[i].path);
+    free(list->entries);
+}
+
+/*
+ * The entries of the bucket, in order: the inventory only lists the objects,
+ * their directories being added by the bucket status. The paths share long
+ * prefixes, and some hold characters escaped within the segments.
+ */
+static int
+_expected_build(struct expected_list *list)
+{
+    static const char   *special[] = {
+        "z/",
+        "z/a \"quoted\" name",
+        "z/back\\slash",
+        "z/caf\xc3\xa9",
+        "z/caf\xc3\xa9s/",
+        "z/caf\xc3\xa9s/deep/",
+        "z/caf\xc3\xa9s/deep/x",
+    };
+    char                path[64];
+    int                 ret = EXIT_SUCCESS;
+    size_t              len;
+
+    for (unsigned int i=0; ret == EXIT_SUCCESS && i < TEST_N_DIRS; ++i)
+    {
+        sprintf(path, "d%04u/", i);
+        ret = _expected_add(list, path, 0, DPL_FTYPE_DIR, false);
+        for (unsigned int j=0; ret == EXIT_SUCCESS && j < TEST_N_FILES; ++j)
+        {
+            sprintf(path, "d%04u/f%03u", i, j);
+            ret = _expected_add(list, path, (uint64_t)i * j, DPL_FTYPE_REG, true);
+        }
+    }
+    if (ret == EXIT_SUCCESS)
+        ret = _expected_add(list, "e/", 0, DPL_FTYPE_DIR, true);
+    for (unsigned int i=0; ret == EXIT_SUCCESS && i < sizeof(special) / sizeof(*special); ++i)
+    {
+        len = strlen(special[i]);
+        if (special[i][len - 1] == '/')
+            ret = _expected_add(list, special[i], 0, DPL_FTYPE_DIR, false);
+        else
+            ret = _expected_add(list, special[i], 4294967296ULL + i, DPL_FTYPE_REG, true);
+    }
+
+    return ret;
+}
+
+static int
+_inventory_write(const char *invpath, const struct expected_list *list)
+{
+    FILE                        *inv = NULL;
+    const struct expected_entry *entry = NULL;
+    int                         ret = EXIT_SUCCESS;
+
+    inv = fopen(invpath, "w");
+    if (inv == NULL)
+        return EXIT_FAILURE;
+
+    for (unsigned int i=0; ret == EXIT_SUCCESS && i < list->n_entries; ++i)
+    {
+        entry = &list->entries[i];
+        if (!entry->listed)
+            continue ;
+        if (fprintf(inv, "%s\t%llu\t%s\n", entry->path,
+                    (unsigned long long)entry->size,
+                    entry->type == DPL_FTYPE_DIR ? "dir" : "file") < 0)
+            ret = EXIT_FAILURE;
+    }
+
+    if (fclose(inv) != 0)
+        ret = EXIT_FAILURE;
+
+    return ret;
+}
+
+/*
+ * Creates a bucket status from an inventory, and iterates over its entries
+ * once loaded back from its segments: each path is rebuilt from the prefix of
+ * the previous one, across the segments.
+ */
+static int
+test_bucket_paths(struct test_store *store)
+{
+    struct expected_list        list = { NULL, 0, 0 };
+    struct bucket_crawl         crawl = { NULL, LISTING_RECURSIVE, NULL };
+    struct bucket_status        *bst = NULL;
+    struct file_transfer_state  filestate = CLOUDMIG_FILESTATE_INITIALIZER;
+    const struct expected_entry *entry = NULL;
+    char                        *invpath = NULL;
+    char                        *name = NULL;
+    uint64_t                    count = 0;
+    uint64_t                    size = 0;
+    uint64_t                    total = 0;
+    unsigned int                n_entries = 0;
+    int                         iret;
+
+    TEST_CHECK(_expected_build(&list) == EXIT_SUCCESS);
+    TEST_CHECK(list.n_entries > CLOUDMIG_STATUS_SEGMENT_SIZE);
+    for (unsigned int i=0; i < list.n_entries; ++i)
+        total += list.entries[i].size;
+
+    invpath = test_store_path(store, "inventory.tsv");
+    TEST_CHECK(invpath != NULL);
+    TEST_CHECK(_inventory_write(invpath, &list) == EXIT_SUCCESS);
+
+    TEST_CHECK(dpl_mkdir(store->ctx, TEST_STORE_PATH, NULL, NULL) == DPL_SUCCESS);
+
+    bst = status_bucket_create(store->ctx, &crawl, TEST_STORE_PATH,
+                               "src", "dst", invpath, &count, &size);
+    TEST_CHECK(bst != NULL);
+    TEST_CHECK(count == list.n_entries);
+    TEST_CHECK(size == total);
+    name = strdup(strrchr(bst->path, '/') + 1);
+    status_bucket_free(bst);
+    TEST_CHECK(name != NULL);
+
+    count = size = 0;
+    bst = status_bucket_load(store->ctx, TEST_STORE_PATH, name, false,
+                             &count, &size);
+    TEST_CHECK(bst != NULL);
+    TEST_CHECK(count == list.n_entries);
+    TEST_CHECK(size == total);
+
+    while ((iret = status_bucket_next_entry(store->ctx, bst, &filestate)) == 1)
+    {
+        TEST_CHECK(n_entries < list.n_entries);
+        entry = &list.entries[n_entries++];
+        if (strcmp(filestate.obj_path, entry->path) != 0)
+            fprintf(stderr, "Entry %u: got '%s', expected '%s'.\n",
+                    n_entries - 1, filestate.obj_path, entry->path);
+        TEST_CHECK(strcmp(filestate.obj_path, entry->path) == 0);
+        TEST_CHECK(filestate.fixed.size == entry->size);
+        TEST_CHECK(filestate.fixed.type == entry->type);
+        status_bucket_release_entry(&filestate);
+    }
+    TEST_CHECK(iret == 0);
+    TEST_CHECK(n_entries == list.n_entries);
+    TEST_CHECK(bst->n_segments == 2);
+
+    status_bucket_clear_entry(&filestate);
+    status_bucket_free(bst);
+    free(name);
+    free(invpath);
+    _expected_free(&list);
+
+    return EXIT_SUCCESS;
+}
+
+int
+main(void)
+{
+    int                 ret = EXIT_FAILURE;
+    struct test_store   store;
+
+    if (test_store_setup(&store) != EXIT_SUCCESS)
+        goto end;
+
+    ret = test_bucket_paths(&store);
+
+end:
+    test_store_cleanup(&store);
+
+    return ret;
+}
@@ -0,0 +1,189 @@
+// Copyright (c) 2015, David Pineau
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of the copyright holder nor the names of its contributors
+//    may be used to endorse or promote products derived from this software
+//    without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER AND CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <droplet.h>
+
+#include "cloudmig.h"
+#include "status.h"
+#include "status_codec.h"
+#include "test_utils.h"
+
+#define TEST_CODEC_PATH     "codec.json"
+
+struct test_sink
+{
+    char    *data;
+    size_t  len;
+    size_t  size;
+};
+
+static int
+_sink_write(void *data, const char *buf, size_t len)
+{
+    struct test_sink    *sink = data;
+    char                *tmp = NULL;
+
+    if (sink->len + len > sink->size)
+    {
+        tmp = realloc(sink->data, sink->len + len);
+        if (tmp == NULL)
+            return EXIT_FAILURE;
+        sink->data = tmp;
+        sink->size = sink->len + len;
+    }
+    memcpy(sink->data + sink->len, buf, len);
+    sink->len += len;
+
+    return EXIT_SUCCESS;
+}
+
+static int
+_decode(const char *stored, size_t len, size_t chunk, struct test_sink *sink)
+{
+    struct status_decoder   *decoder = NULL;
+    int                     ret = EXIT_SUCCESS;
+
+    decoder = status_decoder_new(&_sink_write, sink);
+    if (decoder == NULL)
+        return EXIT_FAILURE;
+
+    for (size_t off=0; ret == EXIT_SUCCESS && off < len; off += chunk)
+        ret = status_decoder_feed(decoder, stored + off,
+                                  off + chunk > len ? len - off : chunk);
+    if (ret == EXIT_SUCCESS)
+        ret = status_decoder_end(decoder);
+    status_decoder_free(decoder);
+
+    return ret;
+}
+
+static int
+test_codec_roundtrip(struct test_store *store, const char *data, size_t len,
+                     bool compress)
+{
+    static const size_t chunks[] = { 1, 7, 4096, 1024*1024 };
+    dpl_status_t        dplret;
+    char                *got = NULL;
+    unsigned int        gotlen = 0;
+    char                *path = NULL;
+    char                *stored = NULL;
+    size_t              storedlen = 0;
+    struct test_sink    sink;
+    int                 ret;
+
+    status_codec_setup(compress);
+
+    dplret = status_codec_put(store->ctx, TEST_CODEC_PATH, data, len);
+    TEST_CHECK(dplret == DPL_SUCCESS);
+
+    dplret = status_codec_get(store->ctx, TEST_CODEC_PATH, &got, &gotlen);
+    TEST_CHECK(dplret == DPL_SUCCESS);
+    ret = (gotlen == len && memcmp(got, data, len) == 0);
+    free(got);
+    TEST_CHECK(ret);
+
+    // The decoder is fed the bytes as fetched from the store.
+    path = test_store_path(store, TEST_CODEC_PATH);
+    TEST_CHECK(path != NULL);
+    stored = test_file_read(path, &storedlen);
+    free(path);
+    TEST_CHECK(stored != NULL);
+    if (compress)
+        TEST_CHECK(storedlen < len && (unsigned char)stored[0] == 0x1f);
+    else
+        TEST_CHECK(storedlen == len && memcmp(stored, data, len) == 0);
+
+    // The ranges fetched from the store may be cut anywhere.
+    for (unsigned int i=0; i < sizeof(chunks) / sizeof(*chunks); ++i)
+    {
+        memset(&sink, 0, sizeof(sink));
+        ret = _decode(stored, storedlen, chunks[i], &sink);
+        if (ret == EXIT_SUCCESS)
+            ret = (sink.len == len && memcmp(sink.data, data, len) == 0)
+                  ? EXIT_SUCCESS : EXIT_FAILURE;
+        free(sink.data);
+        if (ret != EXIT_SUCCESS)
+            fprintf(stderr, "Decoding by chunks of %zu bytes failed.\n", chunks[i]);
+        TEST_CHECK(ret == EXIT_SUCCESS);
+    }
+
+    // A compressed status cut short must not be taken for a whole one.
+    if (compress)
+    {
+        memset(&sink, 0, sizeof(sink));
+        ret = _decode(stored, storedlen - 8, 4096, &sink);
+        free(sink.data);
+        TEST_CHECK(ret != EXIT_SUCCESS);
+    }
+
+    free(stored);
+
+    return EXIT_SUCCESS;
+}
+
+int
+main(void)
+{
+    int                 ret = EXIT_FAILURE;
+    struct test_store   store;
+    char                *data = NULL;
+    size_t              len = 0;
+    size_t              size = 256 * 1024;
+
+    if (test_store_setup(&store) != EXIT_SUCCESS)
+        goto end;
+
+    // Status-like content, larger than the inflate buffers.
+    data = malloc(size);
+    if (data == NULL)
+        goto end;
+    len += sprintf(data, "{ \"objects\": [ ");
+    for (unsigned int i=0; len + 128 < size; ++i)
+        len += sprintf(data + len, "{ \"prefix\": %u, \"suffix\": \"file%u\","
+                       " \"size\": %u, \"done\": false, \"type\": 1 }, ",
+                       i % 7, i, i * 31);
+    len += sprintf(data + len, "] }");
+
+    if (test_codec_roundtrip(&store, data, len, false) != EXIT_SUCCESS)
+        goto end;
+#ifdef HAVE_ZLIB
+    if (test_codec_roundtrip(&store, data, len, true) != EXIT_SUCCESS)
+        goto end;
+#endif
+
+    ret = EXIT_SUCCESS;
+
+end:
+    free(data);
+    test_store_cleanup(&store);
+
+    return ret;
+}
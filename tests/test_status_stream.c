@@ -0,0 +1,233 @@
+// Copyright (c) 2015, David Pineau
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of the copyright holder nor the names of its contributors
+//    may be used to endorse or promote products derived from this software
+//    without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER AND CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cloudmig.h"
+#include "status.h"
+#include "status_stream.h"
+#include "test_utils.h"
+
+/*
+ * A segment as written by the bucket status, with the paths front-coded, an
+ * entry holding its whole path, escaped characters and an unknown member.
+ */
+static const char   *segment =
+    "{ \"objects\": [\n"
+    "  { \"prefix\": 0, \"suffix\": \"dir/\", \"size\": 0, \"done\": true,"
+    " \"type\": 2, \"mtime\": 0 },\n"
+    "  { \"prefix\": 4, \"suffix\": \"a \\\"quoted\\\" name\", \"size\": 12,"
+    " \"done\": false, \"type\": 1, \"mtime\": 1300000000,"
+    " \"unknown\": { \"nested\": [ 1, \"}]\" ] } },\n"
+    "  { \"prefix\": 4, \"suffix\": \"back\\\\slash\", \"size\": 4294967296,"
+    " \"done\": true, \"type\": 1, \"mtime\": 1300000001, \"deleted\": true },\n"
+    "  { \"prefix\": 4, \"suffix\": \"caf\\u00e9\", \"size\": 1, \"done\": false,"
+    " \"type\": 1 },\n"
+    "  { \"prefix\": 7, \"suffix\": \"\\u00e9 \\ud83d\\ude00\", \"size\": 2,"
+    " \"done\": false, \"type\": 3 },\n"
+    "  { \"path\": \"other/whole\", \"size\": 5, \"done\": true, \"type\": 1 },\n"
+    "  { \"prefix\": 6, \"suffix\": \"next\", \"size\": 6, \"done\": false,"
+    " \"type\": 1 }\n"
+    "] }\n";
+
+struct expected_entry
+{
+    const char  *path;
+    uint64_t    size;
+    uint32_t    type;
+    bool        done;
+    int64_t     mtime;
+    bool        deleted;
+};
+
+static const struct expected_entry  expected[] = {
+    { "dir/",                           0,              2, true,  0,          false },
+    { "dir/a \"quoted\" name",          12,             1, false, 1300000000, false },
+    { "dir/back\\slash",                4294967296ULL,  1, true,  1300000001, true  },
+    { "dir/caf\xc3\xa9",                1,              1, false, 0,          false },
+    { "dir/caf\xc3\xa9 \xf0\x9f\x98\x80", 2,            3, false, 0,          false },
+    { "other/whole",                    5,              1, true,  0,          false },
+    { "other/next",                     6,              1, false, 0,          false },
+};
+#define N_EXPECTED  (sizeof(expected) / sizeof(*expected))
+
+struct stream_check
+{
+    unsigned int    n_entries;
+    bool            mismatch;
+};
+
+static int
+_check_emit(void *data, const char *path, const struct bucket_entry *entry)
+{
+    struct stream_check         *check = data;
+    const struct expected_entry *exp = NULL;
+
+    if (check->n_entries >= N_EXPECTED)
+    {
+        fprintf(stderr, "Unexpected entry '%s'.\n", path);
+        check->mismatch = true;
+        return EXIT_FAILURE;
+    }
+
+    exp = &expected[check->n_entries++];
+    if (strcmp(path, exp->path) != 0
+        || entry->size != exp->size
+        || entry->type != exp->type
+        || entry->done != exp->done
+        || entry->mtime != exp->mtime
+        || entry->deleted != exp->deleted)
+    {
+        fprintf(stderr, "Entry %u: got '%s', expected '%s'.\n",
+                check->n_entries - 1, path, exp->path);
+        check->mismatch = true;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Feeds the segment by chunks of every size, for the tokens to be split at
+ * every possible place.
+ */
+static int
+test_stream_chunks(void)
+{
+    size_t                  len = strlen(segment);
+    struct status_stream    *stream = NULL;
+    struct stream_check     check;
+    int                     ret;
+
+    for (size_t chunk=1; chunk <= len; ++chunk)
+    {
+        memset(&check, 0, sizeof(check));
+        stream = status_stream_new(&_check_emit, &check);
+        TEST_CHECK(stream != NULL);
+
+        ret = EXIT_SUCCESS;
+        for (size_t off=0; ret == EXIT_SUCCESS && off < len; off += chunk)
+            ret = status_stream_feed(stream, segment + off,
+                                     off + chunk > len ? len - off : chunk);
+        if (ret == EXIT_SUCCESS)
+            ret = status_stream_end(stream);
+        status_stream_free(stream);
+
+        if (ret != EXIT_SUCCESS || check.mismatch || check.n_entries != N_EXPECTED)
+            fprintf(stderr, "Chunks of %zu bytes failed.\n", chunk);
+        TEST_CHECK(ret == EXIT_SUCCESS);
+        TEST_CHECK(!check.mismatch);
+        TEST_CHECK(check.n_entries == N_EXPECTED);
+    }
+
+    return EXIT_SUCCESS;
+}
+
+static int
+_stream_parse(const char *data, size_t len, struct stream_check *check)
+{
+    struct status_stream    *stream = NULL;
+    int                     ret;
+
+    stream = status_stream_new(&_check_emit, check);
+    if (stream == NULL)
+        return EXIT_FAILURE;
+
+    ret = status_stream_feed(stream, data, len);
+    if (ret == EXIT_SUCCESS)
+        ret = status_stream_end(stream);
+    status_stream_free(stream);
+
+    return ret;
+}
+
+/*
+ * A segment cut anywhere must not be taken for a whole one.
+ */
+static int
+test_stream_truncated(void)
+{
+    size_t                  len;
+    struct stream_check     check;
+    int                     ret;
+
+    // Up to the last closing brace, the trailing newline being optional.
+    len = strrchr(segment, '}') - segment;
+    for (size_t cut=0; cut <= len; ++cut)
+    {
+        memset(&check, 0, sizeof(check));
+        ret = _stream_parse(segment, cut, &check);
+        if (ret == EXIT_SUCCESS)
+            fprintf(stderr, "Segment cut at %zu bytes was accepted.\n", cut);
+        TEST_CHECK(ret != EXIT_SUCCESS);
+    }
+
+    return EXIT_SUCCESS;
+}
+
+static int
+test_stream_invalid(void)
+{
+    static const char       *invalid[] = {
+        // Prefix longer than the previous path
+        "{ \"objects\": [ { \"prefix\": 1, \"suffix\": \"a\", \"size\": 0,"
+        " \"done\": true, \"type\": 1 } ] }",
+        // Missing size
+        "{ \"objects\": [ { \"prefix\": 0, \"suffix\": \"a\","
+        " \"done\": true, \"type\": 1 } ] }",
+        // Mistyped done flag
+        "{ \"objects\": [ { \"prefix\": 0, \"suffix\": \"a\", \"size\": 0,"
+        " \"done\": 1, \"type\": 1 } ] }",
+        // Invalid escape
+        "{ \"objects\": [ { \"prefix\": 0, \"suffix\": \"\\q\", \"size\": 0,"
+        " \"done\": true, \"type\": 1 } ] }",
+        // Trailing data
+        "{ \"objects\": [] } {",
+    };
+    struct stream_check     check;
+
+    for (unsigned int i=0; i < sizeof(invalid) / sizeof(*invalid); ++i)
+    {
+        memset(&check, 0, sizeof(check));
+        TEST_CHECK(_stream_parse(invalid[i], strlen(invalid[i]), &check) != EXIT_SUCCESS);
+    }
+
+    return EXIT_SUCCESS;
+}
+
+int
+main(void)
+{
+    if (test_stream_chunks() != EXIT_SUCCESS
+        || test_stream_truncated() != EXIT_SUCCESS
+        || test_stream_invalid() != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+
+    return EXIT_SUCCESS;
+}
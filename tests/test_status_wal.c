@@ -0,0 +1,245 @@
+// Copyright (c) 2015, David Pineau
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of the copyright holder nor the names of its contributors
+//    may be used to endorse or promote products derived from this software
+//    without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER AND CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <sys/stat.h>
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <droplet.h>
+
+#include "cloudmig.h"
+#include "status_wal.h"
+#include "test_utils.h"
+
+#define TEST_WAL_NAME   "status.log"
+
+/*
+ * Checks the content of a file of the store, NULL meaning it does not exist.
+ */
+static int
+_check_stored(struct test_store *store, const char *path, const char *expected)
+{
+    char    *fpath = NULL;
+    char    *data = NULL;
+    size_t  len = 0;
+    int     ret;
+
+    fpath = test_store_path(store, path);
+    TEST_CHECK(fpath != NULL);
+    data = test_file_read(fpath, &len);
+    free(fpath);
+
+    if (expected == NULL)
+        ret = (data == NULL);
+    else
+        ret = (data != NULL && len == strlen(expected)
+               && memcmp(data, expected, len) == 0);
+    if (!ret)
+        fprintf(stderr, "%s: got '%s', expected '%s'.\n", path,
+                data ? data : "(none)", expected ? expected : "(none)");
+    free(data);
+    TEST_CHECK(ret);
+
+    return EXIT_SUCCESS;
+}
+
+static int
+_store_put(struct test_store *store, const char *path, const char *data)
+{
+    char    *fpath = NULL;
+    int     ret;
+
+    fpath = test_store_path(store, path);
+    TEST_CHECK(fpath != NULL);
+    ret = test_file_write(fpath, data, strlen(data));
+    free(fpath);
+
+    return ret;
+}
+
+static int
+_store_unlink(struct test_store *store, const char *path)
+{
+    char    *fpath = NULL;
+    int     ret;
+
+    fpath = test_store_path(store, path);
+    TEST_CHECK(fpath != NULL);
+    ret = unlink(fpath) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    free(fpath);
+
+    return ret;
+}
+
+/*
+ * Records mutations, and keeps the log as it stood before they were
+ * replicated, with the last record torn as by a crash within its write.
+ */
+static int
+_wal_record_torn(struct test_store *store, const char *walpath,
+                 char **logp, size_t *validp, size_t *lenp)
+{
+    struct status_wal   *wal = NULL;
+    char                *log = NULL;
+    size_t              len = 0;
+    char                *last = NULL;
+
+    wal = status_wal_open(store->ctx, walpath);
+    TEST_CHECK(wal != NULL);
+    TEST_CHECK(status_wal_put(wal, "a.json", "{ \"a\": \"line\\nbreak\" }") == EXIT_SUCCESS);
+    TEST_CHECK(status_wal_put(wal, "b.json", "first") == EXIT_SUCCESS);
+    TEST_CHECK(status_wal_put(wal, "b.json", "second") == EXIT_SUCCESS);
+    TEST_CHECK(status_wal_unlink(wal, "c.json") == EXIT_SUCCESS);
+    TEST_CHECK(status_wal_put(wal, "d.json", "never acknowledged") == EXIT_SUCCESS);
+
+    log = test_file_read(walpath, &len);
+    TEST_CHECK(log != NULL);
+    status_wal_close(wal);
+
+    // One record per line, the last one being cut in its middle.
+    TEST_CHECK(len > 0 && log[len - 1] == '\n');
+    log[len - 1] = 0;
+    last = strrchr(log, '\n');
+    TEST_CHECK(last != NULL);
+    *validp = last + 1 - log;
+    *lenp = *validp + (len - *validp) / 2;
+    *logp = log;
+
+    return EXIT_SUCCESS;
+}
+
+static int
+test_wal_torn_replay(struct test_store *store)
+{
+    struct status_wal   *wal = NULL;
+    char                *walpath = NULL;
+    char                *log = NULL;
+    size_t              valid = 0;
+    size_t              len = 0;
+    struct stat         st;
+
+    walpath = test_store_path(store, TEST_WAL_NAME);
+    TEST_CHECK(walpath != NULL);
+
+    TEST_CHECK(_wal_record_torn(store, walpath, &log, &valid, &len) == EXIT_SUCCESS);
+
+    // Back to the state of the store at the time of the crash.
+    TEST_CHECK(_check_stored(store, "d.json", "never acknowledged") == EXIT_SUCCESS);
+    TEST_CHECK(_store_unlink(store, "a.json") == EXIT_SUCCESS);
+    TEST_CHECK(_store_unlink(store, "b.json") == EXIT_SUCCESS);
+    TEST_CHECK(_store_unlink(store, "d.json") == EXIT_SUCCESS);
+    TEST_CHECK(_store_put(store, "c.json", "stale") == EXIT_SUCCESS);
+    TEST_CHECK(test_file_write(walpath, log, len) == EXIT_SUCCESS);
+
+    // The torn record is dropped, for the next ones not to be appended to it.
+    wal = status_wal_open(store->ctx, walpath);
+    TEST_CHECK(wal != NULL);
+    TEST_CHECK(stat(walpath, &st) == 0 && (size_t)st.st_size == valid);
+
+    TEST_CHECK(status_wal_flush(wal) == EXIT_SUCCESS);
+    TEST_CHECK(_check_stored(store, "a.json", "{ \"a\": \"line\\nbreak\" }") == EXIT_SUCCESS);
+    TEST_CHECK(_check_stored(store, "b.json", "second") == EXIT_SUCCESS);
+    TEST_CHECK(_check_stored(store, "c.json", NULL) == EXIT_SUCCESS);
+    TEST_CHECK(_check_stored(store, "d.json", NULL) == EXIT_SUCCESS);
+
+    // The log goes on with whole records.
+    TEST_CHECK(status_wal_put(wal, "e.json", "after") == EXIT_SUCCESS);
+    free(log);
+    log = test_file_read(walpath, &len);
+    TEST_CHECK(log != NULL && len > 0 && log[len - 1] == '\n');
+    TEST_CHECK(strchr(log, '\n') == log + len - 1);
+    free(log);
+    status_wal_close(wal);
+
+    // Everything replicated, the log is left empty.
+    TEST_CHECK(_check_stored(store, "e.json", "after") == EXIT_SUCCESS);
+    TEST_CHECK(stat(walpath, &st) == 0 && st.st_size == 0);
+    wal = status_wal_open(store->ctx, walpath);
+    TEST_CHECK(wal != NULL);
+    status_wal_close(wal);
+
+    free(walpath);
+
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Only the last record may be torn: a corrupted one followed by others is
+ * not silently dropped.
+ */
+static int
+test_wal_corrupted(struct test_store *store)
+{
+    struct status_wal   *wal = NULL;
+    char                *walpath = NULL;
+    char                *log = NULL;
+    size_t              valid = 0;
+    size_t              len = 0;
+
+    walpath = test_store_path(store, TEST_WAL_NAME);
+    TEST_CHECK(walpath != NULL);
+
+    TEST_CHECK(_wal_record_torn(store, walpath, &log, &valid, &len) == EXIT_SUCCESS);
+
+    // Overwrite the start of the first record.
+    memset(log, '#', 4);
+    TEST_CHECK(test_file_write(walpath, log, len) == EXIT_SUCCESS);
+    free(log);
+
+    wal = status_wal_open(store->ctx, walpath);
+    if (wal)
+        status_wal_close(wal);
+    TEST_CHECK(wal == NULL);
+
+    free(walpath);
+
+    return EXIT_SUCCESS;
+}
+
+int
+main(void)
+{
+    int                 ret = EXIT_FAILURE;
+    struct test_store   store;
+
+    if (test_store_setup(&store) != EXIT_SUCCESS)
+        goto end;
+
+    if (test_wal_torn_replay(&store) != EXIT_SUCCESS
+        || test_wal_corrupted(&store) != EXIT_SUCCESS)
+        goto end;
+
+    ret = EXIT_SUCCESS;
+
+end:
+    test_store_cleanup(&store);
+
+    return ret;
+}
@@ -0,0 +1,180 @@
+// Copyright (c) 2015, David Pineau
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of the copyright holder nor the names of its contributors
+//    may be used to endorse or promote products derived from this software
+//    without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER AND CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <ftw.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <droplet.h>
+
+#include "cloudmig.h"
+#include "test_utils.h"
+
+/*
+ * Defined by the main program of cloudmig.
+ */
+enum cloudmig_loglevel  gl_loglevel = WARN_LVL;
+bool                    gl_isbackground = false;
+
+#define TEST_PROFILE_NAME   "test_store"
+
+int
+test_store_setup(struct test_store *store)
+{
+    int     ret = EXIT_FAILURE;
+    char    *path = NULL;
+    FILE    *profile = NULL;
+
+    memset(store, 0, sizeof(*store));
+
+    store->dir = strdup("/tmp/cloudmig_test.XXXXXX");
+    if (store->dir == NULL || mkdtemp(store->dir) == NULL)
+    {
+        perror("Could not create the test store");
+        goto end;
+    }
+
+    if (asprintf(&path, "%s/"TEST_PROFILE_NAME".profile", store->dir) <= 0)
+    {
+        path = NULL;
+        goto end;
+    }
+    profile = fopen(path, "w");
+    if (profile == NULL
+        || fprintf(profile, "backend=posix\nbase_path=%s\n", store->dir) <= 0
+        || fclose(profile) != 0)
+    {
+        perror("Could not write the test store profile");
+        goto end;
+    }
+
+    store->ctx = dpl_ctx_new(store->dir, TEST_PROFILE_NAME);
+    if (store->ctx == NULL)
+    {
+        fprintf(stderr, "Could not load the test store profile %s.\n", path);
+        goto end;
+    }
+
+    ret = EXIT_SUCCESS;
+
+end:
+    if (path)
+        free(path);
+
+    return ret;
+}
+
+static int
+_test_store_remove(const char *path, const struct stat *st, int flag, struct FTW *ftw)
+{
+    (void)st;
+    (void)flag;
+    (void)ftw;
+    return remove(path);
+}
+
+void
+test_store_cleanup(struct test_store *store)
+{
+    if (store->ctx)
+        dpl_ctx_free(store->ctx);
+    if (store->dir)
+    {
+        (void)nftw(store->dir, &_test_store_remove, 16, FTW_DEPTH | FTW_PHYS);
+        free(store->dir);
+    }
+    memset(store, 0, sizeof(*store));
+}
+
+char*
+test_store_path(struct test_store *store, const char *path)
+{
+    char    *ret = NULL;
+
+    if (asprintf(&ret, "%s/%s", store->dir, path) <= 0)
+        return NULL;
+
+    return ret;
+}
+
+char*
+test_file_read(const char *path, size_t *lenp)
+{
+    char    *ret = NULL;
+    char    *data = NULL;
+    FILE    *file = NULL;
+    long    len;
+
+    file = fopen(path, "rb");
+    if (file == NULL)
+        goto end;
+    if (fseek(file, 0, SEEK_END) != 0 || (len = ftell(file)) < 0
+        || fseek(file, 0, SEEK_SET) != 0)
+        goto end;
+
+    data = malloc(len + 1);
+    if (data == NULL)
+        goto end;
+    if (fread(data, 1, len, file) != (size_t)len)
+        goto end;
+    data[len] = 0;
+    *lenp = len;
+
+    ret = data;
+    data = NULL;
+
+end:
+    if (data)
+        free(data);
+    if (file)
+        fclose(file);
+
+    return ret;
+}
+
+int
+test_file_write(const char *path, const char *data, size_t len)
+{
+    int     ret = EXIT_FAILURE;
+    FILE    *file = NULL;
+
+    file = fopen(path, "wb");
+    if (file == NULL)
+        goto end;
+    if (fwrite(data, 1, len, file) != len)
+        goto end;
+
+    ret = EXIT_SUCCESS;
+
+end:
+    if (file && fclose(file) != 0)
+        ret = EXIT_FAILURE;
+
+    return ret;
+}
@@ -0,0 +1,74 @@
+// Copyright (c) 2015, David Pineau
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of the copyright holder nor the names of its contributors
+//    may be used to endorse or promote products derived from this software
+//    without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER AND CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef __CLOUDMIG_TEST_UTILS_H__
+#define __CLOUDMIG_TEST_UTILS_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <droplet.h>
+
+/*
+ * The tests are standalone programs, exiting with EXIT_SUCCESS once all their
+ * checks passed. A failed check logs its location and fails the test
+ * function it is called from, leaving its resources to the exit.
+ */
+#define TEST_CHECK(cond)                                                    \
+    do {                                                                    \
+        if (!(cond))                                                        \
+        {                                                                   \
+            fprintf(stderr, "%s:%d: check failed: %s\n",                    \
+                    __FILE__, __LINE__, #cond);                             \
+            return EXIT_FAILURE;                                            \
+        }                                                                   \
+    } while (0)
+
+/*
+ * A status store held within a temporary directory, through the posix
+ * backend of droplet, as the default status storage of cloudmig.
+ */
+struct test_store
+{
+    char        *dir;       // base path of the store
+    dpl_ctx_t   *ctx;
+};
+
+int     test_store_setup(struct test_store *store);
+void    test_store_cleanup(struct test_store *store);
+
+/*
+ * @brief Build the local path of a file of the store, to be freed.
+ */
+char    *test_store_path(struct test_store *store, const char *path);
+
+/*
+ * @brief Read or write a whole local file, the data read being to be freed.
+ */
+char    *test_file_read(const char *path, size_t *lenp);
+int     test_file_write(const char *path, const char *data, size_t len);
+
+#endif /* ! __CLOUDMIG_TEST_UTILS_H__ */